@@ -0,0 +1,50 @@
+// G-buffer layout: depth only for positions, octahedral normal RG16_SNORM,
+// albedo RGBA8
+#define GBUFFER_COMPACT
+#define GBUFFER_DEPTH_MAP u_samplers[0]
+#define GBUFFER_NORMAL_MAP u_samplers[1]
+#define GBUFFER_ALBEDO_MAP u_samplers[2]
+
+vec2 oct_wrap(vec2 v)
+{
+    return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0,
+                                    v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// Unit vector to [-1, 1]^2 through an octahedron unfolded onto a square
+vec2 oct_encode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    return n.z >= 0.0 ? n.xy : oct_wrap(n.xy);
+}
+
+vec3 oct_decode(vec2 e)
+{
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = clamp(-n.z, 0.0, 1.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+vec3 gbuffer_position(ivec2 pixel)
+{
+    float depth = texelFetch(GBUFFER_DEPTH_MAP, pixel, 0).r;
+    vec2 dim = vec2(textureSize(GBUFFER_DEPTH_MAP, 0));
+    vec2 ndc = ((vec2(pixel) + 0.5) / dim) * 2.0 - 1.0;
+    float z = linearize_depth(depth);
+    vec3 view_pos =
+        vec3(ndc.x * z / u_proj[0][0], ndc.y * z / u_proj[1][1], -z);
+    // The view matrix is rigid, so its inverse is the transposed rotation
+    return transpose(mat3(u_view)) * (view_pos - u_view[3].xyz);
+}
+
+vec3 gbuffer_normal(ivec2 pixel)
+{
+    return oct_decode(texelFetch(GBUFFER_NORMAL_MAP, pixel, 0).xy);
+}
+
+float gbuffer_coverage(ivec2 pixel)
+{
+    return texelFetch(GBUFFER_DEPTH_MAP, pixel, 0).r < 1.0 ? 1.0 : 0.0;
+}
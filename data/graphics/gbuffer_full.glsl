@@ -0,0 +1,20 @@
+// G-buffer layout: world position RGB16F, normal RGB16F, albedo RGBA16F
+#define GBUFFER_POSITION_MAP u_samplers[0]
+#define GBUFFER_NORMAL_MAP u_samplers[1]
+#define GBUFFER_ALBEDO_MAP u_samplers[2]
+
+vec3 gbuffer_position(ivec2 pixel)
+{
+    return texelFetch(GBUFFER_POSITION_MAP, pixel, 0).xyz;
+}
+
+vec3 gbuffer_normal(ivec2 pixel)
+{
+    return texelFetch(GBUFFER_NORMAL_MAP, pixel, 0).xyz;
+}
+
+// 1 where geometry was written, 0 for the background
+float gbuffer_coverage(ivec2 pixel)
+{
+    return length(gbuffer_normal(pixel));
+}
@@ -0,0 +1,2 @@
+// Draw what was visible last frame
+#define OCCLUSION_PHASE 1
@@ -0,0 +1,2 @@
+// Test everything against the pyramid built from the phase 1 depth
+#define OCCLUSION_PHASE 2
@@ -0,0 +1,19 @@
+in VertexOut
+{
+    vec2 uv;
+};
+
+out vec4 out_color;
+
+// Point lights are added on top by the light volumes, only the directional
+// light from the per frame block is applied here
+void main()
+{
+    ivec2 dim = textureSize(GBUFFER_NORMAL_MAP, 0);
+    ivec2 pixel = min(ivec2(uv * vec2(dim)), dim - 1);
+    vec3 pos = gbuffer_position(pixel);
+    vec3 normal = gbuffer_normal(pixel);
+
+    out_color = vec4(calc_phong(normal, pos), 1);
+    out_color *= gbuffer_coverage(pixel);
+}
@@ -0,0 +1,27 @@
+in VertexOut
+{
+    vec3 pos_world;
+    vec3 normal_world;
+};
+
+#ifdef GBUFFER_COMPACT
+layout (location = 0) out vec2 out_normal;
+layout (location = 1) out vec4 out_albedo;
+#else
+layout (location = 0) out vec3 out_position;
+layout (location = 1) out vec3 out_normal;
+layout (location = 2) out vec4 out_albedo;
+#endif
+
+void main()
+{
+#ifdef GBUFFER_COMPACT
+    // Position comes back from depth, shininess is stored over 255
+    out_normal = oct_encode(normalize(normal_world));
+    out_albedo = vec4(1, 1, 1, 32.0 / 255.0);
+#else
+    out_position = pos_world;
+    out_normal = normalize(normal_world);
+    out_albedo = vec4(1, 1, 1, 32);
+#endif
+}
@@ -0,0 +1,14 @@
+out VertexOut
+{
+    vec3 pos_world;
+    vec3 normal_world;
+};
+
+void main()
+{
+    mat4 model = u_occlusion_objects[gl_BaseInstance].model;
+    vec4 pos = model * vec4(v_pos, 1);
+    pos_world = pos.xyz;
+    normal_world = mat3(transpose(inverse(model))) * v_normal;
+    gl_Position = u_proj * u_view * pos;
+}
@@ -0,0 +1,26 @@
+in VertexOut
+{
+    flat int light_index;
+};
+
+out vec4 out_color;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec3 pos = gbuffer_position(pixel);
+    vec3 normal = gbuffer_normal(pixel);
+
+    PhongLight light = u_point_lights[light_index];
+    if (length(light.pos_or_dir - pos) > light.radius)
+        discard;
+
+    vec3 ka = vec3(0);
+    vec3 kd = vec3(0.9, 0.9, 0.9);
+    vec3 ks = vec3(0.9, 0.9, 0.9);
+    float ns = 32;
+    vec3 color = phong_point_light_color(
+        light, normalize(normal), u_view_pos, pos,
+        ka, kd, ks, ns);
+    out_color = vec4(color, 1);
+}
@@ -0,0 +1,16 @@
+out VertexOut
+{
+    flat int light_index;
+};
+
+// Unit sphere mesh has a radius of 0.5, the polygonal approximation is
+// slightly inflated so it never cuts into the light's reach
+#define PROXY_SCALE (2.0 * 1.05)
+
+void main()
+{
+    light_index = gl_InstanceID;
+    PhongLight light = u_point_lights[gl_InstanceID];
+    vec3 pos = v_pos * (light.radius * PROXY_SCALE) + light.pos_or_dir;
+    gl_Position = u_proj * u_view * vec4(pos, 1);
+}
@@ -1,8 +1,3 @@
-
-#define POSITION_MAP u_samplers[0]
-#define NORMAL_MAP u_samplers[1]
-#define COLOR_MAP u_samplers[2]
-
 in VertexOut
 {
     vec2 uv;
@@ -12,12 +7,17 @@ out vec4 out_color;
 
 void main()
 {
-    vec3 pos = texture(POSITION_MAP, uv).xyz;
-    vec3 normal = texture(NORMAL_MAP, uv).xyz;
-    vec3 color = texture(COLOR_MAP, uv).xyz;
+    ivec2 dim = textureSize(GBUFFER_NORMAL_MAP, 0);
+    ivec2 pixel = min(ivec2(uv * vec2(dim)), dim - 1);
+    vec3 pos = gbuffer_position(pixel);
+    vec3 normal = gbuffer_normal(pixel);
+
+    ivec2 tile = pixel / LIGHT_TILE_SIZE;
+    int tiles_count_x = (dim.x + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+    uint tile_index = uint(tile.y * tiles_count_x + tile.x);
 
-    out_color = vec4(calc_phong(normal, pos), 1);
-    out_color *= length(normal);
+    out_color = vec4(calc_phong_tiled(normal, pos, tile_index), 1);
+    out_color *= gbuffer_coverage(pixel);
     //out_color = vec4((normal + vec3(1)) * 0.5, 1);
     //out_color = vec4(vec3(0.5), 1);
 }
@@ -0,0 +1,11 @@
+out vec3 out_color;
+
+in VertexOut
+{
+    vec2 uv;
+};
+
+void main()
+{
+    out_color = texture(u_samplers[0], uv).xyz;
+}
@@ -10,6 +10,7 @@ struct PhongLight
     float falloff;
     float linear;
     float quadratic;
+    float radius;
 };
 
 #define MAX_PHONG_LIGHTS_COUNT 100
@@ -33,6 +34,61 @@ layout (binding = 1, std140) uniform PerObject
 #define MAX_SAMPLERS_COUNT 16
 layout (binding = 0) uniform sampler2D u_samplers[MAX_SAMPLERS_COUNT];
 
+// Point lights for tiled shading, not limited by the uniform block size
+layout (binding = 0, std430) readonly buffer PointLights
+{
+    uint u_point_lights_count;
+    PhongLight u_point_lights[];
+};
+
+#define LIGHT_TILE_SIZE 16
+#define MAX_LIGHTS_PER_TILE 255
+
+// Each tile owns (MAX_LIGHTS_PER_TILE + 1) entries: the light count followed
+// by the indices into u_point_lights
+layout (binding = 1, std430) buffer LightTiles
+{
+    uint u_light_tiles[];
+};
+
+// Objects submitted through GPU-driven indirect draws, indexed with
+// gl_BaseInstance from the vertex shader
+struct OcclusionObject
+{
+    mat4 model;
+    vec4 aabb_center;
+    vec4 aabb_extent;
+    uint object_id;
+    uint index_count;
+};
+
+layout (binding = 2, std430) readonly buffer OcclusionObjects
+{
+    uint u_occlusion_objects_count;
+    OcclusionObject u_occlusion_objects[];
+};
+
+// Per scene object, persists across frames: 1 if visible last frame
+layout (binding = 3, std430) buffer OcclusionVisibility
+{
+    uint u_occlusion_visibility[];
+};
+
+struct DrawElementsIndirectCommand
+{
+    uint count;
+    uint instance_count;
+    uint first_index;
+    int base_vertex;
+    uint base_instance;
+};
+
+// Two sets of commands, one per culling phase, u_occlusion_objects_count apart
+layout (binding = 4, std430) writeonly buffer OcclusionCommands
+{
+    DrawElementsIndirectCommand u_occlusion_commands[];
+};
+
 vec4 model_to_world_point(vec3 p)
 {
     return u_model * vec4(p, 1);
@@ -65,6 +121,14 @@ float phong_attenutation(PhongLight light, vec3 pos)
         1.0 / (1.0 +
                light.linear * distance +
                light.quadratic * distance * distance);
+    // Lights with a radius fade out to exactly zero at it, so culling them
+    // past that distance doesn't produce visible seams
+    if (light.radius > 0)
+    {
+        float x = distance / light.radius;
+        float window = clamp(1.0 - x * x * x * x, 0.0, 1.0);
+        attenuation *= window * window;
+    }
     return attenuation;
 }
 
@@ -137,4 +201,35 @@ vec3 calc_phong(vec3 normal, vec3 frag_pos)
     }
 
     return color;
-}
\ No newline at end of file
+}
+
+float linearize_depth(float depth)
+{
+    float ndc_z = depth * 2.0 - 1.0;
+    return u_proj[3][2] / (ndc_z + u_proj[2][2]);
+}
+
+vec3 calc_phong_tiled(vec3 normal, vec3 frag_pos, uint tile_index)
+{
+    vec3 n = normalize(normal);
+
+    // Directional lights still come from the per frame block
+    vec3 color = calc_phong(n, frag_pos);
+
+    vec3 ka = vec3(0);
+    vec3 kd = vec3(0.9, 0.9, 0.9);
+    vec3 ks = vec3(0.9, 0.9, 0.9);
+    float ns = 32;
+
+    uint base = tile_index * (MAX_LIGHTS_PER_TILE + 1);
+    uint count = u_light_tiles[base];
+    for (uint i = 0; i < count; i++)
+    {
+        PhongLight light = u_point_lights[u_light_tiles[base + 1 + i]];
+        color += phong_point_light_color(
+            light, n, u_view_pos, frag_pos,
+            ka, kd, ks, ns);
+    }
+
+    return color;
+}
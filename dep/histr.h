@@ -28,8 +28,13 @@ histr_String histr_subappend_impl(histr_String str, const char* s, int n);
 #define HISTR_MAX(a, b) (((a) > (b)) ? (a) : (b))
 #define HISTR_MIN(a, b) (((a) < (b)) ? (a) : (b))
 
+#ifndef HISTR_MALLOC
 #define HISTR_MALLOC(sz) malloc(sz)
+#endif // HISTR_MALLOC
+
+#ifndef HISTR_FREE
 #define HISTR_FREE(p) free(p)
+#endif // HISTR_FREE
 
 #define HISTR_MOVE_PTR_BACKWARD(p, type) ((uint8_t*)(p) - sizeof(type))
 #define HISTR_MOVE_PTR_FORWARD(p, type) ((uint8_t*)(p) + sizeof(type))
@@ -1,17 +1,32 @@
+#include "../src/mem.h"
 //#define HIHASH_IMPL
 //#define HH_VALUE_TY
+//#define HH_MALLOC(sz) mem_alloc(MemTag_String, sz)
+//#define HH_FREE(p) mem_free(p)
 //#include <hihash.h>
 #define HIMATH_IMPL
 #include <himath.h>
 #define HISTR_IMPL
+#define HISTR_MALLOC(sz) mem_alloc(MemTag_String, sz)
+#define HISTR_FREE(p) mem_free(p)
 #include <histr.h>
 #define STB_IMAGE_IMPLEMENTATION
+#define STBI_MALLOC(sz) mem_alloc(MemTag_Image, sz)
+#define STBI_REALLOC(p, newsz) mem_realloc(MemTag_Image, p, newsz)
+#define STBI_FREE(p) mem_free(p)
 #include <stb_image.h>
 #define STB_IMAGE_WRITE_IMPLEMENTATION
+#define STBIW_MALLOC(sz) mem_alloc(MemTag_Image, sz)
+#define STBIW_REALLOC(p, newsz) mem_realloc(MemTag_Image, p, newsz)
+#define STBIW_FREE(p) mem_free(p)
 #include <stb_image_write.h>
 #define CGLTF_IMPLEMENTATION
 #include <cgltf.h>
 #define TINYOBJ_LOADER_C_IMPLEMENTATION
+#define TINYOBJ_MALLOC(sz) mem_alloc(MemTag_Mesh, sz)
+#define TINYOBJ_REALLOC(p, sz) mem_realloc(MemTag_Mesh, p, sz)
+#define TINYOBJ_CALLOC(count, sz) mem_calloc(MemTag_Mesh, count, sz)
+#define TINYOBJ_FREE(p) mem_free(p)
 #include <tinyobj_loader_c.h>
 #ifdef _WIN32
 #define GLAD_WGL_IMPLEMENTATION
@@ -4,8 +4,16 @@ local function mkdir_if_not_exist(path)
     end
 end
 
-local function internal_simple_win32_cpp(name, static_libs, clang_format_path, proj_kind)
+-- console_configs maps extra configuration names to their defines, those
+-- build an optimized console app next to the regular Debug and Release
+local function internal_simple_win32_cpp(name, static_libs, clang_format_path, proj_kind, console_configs)
     clang_format_path = clang_format_path or '.clang-format'
+    console_configs = console_configs or {}
+
+    local configs = {'Debug', 'Release'}
+    for config in pairs(console_configs) do
+        table.insert(configs, config)
+    end
 
     local build_root = 'build/'
     mkdir_if_not_exist(build_root)
@@ -30,7 +38,7 @@ local function internal_simple_win32_cpp(name, static_libs, clang_format_path, p
     }
 
     workspace(name)
-        configurations {'Debug', 'Release'}
+        configurations(configs)
         files(clang_format_path)
 
     project(name .. '_win32')
@@ -83,14 +91,24 @@ local function internal_simple_win32_cpp(name, static_libs, clang_format_path, p
         filter 'configurations:Release'
             disablewarnings '4101'
             optimize 'On'
+
+        for config, config_defines in pairs(console_configs) do
+            filter('configurations:' .. config)
+                kind 'ConsoleApp'
+                defines(config_defines)
+                disablewarnings '4101'
+                optimize 'On'
+        end
 end
 
-function simple_win32_windowed_cpp(name, static_libs, clang_format_path)
-    internal_simple_win32_cpp(name, static_libs, clang_format_path, 'WindowedApp')
+function simple_win32_windowed_cpp(name, static_libs, clang_format_path, console_configs)
+    internal_simple_win32_cpp(name, static_libs, clang_format_path, 'WindowedApp', console_configs)
 end
 
-function simple_win32_console_cpp(name, static_libs, clang_format_path)
-    internal_simple_win32_cpp(name, static_libs, clang_format_path, 'ConsoleApp')
+function simple_win32_console_cpp(name, static_libs, clang_format_path, console_configs)
+    internal_simple_win32_cpp(name, static_libs, clang_format_path, 'ConsoleApp', console_configs)
 end
 
-simple_win32_windowed_cpp('zen', {'user32', 'winmm', 'opengl32'})
+-- RaytracerHeadless runs the raytracer benchmark from the command line
+simple_win32_windowed_cpp('zen', {'user32', 'winmm', 'opengl32'}, nil,
+                          {RaytracerHeadless = {'RAYTRACER_HEADLESS'}})
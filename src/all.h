@@ -4,7 +4,11 @@
 #include "debug.h"
 #include "example.h"
 #include "filesystem.h"
+#include "job.h"
+#include "mem.h"
+#include "pool.h"
 #include "primitive.h"
+#include "raytrace.h"
 #include "renderer.h"
 #include "resource.h"
 #include "scene.h"
@@ -31,6 +31,9 @@ typedef struct Input_
     float dt;
 } Input;
 
+// Milliseconds from an arbitrary origin, for measuring intervals
+double a_get_time_ms();
+
 inline bool a_input_is_key_down(const Input* input, Key key)
 {
     return input->key_down[input->key_map[key]];
@@ -0,0 +1,37 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include "util.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Pages are committed in steps of this as the arena fills up
+#define ARENA_COMMIT_SIZE ((size_t)1 << 20)
+
+// A linear allocator over one reserved range of address space, pages are
+// only committed once something is pushed into them. Everything goes away in
+// one call, there is no freeing of single allocations.
+typedef struct Arena_
+{
+    uint8_t* base;
+    size_t reserved;
+    size_t committed;
+    size_t used; // Live bytes, alignment padding included
+    size_t peak; // Bytes past this were never handed out and are still zero
+    int pushes_count;
+} Arena;
+
+bool arena_init(Arena* arena, size_t reserve_size);
+void arena_release(Arena* arena);
+// Zeroed memory, NULL when the reservation is used up
+void* arena_push(Arena* arena, size_t size, size_t align);
+// Copy of str with its terminator, NULL when the reservation is used up
+char* arena_push_str(Arena* arena, const char* str);
+// Everything pushed after the mark is popped, committed pages stay
+size_t arena_mark(const Arena* arena);
+void arena_pop_to(Arena* arena, size_t mark);
+
+#define ARENA_PUSH_ARRAY(arena, type, count)                                   \
+    ((type*)arena_push(arena, (size_t)(count) * sizeof(type), ALIGN_OF(type)))
+
+#endif // ARENA_H
@@ -0,0 +1,81 @@
+#include "arena.h"
+#include "debug.h"
+#include <string.h>
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+bool arena_init(Arena* arena, size_t reserve_size)
+{
+    *arena = (Arena){0};
+    void* base = VirtualAlloc(NULL, reserve_size, MEM_RESERVE, PAGE_NOACCESS);
+    if (!base)
+        return false;
+
+    arena->base = (uint8_t*)base;
+    arena->reserved = reserve_size;
+    return true;
+}
+
+void arena_release(Arena* arena)
+{
+    if (arena->base)
+        VirtualFree(arena->base, 0, MEM_RELEASE);
+    *arena = (Arena){0};
+}
+
+void* arena_push(Arena* arena, size_t size, size_t align)
+{
+    ASSERT(align > 0 && (align & (align - 1)) == 0);
+    uintptr_t top = (uintptr_t)arena->base + arena->used;
+    size_t padding = (size_t)((align - (top & (align - 1))) & (align - 1));
+    size_t begin = arena->used + padding;
+    if (begin > arena->reserved || size > arena->reserved - begin)
+        return NULL;
+
+    size_t end = begin + size;
+    if (end > arena->committed)
+    {
+        size_t steps = (end + ARENA_COMMIT_SIZE - 1) / ARENA_COMMIT_SIZE;
+        size_t commit_end = steps * ARENA_COMMIT_SIZE;
+        if (commit_end > arena->reserved)
+            commit_end = arena->reserved;
+        if (!VirtualAlloc(arena->base + arena->committed,
+                          commit_end - arena->committed, MEM_COMMIT,
+                          PAGE_READWRITE))
+        {
+            return NULL;
+        }
+        arena->committed = commit_end;
+    }
+
+    // Fresh pages come zeroed, only memory handed out before needs clearing
+    void* result = arena->base + begin;
+    if (begin < arena->peak)
+        memset(result, 0, (end < arena->peak ? end : arena->peak) - begin);
+
+    arena->used = end;
+    if (end > arena->peak)
+        arena->peak = end;
+    ++arena->pushes_count;
+    return result;
+}
+
+char* arena_push_str(Arena* arena, const char* str)
+{
+    size_t size = strlen(str) + 1;
+    char* result = (char*)arena_push(arena, size, 1);
+    if (result)
+        memcpy(result, str, size);
+    return result;
+}
+
+size_t arena_mark(const Arena* arena)
+{
+    return arena->used;
+}
+
+void arena_pop_to(Arena* arena, size_t mark)
+{
+    ASSERT(mark <= arena->used);
+    arena->used = mark;
+}
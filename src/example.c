@@ -8,39 +8,58 @@
 #include <stdlib.h>
 #include <math.h>
 
-Example*
-    e_example_make_impl(const char* name, size_t scene_size, size_t scene_align)
+Example* e_example_alloc_impl(const char* name,
+                              size_t scene_size,
+                              size_t scene_align)
 {
-    void* mem = calloc(1, sizeof(Example) + scene_size + scene_align);
-    Example* e = (Example*)mem;
+    Arena arena;
+    if (!arena_init(&arena, EXAMPLE_ARENA_RESERVE_SIZE))
+    {
+        // Not PRINTLN, this has to show up in Release builds too
+        d_print("Failed to reserve the arena of %s\n", name);
+        ASSERT(false);
+        abort();
+    }
+
+    Example* e = (Example*)arena_push(&arena, sizeof(Example),
+                                      ALIGN_OF(Example));
     e->name = name;
+    e->scene = arena_push(&arena, scene_size, scene_align);
+    e->arena = arena;
+    return e;
+}
 
+void e_example_init_gpu(Example* e)
+{
     glGenBuffers(1, &e->per_frame_ubo);
-    glBindBuffer(GL_UNIFORM_BUFFER, e->per_frame_ubo);
+    r_state_bind_buffer(GL_UNIFORM_BUFFER, e->per_frame_ubo);
     glBufferData(GL_UNIFORM_BUFFER, sizeof(ExamplePerFrameUBO), NULL,
                  GL_DYNAMIC_DRAW);
-    glBindBufferBase(GL_UNIFORM_BUFFER, 0, e->per_frame_ubo);
+    r_state_bind_buffer_base(GL_UNIFORM_BUFFER, 0, e->per_frame_ubo);
 
     glGenBuffers(1, &e->per_object_ubo);
-    glBindBuffer(GL_UNIFORM_BUFFER, e->per_object_ubo);
+    r_state_bind_buffer(GL_UNIFORM_BUFFER, e->per_object_ubo);
     glBufferData(GL_UNIFORM_BUFFER, sizeof(ExamplePerObjectUBO), NULL,
                  GL_DYNAMIC_DRAW);
-    glBindBufferBase(GL_UNIFORM_BUFFER, 1, e->per_object_ubo);
+    r_state_bind_buffer_base(GL_UNIFORM_BUFFER, 1, e->per_object_ubo);
 
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
-
-    uint8_t* scene_mem = (uint8_t*)mem + sizeof(Example);
-    scene_mem += (scene_align - ((uintptr_t)scene_mem % scene_align));
-    e->scene = scene_mem;
+    r_state_bind_buffer(GL_UNIFORM_BUFFER, 0);
+}
 
+Example*
+    e_example_make_impl(const char* name, size_t scene_size, size_t scene_align)
+{
+    Example* e = e_example_alloc_impl(name, scene_size, scene_align);
+    e_example_init_gpu(e);
     return e;
 }
 
 void e_example_destroy(Example* e)
 {
-    glDeleteBuffers(1, &e->per_frame_ubo);
-    glDeleteBuffers(1, &e->per_object_ubo);
-    free(e);
+    r_state_delete_buffers(1, &e->per_frame_ubo);
+    r_state_delete_buffers(1, &e->per_object_ubo);
+    Arena arena = e->arena;
+    arena_release(&arena);
 }
 
 Mesh e_mesh_load_from_obj(const Example* e, const char* obj_filename)
@@ -55,8 +74,26 @@ Mesh e_mesh_load_from_obj(const Example* e, const char* obj_filename)
 
 GLuint e_shader_load(const Example* e, const char* shader_name)
 {
-    PRINTLN("Building shader (%s)...", shader_name);
+    return e_shader_load_variant(e, shader_name, NULL);
+}
+
+GLuint e_shader_load_variant(const Example* e,
+                             const char* shader_name,
+                             const char* variant_name)
+{
+    PRINTLN("Building shader (%s, %s)...", shader_name,
+            variant_name ? variant_name : "default");
+    ShaderText text = e_shader_read_variant(e, shader_name, variant_name);
+    GLuint result = rc_shader_load_from_source(text.stages[0], text.stages[1],
+                                               text.stages[2], text.stages[3]);
+    rc_shader_text_cleanup(&text);
+    return result;
+}
 
+ShaderText e_shader_read_variant(const Example* e,
+                                 const char* shader_name,
+                                 const char* variant_name)
+{
     Path shared_root_path = fs_path_make_working_dir();
     fs_path_append2(&shared_root_path, "shared", "shaders");
 
@@ -75,6 +112,16 @@ GLuint e_shader_load(const Example* e, const char* shader_name)
     Path example_shader_root_path = fs_path_make_working_dir();
     fs_path_append(&example_shader_root_path, e->name);
 
+    // The variant file goes right before the shader itself in every stage
+    Path variant_filepath = fs_path_copy(example_shader_root_path);
+    if (variant_name)
+    {
+        histr_String variant_filename = histr_makestr(variant_name);
+        histr_append(variant_filename, ".glsl");
+        fs_path_append(&variant_filepath, variant_filename);
+        histr_destroy(variant_filename);
+    }
+
     Path vs_filepath = fs_path_copy(example_shader_root_path);
     {
         histr_String vs_filename = histr_makestr(shader_name);
@@ -90,10 +137,13 @@ GLuint e_shader_load(const Example* e, const char* shader_name)
                 shared_vertex_input_path.abs_path_str,
                 shared_shared_path.abs_path_str,
                 shared_vs_shared_path.abs_path_str,
-                vs_filepath.abs_path_str,
             },
-        .filenames_count = 5,
+        .filenames_count = 4,
     };
+    if (variant_name)
+        vs_desc.filenames[vs_desc.filenames_count++] =
+            variant_filepath.abs_path_str;
+    vs_desc.filenames[vs_desc.filenames_count++] = vs_filepath.abs_path_str;
 
     Path fs_filepath = fs_path_copy(example_shader_root_path);
     {
@@ -108,10 +158,13 @@ GLuint e_shader_load(const Example* e, const char* shader_name)
             {
                 shared_version_path.abs_path_str,
                 shared_shared_path.abs_path_str,
-                fs_filepath.abs_path_str,
             },
-        .filenames_count = 3,
+        .filenames_count = 2,
     };
+    if (variant_name)
+        fs_desc.filenames[fs_desc.filenames_count++] =
+            variant_filepath.abs_path_str;
+    fs_desc.filenames[fs_desc.filenames_count++] = fs_filepath.abs_path_str;
 
     Path gs_filepath = fs_path_copy(example_shader_root_path);
     {
@@ -126,17 +179,21 @@ GLuint e_shader_load(const Example* e, const char* shader_name)
             {
                 shared_version_path.abs_path_str,
                 shared_shared_path.abs_path_str,
-                gs_filepath.abs_path_str,
             },
-        .filenames_count = 3,
+        .filenames_count = 2,
     };
+    if (variant_name)
+        gs_desc.filenames[gs_desc.filenames_count++] =
+            variant_filepath.abs_path_str;
+    gs_desc.filenames[gs_desc.filenames_count++] = gs_filepath.abs_path_str;
 
-    GLuint result = rc_shader_load_from_files(vs_desc, fs_desc, gs_desc,
-                                              (ShaderLoadDesc){0});
+    ShaderText result =
+        rc_shader_read_files(vs_desc, fs_desc, gs_desc, (ShaderLoadDesc){0});
 
     fs_path_cleanup(&gs_filepath);
     fs_path_cleanup(&fs_filepath);
     fs_path_cleanup(&vs_filepath);
+    fs_path_cleanup(&variant_filepath);
     fs_path_cleanup(&example_shader_root_path);
     fs_path_cleanup(&shared_vs_shared_path);
     fs_path_cleanup(&shared_shared_path);
@@ -147,6 +204,84 @@ GLuint e_shader_load(const Example* e, const char* shader_name)
     return result;
 }
 
+GLuint e_compute_shader_load(const Example* e, const char* shader_name)
+{
+    return e_compute_shader_load_variant(e, shader_name, NULL);
+}
+
+GLuint e_compute_shader_load_variant(const Example* e,
+                                     const char* shader_name,
+                                     const char* variant_name)
+{
+    PRINTLN("Building compute shader (%s, %s)...", shader_name,
+            variant_name ? variant_name : "default");
+    ShaderText text =
+        e_compute_shader_read_variant(e, shader_name, variant_name);
+    GLuint result = rc_shader_load_from_source(text.stages[0], text.stages[1],
+                                               text.stages[2], text.stages[3]);
+    rc_shader_text_cleanup(&text);
+    return result;
+}
+
+ShaderText e_compute_shader_read_variant(const Example* e,
+                                         const char* shader_name,
+                                         const char* variant_name)
+{
+    Path shared_root_path = fs_path_make_working_dir();
+    fs_path_append2(&shared_root_path, "shared", "shaders");
+
+    Path shared_version_path = fs_path_copy(shared_root_path);
+    fs_path_append(&shared_version_path, "version.glsl");
+
+    Path shared_shared_path = fs_path_copy(shared_root_path);
+    fs_path_append(&shared_shared_path, "shared.glsl");
+
+    Path example_shader_root_path = fs_path_make_working_dir();
+    fs_path_append(&example_shader_root_path, e->name);
+
+    Path variant_filepath = fs_path_copy(example_shader_root_path);
+    if (variant_name)
+    {
+        histr_String variant_filename = histr_makestr(variant_name);
+        histr_append(variant_filename, ".glsl");
+        fs_path_append(&variant_filepath, variant_filename);
+        histr_destroy(variant_filename);
+    }
+
+    Path cs_filepath = fs_path_copy(example_shader_root_path);
+    {
+        histr_String cs_filename = histr_makestr(shader_name);
+        histr_append(cs_filename, ".comp");
+        fs_path_append(&cs_filepath, cs_filename);
+        histr_destroy(cs_filename);
+    }
+
+    ShaderLoadDesc cs_desc = {
+        .filenames =
+            {
+                shared_version_path.abs_path_str,
+                shared_shared_path.abs_path_str,
+            },
+        .filenames_count = 2,
+    };
+    if (variant_name)
+        cs_desc.filenames[cs_desc.filenames_count++] =
+            variant_filepath.abs_path_str;
+    cs_desc.filenames[cs_desc.filenames_count++] = cs_filepath.abs_path_str;
+
+    ShaderText result = rc_shader_read_files(
+        (ShaderLoadDesc){0}, (ShaderLoadDesc){0}, (ShaderLoadDesc){0}, cs_desc);
+
+    fs_path_cleanup(&cs_filepath);
+    fs_path_cleanup(&variant_filepath);
+    fs_path_cleanup(&example_shader_root_path);
+    fs_path_cleanup(&shared_shared_path);
+    fs_path_cleanup(&shared_version_path);
+    fs_path_cleanup(&shared_root_path);
+
+    return result;
+}
+
 GLuint e_texture_load(const Example* e, const char* texture_filename)
 {
     GLuint result = 0;
@@ -160,7 +295,7 @@ GLuint e_texture_load(const Example* e, const char* texture_filename)
     {
         GLuint texture;
         glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        r_state_bind_texture(0, GL_TEXTURE_2D, texture);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -175,7 +310,7 @@ GLuint e_texture_load(const Example* e, const char* texture_filename)
             glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGBA,
                          GL_UNSIGNED_BYTE, pixels);
         }
-        glBindTexture(GL_TEXTURE_2D, 0);
+        r_state_bind_texture(0, GL_TEXTURE_2D, 0);
 
         result = texture;
     }
@@ -184,18 +319,18 @@ GLuint e_texture_load(const Example* e, const char* texture_filename)
     return result;
 }
 
+// The uniform buffer stays bound after the upload; the state cache turns the
+// next bind into a no-op when the same buffer is updated again.
 void e_apply_per_frame_ubo(const Example* e, const ExamplePerFrameUBO* data)
 {
-    glBindBuffer(GL_UNIFORM_BUFFER, e->per_frame_ubo);
+    r_state_bind_buffer(GL_UNIFORM_BUFFER, e->per_frame_ubo);
     glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(*data), data);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
 }
 
 void e_apply_per_object_ubo(const Example* e, const ExamplePerObjectUBO* data)
 {
-    glBindBuffer(GL_UNIFORM_BUFFER, e->per_object_ubo);
+    r_state_bind_buffer(GL_UNIFORM_BUFFER, e->per_object_ubo);
     glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(*data), data);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
 }
 
 void e_fpscam_update(ExampleFpsCamera* cam, const Input* input, float speed)
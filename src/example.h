@@ -1,7 +1,9 @@
 #ifndef EXAMPLE_H
 #define EXAMPLE_H
+#include "arena.h"
 #include "scene.h"
 #include "renderer.h"
+#include "resource.h"
 #include "util.h"
 
 #define EXAMPLE_INIT_FN_SIG(scene_name) SCENE_INIT_FN_SIG(scene_name##_init)
@@ -9,6 +11,10 @@
     SCENE_CLEANUP_FN_SIG(scene_name##_cleanup)
 #define EXAMPLE_UPDATE_FN_SIG(scene_name)                                      \
     SCENE_UPDATE_FN_SIG(scene_name##_update)
+#define EXAMPLE_PREPARE_FN_SIG(scene_name)                                     \
+    SCENE_PREPARE_FN_SIG(scene_name##_prepare)
+#define EXAMPLE_ACTIVATE_FN_SIG(scene_name)                                    \
+    SCENE_ACTIVATE_FN_SIG(scene_name##_activate)
 
 #define EXAMPLE_DECL(scene_name)                                               \
     EXAMPLE_INIT_FN_SIG(scene_name);                                           \
@@ -22,12 +28,27 @@
         .update = scene_name##_update                                          \
     }
 
+// For examples that define prepare and activate instead of init, they only
+// load in the background through s_update
+#define EXAMPLE_PRELOAD_LITERAL(scene_name)                                    \
+    (SceneCallbacks)                                                           \
+    {                                                                          \
+        .cleanup = scene_name##_cleanup, .update = scene_name##_update,        \
+        .prepare = scene_name##_prepare, .activate = scene_name##_activate     \
+    }
+
+// Address space reserved for each example, only what's pushed is committed
+#define EXAMPLE_ARENA_RESERVE_SIZE ((size_t)16 << 30)
+
 typedef struct Example_
 {
     const char* name;
     GLuint per_frame_ubo;
     GLuint per_object_ubo;
     void* scene;
+    // Holds the example and its scene struct, plus whatever the scene pushes
+    // for its whole lifetime. Released at once by e_example_destroy.
+    Arena arena;
 } Example;
 
 #define e_example_make(name, scene_type)                                       \
@@ -35,10 +56,36 @@ typedef struct Example_
 Example* e_example_make_impl(const char* name,
                              size_t scene_size,
                              size_t scene_align);
+// CPU-only half of e_example_make for prepare, e_example_init_gpu finishes it
+// on the main thread. Both abort when the arena can't be reserved.
+#define e_example_alloc(name, scene_type)                                      \
+    e_example_alloc_impl(name, sizeof(scene_type), ALIGN_OF(scene_type))
+Example* e_example_alloc_impl(const char* name,
+                              size_t scene_size,
+                              size_t scene_align);
+void e_example_init_gpu(Example* e);
+// Also releases the arena, e itself included
 void e_example_destroy(Example* e);
 
 Mesh e_mesh_load_from_obj(const Example* e, const char* obj_filename);
 GLuint e_shader_load(const Example* e, const char* shader_name);
+// Same as e_shader_load, with <variant_name>.glsl from the example's shader
+// directory prepended to every stage
+GLuint e_shader_load_variant(const Example* e,
+                             const char* shader_name,
+                             const char* variant_name);
+GLuint e_compute_shader_load(const Example* e, const char* shader_name);
+GLuint e_compute_shader_load_variant(const Example* e,
+                                     const char* shader_name,
+                                     const char* variant_name);
+// The text the two loads above compile, without touching GL, so prepare can
+// read it on a worker. Free it with rc_shader_text_cleanup.
+ShaderText e_shader_read_variant(const Example* e,
+                                 const char* shader_name,
+                                 const char* variant_name);
+ShaderText e_compute_shader_read_variant(const Example* e,
+                                         const char* shader_name,
+                                         const char* variant_name);
 GLuint e_texture_load(const Example* e, const char* texture_filename);
 
 typedef enum ExamplePhongLightType_
@@ -60,6 +107,7 @@ typedef struct ExamplePhongLight_
     ALIGN_AS(4) float falloff;
     ALIGN_AS(4) float linear;
     ALIGN_AS(4) float quadratic;
+    ALIGN_AS(4) float radius; // 0 means unbounded
 } ExamplePhongLight;
 
 #define MAX_PHONG_LIGHTS_COUNT 100
@@ -1,28 +1,70 @@
 #include <vector>
 #include "himath.h"
+extern "C"
+{
+#include "../../mem.h"
+}
+
+// Keeps the vectors' blocks in the tracked allocator too
+template <typename T>
+struct MemAllocator
+{
+    typedef T value_type;
+
+    MemAllocator() = default;
+    template <typename U>
+    MemAllocator(const MemAllocator<U>&)
+    {
+    }
+
+    T* allocate(size_t count)
+    {
+        return (T*)mem_alloc(MemTag_Misc, count * sizeof(T));
+    }
+    void deallocate(T* ptr, size_t)
+    {
+        mem_free(ptr);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const MemAllocator<T>&, const MemAllocator<U>&)
+{
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const MemAllocator<T>&, const MemAllocator<U>&)
+{
+    return false;
+}
+
+typedef std::vector<float, MemAllocator<float>> FloatVector;
 
-static void cubic_spline(std::vector<float>* xs, std::vector<float>* out_xs);
+static void cubic_spline(FloatVector* xs, FloatVector* out_xs);
 
 extern "C" void calc_cubic_spline(const FVec3* input_points,
                                   int input_points_count,
                                   FVec3** out_points,
                                   int* out_points_count)
 {
-    std::vector<float> xs(input_points_count);
-    std::vector<float> ys(input_points_count);
+    FloatVector xs(input_points_count);
+    FloatVector ys(input_points_count);
     for (int i = 0; i < input_points_count; i++)
     {
         xs[i] = input_points[i].x;
         ys[i] = input_points[i].y;
     }
 
-    std::vector<float> out_xs;
-    std::vector<float> out_ys;
+    FloatVector out_xs;
+    FloatVector out_ys;
 
     cubic_spline(&xs, &out_xs);
     cubic_spline(&ys, &out_ys);
 
-    *out_points = (FVec3*)malloc(out_xs.size() * sizeof(FVec3));
+    // Freed by the caller with mem_free
+    *out_points =
+        (FVec3*)mem_alloc(MemTag_Misc, out_xs.size() * sizeof(FVec3));
     *out_points_count = (int)out_xs.size();
 
     for (int i = 0; i < *out_points_count; i++)
@@ -33,14 +75,15 @@ extern "C" void calc_cubic_spline(const FVec3* input_points,
     }
 }
 
-static void cubic_spline(std::vector<float>* xs, std::vector<float>* out_xs)
+static void cubic_spline(FloatVector* xs, FloatVector* out_xs)
 {
     int n = (int)xs->size() - 1;
 
     struct helper
     {
         float alpha, l, u, z, c, b, d;
-    }* helpers = (struct helper*)malloc((n + 1) * sizeof(struct helper));
+    }* helpers = (struct helper*)mem_alloc(MemTag_Misc,
+                                           (n + 1) * sizeof(struct helper));
 
     helpers[0].l = 1;
     helpers[0].u = 0;
@@ -82,5 +125,5 @@ static void cubic_spline(std::vector<float>* xs, std::vector<float>* out_xs)
         }
     }
 
-    free(helpers);
+    mem_free(helpers);
 }
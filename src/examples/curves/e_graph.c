@@ -2,6 +2,7 @@
 #include "../../resource.h"
 #include "../../app.h"
 #include "../../debug.h"
+#include "../../mem.h"
 #include <himath.h>
 #include <glad/gl.h>
 #include <stdlib.h>
@@ -79,8 +80,8 @@ static void plt_append_points_buffer(Plotter* p,
                                      int points_count,
                                      const PlotAttribs* attribs)
 {
-    uint8_t* buf =
-        (uint8_t*)malloc(sizeof(PointsBuffer) + points_count * sizeof(FVec3));
+    uint8_t* buf = (uint8_t*)mem_alloc(
+        MemTag_Misc, sizeof(PointsBuffer) + points_count * sizeof(FVec3));
     PointsBuffer* header = (PointsBuffer*)buf;
     header->next = p->buffers;
     header->type = type;
@@ -138,7 +139,7 @@ static void plt_cleanup(Plotter* p)
     {
         PointsBuffer* tmp = curr;
         curr = curr->next;
-        free(tmp);
+        mem_free(tmp);
     }
     *p = (Plotter){0};
 }
@@ -151,8 +152,17 @@ typedef struct PlotRenderer_
     GLuint lines_vbo;
 
     GLuint unlit_shader;
+
+    RenderQueue queue;
 } PlotRenderer;
 
+// Depth testing is off, so the pass bits keep points on top of lines
+typedef enum PlotLayer_
+{
+    PlotLayer_Lines = 0,
+    PlotLayer_Points,
+} PlotLayer;
+
 static void plt_renderer_init(Example* e, PlotRenderer* r)
 {
     *r = (PlotRenderer){0};
@@ -160,38 +170,41 @@ static void plt_renderer_init(Example* e, PlotRenderer* r)
     r_vb_init(&r->point_vb, &point_mesh, GL_TRIANGLES);
 
     glGenVertexArrays(1, &r->lines_vao);
-    glBindVertexArray(r->lines_vao);
+    r_state_bind_vertex_array(r->lines_vao);
     glGenBuffers(1, &r->lines_vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, r->lines_vbo);
+    r_state_bind_buffer(GL_ARRAY_BUFFER, r->lines_vbo);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(FVec3), (GLvoid*)0);
 
     r->unlit_shader = e_shader_load(e, "unlit");
+
+    r_queue_init(&r->queue, e->per_object_ubo, sizeof(ExamplePerObjectUBO));
 }
 
 static void plt_renderer_cleanup(PlotRenderer* r)
 {
+    r_queue_cleanup(&r->queue);
     glDeleteProgram(r->unlit_shader);
 
-    glDeleteBuffers(1, &r->lines_vbo);
-    glDeleteVertexArrays(1, &r->lines_vao);
+    r_state_delete_buffers(1, &r->lines_vbo);
+    r_state_delete_vertex_arrays(1, &r->lines_vao);
     r_vb_cleanup(&r->point_vb);
     *r = (PlotRenderer){0};
 }
 
-static void plt_draw(const Example* e, const Plotter* p, const PlotRenderer* r)
+static void plt_draw(const Example* e, const Plotter* p, PlotRenderer* r)
 {
     // glDisable(GL_SCISSOR_TEST);
-    glDisable(GL_CULL_FACE);
-    glEnable(GL_SCISSOR_TEST);
-    glViewport(p->canvas.pos.x, p->canvas.pos.y, p->canvas.size.x,
-               p->canvas.size.y);
-    glScissor(p->canvas.pos.x, p->canvas.pos.y, p->canvas.size.x,
-              p->canvas.size.y);
-    glClearColor(0.5f, 0.1f, 0.5f, 1);
+    r_state_set_enabled(GL_CULL_FACE, false);
+    r_state_set_enabled(GL_SCISSOR_TEST, true);
+    r_state_viewport(p->canvas.pos.x, p->canvas.pos.y, p->canvas.size.x,
+                     p->canvas.size.y);
+    r_state_scissor(p->canvas.pos.x, p->canvas.pos.y, p->canvas.size.x,
+                    p->canvas.size.y);
+    r_state_clear_color(0.5f, 0.1f, 0.5f, 1);
     glClear(GL_COLOR_BUFFER_BIT);
-    glDisable(GL_DEPTH_TEST);
-    glUseProgram(r->unlit_shader);
+    r_state_set_enabled(GL_DEPTH_TEST, false);
+    r_state_use_program(r->unlit_shader);
 
     ExamplePerFrameUBO per_frame = {0};
     per_frame.view =
@@ -254,8 +267,8 @@ static void plt_draw(const Example* e, const Plotter* p, const PlotRenderer* r)
         }
     }
 
-    glBindVertexArray(r->lines_vao);
-    glBindBuffer(GL_ARRAY_BUFFER, r->lines_vbo);
+    r_state_bind_vertex_array(r->lines_vao);
+    r_state_bind_buffer(GL_ARRAY_BUFFER, r->lines_vbo);
     glBufferData(GL_ARRAY_BUFFER, total_line_points_count * sizeof(FVec3), NULL,
                  GL_DYNAMIC_DRAW);
     {
@@ -272,8 +285,19 @@ static void plt_draw(const Example* e, const Plotter* p, const PlotRenderer* r)
                     .model = mat4_identity(),
                     .color = {curr->color.x, curr->color.y, curr->color.z},
                 };
-                e_apply_per_object_ubo(e, &per_object);
-                glDrawArrays(GL_LINE_STRIP, offset, curr->points_count);
+                RenderCommand cmd = {
+                    .key = r_queue_make_key(&(RenderKeyDesc){
+                        .pass = PlotLayer_Lines,
+                        .program = r->unlit_shader,
+                        .vao = r->lines_vao,
+                    }),
+                    .program = r->unlit_shader,
+                    .vao = r->lines_vao,
+                    .mode = GL_LINE_STRIP,
+                    .first = offset,
+                    .count = curr->points_count,
+                };
+                r_queue_push(&r->queue, &cmd, &per_object);
                 offset += curr->points_count;
             }
             curr = curr->next;
@@ -286,6 +310,12 @@ static void plt_draw(const Example* e, const Plotter* p, const PlotRenderer* r)
             fabsf(p->axes[1].range_max - p->axes[1].range_min),
         };
 
+        uint64_t key = r_queue_make_key(&(RenderKeyDesc){
+            .pass = PlotLayer_Points,
+            .program = r->unlit_shader,
+            .vao = r->point_vb.vao,
+        });
+
         PointsBuffer* curr = p->buffers;
         while (curr != NULL)
         {
@@ -309,13 +339,15 @@ static void plt_draw(const Example* e, const Plotter* p, const PlotRenderer* r)
                         curr->color.y,
                         curr->color.z,
                     };
-                    e_apply_per_object_ubo(e, &per_object);
-                    r_vb_draw(&r->point_vb);
+                    r_queue_push_vb(&r->queue, key, r->unlit_shader,
+                                    &r->point_vb, NULL, 0, &per_object);
                 }
             }
             curr = curr->next;
         }
     }
+
+    r_queue_execute(&r->queue, 0, NULL, NULL);
 }
 
 typedef struct ControlState_
@@ -673,9 +705,11 @@ static void calc_polynomial_newton(const FVec3* input_points,
                                    FVec3* out_points,
                                    int out_points_count)
 {
-    FVec3* temps = (FVec3*)malloc(input_points_count * sizeof(FVec3));
+    FVec3* temps =
+        (FVec3*)mem_alloc(MemTag_Misc, input_points_count * sizeof(FVec3));
     memcpy(temps, input_points, input_points_count * sizeof(FVec3));
-    FVec3* coeffs = (FVec3*)malloc(input_points_count * sizeof(FVec3));
+    FVec3* coeffs =
+        (FVec3*)mem_alloc(MemTag_Misc, input_points_count * sizeof(FVec3));
     coeffs[0] = input_points[0];
     int coeffs_count = 1;
 
@@ -710,8 +744,8 @@ static void calc_polynomial_newton(const FVec3* input_points,
         }
     }
 
-    free(coeffs);
-    free(temps);
+    mem_free(coeffs);
+    mem_free(temps);
 }
 
 void calc_cubic_spline(const FVec3* input_points,
@@ -812,14 +846,16 @@ EXAMPLE_UPDATE_FN_SIG(graph)
 #endif
 
     static int div_count = 10;
-    glClearColor(0.1f, 0.1f, 0.1f, 1);
-    glViewport(0, 0, input->window_size.x, input->window_size.y);
-    glDisable(GL_SCISSOR_TEST);
+    r_state_clear_color(0.1f, 0.1f, 0.1f, 1);
+    r_state_viewport(0, 0, input->window_size.x, input->window_size.y);
+    r_state_set_enabled(GL_SCISSOR_TEST, false);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     {
-        float* coeffs_x = malloc(s->control_points_count * sizeof(float));
-        float* coeffs_y = malloc(s->control_points_count * sizeof(float));
+        float* coeffs_x =
+            mem_alloc(MemTag_Misc, s->control_points_count * sizeof(float));
+        float* coeffs_y =
+            mem_alloc(MemTag_Misc, s->control_points_count * sizeof(float));
         FVec3 values[500] = {0};
         for (int i = 0; i < s->control_points_count; i++)
         {
@@ -829,8 +865,10 @@ EXAMPLE_UPDATE_FN_SIG(graph)
 
         int max_midpoints_count = 10000;
         int results_count = 0;
-        float* results_x = malloc(max_midpoints_count * sizeof(float));
-        float* results_y = malloc(max_midpoints_count * sizeof(float));
+        float* results_x =
+            mem_alloc(MemTag_Misc, max_midpoints_count * sizeof(float));
+        float* results_y =
+            mem_alloc(MemTag_Misc, max_midpoints_count * sizeof(float));
 
         if (method == 0 || method == 1)
         {
@@ -858,8 +896,10 @@ EXAMPLE_UPDATE_FN_SIG(graph)
         }
         else if (method == 2)
         {
-            float* midpoints_x = malloc(max_midpoints_count * sizeof(float));
-            float* midpoints_y = malloc(max_midpoints_count * sizeof(float));
+            float* midpoints_x =
+                mem_alloc(MemTag_Misc, max_midpoints_count * sizeof(float));
+            float* midpoints_y =
+                mem_alloc(MemTag_Misc, max_midpoints_count * sizeof(float));
 
             int midpoints_count = 0;
 
@@ -929,13 +969,14 @@ EXAMPLE_UPDATE_FN_SIG(graph)
                 iteration_count *= 2;
             }
 
-            free(midpoints_x);
-            free(midpoints_y);
+            mem_free(midpoints_x);
+            mem_free(midpoints_y);
         }
 
         int shell_points_count =
             s->control_points_count * (s->control_points_count - 1) / 2;
-        FVec3* shell_points = calloc(shell_points_count, sizeof(FVec3));
+        FVec3* shell_points =
+            mem_calloc(MemTag_Misc, shell_points_count, sizeof(FVec3));
 
         if (method == 0)
         {
@@ -970,8 +1011,8 @@ EXAMPLE_UPDATE_FN_SIG(graph)
             }
         }
 
-        free(coeffs_x);
-        free(coeffs_y);
+        mem_free(coeffs_x);
+        mem_free(coeffs_y);
 
         calc_polynomial_newton(s->control_points, s->control_points_count,
                                values, ARRAY_LENGTH(values));
@@ -1030,7 +1071,8 @@ EXAMPLE_UPDATE_FN_SIG(graph)
 
         if (method == 2)
         {
-            FVec3* results = calloc(results_count, sizeof(FVec3));
+            FVec3* results =
+                mem_calloc(MemTag_Misc, results_count, sizeof(FVec3));
             for (int i = 0; i < results_count; i++)
             {
                 results[i].x = results_x[i];
@@ -1041,11 +1083,11 @@ EXAMPLE_UPDATE_FN_SIG(graph)
                           .color = (FVec4){1, 0, 0, 1},
                           .thickness = s->control_point_radius * 0.3f,
                       });
-            free(results);
+            mem_free(results);
         }
 
-        free(results_x);
-        free(results_y);
+        mem_free(results_x);
+        mem_free(results_y);
 
         plt_points(&plotter, s->control_points, s->control_points_count,
                    &(PlotAttribs){
@@ -1070,14 +1112,14 @@ EXAMPLE_UPDATE_FN_SIG(graph)
                   &(PlotAttribs){
                       .color = (FVec4){1, 1, 1, 1},
                   });
-        free(s_values);
+        mem_free(s_values);
 
         plotter.canvas = canvas;
         plt_draw(e, &plotter, &s->plot_renderer);
 
         plt_cleanup(&plotter);
 
-        free(shell_points);
+        mem_free(shell_points);
     }
 }
 
@@ -1,10 +1,18 @@
 #include "graphics_bv.h"
+#include "graphics_grid.h"
+#include "graphics_octree.h"
+#include "graphics_transform.h"
 #include "../../all.h"
 #include <stdlib.h>
 #include <math.h>
 
-#define MAX_MODELS_COUNT 100
-#define MAX_LIGHT_SOURCES_COUNT 100
+#define MAX_LIGHT_SOURCES_SLIDER 1024
+#define STRESS_MAX_OBJECTS_COUNT 100000
+#define STRESS_MAX_LIGHT_SOURCES_COUNT 100000
+
+// Must match LIGHT_TILE_SIZE and MAX_LIGHTS_PER_TILE in shared.glsl
+#define LIGHT_TILE_SIZE 16
+#define MAX_LIGHTS_PER_TILE 255
 
 typedef struct LightSource_
 {
@@ -12,16 +20,129 @@ typedef struct LightSource_
     FVec3 color;
 } LightSource;
 
+typedef enum GBufferLayout_
+{
+    GBufferLayout_Full = 0, // Position, normal and albedo in half floats
+    GBufferLayout_Compact,  // Position from depth, octahedral normal, RGBA8
+    GBufferLayout_Count,
+} GBufferLayout;
+
+// Shader variant file injected in front of the shaders reading the G-buffer
+static const char* gbuffer_layout_variants[GBufferLayout_Count] = {
+    "gbuffer_full",
+    "gbuffer_compact",
+};
+
+// Bytes written per pixel by the first pass, including depth/stencil
+static const int gbuffer_layout_pixel_sizes[GBufferLayout_Count] = {
+    6 + 6 + 8 + 4,
+    4 + 4 + 4,
+};
+
 typedef struct GBuffer_
 {
     IVec2 dim;
+    GBufferLayout layout;
     uint framebuffer;
-    uint position_texture;
+    uint position_texture; // 0 in the compact layout
     uint normal_texture;
     uint albedo_texture;
-    uint depth_stencil_buffer;
+    uint depth_stencil_texture;
 } GBuffer;
 
+static uint gbuffer_attach_texture(IVec2 dim,
+                                   GLenum attachment,
+                                   GLenum internal_format,
+                                   GLenum format,
+                                   GLenum type)
+{
+    uint texture;
+    glGenTextures(1, &texture);
+    r_state_bind_texture(0, GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, dim.x, dim.y, 0, format,
+                 type, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture,
+                           0);
+    return texture;
+}
+
+static void gbuffer_init(GBuffer* g, IVec2 dim, GBufferLayout layout)
+{
+    *g = (GBuffer){.dim = dim, .layout = layout};
+    glGenFramebuffers(1, &g->framebuffer);
+    r_state_bind_framebuffer(GL_FRAMEBUFFER, g->framebuffer);
+
+    int attachments_count = 0;
+    uint attachments[3];
+    if (layout == GBufferLayout_Full)
+    {
+        attachments[attachments_count++] = GL_COLOR_ATTACHMENT0;
+        g->position_texture = gbuffer_attach_texture(
+            dim, GL_COLOR_ATTACHMENT0, GL_RGB16F, GL_RGB, GL_FLOAT);
+        attachments[attachments_count++] = GL_COLOR_ATTACHMENT1;
+        g->normal_texture = gbuffer_attach_texture(
+            dim, GL_COLOR_ATTACHMENT1, GL_RGB16F, GL_RGB, GL_FLOAT);
+        attachments[attachments_count++] = GL_COLOR_ATTACHMENT2;
+        g->albedo_texture = gbuffer_attach_texture(
+            dim, GL_COLOR_ATTACHMENT2, GL_RGBA16F, GL_RGBA, GL_FLOAT);
+    }
+    else
+    {
+        attachments[attachments_count++] = GL_COLOR_ATTACHMENT0;
+        g->normal_texture = gbuffer_attach_texture(
+            dim, GL_COLOR_ATTACHMENT0, GL_RG16_SNORM, GL_RG, GL_SHORT);
+        attachments[attachments_count++] = GL_COLOR_ATTACHMENT1;
+        g->albedo_texture = gbuffer_attach_texture(
+            dim, GL_COLOR_ATTACHMENT1, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+    }
+    glDrawBuffers(attachments_count, attachments);
+
+    // A texture rather than a renderbuffer so light culling can read depth
+    g->depth_stencil_texture = gbuffer_attach_texture(
+        dim, GL_DEPTH_STENCIL_ATTACHMENT, GL_DEPTH24_STENCIL8,
+        GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8);
+
+    r_state_bind_framebuffer(GL_FRAMEBUFFER, 0);
+}
+
+static void gbuffer_cleanup(GBuffer* g)
+{
+    r_state_delete_framebuffers(1, &g->framebuffer);
+    r_state_delete_textures(1, &g->depth_stencil_texture);
+    r_state_delete_textures(1, &g->albedo_texture);
+    r_state_delete_textures(1, &g->normal_texture);
+    if (g->position_texture)
+        r_state_delete_textures(1, &g->position_texture);
+    *g = (GBuffer){0};
+}
+
+// Texture holding what the lighting shaders read as positions
+static uint gbuffer_position_source(const GBuffer* g)
+{
+    return (g->layout == GBufferLayout_Compact) ? g->depth_stencil_texture
+                                                : g->position_texture;
+}
+
+typedef enum GraphicsPass_
+{
+    GraphicsPass_GBuffer = 0,
+    GraphicsPass_GBufferLate, // Objects found visible by occlusion phase 2
+    GraphicsPass_Lighting,
+    GraphicsPass_LightVolumes,
+    GraphicsPass_DebugSolid,
+    GraphicsPass_DebugWire,
+    GraphicsPass_Count,
+} GraphicsPass;
+
+typedef enum LightingMode_
+{
+    LightingMode_Tiled = 0, // Full-screen pass over per-tile light lists
+    LightingMode_Volumes,   // Additive sphere proxies, one per point light
+    LightingMode_Count,
+} LightingMode;
+
 typedef enum DrawMode_
 {
     DrawMode_FinalScene = 0,
@@ -30,20 +151,34 @@ typedef enum DrawMode_
     DrawMode_AlbedoMap,
 } DrawMode;
 
-typedef struct transform
-{
-    FVec3 pos;
-    FVec3 scale;
-    FVec3 rot;
-} transform_t;
-
 typedef struct scene_object
 {
+    int model; // Index into the per-model arrays of the scene
     Mesh* mesh;
     VertexBuffer* vb;
-    struct transform transform;
+    // Fitted once per model, in mesh space
+    const struct aabb* model_aabb;
+    const struct bsphere* model_bsphere;
+    const struct obb* model_obb;
+    const struct kdop* model_kdop; // 26-DOP
+    // Entry in a store shared by all objects of the scene
+    const struct transform_store* transforms;
+    int transform;
+    // Leaves of the object trees, moved along when the object moves
+    struct node* leaves[bv_type_count];
+    FVec3 origin; // Animation center
 } scene_object_t;
 
+// What the last transform_store_update composed. An entry flagged since then
+// is composed on the spot, children of a moved parent aren't flagged until
+// the update though.
+static Mat4 calc_object_world(const struct scene_object* o)
+{
+    if (o->transforms->dirty[o->transform])
+        return transform_store_calc_world(o->transforms, o->transform);
+    return o->transforms->worlds[o->transform];
+}
+
 static void create_point_cloud(struct scene_object* objects,
                                int objects_count,
                                float** out_points,
@@ -56,19 +191,18 @@ static void create_point_cloud(struct scene_object* objects,
         *out_points_count += o->mesh->vertices_count;
     }
 
-    *out_points = (float*)malloc(*out_points_count * sizeof(float[3]));
+    *out_points =
+        (float*)mem_alloc(MemTag_Misc, *out_points_count * sizeof(float[3]));
 
     float* p = *out_points;
     for (int i = 0; i < objects_count; i++)
     {
         struct scene_object* o = &objects[i];
+        Mat4 world = calc_object_world(o);
         for (int j = 0; j < o->mesh->vertices_count; j++)
         {
-            FVec3 tp = o->mesh->vertices[j].pos;
-            // TODO: Support rotation
-            tp = fvec3_mul(tp, o->transform.scale);
-            tp = fvec3_add(tp, o->transform.pos);
-            float3_copy(p, (float*)&tp);
+            transform_point(&world, (const float*)&o->mesh->vertices[j].pos,
+                            p);
             p += 3;
         }
     }
@@ -90,458 +224,3263 @@ typedef struct node
 
     struct scene_object* scene_object;
 
+    struct node* parent;
     struct node* left;
     struct node* right;
+
+    // Set by flat_bvh_from_tree. The 4-wide slot is -1 for nodes opened into
+    // their children.
+    int flat_index;
+    int flat4_slot;
 } node_t;
 
-static int compare_points(int* axis, const float* a, const float* b)
+static void tree_cleanup(struct node* tree)
 {
-    if (a[*axis] < b[*axis])
-        return -1;
-    else
-        return 1;
+    if (!tree)
+        return;
+    tree_cleanup(tree->left);
+    tree_cleanup(tree->right);
+
+    mem_free(tree);
 }
 
-static int partition_points(float* points, int points_count, int axis)
+#define TOP_DOWN_BINS_COUNT 16
+// Smaller subtrees are built on the thread that partitioned them
+#define TOP_DOWN_PARALLEL_MIN_POINTS 16384
+#define BVH_SAH_TRAVERSAL_COST 1.f
+#define BVH_SAH_INTERSECT_COST 1.f
+
+typedef struct top_down_params
 {
-    qsort_s(points, points_count, sizeof(float[3]), &compare_points, &axis);
+    int leaf_size; // Points per leaf, exceeded only when max_depth is reached
+    int max_depth;
+    enum bsphere_fit sphere_fit;
+} top_down_params_t;
 
-    return points_count / 2;
-}
+typedef struct bvh_stats
+{
+    int nodes_count;
+    int leaves_count;
+    int depth;
+    float sah_cost; // Relative to the root surface area
+    double build_ms;
+} bvh_stats_t;
+
+typedef struct top_down_task
+{
+    struct node** tree;
+    struct node* parent;
+    float* points;
+    int points_count;
+    int depth;
+    enum bv_type type;
+    const struct top_down_params* params;
+    JobCounter* counter;
+} top_down_task_t;
 
-static void tree_cleanup(struct node* tree)
+typedef struct sah_bin
 {
-    if (!tree)
-        return;
-    tree_cleanup(tree->left);
-    tree_cleanup(tree->right);
+    float min_bound[3];
+    float max_bound[3];
+    int count;
+} sah_bin_t;
 
-    free(tree);
+static float bounds_surface_area(const float* min_bound, const float* max_bound)
+{
+    float d[3];
+    for (int i = 0; i < 3; i++)
+        d[i] = max_bound[i] - min_bound[i];
+    float result = 2 * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+    return result;
 }
 
-static void top_down_bv_tree_rec(struct node** tree,
-                                 float* points,
-                                 int points_count,
-                                 struct bvolume* bv,
-                                 int depth,
-                                 enum bv_type type);
-static void top_down_bv_tree(struct node** tree,
-                             float* points,
-                             int points_count,
-                             enum bv_type type)
+static void bounds_grow(float* min_bound, float* max_bound, const float* p)
 {
-    struct bvolume bv;
-    bv.type = type;
-    switch (type)
+    for (int i = 0; i < 3; i++)
     {
-    case bv_type_aabb:
-        bv.aabb = calc_aabb(points, points_count, 0, sizeof(float[3]));
-        break;
-    case bv_type_sphere:
-        bv.sphere = calc_bsphere(points, points_count, 0, sizeof(float[3]));
-        break;
+        if (min_bound[i] > p[i])
+            min_bound[i] = p[i];
+        if (max_bound[i] < p[i])
+            max_bound[i] = p[i];
     }
-    top_down_bv_tree_rec(tree, points, points_count, &bv, 0, type);
 }
 
-static void top_down_bv_tree_rec(struct node** tree,
-                                 float* points,
-                                 int points_count,
-                                 struct bvolume* bv,
-                                 int depth,
-                                 enum bv_type type)
+static int sah_bin_index(float v, float min_v, float scale)
 {
-    if (depth >= 10)
-        return;
-
-    ASSERT(points_count > 0);
-    int min_points_count_per_leaf = 500;
-
-    struct node* node = (struct node*)calloc(sizeof(*node), 1);
-    *tree = node;
-
-    node->bv = *bv;
+    int result = (int)((v - min_v) * scale);
+    if (result >= TOP_DOWN_BINS_COUNT)
+        result = TOP_DOWN_BINS_COUNT - 1;
+    return result;
+}
 
-    if (points_count <= min_points_count_per_leaf)
+// Bins the points along every axis, picks the plane with the lowest
+// SAH cost and partitions the points around it in place. Returns the number
+// of points in front of the plane, 0 when no plane separates them.
+static int sah_partition_points(float* points,
+                                int points_count,
+                                const float* min_bound,
+                                const float* max_bound)
+{
+    struct sah_bin bins[3][TOP_DOWN_BINS_COUNT];
+    float scale[3];
+    for (int axis = 0; axis < 3; axis++)
     {
-        node->type = node_type_leaf;
-        node->points_base = points;
-        node->points_count = points_count;
+        float extent = max_bound[axis] - min_bound[axis];
+        scale[axis] = (extent > 0) ? TOP_DOWN_BINS_COUNT / extent : 0;
+        for (int i = 0; i < TOP_DOWN_BINS_COUNT; i++)
+        {
+            struct sah_bin* b = &bins[axis][i];
+            b->min_bound[0] = b->min_bound[1] = b->min_bound[2] = FLT_MAX;
+            b->max_bound[0] = b->max_bound[1] = b->max_bound[2] = -FLT_MAX;
+            b->count = 0;
+        }
     }
-    else
+
+    for (int i = 0; i < points_count; i++)
     {
-        node->type = node_type_node;
+        float* p = points + i * 3;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            int bi = sah_bin_index(p[axis], min_bound[axis], scale[axis]);
+            struct sah_bin* b = &bins[axis][bi];
+            bounds_grow(b->min_bound, b->max_bound, p);
+            ++b->count;
+        }
+    }
 
-        float min_total_child_volume = FLT_MAX;
-        int min_axis = -1;
-        struct bvolume min_left_bv;
-        struct bvolume min_right_bv;
-        int min_k = -1;
+    float best_cost = FLT_MAX;
+    int best_axis = -1;
+    int best_bin = -1;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (scale[axis] == 0)
+            continue;
+
+        // Right side of the plane in front of bin i covers bins [i, count)
+        float right_areas[TOP_DOWN_BINS_COUNT];
+        int right_counts[TOP_DOWN_BINS_COUNT];
+        struct sah_bin acc = bins[axis][TOP_DOWN_BINS_COUNT - 1];
+        for (int i = TOP_DOWN_BINS_COUNT - 1; i > 0; i--)
+        {
+            if (i < TOP_DOWN_BINS_COUNT - 1)
+            {
+                struct sah_bin* b = &bins[axis][i];
+                if (b->count > 0)
+                {
+                    bounds_grow(acc.min_bound, acc.max_bound, b->min_bound);
+                    bounds_grow(acc.min_bound, acc.max_bound, b->max_bound);
+                    acc.count += b->count;
+                }
+            }
+            right_counts[i] = acc.count;
+            right_areas[i] = (acc.count > 0)
+                                 ? bounds_surface_area(acc.min_bound,
+                                                       acc.max_bound)
+                                 : 0;
+        }
 
-        for (int i = 0; i < 3; i++)
+        acc = bins[axis][0];
+        for (int i = 1; i < TOP_DOWN_BINS_COUNT; i++)
         {
-            int k = partition_points(points, points_count, i);
-            struct bvolume left_bv;
-            struct bvolume right_bv;
-            left_bv.type = right_bv.type = type;
-            float left_volume = 0;
-            float right_volume = 0;
-            switch (type)
+            if (acc.count > 0 && right_counts[i] > 0)
             {
-            case bv_type_aabb:
-                left_bv.aabb = calc_aabb(points, k, 0, sizeof(float[3]));
-                left_volume = aabb_volume(&left_bv.aabb);
-                right_bv.aabb = calc_aabb(points + k * 3, points_count - k, 0,
-                                          sizeof(float[3]));
-                right_volume = aabb_volume(&right_bv.aabb);
-                break;
-            case bv_type_sphere:
-                left_bv.sphere = calc_bsphere(points, k, 0, sizeof(float[3]));
-                left_volume = bsphere_volume(&left_bv.sphere);
-                right_bv.sphere = calc_bsphere(points + k * 3, points_count - k,
-                                               0, sizeof(float[3]));
-                right_volume = bsphere_volume(&right_bv.sphere);
-                break;
+                float cost =
+                    bounds_surface_area(acc.min_bound, acc.max_bound) *
+                        acc.count +
+                    right_areas[i] * right_counts[i];
+                if (best_cost > cost)
+                {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_bin = i;
+                }
             }
-            float total_volume = left_volume + right_volume;
 
-            if (min_total_child_volume > total_volume)
+            struct sah_bin* b = &bins[axis][i];
+            if (b->count > 0)
             {
-                min_total_child_volume = total_volume;
-                min_axis = i;
-                min_left_bv = left_bv;
-                min_right_bv = right_bv;
-                min_k = k;
+                bounds_grow(acc.min_bound, acc.max_bound, b->min_bound);
+                bounds_grow(acc.min_bound, acc.max_bound, b->max_bound);
+                acc.count += b->count;
             }
         }
-
-        ASSERT(min_k >= 0);
-
-        qsort_s(points, points_count, sizeof(float[3]), &compare_points,
-                &min_axis);
-
-        top_down_bv_tree_rec(&node->left, points, min_k, &min_left_bv,
-                             depth + 1, type);
-        top_down_bv_tree_rec(&node->right, points + min_k * 3,
-                             points_count - min_k, &min_right_bv, depth + 1,
-                             type);
     }
-}
 
-static void find_nodes_to_merge(struct node** nodes,
-                                int nodes_count,
-                                int* out_a,
-                                int* out_b)
-{
-    float min_d_sq = FLT_MAX;
-    for (int i = 0; i < nodes_count; i++)
-    {
-        struct node* n0 = nodes[i];
-        float c0[3];
+    if (best_axis < 0)
+        return 0;
 
-        switch (n0->bv.type)
+    int i = 0;
+    int j = points_count - 1;
+    while (i <= j)
+    {
+        float* p = points + i * 3;
+        int bi = sah_bin_index(p[best_axis], min_bound[best_axis],
+                               scale[best_axis]);
+        if (bi < best_bin)
         {
-        case bv_type_aabb: float3_copy(c0, n0->bv.aabb.c); break;
-        case bv_type_sphere: float3_copy(c0, n0->bv.sphere.c); break;
+            ++i;
         }
-
-        for (int j = 0; j < nodes_count; j++)
+        else
         {
-            if (i == j)
-                continue;
+            float temp[3];
+            float3_copy(temp, p);
+            float3_copy(p, points + j * 3);
+            float3_copy(points + j * 3, temp);
+            --j;
+        }
+    }
 
-            struct node* n1 = nodes[j];
-            float c1[3];
+    return i;
+}
 
-            switch (n1->bv.type)
-            {
-            case bv_type_aabb: float3_copy(c1, n1->bv.aabb.c); break;
-            case bv_type_sphere: float3_copy(c1, n1->bv.sphere.c); break;
-            }
+static void top_down_bv_tree_rec(const struct top_down_task* task);
 
-            float dv[3];
-            float3_sub_r(dv, c0, c1);
-            float d_sq = float3_length_sq(dv);
-            if (min_d_sq > d_sq)
-            {
-                *out_a = i;
-                *out_b = j;
-                min_d_sq = d_sq;
-            }
-        }
-    }
+static JOB_FN_SIG(top_down_bv_tree_job)
+{
+    struct top_down_task* task = (struct top_down_task*)udata;
+    top_down_bv_tree_rec(task);
+    mem_free(task);
 }
-static void collect_scene_objects_rec(struct node* tree,
-                                      int* count,
-                                      struct scene_object* out_scene_objects)
+
+static void top_down_bv_tree_spawn(const struct top_down_task* task)
 {
-    if (tree->type == node_type_leaf)
+    if (task->points_count >= TOP_DOWN_PARALLEL_MIN_POINTS &&
+        j_get_workers_count() > 0)
     {
-        out_scene_objects[(*count)++] = *tree->scene_object;
+        struct top_down_task* job_task =
+            (struct top_down_task*)mem_alloc(MemTag_Bvh, sizeof(*job_task));
+        *job_task = *task;
+        j_run(&top_down_bv_tree_job, job_task, task->counter);
     }
     else
     {
-        collect_scene_objects_rec(tree->left, count, out_scene_objects);
-        collect_scene_objects_rec(tree->right, count, out_scene_objects);
+        top_down_bv_tree_rec(task);
     }
 }
 
-static void collect_scene_objects(struct node* tree,
-                                  struct scene_object* out_scene_objects,
-                                  int* out_count)
+static void top_down_bv_tree_rec(const struct top_down_task* task)
 {
-    *out_count = 0;
-    collect_scene_objects_rec(tree, out_count, out_scene_objects);
-}
+    float* points = task->points;
+    int points_count = task->points_count;
+    ASSERT(points_count > 0);
 
-static struct node* bottom_up_bv_tree(struct scene_object* objects,
-                                      int objects_count,
-                                      enum bv_type type)
-{
-    ASSERT(objects_count > 0);
+    float min_bound[3];
+    float max_bound[3];
+    calc_bounds(points, points_count, 0, sizeof(float[3]), min_bound,
+                max_bound);
 
-    struct node** nodes =
-        (struct node**)calloc(objects_count * sizeof(*nodes), 1);
-    for (int i = 0; i < objects_count; i++)
+    struct node* node = (struct node*)mem_calloc(MemTag_Bvh, 1, sizeof(*node));
+    *task->tree = node;
+
+    node->parent = task->parent;
+    if (task->type == bv_type_aabb ||
+        (task->type == bv_type_sphere &&
+         task->params->sphere_fit == bsphere_fit_box))
     {
-        struct scene_object* o = &objects[i];
-        struct node* l = nodes[i] = (struct node*)calloc(sizeof(*l), 1);
-        l->type = node_type_leaf;
-        l->scene_object = o;
-        l->bv.type = type;
-        float* points;
-        int points_count;
-        create_point_cloud(o, 1, &points, &points_count);
-        switch (type)
-        {
-        case bv_type_aabb:
-            l->bv.aabb = calc_aabb(points, points_count, 0, sizeof(float[3]));
-            break;
-        case bv_type_sphere:
-            l->bv.sphere =
-                calc_bsphere(points, points_count, 0, sizeof(float[3]));
-            break;
-        }
-        free(points);
+        node->bv = bvolume_from_bounds(task->type, min_bound, max_bound);
+    }
+    else
+    {
+        node->bv =
+            bvolume_from_points(task->type, task->params->sphere_fit, points,
+                                points_count, 0, sizeof(float[3]));
     }
 
-    struct scene_object* subtree_objects =
-        malloc(objects_count * sizeof(*subtree_objects));
-    int subtree_objects_count = 0;
-
-    while (objects_count > 1)
+    int k = 0;
+    if (points_count > task->params->leaf_size &&
+        task->depth < task->params->max_depth)
     {
-        int a, b;
-        find_nodes_to_merge(nodes, objects_count, &a, &b);
-        struct node* pair = calloc(sizeof(*pair), 1);
-        pair->type = node_type_node;
-        pair->left = nodes[a];
-        pair->right = nodes[b];
+        k = sah_partition_points(points, points_count, min_bound, max_bound);
+    }
 
-        collect_scene_objects(pair, subtree_objects, &subtree_objects_count);
+    if (k == 0)
+    {
+        node->type = node_type_leaf;
+        node->points_base = points;
+        node->points_count = points_count;
+        return;
+    }
 
-        float* points;
-        int points_count;
-        create_point_cloud(subtree_objects, subtree_objects_count, &points,
-                           &points_count);
+    node->type = node_type_node;
 
-        pair->bv.type = type;
-        switch (type)
-        {
-        case bv_type_aabb:
-            pair->bv.aabb =
-                calc_aabb(points, points_count, 0, sizeof(float[3]));
-            break;
-        case bv_type_sphere:
-            pair->bv.sphere =
-                calc_bsphere(points, points_count, 0, sizeof(float[3]));
-            break;
-        }
+    struct top_down_task left = *task;
+    left.tree = &node->left;
+    left.parent = node;
+    left.points_count = k;
+    left.depth = task->depth + 1;
 
-        free(points);
+    struct top_down_task right = left;
+    right.tree = &node->right;
+    right.points = points + k * 3;
+    right.points_count = points_count - k;
 
-        if (a > b)
-        {
-            int temp = a;
-            a = b;
-            b = temp;
-        }
+    top_down_bv_tree_spawn(&right);
+    top_down_bv_tree_rec(&left);
+}
 
-        nodes[a] = pair;
-        nodes[b] = nodes[objects_count - 1];
+static void calc_bvh_stats_rec(struct node* tree,
+                               int depth,
+                               float root_area,
+                               struct bvh_stats* stats)
+{
+    ++stats->nodes_count;
+    stats->depth = HIMATH_MAX(stats->depth, depth);
 
-        --objects_count;
+    float area = bvolume_surface_area(&tree->bv) / root_area;
+    if (tree->type == node_type_leaf)
+    {
+        ++stats->leaves_count;
+        int primitives_count = tree->scene_object ? 1 : tree->points_count;
+        stats->sah_cost += area * primitives_count * BVH_SAH_INTERSECT_COST;
+    }
+    else
+    {
+        stats->sah_cost += area * BVH_SAH_TRAVERSAL_COST;
+        calc_bvh_stats_rec(tree->left, depth + 1, root_area, stats);
+        calc_bvh_stats_rec(tree->right, depth + 1, root_area, stats);
     }
-
-    struct node* root = nodes[0];
-
-    free(subtree_objects);
-    free(nodes);
-
-    return root;
 }
 
-static void draw_bvh_rec(Example* e,
-                         struct node* tree,
-                         uint shader,
-                         VertexBuffer* vb,
-                         int depth,
-                         int highlight_depth)
+static void calc_bvh_stats(struct node* tree, struct bvh_stats* stats)
 {
+    double build_ms = stats->build_ms;
+    *stats = (struct bvh_stats){.build_ms = build_ms};
     if (!tree)
         return;
 
-    FVec3 color = {0.5f, 0.5f, 1};
-
-    if (depth == highlight_depth)
-    {
-        struct bvolume* bv = &tree->bv;
-
-        glDisable(GL_CULL_FACE);
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-        glUseProgram(shader);
-        Mat4 trans_mat;
-        Mat4 scale_mat;
-        switch (bv->type)
-        {
-        case bv_type_aabb: {
-            struct aabb* aabb = &bv->aabb;
-            FVec3 c = {aabb->c[0], aabb->c[1], aabb->c[2]};
-            trans_mat = mat4_translation(c);
-            scale_mat = mat4_scalev(
-                (FVec3){aabb->r[0] * 2, aabb->r[1] * 2, aabb->r[2] * 2});
-            break;
-        }
-        case bv_type_sphere: {
-            struct bsphere* bsphere = &bv->sphere;
-            FVec3 c = {bsphere->c[0], bsphere->c[1], bsphere->c[2]};
-            trans_mat = mat4_translation(c);
-            scale_mat = mat4_scale(bsphere->r * 2);
+    float root_area = bvolume_surface_area(&tree->bv);
+    if (root_area <= 0)
+        root_area = 1;
+    calc_bvh_stats_rec(tree, 0, root_area, stats);
+}
 
-            break;
-        }
-        }
+// Binned SAH builder over the point cloud. Points are reordered in place so
+// each leaf references a contiguous range. Splits depend on the points only,
+// so building a second tree of another bv type over the same array keeps the
+// ranges of the first one valid.
+static void top_down_bv_tree(struct node** tree,
+                             float* points,
+                             int points_count,
+                             enum bv_type type,
+                             const struct top_down_params* params,
+                             struct bvh_stats* stats)
+{
+    double start_ms = a_get_time_ms();
 
-        Mat4 model_mat = mat4_mul(&trans_mat, &scale_mat);
-        ExamplePerObjectUBO per_object = {.model = model_mat, .color = color};
-        e_apply_per_object_ubo(e, &per_object);
-        r_vb_draw(vb);
+    *tree = NULL;
+    JobCounter counter = {0};
+    if (points_count > 0)
+    {
+        struct top_down_task root = {
+            .tree = tree,
+            .points = points,
+            .points_count = points_count,
+            .type = type,
+            .params = params,
+            .counter = &counter,
+        };
+        top_down_bv_tree_rec(&root);
+        j_wait(&counter);
     }
 
-    draw_bvh_rec(e, tree->left, shader, vb, depth + 1, highlight_depth);
-    draw_bvh_rec(e, tree->right, shader, vb, depth + 1, highlight_depth);
+    stats->build_ms = a_get_time_ms() - start_ms;
+    calc_bvh_stats(*tree, stats);
 }
 
-static void draw_bvh(Example* e,
-                     struct node* tree,
-                     uint shader,
-                     VertexBuffer* vb,
-                     int highlight_depth)
+static uint32_t morton_expand_bits(uint32_t v)
 {
-    draw_bvh_rec(e, tree, shader, vb, 0, highlight_depth);
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
 }
 
-typedef struct GraphicsScene_
+// 30-bit code of a point normalized to [0, 1]
+static uint32_t morton_code(const float* p)
 {
-    Path model_file_paths[MAX_MODELS_COUNT];
-    Mesh model_meshes[MAX_MODELS_COUNT];
-    VertexBuffer model_vbs[MAX_MODELS_COUNT];
-    int models_count;
-
-    uint model_shader;
-    uint normal_debug_shader;
-
-    struct scene_object scene_objects[100];
-    int scene_objects_count;
-
-    Mesh aabb_mesh;
-    VertexBuffer aabb_vb;
-    Mesh bsphere_mesh;
-    VertexBuffer bsphere_vb;
-
-    float* scene_points;
-    int scene_points_count;
-    struct node* bvh_aabb;
-    struct node* bvh_sphere;
-    int bvh_highlight_depth;
-    int bvh_type;
-    enum bv_type visible_bv_type;
-
-    Mesh light_source_mesh;
-    VertexBuffer light_source_vb;
-    LightSource light_sources[MAX_LIGHT_SOURCES_COUNT];
-    int light_sources_count;
-    uint light_source_shader;
-    float light_intensity;
-
-    FVec3 orbit_pos;
-    float orbit_speed_deg;
-    float orbit_radius;
-
-    ExampleFpsCamera cam;
+    uint32_t result = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        float v = HIMATH_CLAMP(p[i] * 1024.f, 0.f, 1023.f);
+        result |= morton_expand_bits((uint32_t)v) << (2 - i);
+    }
+    return result;
+}
 
-    float t;
+static uint64_t morton_expand_bits21(uint64_t v)
+{
+    v &= 0x1FFFFF;
+    v = (v | v << 32) & 0x001F00000000FFFFull;
+    v = (v | v << 16) & 0x001F0000FF0000FFull;
+    v = (v | v << 8) & 0x100F00F00F00F00Full;
+    v = (v | v << 4) & 0x10C30C30C30C30C3ull;
+    v = (v | v << 2) & 0x1249249249249249ull;
+    return v;
+}
 
-    Mesh fsq_mesh;
-    VertexBuffer fsq_vb;
-    uint fsq_shader;
-    uint fsq_target_texture;
+// 63-bit code of a point normalized to [0, 1]
+static uint64_t morton_code63(const float* p)
+{
+    uint64_t result = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        float v = HIMATH_CLAMP(p[i] * 2097152.f, 0.f, 2097151.f);
+        result |= morton_expand_bits21((uint64_t)v) << (2 - i);
+    }
+    return result;
+}
 
-    GBuffer gbuffer;
-    uint deferred_first_pass_shader;
-    uint deferred_second_pass_shader;
+// Linear BVH (Karras 2012): points are sorted along a Morton curve and the
+// hierarchy falls out of the common prefixes of neighbouring codes, so every
+// stage runs in parallel without the partitioning of the top-down builder
+#define LBVH_BATCH_SIZE 4096
+#define LBVH_LEAVES_BATCH_SIZE 16
+#define LBVH_RADIX_BITS 8
+#define LBVH_RADIX_BUCKETS_COUNT (1 << LBVH_RADIX_BITS)
+// Treelet optimization (Karras and Aila 2013) restructures up to this many
+// subtrees below every node for the lowest SAH cost
+#define LBVH_TREELET_LEAVES_COUNT 7
+#define LBVH_MAX_TREELET_PASSES 3
+
+typedef struct lbvh_params
+{
+    bool wide_codes; // 63-bit codes instead of 30-bit
+    int treelet_passes;
+} lbvh_params_t;
 
-    DrawMode draw_mode;
+// Karras node over the sorted points [first, last], children at split and
+// split + 1 are leaves when their range holds a single point
+typedef struct lbvh_karras_node
+{
+    int first;
+    int last;
+    int split;
+} lbvh_karras_node_t;
 
-    bool copy_depth;
-    IVec2 orbits_count;
-} GraphicsScene;
+// Internal nodes of the collapsed tree come first, the leaves after them
+typedef struct lbvh_node
+{
+    struct bvolume bv;
+    int left; // -1 for leaves
+    int right;
+    int parent;
+    int first;
+    int count;
+    volatile long visits;
+} lbvh_node_t;
+
+typedef struct lbvh_build
+{
+    float* points;
+    float* points_temp;
+    int points_count;
+    enum bv_type type;
+    const struct top_down_params* params;
+    const struct lbvh_params* lbvh_params;
+
+    float min_bound[3];
+    float inv_extent[3];
+
+    uint64_t* codes;
+    uint64_t* codes_temp;
+    int* indices;
+    int* indices_temp;
+    int chunks_count;
+    int chunk_size;
+    int (*histograms)[LBVH_RADIX_BUCKETS_COUNT];
+    int shift;
+
+    struct lbvh_karras_node* karras_nodes;
+    int* compact_ids; // Of the kept Karras nodes, -1 for collapsed ones
+    int* chunk_counts; // Kept nodes and leaves per chunk, then their offsets
+
+    struct lbvh_node* nodes;
+    int internal_count;
+    int leaves_count;
+} lbvh_build_t;
+
+// Common prefix length of the codes at i and j, with the indices breaking
+// ties between duplicate codes. -1 outside of the points.
+static int lbvh_delta(const struct lbvh_build* b, int i, int j)
+{
+    if (j < 0 || j >= b->points_count)
+        return -1;
+    uint64_t x = b->codes[i] ^ b->codes[j];
+    if (x == 0)
+        return 32 + count_leading_zeros64((uint32_t)(i ^ j));
+    return count_leading_zeros64(x);
+}
 
-static void reconstruct_bvh(GraphicsScene* s)
+static JOB_FOR_FN_SIG(lbvh_codes_job)
 {
-    free(s->scene_points);
-    tree_cleanup(s->bvh_aabb);
-    tree_cleanup(s->bvh_sphere);
-    create_point_cloud(s->scene_objects, s->scene_objects_count,
-                       &s->scene_points, &s->scene_points_count);
-    if (s->bvh_type == 0)
+    struct lbvh_build* b = (struct lbvh_build*)udata;
+    for (int i = begin; i < end; i++)
     {
-        s->bvh_aabb = bottom_up_bv_tree(s->scene_objects,
-                                        s->scene_objects_count, bv_type_aabb);
-        s->bvh_sphere = bottom_up_bv_tree(
-            s->scene_objects, s->scene_objects_count, bv_type_sphere);
+        const float* p = b->points + i * 3;
+        float n[3];
+        for (int j = 0; j < 3; j++)
+            n[j] = (p[j] - b->min_bound[j]) * b->inv_extent[j];
+        b->codes[i] = b->lbvh_params->wide_codes ? morton_code63(n)
+                                                  : morton_code(n);
+        b->indices[i] = i;
     }
-    else
+}
+
+static JOB_FOR_FN_SIG(lbvh_histogram_job)
+{
+    struct lbvh_build* b = (struct lbvh_build*)udata;
+    for (int c = begin; c < end; c++)
     {
-        top_down_bv_tree(&s->bvh_aabb, s->scene_points, s->scene_points_count,
-                         bv_type_aabb);
-        top_down_bv_tree(&s->bvh_sphere, s->scene_points, s->scene_points_count,
-                         bv_type_sphere);
+        int* histogram = b->histograms[c];
+        memset(histogram, 0, sizeof(b->histograms[c]));
+        int first = c * b->chunk_size;
+        int last = HIMATH_MIN(first + b->chunk_size, b->points_count);
+        for (int i = first; i < last; i++)
+            ++histogram[(b->codes[i] >> b->shift) &
+                        (LBVH_RADIX_BUCKETS_COUNT - 1)];
     }
 }
 
-static void add_random_scene_object(GraphicsScene* s)
+static JOB_FOR_FN_SIG(lbvh_scatter_job)
 {
-    struct scene_object* o = &s->scene_objects[s->scene_objects_count++];
-    int model_index = rand() % s->models_count;
-    o->mesh = &s->model_meshes[model_index];
-    o->vb = &s->model_vbs[model_index];
-    o->transform.scale = (FVec3){1, 1, 1};
-    o->transform.pos.x = (rand() % 25 - 12) * 0.1f;
-    o->transform.pos.y = (rand() % 25 - 12) * 0.1f;
-    o->transform.pos.z = (rand() % 25 - 12) * 0.1f;
-
-    reconstruct_bvh(s);
+    struct lbvh_build* b = (struct lbvh_build*)udata;
+    for (int c = begin; c < end; c++)
+    {
+        int* offsets = b->histograms[c];
+        int first = c * b->chunk_size;
+        int last = HIMATH_MIN(first + b->chunk_size, b->points_count);
+        for (int i = first; i < last; i++)
+        {
+            uint64_t code = b->codes[i];
+            int dst =
+                offsets[(code >> b->shift) & (LBVH_RADIX_BUCKETS_COUNT - 1)]++;
+            b->codes_temp[dst] = code;
+            b->indices_temp[dst] = b->indices[i];
+        }
+    }
 }
 
-static FILE_FOREACH_FN_DECL(push_model)
+// LSD radix sort like the render queue's, with every pass split into chunks
+// that count and scatter in parallel. Each chunk scatters to the offsets left
+// by the chunks before it, which keeps the sort stable.
+static void lbvh_sort_codes(struct lbvh_build* b, int key_bits)
 {
-    GraphicsScene* s = (GraphicsScene*)udata;
-    ASSERT(s->models_count < MAX_MODELS_COUNT);
-    s->model_file_paths[s->models_count] = fs_path_copy(*file_path);
-    Mesh* mesh = &s->model_meshes[s->models_count];
-    rc_mesh_load_from_obj(mesh,
-                          s->model_file_paths[s->models_count].abs_path_str);
+    for (b->shift = 0; b->shift < key_bits; b->shift += LBVH_RADIX_BITS)
+    {
+        j_parallel_for(b->chunks_count, 1, &lbvh_histogram_job, b);
+
+        int totals[LBVH_RADIX_BUCKETS_COUNT] = {0};
+        for (int c = 0; c < b->chunks_count; c++)
+        {
+            for (int i = 0; i < LBVH_RADIX_BUCKETS_COUNT; i++)
+                totals[i] += b->histograms[c][i];
+        }
+        int first_digit = (int)(b->codes[0] >> b->shift) &
+                          (LBVH_RADIX_BUCKETS_COUNT - 1);
+        if (totals[first_digit] == b->points_count)
+            continue;
+
+        int offset = 0;
+        for (int i = 0; i < LBVH_RADIX_BUCKETS_COUNT; i++)
+        {
+            for (int c = 0; c < b->chunks_count; c++)
+            {
+                int count = b->histograms[c][i];
+                b->histograms[c][i] = offset;
+                offset += count;
+            }
+        }
+
+        j_parallel_for(b->chunks_count, 1, &lbvh_scatter_job, b);
+
+        uint64_t* codes = b->codes;
+        b->codes = b->codes_temp;
+        b->codes_temp = codes;
+        int* indices = b->indices;
+        b->indices = b->indices_temp;
+        b->indices_temp = indices;
+    }
+}
+
+static JOB_FOR_FN_SIG(lbvh_gather_points_job)
+{
+    struct lbvh_build* b = (struct lbvh_build*)udata;
+    for (int i = begin; i < end; i++)
+        float3_copy(b->points_temp + i * 3, b->points + b->indices[i] * 3);
+}
+
+static JOB_FOR_FN_SIG(lbvh_karras_job)
+{
+    struct lbvh_build* b = (struct lbvh_build*)udata;
+    for (int i = begin; i < end; i++)
+    {
+        // Direction of the range from the neighbour sharing more bits
+        int d = (lbvh_delta(b, i, i + 1) - lbvh_delta(b, i, i - 1)) >= 0 ? 1
+                                                                          : -1;
+        int delta_min = lbvh_delta(b, i, i - d);
+        int l_max = 2;
+        while (lbvh_delta(b, i, i + l_max * d) > delta_min)
+            l_max *= 2;
+        int l = 0;
+        for (int t = l_max / 2; t >= 1; t /= 2)
+        {
+            if (lbvh_delta(b, i, i + (l + t) * d) > delta_min)
+                l += t;
+        }
+        int j = i + l * d;
+
+        // Binary search for the last point sharing the node's prefix
+        int delta_node = lbvh_delta(b, i, j);
+        int s = 0;
+        for (int div = 2;; div *= 2)
+        {
+            int t = (l + div - 1) / div;
+            if (lbvh_delta(b, i, i + (s + t) * d) > delta_node)
+                s += t;
+            if (t <= 1)
+                break;
+        }
+
+        struct lbvh_karras_node* node = &b->karras_nodes[i];
+        node->first = HIMATH_MIN(i, j);
+        node->last = HIMATH_MAX(i, j);
+        node->split = i + s * d + HIMATH_MIN(d, 0);
+    }
+}
+
+static bool lbvh_karras_kept(const struct lbvh_build* b, int first, int last)
+{
+    return last - first + 1 > b->params->leaf_size;
+}
+
+// Karras nodes with more points than a leaf holds are kept, and each of
+// their children that isn't becomes a leaf
+static JOB_FOR_FN_SIG(lbvh_count_job)
+{
+    struct lbvh_build* b = (struct lbvh_build*)udata;
+    for (int c = begin; c < end; c++)
+    {
+        int first = c * b->chunk_size;
+        int last = HIMATH_MIN(first + b->chunk_size, b->points_count - 1);
+        int kept_count = 0;
+        int leaves_count = 0;
+        for (int i = first; i < last; i++)
+        {
+            const struct lbvh_karras_node* node = &b->karras_nodes[i];
+            if (!lbvh_karras_kept(b, node->first, node->last))
+                continue;
+            ++kept_count;
+            leaves_count += !lbvh_karras_kept(b, node->first, node->split);
+            leaves_count += !lbvh_karras_kept(b, node->split + 1, node->last);
+        }
+        b->chunk_counts[c * 2] = kept_count;
+        b->chunk_counts[c * 2 + 1] = leaves_count;
+    }
+}
+
+static JOB_FOR_FN_SIG(lbvh_assign_ids_job)
+{
+    struct lbvh_build* b = (struct lbvh_build*)udata;
+    for (int c = begin; c < end; c++)
+    {
+        int first = c * b->chunk_size;
+        int last = HIMATH_MIN(first + b->chunk_size, b->points_count - 1);
+        int id = b->chunk_counts[c * 2];
+        for (int i = first; i < last; i++)
+        {
+            const struct lbvh_karras_node* node = &b->karras_nodes[i];
+            b->compact_ids[i] =
+                lbvh_karras_kept(b, node->first, node->last) ? id++ : -1;
+        }
+    }
+}
+
+static int lbvh_link_child(struct lbvh_build* b,
+                           int parent,
+                           int karras_index,
+                           int first,
+                           int last,
+                           int* leaf_id)
+{
+    int id = 0;
+    if (lbvh_karras_kept(b, first, last))
+    {
+        id = b->compact_ids[karras_index];
+    }
+    else
+    {
+        id = (*leaf_id)++;
+        struct lbvh_node* leaf = &b->nodes[id];
+        leaf->left = leaf->right = -1;
+        leaf->first = first;
+        leaf->count = last - first + 1;
+    }
+    b->nodes[id].parent = parent;
+    return id;
+}
+
+static JOB_FOR_FN_SIG(lbvh_link_job)
+{
+    struct lbvh_build* b = (struct lbvh_build*)udata;
+    for (int c = begin; c < end; c++)
+    {
+        int first = c * b->chunk_size;
+        int last = HIMATH_MIN(first + b->chunk_size, b->points_count - 1);
+        int leaf_id = b->internal_count + b->chunk_counts[c * 2 + 1];
+        for (int i = first; i < last; i++)
+        {
+            int id = b->compact_ids[i];
+            if (id < 0)
+                continue;
+            const struct lbvh_karras_node* k = &b->karras_nodes[i];
+            struct lbvh_node* node = &b->nodes[id];
+            node->first = k->first;
+            node->count = k->last - k->first + 1;
+            node->left = lbvh_link_child(b, id, k->split, k->first, k->split,
+                                         &leaf_id);
+            node->right = lbvh_link_child(b, id, k->split + 1, k->split + 1,
+                                          k->last, &leaf_id);
+        }
+    }
+}
+
+static float lbvh_node_area(const struct lbvh_build* b, int index)
+{
+    return bvolume_surface_area(&b->nodes[index].bv);
+}
+
+static int lbvh_treelet_emit(struct lbvh_build* b,
+                             const int* leaves,
+                             const int* internals,
+                             int* next_internal,
+                             const int* best,
+                             const struct bvolume* bvs,
+                             int subset,
+                             int parent)
+{
+    int index = 0;
+    if ((subset & (subset - 1)) == 0)
+    {
+        int bit = 0;
+        while ((subset >> bit) != 1)
+            ++bit;
+        index = leaves[bit];
+    }
+    else
+    {
+        index = internals[(*next_internal)++];
+        struct lbvh_node* node = &b->nodes[index];
+        node->bv = bvs[subset];
+        node->left = lbvh_treelet_emit(b, leaves, internals, next_internal,
+                                       best, bvs, best[subset], index);
+        node->right =
+            lbvh_treelet_emit(b, leaves, internals, next_internal, best, bvs,
+                              subset ^ best[subset], index);
+    }
+    b->nodes[index].parent = parent;
+    return index;
+}
+
+// Grows a treelet below the node by opening its largest subtrees, then
+// finds the topology over those subtrees with the smallest summed surface
+// area of the internal nodes by dynamic programming over all subsets
+static void lbvh_optimize_treelet(struct lbvh_build* b, int root)
+{
+    int leaves[LBVH_TREELET_LEAVES_COUNT];
+    int internals[LBVH_TREELET_LEAVES_COUNT - 1];
+    int leaves_count = 2;
+    int internals_count = 1;
+    leaves[0] = b->nodes[root].left;
+    leaves[1] = b->nodes[root].right;
+    internals[0] = root;
+    float old_cost = lbvh_node_area(b, root);
+    while (leaves_count < LBVH_TREELET_LEAVES_COUNT)
+    {
+        int largest = -1;
+        float largest_area = -1;
+        for (int i = 0; i < leaves_count; i++)
+        {
+            if (b->nodes[leaves[i]].left < 0)
+                continue;
+            float area = lbvh_node_area(b, leaves[i]);
+            if (largest_area < area)
+            {
+                largest_area = area;
+                largest = i;
+            }
+        }
+        if (largest < 0)
+            break;
+
+        int opened = leaves[largest];
+        internals[internals_count++] = opened;
+        old_cost += largest_area;
+        leaves[largest] = b->nodes[opened].left;
+        leaves[leaves_count++] = b->nodes[opened].right;
+    }
+    if (leaves_count < 3)
+        return;
+
+    struct bvolume bvs[1 << LBVH_TREELET_LEAVES_COUNT];
+    float costs[1 << LBVH_TREELET_LEAVES_COUNT];
+    int best[1 << LBVH_TREELET_LEAVES_COUNT];
+    int full = (1 << leaves_count) - 1;
+    for (int subset = 1; subset <= full; subset++)
+    {
+        int low = subset & -subset;
+        if (subset == low)
+        {
+            int bit = 0;
+            while ((low >> bit) != 1)
+                ++bit;
+            bvs[subset] = b->nodes[leaves[bit]].bv;
+            costs[subset] = 0;
+            continue;
+        }
+
+        bvs[subset] = merge_bvolumes(&bvs[subset ^ low], &bvs[low]);
+        // Partitions with the lowest leaf on the left, each visited once
+        costs[subset] = FLT_MAX;
+        for (int part = (subset - 1) & subset; part > 0;
+             part = (part - 1) & subset)
+        {
+            if (!(part & low))
+                continue;
+            float cost = costs[part] + costs[subset ^ part];
+            if (costs[subset] > cost)
+            {
+                costs[subset] = cost;
+                best[subset] = part;
+            }
+        }
+        costs[subset] += bvolume_surface_area(&bvs[subset]);
+    }
+
+    if (costs[full] < old_cost * 0.999f)
+    {
+        int next_internal = 0;
+        lbvh_treelet_emit(b, leaves, internals, &next_internal, best, bvs,
+                          full, b->nodes[root].parent);
+    }
+}
+
+// Each leaf walks towards the root and the second job to reach a node
+// handles it, so a node is only visited once both subtrees are done
+static void lbvh_walk_up(struct lbvh_build* b, int index, bool optimize)
+{
+    int parent = b->nodes[index].parent;
+    while (parent >= 0)
+    {
+        struct lbvh_node* node = &b->nodes[parent];
+        if (j_atomic_increment(&node->visits) == 1)
+            return;
+
+        // Refit after the treelet as well, its subtrees may have changed
+        if (optimize)
+            lbvh_optimize_treelet(b, parent);
+        node->bv = merge_bvolumes(&b->nodes[node->left].bv,
+                                  &b->nodes[node->right].bv);
+        parent = node->parent;
+    }
+}
+
+static JOB_FOR_FN_SIG(lbvh_fit_leaves_job)
+{
+    struct lbvh_build* b = (struct lbvh_build*)udata;
+    for (int i = begin; i < end; i++)
+    {
+        struct lbvh_node* leaf = &b->nodes[b->internal_count + i];
+        float* points = b->points + leaf->first * 3;
+        if (b->type == bv_type_aabb ||
+            (b->type == bv_type_sphere &&
+             b->params->sphere_fit == bsphere_fit_box))
+        {
+            float min_bound[3];
+            float max_bound[3];
+            calc_bounds(points, leaf->count, 0, sizeof(float[3]), min_bound,
+                        max_bound);
+            leaf->bv = bvolume_from_bounds(b->type, min_bound, max_bound);
+        }
+        else
+        {
+            leaf->bv = bvolume_from_points(b->type, b->params->sphere_fit,
+                                           points, leaf->count, 0,
+                                           sizeof(float[3]));
+        }
+        lbvh_walk_up(b, b->internal_count + i, false);
+    }
+}
+
+static JOB_FOR_FN_SIG(lbvh_optimize_job)
+{
+    struct lbvh_build* b = (struct lbvh_build*)udata;
+    for (int i = begin; i < end; i++)
+        lbvh_walk_up(b, b->internal_count + i, true);
+}
+
+static struct node* lbvh_emit_tree(const struct lbvh_build* b,
+                                   int index,
+                                   struct node* parent)
+{
+    const struct lbvh_node* src = &b->nodes[index];
+    struct node* node = (struct node*)mem_calloc(MemTag_Bvh, 1, sizeof(*node));
+    node->bv = src->bv;
+    node->parent = parent;
+    if (src->left < 0)
+    {
+        node->type = node_type_leaf;
+        node->points_base = b->points + src->first * 3;
+        node->points_count = src->count;
+    }
+    else
+    {
+        node->type = node_type_node;
+        node->left = lbvh_emit_tree(b, src->left, node);
+        node->right = lbvh_emit_tree(b, src->right, node);
+    }
+    return node;
+}
+
+// Points are reordered along the Morton curve, stably, so building a second
+// tree over the same array leaves them and the ranges of the first in place.
+// Leaves hold up to leaf_size points, max_depth doesn't apply.
+static void lbvh_bv_tree(struct node** tree,
+                         float* points,
+                         int points_count,
+                         enum bv_type type,
+                         const struct top_down_params* params,
+                         const struct lbvh_params* lbvh_params,
+                         struct bvh_stats* stats)
+{
+    double start_ms = a_get_time_ms();
+
+    *tree = NULL;
+    if (points_count > 0)
+    {
+        struct lbvh_build b = {
+            .points = points,
+            .points_count = points_count,
+            .type = type,
+            .params = params,
+            .lbvh_params = lbvh_params,
+        };
+
+        float max_bound[3];
+        calc_bounds(points, points_count, 0, sizeof(float[3]), b.min_bound,
+                    max_bound);
+        for (int i = 0; i < 3; i++)
+        {
+            float extent = max_bound[i] - b.min_bound[i];
+            b.inv_extent[i] = (extent > 0) ? 1.f / extent : 0;
+        }
+
+        int workers_count = j_get_workers_count() + 1;
+        b.chunks_count = HIMATH_CLAMP(points_count / LBVH_BATCH_SIZE, 1,
+                                      workers_count * 4);
+        b.chunk_size = (points_count + b.chunks_count - 1) / b.chunks_count;
+
+        b.codes =
+            (uint64_t*)mem_alloc(MemTag_Bvh, points_count * sizeof(*b.codes));
+        b.codes_temp =
+            (uint64_t*)mem_alloc(MemTag_Bvh, points_count * sizeof(*b.codes));
+        b.indices =
+            (int*)mem_alloc(MemTag_Bvh, points_count * sizeof(*b.indices));
+        b.indices_temp =
+            (int*)mem_alloc(MemTag_Bvh, points_count * sizeof(*b.indices));
+        b.histograms = (int(*)[LBVH_RADIX_BUCKETS_COUNT])mem_alloc(
+            MemTag_Bvh, b.chunks_count * sizeof(*b.histograms));
+        b.points_temp =
+            (float*)mem_alloc(MemTag_Bvh, points_count * sizeof(float[3]));
+
+        j_parallel_for(points_count, LBVH_BATCH_SIZE, &lbvh_codes_job, &b);
+        lbvh_sort_codes(&b, lbvh_params->wide_codes ? 63 : 30);
+        j_parallel_for(points_count, LBVH_BATCH_SIZE, &lbvh_gather_points_job,
+                       &b);
+        memcpy(points, b.points_temp, points_count * sizeof(float[3]));
+
+        if (lbvh_karras_kept(&b, 0, points_count - 1))
+        {
+            b.karras_nodes = (struct lbvh_karras_node*)mem_alloc(
+                MemTag_Bvh, (points_count - 1) * sizeof(*b.karras_nodes));
+            b.compact_ids = (int*)mem_alloc(
+                MemTag_Bvh, (points_count - 1) * sizeof(*b.compact_ids));
+            b.chunk_counts = (int*)mem_alloc(
+                MemTag_Bvh, b.chunks_count * 2 * sizeof(*b.chunk_counts));
+            j_parallel_for(points_count - 1, LBVH_BATCH_SIZE, &lbvh_karras_job,
+                           &b);
+
+            j_parallel_for(b.chunks_count, 1, &lbvh_count_job, &b);
+            for (int c = 0; c < b.chunks_count; c++)
+            {
+                int kept_count = b.chunk_counts[c * 2];
+                int leaves_count = b.chunk_counts[c * 2 + 1];
+                b.chunk_counts[c * 2] = b.internal_count;
+                b.chunk_counts[c * 2 + 1] = b.leaves_count;
+                b.internal_count += kept_count;
+                b.leaves_count += leaves_count;
+            }
+            b.nodes = (struct lbvh_node*)mem_calloc(
+                MemTag_Bvh, b.internal_count + b.leaves_count,
+                sizeof(*b.nodes));
+            j_parallel_for(b.chunks_count, 1, &lbvh_assign_ids_job, &b);
+            j_parallel_for(b.chunks_count, 1, &lbvh_link_job, &b);
+        }
+        else
+        {
+            b.leaves_count = 1;
+            b.nodes =
+                (struct lbvh_node*)mem_calloc(MemTag_Bvh, 1, sizeof(*b.nodes));
+            b.nodes[0].left = b.nodes[0].right = -1;
+            b.nodes[0].count = points_count;
+        }
+        b.nodes[0].parent = -1;
+
+        j_parallel_for(b.leaves_count, LBVH_LEAVES_BATCH_SIZE,
+                       &lbvh_fit_leaves_job, &b);
+        for (int pass = 0; pass < lbvh_params->treelet_passes; pass++)
+        {
+            for (int i = 0; i < b.internal_count; i++)
+                b.nodes[i].visits = 0;
+            j_parallel_for(b.leaves_count, LBVH_LEAVES_BATCH_SIZE,
+                           &lbvh_optimize_job, &b);
+        }
+
+        *tree = lbvh_emit_tree(&b, 0, NULL);
+
+        mem_free(b.nodes);
+        mem_free(b.chunk_counts);
+        mem_free(b.compact_ids);
+        mem_free(b.karras_nodes);
+        mem_free(b.points_temp);
+        mem_free(b.histograms);
+        mem_free(b.indices_temp);
+        mem_free(b.indices);
+        mem_free(b.codes_temp);
+        mem_free(b.codes);
+    }
+
+    stats->build_ms = a_get_time_ms() - start_ms;
+    calc_bvh_stats(*tree, stats);
+}
+
+// Approximate agglomerative clustering (Gu et al. 2013): leaves are sorted
+// along a Morton curve and split top-down by Morton bits, then clusters are
+// merged bottom-up inside each split, keeping at most aac_reduce_count(n)
+// clusters per subtree so every greedy search stays small
+#define AAC_DELTA 4
+#define AAC_EPSILON 0.2f
+
+typedef struct aac_leaf
+{
+    uint32_t code;
+    struct node* node;
+} aac_leaf_t;
+
+static int compare_aac_leaves(const void* a, const void* b)
+{
+    uint32_t ca = ((const struct aac_leaf*)a)->code;
+    uint32_t cb = ((const struct aac_leaf*)b)->code;
+    return (ca > cb) - (ca < cb);
+}
+
+static int aac_reduce_count(int n)
+{
+    float c = powf(AAC_DELTA, 0.5f + AAC_EPSILON) * 0.5f;
+    int result = (int)ceilf(c * powf((float)n, 0.5f - AAC_EPSILON));
+    return HIMATH_MAX(result, 1);
+}
+
+static float aac_merge_cost(const struct node* a, const struct node* b)
+{
+    struct bvolume merged = merge_bvolumes(&a->bv, &b->bv);
+    return bvolume_surface_area(&merged);
+}
+
+static void aac_find_closest(struct node** clusters,
+                             int count,
+                             int i,
+                             int* closest,
+                             float* closest_cost)
+{
+    closest_cost[i] = FLT_MAX;
+    for (int j = 0; j < count; j++)
+    {
+        if (i == j)
+            continue;
+        float cost = aac_merge_cost(clusters[i], clusters[j]);
+        if (closest_cost[i] > cost)
+        {
+            closest_cost[i] = cost;
+            closest[i] = j;
+        }
+    }
+}
+
+// Greedily merges the pair with the smallest merged surface area until
+// target_count clusters remain. Returns the new clusters count.
+static int aac_combine_clusters(struct node** clusters,
+                                int count,
+                                int target_count)
+{
+    if (count <= target_count)
+        return count;
+
+    int* closest = (int*)mem_alloc(MemTag_Bvh, count * sizeof(*closest));
+    float* closest_cost =
+        (float*)mem_alloc(MemTag_Bvh, count * sizeof(*closest_cost));
+    for (int i = 0; i < count; i++)
+        aac_find_closest(clusters, count, i, closest, closest_cost);
+
+    while (count > target_count)
+    {
+        int a = 0;
+        for (int i = 1; i < count; i++)
+        {
+            if (closest_cost[a] > closest_cost[i])
+                a = i;
+        }
+        int b = closest[a];
+        if (a > b)
+        {
+            int temp = a;
+            a = b;
+            b = temp;
+        }
+
+        struct node* pair =
+            (struct node*)mem_calloc(MemTag_Bvh, 1, sizeof(*pair));
+        pair->type = node_type_node;
+        pair->left = clusters[a];
+        pair->right = clusters[b];
+        pair->left->parent = pair->right->parent = pair;
+        pair->bv = merge_bvolumes(&pair->left->bv, &pair->right->bv);
+
+        // b is replaced by the last cluster, a by the pair
+        int last = count - 1;
+        clusters[a] = pair;
+        clusters[b] = clusters[last];
+        closest[b] = closest[last];
+        closest_cost[b] = closest_cost[last];
+        --count;
+
+        for (int i = 0; i < count; i++)
+        {
+            int c = closest[i];
+            if (i == a || c == a || c == b)
+                aac_find_closest(clusters, count, i, closest, closest_cost);
+            else if (c == last)
+                closest[i] = b;
+        }
+    }
+
+    mem_free(closest_cost);
+    mem_free(closest);
+    return count;
+}
+
+// Builds the clusters of leaves[0, count) into out and returns their count
+static int aac_build_rec(struct aac_leaf* leaves,
+                         int count,
+                         int bit,
+                         struct node** out)
+{
+    if (count < AAC_DELTA)
+    {
+        for (int i = 0; i < count; i++)
+            out[i] = leaves[i].node;
+        return aac_combine_clusters(out, count, aac_reduce_count(AAC_DELTA));
+    }
+
+    // Split where the highest differing Morton bit flips, in the middle when
+    // every code is the same
+    int split = count / 2;
+    uint32_t first = leaves[0].code;
+    uint32_t last = leaves[count - 1].code;
+    while (bit >= 0 && ((first ^ last) & (1u << bit)) == 0)
+        --bit;
+    if (bit >= 0)
+    {
+        int lo = 0;
+        int hi = count - 1;
+        while (lo < hi)
+        {
+            int mid = (lo + hi) / 2;
+            if (leaves[mid].code & (1u << bit))
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        split = lo;
+    }
+
+    int left_count = aac_build_rec(leaves, split, bit - 1, out);
+    int right_count = aac_build_rec(leaves + split, count - split, bit - 1,
+                                    out + left_count);
+    return aac_combine_clusters(out, left_count + right_count,
+                                aac_reduce_count(count));
+}
+
+// The world matrix maps the mesh box and sphere to a bounding box and sphere
+// directly. The mesh OBB follows a rotation with uniform scale exactly and
+// the DOP only the unrotated case, other transforms shear them, so they are
+// refitted around the transformed corners of the mesh OBB.
+static struct bvolume calc_object_bvolume(const struct scene_object* o,
+                                          enum bv_type type)
+{
+    Mat4 m = calc_object_world(o);
+    const float* pos = &m.m[12];
+    float scale[3];
+    for (int i = 0; i < 3; i++)
+        scale[i] = float3_length(&m.m[i * 4]);
+    bool rotated = (m.m[1] != 0 || m.m[2] != 0 || m.m[4] != 0 ||
+                    m.m[6] != 0 || m.m[8] != 0 || m.m[9] != 0);
+    float tolerance = 1e-5f * scale[0];
+    bool uniform_scale = (fabsf(scale[0] - scale[1]) <= tolerance &&
+                          fabsf(scale[1] - scale[2]) <= tolerance);
+    // Sheared by a non-uniform parent scale
+    bool orthogonal =
+        !rotated || (fabsf(float3_dot(&m.m[0], &m.m[4])) <= tolerance &&
+                     fabsf(float3_dot(&m.m[0], &m.m[8])) <= tolerance &&
+                     fabsf(float3_dot(&m.m[4], &m.m[8])) <= tolerance);
+    bool exact = (type == bv_type_obb)
+                     ? uniform_scale && orthogonal
+                     : !rotated && m.m[0] == m.m[5] && m.m[5] == m.m[10];
+    if (type >= bv_type_obb && !exact)
+    {
+        float corners[8][3];
+        obb_corners(o->model_obb, corners);
+        for (int i = 0; i < 8; i++)
+            transform_point(&m, corners[i], corners[i]);
+        return bvolume_from_points(type, bsphere_fit_box, (float*)corners, 8,
+                                   0, sizeof(float[3]));
+    }
+
+    if (type == bv_type_obb)
+    {
+        struct bvolume result = {.type = type};
+        const struct obb* obb = o->model_obb;
+        transform_point(&m, obb->c, result.obb.c);
+        for (int i = 0; i < 3; i++)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                result.obb.u[i][j] = (m.m[j] * obb->u[i][0] +
+                                      m.m[4 + j] * obb->u[i][1] +
+                                      m.m[8 + j] * obb->u[i][2]) /
+                                     scale[0];
+            }
+            result.obb.e[i] = obb->e[i] * scale[0];
+        }
+        return result;
+    }
+
+    if (type >= bv_type_kdop14)
+    {
+        // A negative scale swaps the slab ends
+        struct bvolume result = {.type = type};
+        result.kdop = kdop_restrict(o->model_kdop, bv_type_kdop_k(type));
+        for (int i = 0; i < KDOP_SLABS_COUNT; i++)
+        {
+            if (!kdop_slab_used(result.kdop.k, i))
+                continue;
+            float offset = epos_normals[0][i] * pos[0] +
+                           epos_normals[1][i] * pos[1] +
+                           epos_normals[2][i] * pos[2];
+            float min_d = result.kdop.min[i] * m.m[0] + offset;
+            float max_d = result.kdop.max[i] * m.m[0] + offset;
+            result.kdop.min[i] = fminf(min_d, max_d);
+            result.kdop.max[i] = fmaxf(min_d, max_d);
+        }
+        return result;
+    }
+
+    if (type == bv_type_sphere)
+    {
+        struct bvolume result = {.type = type};
+        const struct bsphere* sphere = o->model_bsphere;
+        transform_point(&m, sphere->c, result.sphere.c);
+        result.sphere.r =
+            sphere->r * fmaxf(scale[0], fmaxf(scale[1], scale[2]));
+        return result;
+    }
+
+    const struct aabb* aabb = o->model_aabb;
+    float c[3];
+    transform_point(&m, aabb->c, c);
+    float min_bound[3];
+    float max_bound[3];
+    for (int i = 0; i < 3; i++)
+    {
+        float r = fabsf(m.m[i]) * aabb->r[0] + fabsf(m.m[4 + i]) * aabb->r[1] +
+                  fabsf(m.m[8 + i]) * aabb->r[2];
+        min_bound[i] = c[i] - r;
+        max_bound[i] = c[i] + r;
+    }
+    return bvolume_from_bounds(type, min_bound, max_bound);
+}
+
+static struct node* bottom_up_bv_tree(struct scene_object* objects,
+                                      int objects_count,
+                                      enum bv_type type)
+{
+    ASSERT(objects_count > 0);
+
+    struct aac_leaf* leaves = (struct aac_leaf*)mem_alloc(
+        MemTag_Bvh, objects_count * sizeof(*leaves));
+    float min_bound[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float max_bound[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (int i = 0; i < objects_count; i++)
+    {
+        struct scene_object* o = &objects[i];
+        struct node* l = (struct node*)mem_calloc(MemTag_Bvh, 1, sizeof(*l));
+        l->type = node_type_leaf;
+        l->scene_object = o;
+        l->bv = calc_object_bvolume(o, type);
+
+        float c[3];
+        bvolume_center(&l->bv, c);
+        bounds_grow(min_bound, max_bound, c);
+        leaves[i] = (struct aac_leaf){.node = l};
+    }
+
+    float extent[3];
+    for (int j = 0; j < 3; j++)
+    {
+        extent[j] = max_bound[j] - min_bound[j];
+        if (extent[j] <= 0)
+            extent[j] = 1;
+    }
+    for (int i = 0; i < objects_count; i++)
+    {
+        float c[3];
+        bvolume_center(&leaves[i].node->bv, c);
+        float p[3];
+        for (int j = 0; j < 3; j++)
+            p[j] = (c[j] - min_bound[j]) / extent[j];
+        leaves[i].code = morton_code(p);
+    }
+    qsort(leaves, objects_count, sizeof(*leaves), &compare_aac_leaves);
+
+    struct node** clusters =
+        (struct node**)mem_alloc(MemTag_Bvh, objects_count * sizeof(*clusters));
+    int clusters_count = aac_build_rec(leaves, objects_count, 29, clusters);
+    clusters_count = aac_combine_clusters(clusters, clusters_count, 1);
+    ASSERT(clusters_count == 1);
+
+    struct node* root = clusters[0];
+
+    mem_free(clusters);
+    mem_free(leaves);
+
+    return root;
+}
+
+static void bvh_replace_child(struct node* parent,
+                              struct node* old_child,
+                              struct node* new_child)
+{
+    if (parent->left == old_child)
+        parent->left = new_child;
+    else
+        parent->right = new_child;
+    new_child->parent = parent;
+}
+
+// Swaps a child with a grandchild under the other child when that shrinks
+// the other child's surface area. The node itself must be refit afterwards.
+// Returns true when the nodes were swapped.
+static bool bvh_rotate(struct node* n)
+{
+    float best_gain = 0;
+    struct node* best_child = NULL;
+    struct node* best_grandchild = NULL;
+    struct node* children[2] = {n->left, n->right};
+    for (int i = 0; i < 2; i++)
+    {
+        struct node* c = children[i];
+        struct node* other = children[1 - i];
+        if (other->type == node_type_leaf)
+            continue;
+
+        float area = bvolume_surface_area(&other->bv);
+        struct node* grandchildren[2] = {other->left, other->right};
+        for (int j = 0; j < 2; j++)
+        {
+            struct node* kept = grandchildren[1 - j];
+            struct bvolume merged = merge_bvolumes(&c->bv, &kept->bv);
+            float gain = area - bvolume_surface_area(&merged);
+            if (best_gain < gain)
+            {
+                best_gain = gain;
+                best_child = c;
+                best_grandchild = grandchildren[j];
+            }
+        }
+    }
+
+    if (best_child)
+    {
+        struct node* other = best_grandchild->parent;
+        bvh_replace_child(n, best_child, best_grandchild);
+        bvh_replace_child(other, best_grandchild, best_child);
+        other->bv = merge_bvolumes(&other->left->bv, &other->right->bv);
+    }
+    return best_child != NULL;
+}
+
+// Returns true when a rotation changed the shape of the tree
+static bool bvh_refit_upwards(struct node* n)
+{
+    bool rotated = false;
+    for (; n; n = n->parent)
+    {
+        if (bvh_rotate(n))
+            rotated = true;
+        n->bv = merge_bvolumes(&n->left->bv, &n->right->bv);
+    }
+    return rotated;
+}
+
+// Greedy descent towards the sibling that adds the least surface area,
+// counting the growth of every ancestor on the way
+static struct node* bvh_find_sibling(struct node* root,
+                                     const struct bvolume* bv)
+{
+    struct node* n = root;
+    while (n->type != node_type_leaf)
+    {
+        struct bvolume merged = merge_bvolumes(&n->bv, bv);
+        float merged_area = bvolume_surface_area(&merged);
+        float cost = 2 * merged_area;
+        float inherited_cost =
+            2 * (merged_area - bvolume_surface_area(&n->bv));
+
+        float child_costs[2];
+        struct node* children[2] = {n->left, n->right};
+        for (int i = 0; i < 2; i++)
+        {
+            struct node* c = children[i];
+            struct bvolume child_merged = merge_bvolumes(&c->bv, bv);
+            child_costs[i] =
+                bvolume_surface_area(&child_merged) + inherited_cost;
+            if (c->type != node_type_leaf)
+                child_costs[i] -= bvolume_surface_area(&c->bv);
+        }
+
+        if (cost < child_costs[0] && cost < child_costs[1])
+            break;
+        n = (child_costs[0] <= child_costs[1]) ? n->left : n->right;
+    }
+    return n;
+}
+
+static struct node* bvh_insert(struct node** root,
+                               struct scene_object* o,
+                               enum bv_type type)
+{
+    struct node* leaf = (struct node*)mem_calloc(MemTag_Bvh, 1, sizeof(*leaf));
+    leaf->type = node_type_leaf;
+    leaf->scene_object = o;
+    leaf->bv = calc_object_bvolume(o, type);
+
+    if (!*root)
+    {
+        *root = leaf;
+        return leaf;
+    }
+
+    struct node* sibling = bvh_find_sibling(*root, &leaf->bv);
+    struct node* old_parent = sibling->parent;
+    struct node* pair = (struct node*)mem_calloc(MemTag_Bvh, 1, sizeof(*pair));
+    pair->type = node_type_node;
+    pair->left = sibling;
+    pair->right = leaf;
+    sibling->parent = leaf->parent = pair;
+    if (old_parent)
+        bvh_replace_child(old_parent, sibling, pair);
+    else
+        *root = pair;
+
+    bvh_refit_upwards(pair);
+    return leaf;
+}
+
+static void bvh_remove(struct node** root, struct node* leaf)
+{
+    struct node* parent = leaf->parent;
+    if (!parent)
+    {
+        *root = NULL;
+    }
+    else
+    {
+        struct node* sibling =
+            (parent->left == leaf) ? parent->right : parent->left;
+        struct node* grandparent = parent->parent;
+        if (grandparent)
+        {
+            bvh_replace_child(grandparent, parent, sibling);
+            bvh_refit_upwards(grandparent);
+        }
+        else
+        {
+            sibling->parent = NULL;
+            *root = sibling;
+        }
+        mem_free(parent);
+    }
+    mem_free(leaf);
+}
+
+// Call after the leaf's object transform changed, same result as
+// bvh_refit_upwards
+static bool bvh_refit(struct node* leaf)
+{
+    leaf->bv = calc_object_bvolume(leaf->scene_object, leaf->bv.type);
+    return bvh_refit_upwards(leaf->parent);
+}
+
+#define MAX_DEPTH_PYRAMID_LEVELS 16
+
+// Must match OcclusionObject in shared.glsl (std430)
+typedef struct OcclusionObject_
+{
+    Mat4 model;
+    float aabb_center[4];
+    float aabb_extent[4];
+    uint32_t object_id;
+    uint32_t index_count;
+    uint32_t padding[2];
+} OcclusionObject;
+
+typedef struct DrawElementsIndirectCommand_
+{
+    uint32_t count;
+    uint32_t instance_count;
+    uint32_t first_index;
+    int32_t base_vertex;
+    uint32_t base_instance;
+} DrawElementsIndirectCommand;
+
+// Max-reduced depth mip chain. Each level also gets a single-level view so
+// the reduction shader can read the previous level at lod 0.
+typedef struct DepthPyramid_
+{
+    IVec2 dim;
+    int levels_count;
+    uint texture;
+    uint level_views[MAX_DEPTH_PYRAMID_LEVELS];
+} DepthPyramid;
+
+static void depth_pyramid_init(DepthPyramid* p, IVec2 dim)
+{
+    *p = (DepthPyramid){.dim = dim};
+    int max_dim = HIMATH_MAX(dim.x, dim.y);
+    while ((max_dim >> p->levels_count) > 0 &&
+           p->levels_count < MAX_DEPTH_PYRAMID_LEVELS)
+    {
+        ++p->levels_count;
+    }
+
+    glGenTextures(1, &p->texture);
+    r_state_bind_texture(0, GL_TEXTURE_2D, p->texture);
+    glTexStorage2D(GL_TEXTURE_2D, p->levels_count, GL_R32F, dim.x, dim.y);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenTextures(p->levels_count, p->level_views);
+    for (int i = 0; i < p->levels_count; i++)
+    {
+        glTextureView(p->level_views[i], GL_TEXTURE_2D, p->texture, GL_R32F, i,
+                      1, 0, 1);
+    }
+}
+
+static void depth_pyramid_cleanup(DepthPyramid* p)
+{
+    r_state_delete_textures(p->levels_count, p->level_views);
+    r_state_delete_textures(1, &p->texture);
+    *p = (DepthPyramid){0};
+}
+
+// Traversals start on a local stack of this many entries. Nothing bounds the
+// depth of incremental, AAC or LBVH trees and point trees can go down to
+// single points, so deeper trees move it to the heap.
+#define FLAT_BVH_STACK_SIZE 128
+
+// 32 bytes. Nodes are stored depth-first, so the left child of an inner node
+// is the node right after it. OBB and DOP nodes keep their box here and the
+// volume itself in flat_bvh.volumes.
+typedef struct flat_node
+{
+    union
+    {
+        struct aabb aabb;
+        struct bsphere sphere;
+    };
+    int32_t offset; // Right child of an inner node, first primitive of a leaf
+    int32_t count;  // Primitives of a leaf, 0 for inner nodes
+} flat_node_t;
+
+// Bounds of four children in SoA, so one test covers all of them. Spheres
+// keep their radius in ex, OBBs and DOPs their box. Unused slots have a count
+// of -1.
+typedef struct flat_node4
+{
+    float cx[4];
+    float cy[4];
+    float cz[4];
+    float ex[4];
+    float ey[4];
+    float ez[4];
+    int32_t offsets[4]; // Child flat_node4 when count is 0, else primitive
+    int32_t counts[4];
+} flat_node4_t;
+
+// Leaves of object trees index scene objects, leaves of point trees index
+// points of the cloud
+typedef struct flat_bvh
+{
+    enum bv_type type;
+    struct flat_node* nodes;
+    int nodes_count;
+    int nodes_cap;
+    struct flat_node4* nodes4;
+    int nodes4_count;
+    int nodes4_cap;
+    // Volumes of OBB and DOP trees that don't fit the nodes, per node and per
+    // slot of the 4-wide nodes. Boxes reject first, these refine the rest.
+    struct bvolume* volumes;
+    struct bvolume* volumes4;
+    // Per node, see flat_bvh_refit_upwards
+    uint32_t* refit_stamps;
+    uint32_t refit_stamp;
+} flat_bvh_t;
+
+static void flat_bvh_cleanup(struct flat_bvh* bvh)
+{
+    mem_free(bvh->nodes);
+    mem_free(bvh->refit_stamps);
+    mem_free(bvh->nodes4);
+    mem_free(bvh->volumes);
+    mem_free(bvh->volumes4);
+    *bvh = (struct flat_bvh){0};
+}
+
+// Doubles cap, local_stack is the traversal's initial array
+static void* flat_bvh_stack_grow(void* stack,
+                                 const void* local_stack,
+                                 int* cap,
+                                 size_t entry_size)
+{
+    size_t size = (size_t)*cap * entry_size;
+    void* result = (stack == local_stack)
+                       ? mem_alloc(MemTag_Bvh, size * 2)
+                       : mem_realloc(MemTag_Bvh, stack, size * 2);
+    if (!result)
+    {
+        // Not ASSERT, the traversal can't go on without it in Release either
+        d_print("Can't grow a BVH traversal stack to %d entries\n", *cap * 2);
+        abort();
+    }
+    if (stack == local_stack)
+        memcpy(result, local_stack, size);
+    *cap *= 2;
+    return result;
+}
+
+static bool flat_bvh_has_volumes(enum bv_type type)
+{
+    return type >= bv_type_obb;
+}
+
+static int tree_count_nodes(struct node* tree)
+{
+    if (tree->type == node_type_leaf)
+        return 1;
+    return 1 + tree_count_nodes(tree->left) + tree_count_nodes(tree->right);
+}
+
+static void flat_leaf_range(const struct node* leaf,
+                            const struct scene_object* objects,
+                            const float* points,
+                            int32_t* out_offset,
+                            int32_t* out_count)
+{
+    if (leaf->scene_object)
+    {
+        *out_offset = (int32_t)(leaf->scene_object - objects);
+        *out_count = 1;
+    }
+    else
+    {
+        *out_offset = (int32_t)((leaf->points_base - points) / 3);
+        *out_count = leaf->points_count;
+    }
+}
+
+static void flat_node_set_bounds(struct flat_bvh* bvh,
+                                 int index,
+                                 const struct bvolume* bv)
+{
+    struct flat_node* n = &bvh->nodes[index];
+    if (bv->type == bv_type_sphere)
+        n->sphere = bv->sphere;
+    else
+        n->aabb = bvolume_aabb(bv);
+    if (flat_bvh_has_volumes(bv->type))
+        bvh->volumes[index] = *bv;
+}
+
+// slot is the node4 index times four plus the child
+static void flat_node4_set_bounds(struct flat_bvh* bvh,
+                                  int slot,
+                                  const struct bvolume* bv)
+{
+    struct flat_node4* n4 = &bvh->nodes4[slot / 4];
+    int i = slot % 4;
+    if (bv->type == bv_type_sphere)
+    {
+        n4->cx[i] = bv->sphere.c[0];
+        n4->cy[i] = bv->sphere.c[1];
+        n4->cz[i] = bv->sphere.c[2];
+        n4->ex[i] = n4->ey[i] = n4->ez[i] = bv->sphere.r;
+    }
+    else
+    {
+        struct aabb aabb = bvolume_aabb(bv);
+        n4->cx[i] = aabb.c[0];
+        n4->cy[i] = aabb.c[1];
+        n4->cz[i] = aabb.c[2];
+        n4->ex[i] = aabb.r[0];
+        n4->ey[i] = aabb.r[1];
+        n4->ez[i] = aabb.r[2];
+    }
+    if (flat_bvh_has_volumes(bv->type))
+        bvh->volumes4[slot] = *bv;
+}
+
+static int flat_bvh_push_rec(struct flat_bvh* bvh,
+                             struct node* tree,
+                             const struct scene_object* objects,
+                             const float* points)
+{
+    int index = bvh->nodes_count++;
+    struct flat_node* n = &bvh->nodes[index];
+    tree->flat_index = index;
+    flat_node_set_bounds(bvh, index, &tree->bv);
+
+    if (tree->type == node_type_leaf)
+    {
+        flat_leaf_range(tree, objects, points, &n->offset, &n->count);
+    }
+    else
+    {
+        n->count = 0;
+        flat_bvh_push_rec(bvh, tree->left, objects, points);
+        int right = flat_bvh_push_rec(bvh, tree->right, objects, points);
+        bvh->nodes[index].offset = right;
+    }
+    return index;
+}
+
+// Opens the largest inner node of the set until it has four members
+static int flat_bvh_push4_rec(struct flat_bvh* bvh,
+                              struct node* tree,
+                              const struct scene_object* objects,
+                              const float* points)
+{
+    struct node* children[4] = {tree};
+    int children_count = 1;
+    while (children_count < 4)
+    {
+        int largest = -1;
+        float largest_area = -1;
+        for (int i = 0; i < children_count; i++)
+        {
+            float area = bvolume_surface_area(&children[i]->bv);
+            if (children[i]->type != node_type_leaf && largest_area < area)
+            {
+                largest = i;
+                largest_area = area;
+            }
+        }
+        if (largest < 0)
+            break;
+
+        struct node* n = children[largest];
+        n->flat4_slot = -1;
+        children[largest] = n->left;
+        children[children_count++] = n->right;
+    }
+
+    int index = bvh->nodes4_count++;
+    struct flat_node4* n4 = &bvh->nodes4[index];
+    *n4 = (struct flat_node4){0};
+    for (int i = 0; i < 4; i++)
+    {
+        if (i >= children_count)
+        {
+            n4->counts[i] = -1;
+            continue;
+        }
+
+        children[i]->flat4_slot = index * 4 + i;
+        flat_node4_set_bounds(bvh, index * 4 + i, &children[i]->bv);
+
+        if (children[i]->type == node_type_leaf)
+        {
+            flat_leaf_range(children[i], objects, points, &n4->offsets[i],
+                            &n4->counts[i]);
+        }
+        else
+        {
+            int child = flat_bvh_push4_rec(bvh, children[i], objects, points);
+            bvh->nodes4[index].offsets[i] = child;
+            bvh->nodes4[index].counts[i] = 0;
+        }
+    }
+    return index;
+}
+
+// Converts a pointer tree built by any of the builders. Arrays are reused
+// between conversions.
+static void flat_bvh_from_tree(struct flat_bvh* bvh,
+                               struct node* tree,
+                               const struct scene_object* objects,
+                               const float* points)
+{
+    bvh->nodes_count = 0;
+    bvh->nodes4_count = 0;
+    if (!tree)
+        return;
+
+    bvh->type = tree->bv.type;
+    int nodes_count = tree_count_nodes(tree);
+    if (bvh->nodes_cap < nodes_count)
+    {
+        bvh->nodes_cap = nodes_count;
+        bvh->nodes = (struct flat_node*)mem_realloc(
+            MemTag_Bvh, bvh->nodes, nodes_count * sizeof(*bvh->nodes));
+        mem_free(bvh->refit_stamps);
+        bvh->refit_stamps = (uint32_t*)mem_calloc(
+            MemTag_Bvh, nodes_count, sizeof(*bvh->refit_stamps));
+        bvh->refit_stamp = 0;
+        // Every flat_node4 but the root replaces at least one inner node
+        bvh->nodes4_cap = nodes_count / 2 + 1;
+        bvh->nodes4 = (struct flat_node4*)mem_realloc(
+            MemTag_Bvh, bvh->nodes4, bvh->nodes4_cap * sizeof(*bvh->nodes4));
+        // Dropped so the next volume tree reallocates them at the new size
+        mem_free(bvh->volumes);
+        mem_free(bvh->volumes4);
+        bvh->volumes = bvh->volumes4 = NULL;
+    }
+    if (flat_bvh_has_volumes(bvh->type) && !bvh->volumes)
+    {
+        bvh->volumes = (struct bvolume*)mem_alloc(
+            MemTag_Bvh, bvh->nodes_cap * sizeof(*bvh->volumes));
+        bvh->volumes4 = (struct bvolume*)mem_alloc(
+            MemTag_Bvh, bvh->nodes4_cap * 4 * sizeof(*bvh->volumes4));
+    }
+
+    flat_bvh_push_rec(bvh, tree, objects, points);
+    flat_bvh_push4_rec(bvh, tree, objects, points);
+    ASSERT(bvh->nodes_count == nodes_count);
+    ASSERT(bvh->nodes4_count <= bvh->nodes4_cap);
+}
+
+// Starts a refit pass, see flat_bvh_refit_upwards
+static void flat_bvh_begin_refit(struct flat_bvh* bvh)
+{
+    ++bvh->refit_stamp;
+}
+
+// Copies the bounds of a refit leaf and its ancestors from the pointer tree,
+// which must have the shape of the last conversion. Ancestors already copied
+// in this pass are skipped, the pointer tree is refit in full beforehand.
+static void flat_bvh_refit_upwards(struct flat_bvh* bvh, const struct node* n)
+{
+    for (; n; n = n->parent)
+    {
+        if (bvh->refit_stamps[n->flat_index] == bvh->refit_stamp)
+            break;
+        bvh->refit_stamps[n->flat_index] = bvh->refit_stamp;
+        flat_node_set_bounds(bvh, n->flat_index, &n->bv);
+        if (n->flat4_slot >= 0)
+            flat_node4_set_bounds(bvh, n->flat4_slot, &n->bv);
+    }
+}
+
+static struct bvolume flat_node_bvolume(const struct flat_bvh* bvh,
+                                        const struct flat_node* n)
+{
+    if (flat_bvh_has_volumes(bvh->type))
+        return bvh->volumes[n - bvh->nodes];
+
+    struct bvolume result = {.type = bvh->type};
+    if (bvh->type == bv_type_aabb)
+        result.aabb = n->aabb;
+    else
+        result.sphere = n->sphere;
+    return result;
+}
+
+typedef struct FrustumCullStats_
+{
+    int nodes_visited;
+    int subtrees_accepted;
+    int visible_count;
+    int culled_count;
+    float traversal_ms;
+} FrustumCullStats;
+
+static void flat_bvh_emit_leaf(int32_t offset,
+                               int32_t count,
+                               int* out_primitives,
+                               int* out_count)
+{
+    for (int i = 0; i < count; i++)
+        out_primitives[(*out_count)++] = offset + i;
+}
+
+// Every leaf of a depth-first subtree lies in [index, end), where end is the
+// right sibling's index or the end of the array
+static void flat_bvh_collect(const struct flat_bvh* bvh,
+                             int index,
+                             int end,
+                             int* out_primitives,
+                             int* out_count)
+{
+    for (int i = index; i < end; i++)
+    {
+        const struct flat_node* n = &bvh->nodes[i];
+        if (n->count > 0)
+            flat_bvh_emit_leaf(n->offset, n->count, out_primitives, out_count);
+    }
+}
+
+typedef struct flat_bvh_cull_entry
+{
+    int index;
+    int end; // Subtree end, see flat_bvh_collect
+    int plane_mask;
+} flat_bvh_cull_entry_t;
+
+static void flat_bvh_frustum_cull(const struct flat_bvh* bvh,
+                                  const struct frustum* frustum,
+                                  int* out_primitives,
+                                  int* out_count,
+                                  FrustumCullStats* stats)
+{
+    if (bvh->nodes_count == 0)
+        return;
+
+    struct flat_bvh_cull_entry local_stack[FLAT_BVH_STACK_SIZE];
+    struct flat_bvh_cull_entry* stack = local_stack;
+    int stack_cap = FLAT_BVH_STACK_SIZE;
+    int stack_count = 0;
+    stack[stack_count++] = (struct flat_bvh_cull_entry){
+        .index = 0,
+        .end = bvh->nodes_count,
+        .plane_mask = FRUSTUM_PLANES_ALL,
+    };
+
+    while (stack_count > 0)
+    {
+        struct flat_bvh_cull_entry e = stack[--stack_count];
+        const struct flat_node* n = &bvh->nodes[e.index];
+        ++stats->nodes_visited;
+
+        struct bvolume bv = flat_node_bvolume(bvh, n);
+        enum frustum_result result =
+            frustum_test_bvolume(frustum, &bv, &e.plane_mask);
+        if (result == frustum_result_outside)
+            continue;
+
+        if (result == frustum_result_inside)
+        {
+            // Every plane is satisfied, no need to test anything below
+            ++stats->subtrees_accepted;
+            flat_bvh_collect(bvh, e.index, e.end, out_primitives, out_count);
+        }
+        else if (n->count > 0)
+        {
+            flat_bvh_emit_leaf(n->offset, n->count, out_primitives, out_count);
+        }
+        else
+        {
+            if (stack_count + 2 > stack_cap)
+            {
+                stack = (struct flat_bvh_cull_entry*)flat_bvh_stack_grow(
+                    stack, local_stack, &stack_cap, sizeof(*stack));
+            }
+            stack[stack_count++] = (struct flat_bvh_cull_entry){
+                .index = n->offset,
+                .end = e.end,
+                .plane_mask = e.plane_mask,
+            };
+            stack[stack_count++] = (struct flat_bvh_cull_entry){
+                .index = e.index + 1,
+                .end = n->offset,
+                .plane_mask = e.plane_mask,
+            };
+        }
+    }
+    if (stack != local_stack)
+        mem_free(stack);
+}
+
+static void flat_bvh4_collect(const struct flat_bvh* bvh,
+                              int index,
+                              int* out_primitives,
+                              int* out_count)
+{
+    const struct flat_node4* n4 = &bvh->nodes4[index];
+    for (int i = 0; i < 4; i++)
+    {
+        if (n4->counts[i] > 0)
+        {
+            flat_bvh_emit_leaf(n4->offsets[i], n4->counts[i], out_primitives,
+                               out_count);
+        }
+        else if (n4->counts[i] == 0)
+        {
+            flat_bvh4_collect(bvh, n4->offsets[i], out_primitives, out_count);
+        }
+    }
+}
+
+static void flat_bvh4_frustum_cull_rec(const struct flat_bvh* bvh,
+                                       int index,
+                                       const struct frustum* frustum,
+                                       int plane_mask,
+                                       int* out_primitives,
+                                       int* out_count,
+                                       FrustumCullStats* stats)
+{
+    const struct flat_node4* n4 = &bvh->nodes4[index];
+    ++stats->nodes_visited;
+
+    int child_masks[4];
+    int outside = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        child_masks[i] = plane_mask;
+        if (n4->counts[i] < 0)
+            outside |= 1 << i;
+    }
+
+    bool box = (bvh->type != bv_type_sphere);
+    __m128 cx = _mm_loadu_ps(n4->cx);
+    __m128 cy = _mm_loadu_ps(n4->cy);
+    __m128 cz = _mm_loadu_ps(n4->cz);
+    __m128 ex = _mm_loadu_ps(n4->ex);
+    __m128 ey = _mm_loadu_ps(n4->ey);
+    __m128 ez = _mm_loadu_ps(n4->ez);
+    for (int p = 0; p < 6; p++)
+    {
+        if (!(plane_mask & (1 << p)))
+            continue;
+
+        int plane_outside;
+        int plane_inside;
+        frustum_classify_plane4(frustum, p, cx, cy, cz, ex, ey, ez, box,
+                                &plane_outside, &plane_inside);
+        outside |= plane_outside;
+        for (int i = 0; i < 4; i++)
+        {
+            if (plane_inside & (1 << i))
+                child_masks[i] &= ~(1 << p);
+        }
+    }
+
+    // Boxes the volumes are inside of passed, the volumes may still be out
+    if (flat_bvh_has_volumes(bvh->type))
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            if (!(outside & (1 << i)) &&
+                frustum_test_bvolume(frustum, &bvh->volumes4[index * 4 + i],
+                                     &child_masks[i]) ==
+                    frustum_result_outside)
+            {
+                outside |= 1 << i;
+            }
+        }
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        if (outside & (1 << i))
+            continue;
+
+        int32_t offset = n4->offsets[i];
+        int32_t count = n4->counts[i];
+        if (count > 0)
+        {
+            flat_bvh_emit_leaf(offset, count, out_primitives, out_count);
+        }
+        else if (child_masks[i] == 0)
+        {
+            ++stats->subtrees_accepted;
+            flat_bvh4_collect(bvh, offset, out_primitives, out_count);
+        }
+        else
+        {
+            flat_bvh4_frustum_cull_rec(bvh, offset, frustum, child_masks[i],
+                                       out_primitives, out_count, stats);
+        }
+    }
+}
+
+// Same result as flat_bvh_frustum_cull, testing four children per node
+static void flat_bvh4_frustum_cull(const struct flat_bvh* bvh,
+                                   const struct frustum* frustum,
+                                   int* out_primitives,
+                                   int* out_count,
+                                   FrustumCullStats* stats)
+{
+    if (bvh->nodes4_count > 0)
+    {
+        flat_bvh4_frustum_cull_rec(bvh, 0, frustum, FRUSTUM_PLANES_ALL,
+                                   out_primitives, out_count, stats);
+    }
+}
+
+// Nodes and leaves whose volume the ray enters, the work a traversal does
+// before it gets to test any triangles
+static void flat_bvh_count_ray_hits(const struct flat_bvh* bvh,
+                                    const float* org,
+                                    const float* dir,
+                                    float t_max,
+                                    int* out_nodes,
+                                    int* out_leaves)
+{
+    *out_nodes = 0;
+    *out_leaves = 0;
+    if (bvh->nodes_count == 0)
+        return;
+
+    int local_stack[FLAT_BVH_STACK_SIZE];
+    int* stack = local_stack;
+    int stack_cap = FLAT_BVH_STACK_SIZE;
+    int stack_count = 0;
+    stack[stack_count++] = 0;
+    while (stack_count > 0)
+    {
+        int index = stack[--stack_count];
+        const struct flat_node* n = &bvh->nodes[index];
+        struct bvolume bv = flat_node_bvolume(bvh, n);
+        float t;
+        if (!bvolume_intersect_ray(&bv, org, dir, t_max, &t))
+            continue;
+
+        ++*out_nodes;
+        if (n->count > 0)
+        {
+            ++*out_leaves;
+        }
+        else
+        {
+            if (stack_count + 2 > stack_cap)
+            {
+                stack = (int*)flat_bvh_stack_grow(stack, local_stack,
+                                                  &stack_cap, sizeof(*stack));
+            }
+            stack[stack_count++] = n->offset;
+            stack[stack_count++] = index + 1;
+        }
+    }
+    if (stack != local_stack)
+        mem_free(stack);
+}
+
+// Leaves whose volume overlaps bv, which has the type of the tree
+static int flat_bvh_count_overlaps(const struct flat_bvh* bvh,
+                                   const struct bvolume* bv)
+{
+    int result = 0;
+    if (bvh->nodes_count == 0)
+        return result;
+
+    int local_stack[FLAT_BVH_STACK_SIZE];
+    int* stack = local_stack;
+    int stack_cap = FLAT_BVH_STACK_SIZE;
+    int stack_count = 0;
+    stack[stack_count++] = 0;
+    while (stack_count > 0)
+    {
+        int index = stack[--stack_count];
+        const struct flat_node* n = &bvh->nodes[index];
+        struct bvolume node_bv = flat_node_bvolume(bvh, n);
+        if (!bvolumes_overlap(&node_bv, bv))
+            continue;
+
+        if (n->count > 0)
+        {
+            ++result;
+        }
+        else
+        {
+            if (stack_count + 2 > stack_cap)
+            {
+                stack = (int*)flat_bvh_stack_grow(stack, local_stack,
+                                                  &stack_cap, sizeof(*stack));
+            }
+            stack[stack_count++] = n->offset;
+            stack[stack_count++] = index + 1;
+        }
+    }
+    if (stack != local_stack)
+        mem_free(stack);
+    return result;
+}
+
+static void draw_bvh(RenderQueue* queue,
+                     const struct flat_bvh* bvh,
+                     uint shader,
+                     VertexBuffer* vb,
+                     int highlight_depth)
+{
+    FVec3 color = {0.5f, 0.5f, 1};
+
+    // Depth of every node on the stack of pending right children
+    int local_stack[FLAT_BVH_STACK_SIZE];
+    int* stack = local_stack;
+    int stack_cap = FLAT_BVH_STACK_SIZE;
+    int stack_count = 0;
+    int depth = 0;
+    for (int i = 0; i < bvh->nodes_count; i++)
+    {
+        const struct flat_node* n = &bvh->nodes[i];
+        if (depth == highlight_depth)
+        {
+            Mat4 trans_mat;
+            Mat4 scale_mat;
+            switch (bvh->type)
+            {
+            case bv_type_aabb: {
+                const struct aabb* aabb = &n->aabb;
+                FVec3 c = {aabb->c[0], aabb->c[1], aabb->c[2]};
+                trans_mat = mat4_translation(c);
+                scale_mat = mat4_scalev(
+                    (FVec3){aabb->r[0] * 2, aabb->r[1] * 2, aabb->r[2] * 2});
+                break;
+            }
+            case bv_type_sphere: {
+                const struct bsphere* bsphere = &n->sphere;
+                FVec3 c = {bsphere->c[0], bsphere->c[1], bsphere->c[2]};
+                trans_mat = mat4_translation(c);
+                scale_mat = mat4_scale(bsphere->r * 2);
+                break;
+            }
+            default: {
+                // The rotation goes in with the scale. DOPs have their own
+                // line mesh, see build_kdop_lines_vb, this draws their box.
+                const struct bvolume* bv = &bvh->volumes[i];
+                const struct aabb* aabb = &n->aabb;
+                FVec3 c = {aabb->c[0], aabb->c[1], aabb->c[2]};
+                Mat4 rotation = mat4_identity();
+                float e[3];
+                float3_copy(e, (float*)aabb->r);
+                if (bv->type == bv_type_obb)
+                {
+                    c = (FVec3){bv->obb.c[0], bv->obb.c[1], bv->obb.c[2]};
+                    float3_copy(e, (float*)bv->obb.e);
+                    for (int j = 0; j < 3; j++)
+                    {
+                        for (int k = 0; k < 3; k++)
+                            rotation.mm[j][k] = bv->obb.u[j][k];
+                    }
+                }
+                trans_mat = mat4_translation(c);
+                Mat4 axes_scale_mat =
+                    mat4_scalev((FVec3){e[0] * 2, e[1] * 2, e[2] * 2});
+                scale_mat = mat4_mul(&rotation, &axes_scale_mat);
+                break;
+            }
+            }
+
+            Mat4 model_mat = mat4_mul(&trans_mat, &scale_mat);
+            ExamplePerObjectUBO per_object = {.model = model_mat,
+                                              .color = color};
+            uint64_t key = r_queue_make_key(&(RenderKeyDesc){
+                .pass = GraphicsPass_DebugWire,
+                .program = shader,
+                .vao = vb->vao,
+            });
+            r_queue_push_vb(queue, key, shader, vb, NULL, 0, &per_object);
+        }
+
+        // Depth-first order: an inner node is followed by its left child, a
+        // leaf by the right child of the closest pending ancestor
+        if (n->count == 0)
+        {
+            if (stack_count == stack_cap)
+            {
+                stack = (int*)flat_bvh_stack_grow(stack, local_stack,
+                                                  &stack_cap, sizeof(*stack));
+            }
+            stack[stack_count++] = ++depth;
+        }
+        else if (stack_count > 0)
+        {
+            depth = stack[--stack_count];
+        }
+    }
+    if (stack != local_stack)
+        mem_free(stack);
+}
+
+// Edges of the DOPs at the highlighted depth as one world-space line list.
+// Clipping out the polytopes isn't free, so this only runs when the tree or
+// the depth changes.
+static void build_kdop_lines_vb(VertexBuffer* vb,
+                                const struct flat_bvh* bvh,
+                                int highlight_depth)
+{
+    if (vb->vao)
+        r_vb_cleanup(vb);
+
+    Vertex* vertices = NULL;
+    int vertices_count = 0;
+    int vertices_cap = 0;
+    struct kdop_polytope* polytope =
+        (struct kdop_polytope*)mem_alloc(MemTag_Mesh, sizeof(*polytope));
+
+    int local_stack[FLAT_BVH_STACK_SIZE];
+    int* stack = local_stack;
+    int stack_cap = FLAT_BVH_STACK_SIZE;
+    int stack_count = 0;
+    int depth = 0;
+    for (int i = 0; i < bvh->nodes_count; i++)
+    {
+        const struct flat_node* n = &bvh->nodes[i];
+        if (depth == highlight_depth &&
+            calc_kdop_polytope(&bvh->volumes[i].kdop, polytope))
+        {
+            for (int f = 0; f < polytope->faces_count; f++)
+            {
+                int count = polytope->counts[f];
+                if (vertices_cap < vertices_count + count * 2)
+                {
+                    vertices_cap = HIMATH_MAX(vertices_cap * 2,
+                                              vertices_count + count * 2);
+                    vertices = (Vertex*)mem_realloc(
+                        MemTag_Mesh, vertices,
+                        vertices_cap * sizeof(*vertices));
+                }
+                for (int j = 0; j < count; j++)
+                {
+                    const float* a = polytope->vertices[f][j];
+                    const float* b = polytope->vertices[f][(j + 1) % count];
+                    vertices[vertices_count++] =
+                        (Vertex){.pos = {a[0], a[1], a[2]}};
+                    vertices[vertices_count++] =
+                        (Vertex){.pos = {b[0], b[1], b[2]}};
+                }
+            }
+        }
+
+        if (n->count == 0)
+        {
+            if (stack_count == stack_cap)
+            {
+                stack = (int*)flat_bvh_stack_grow(stack, local_stack,
+                                                  &stack_cap, sizeof(*stack));
+            }
+            stack[stack_count++] = ++depth;
+        }
+        else if (stack_count > 0)
+        {
+            depth = stack[--stack_count];
+        }
+    }
+    if (stack != local_stack)
+        mem_free(stack);
+
+    if (vertices_count > 0)
+    {
+        Mesh mesh = {.vertices_count = vertices_count, .vertices = vertices};
+        r_vb_init(vb, &mesh, GL_LINES);
+    }
+    mem_free(polytope);
+    mem_free(vertices);
+}
+
+#define BROADPHASE_BENCH_QUERIES_COUNT 1000
+#define PLACEMENT_MAX_ATTEMPTS 32
+
+typedef struct broadphase_bench
+{
+    double build_ms;
+    double pairs_ms;
+    double queries_ms;
+    int pairs_count;
+    int query_hits;
+} broadphase_bench_t;
+
+#define POINT_VIEWER_SLOTS_COUNT 1024
+#define POINT_VIEWER_DEPTH_COLORS_COUNT 8
+
+// Resident octree nodes live in fixed slots of one vertex buffer, each sized
+// for the largest node. Slots not drawn this frame are reused oldest first.
+typedef struct point_viewer
+{
+    bool enabled;
+    bool color_by_depth;
+    int points_budget;
+    float max_error; // Projected point spacing in pixels
+    int uploads_per_frame;
+
+    struct point_octree octree;
+    double build_ms;
+
+    uint vao;
+    uint vbo;
+    int slot_nodes[POINT_VIEWER_SLOTS_COUNT]; // -1 when free
+    uint32_t slot_frames[POINT_VIEWER_SLOTS_COUNT]; // Last frame drawn
+    int* node_slots; // -1 when not resident
+    uint32_t frame;
+
+    int selected_nodes[POINT_VIEWER_SLOTS_COUNT];
+    int selected_count;
+    struct octree_select_stats select_stats;
+    double select_ms;
+    int uploads_count;
+    int drawn_nodes_count;
+    int drawn_points_count;
+} point_viewer_t;
+
+// graphics_activate goes through these in order, see activate_next_item
+typedef enum ActivateStep_
+{
+    ActivateStep_ModelVbs = 0,
+    ActivateStep_HullVbs,
+    ActivateStep_ShapeVbs,
+    ActivateStep_Shaders,
+    ActivateStep_RenderTargets,
+    ActivateStep_OcclusionBuffers,
+    ActivateStep_PointViewer,
+    ActivateStep_Done,
+} ActivateStep;
+
+#define GRAPHICS_SHADERS_COUNT (8 + 5 * GBufferLayout_Count)
+// Each program is built in one activate item per stage plus one to link
+#define GRAPHICS_SHADER_ITEMS_COUNT                                            \
+    (GRAPHICS_SHADERS_COUNT * (SHADER_STAGES_COUNT + 1))
+
+// The path string lives in the arena, filename points into it
+typedef struct ModelFilePath_
+{
+    const char* abs_path_str;
+    const char* filename;
+} ModelFilePath;
+
+typedef struct GraphicsScene_
+{
+    // Per-model arrays sized once, see alloc_models
+    ModelFilePath* model_file_paths;
+    Mesh* model_meshes;
+    VertexBuffer* model_vbs;
+    RtMeshBvh* model_rt_bvhs;
+    int models_count;
+    int models_cap;
+    ActivateStep activate_step;
+    int activate_items_done; // Models, hulls or shader items of the step
+    // Read by prepare, freed once the program is linked
+    ShaderText shader_texts[GRAPHICS_SHADERS_COUNT];
+    // Stages of the program being built, see ActivateStep_Shaders
+    GLuint shader_stages[SHADER_STAGES_COUNT];
+    bool shader_stages_compiled;
+    Arena* arena; // The example's, for data that lives as long as the scene
+
+    uint model_shader;
+    uint normal_debug_shader;
+
+    Pool scene_objects; // Of struct scene_object
+    // Object i uses entry i, world matrices are recomposed once per frame
+    struct transform_store transforms;
+    double transform_update_ms;
+
+    // Object-level trees, their leaves are scene objects
+    struct node* object_bvh[bv_type_count];
+    // Linearized copies every traversal runs on
+    struct flat_bvh object_flat_bvh[bv_type_count];
+    struct flat_bvh debug_flat_bvh[bv_type_count];
+    bool wide_bvh;
+    bool animate_objects;
+    double bvh_update_ms;
+    // Broadphase over the object boxes, ids are scene object indices
+    struct spatial_grid object_grid;
+    int grid_pairs_count;
+    double grid_update_ms;
+    bool place_without_overlaps;
+    int broadphase_bench_objects_count;
+    struct broadphase_bench broadphase_bench[1 + bv_type_count];
+    bool frustum_culling;
+    Mat4 view_proj;
+    // Scratch sized to the object pool, see reserve_scene_objects
+    int* visible_object_indices;
+    struct scene_object** visible_objects;
+    int visible_objects_count;
+    int object_scratch_cap;
+    FrustumCullStats cull_stats;
+
+    // Mouse picking against the triangles of the scene objects
+    RtScene rt_scene;
+    PoolHandle picked_object;
+    RayHit pick_hit;
+    double pick_ms;
+    // What the pick ray and the picked object's volume cost in every tree
+    int pick_ray_nodes[bv_type_count];
+    int pick_ray_leaves[bv_type_count];
+    int pick_overlaps[bv_type_count];
+
+    // Two-phase Hi-Z occlusion culling on the GPU
+    bool occlusion_culling;
+    struct aabb* model_aabbs;
+    struct bsphere* model_bspheres;
+    struct obb* model_obbs;
+    struct kdop* model_kdops; // 26-DOPs
+    double model_fit_ms;
+    // Convex hulls of the models, simplified when hull_max_vertices is set
+    Mesh* model_hulls;
+    VertexBuffer* model_hull_vbs;
+    int hull_max_vertices;
+    double hull_build_ms;
+    bool draw_hulls;
+    MeshHalfEdges* model_half_edges;
+    double half_edges_build_ms;
+    uint first_pass_indirect_shaders[GBufferLayout_Count];
+    uint depth_pyramid_shader;
+    uint occlusion_cull_shaders[2];
+    DepthPyramid depth_pyramid;
+    uint occlusion_objects_buffer;
+    uint occlusion_visibility_buffer;
+    uint occlusion_commands_buffer;
+    OcclusionObject* occlusion_objects;
+    int occlusion_objects_count;
+    int occlusion_buffers_cap; // Objects the GPU buffers have room for
+    int* model_group_offsets;  // models_count + 1
+    int* model_group_cursors;
+
+    Mesh aabb_mesh;
+    VertexBuffer aabb_vb;
+    Mesh bsphere_mesh;
+    VertexBuffer bsphere_vb;
+    // Debug lines of the DOP tree shown, see build_kdop_lines_vb
+    VertexBuffer kdop_lines_vb;
+    bool kdop_lines_dirty;
+    int kdop_lines_depth;
+    enum bv_type kdop_lines_type;
+
+    float* scene_points;
+    int scene_points_count;
+    struct node* point_bvh[bv_type_count];
+    int bvh_highlight_depth;
+    int bvh_type;
+    enum bv_type visible_bv_type;
+    struct top_down_params top_down_params;
+    struct lbvh_params lbvh_params;
+    struct bvh_stats bvh_stats[bv_type_count];
+    struct point_viewer point_viewer;
+
+    Mesh light_source_mesh;
+    VertexBuffer light_source_vb;
+    Pool light_sources; // Of LightSource
+    int requested_light_sources_count;
+    uint light_source_shader;
+    float light_intensity;
+
+    FVec3 orbit_pos;
+    float orbit_speed_deg;
+    float orbit_radius;
+
+    ExampleFpsCamera cam;
+
+    float t;
+
+    Mesh fsq_mesh;
+    VertexBuffer fsq_vb;
+    uint fsq_shader;
+    uint fsq_target_texture;
+
+    GBuffer gbuffer;
+    uint deferred_first_pass_shaders[GBufferLayout_Count];
+    uint deferred_second_pass_shaders[GBufferLayout_Count];
+    GpuTimer gbuffer_timers[GBufferLayout_Count];
+
+    uint light_culling_shader;
+    uint point_lights_buffer;
+    uint light_tiles_buffer;
+    IVec2 light_tiles_count;
+    float light_linear;
+    float light_quadratic;
+    float light_cutoff;
+    ExamplePhongLight* point_lights;
+    int point_lights_cap;
+
+    LightingMode lighting_mode;
+    uint deferred_directional_shaders[GBufferLayout_Count];
+    uint light_volume_shaders[GBufferLayout_Count];
+    uint light_framebuffer;
+    uint light_texture;
+    uint light_depth_stencil_texture; // Filled by copy_gbuffer_depth_stencil
+    GpuTimer lighting_timers[LightingMode_Count];
+
+    DrawMode draw_mode;
+
+    RenderQueue queue;
+    IVec2 window_size;
+
+    bool copy_depth;
+    IVec2 orbits_count;
+
+    // Bulk spawning to find where the per-object CPU costs break down
+    int stress_objects_count;
+    double stress_spawn_ms;
+    double stress_build_ms;
+    double cull_ms;
+    double submit_ms;
+    double queue_execute_ms;
+} GraphicsScene;
+
+static struct scene_object* get_scene_object(const GraphicsScene* s,
+                                             int index)
+{
+    return (struct scene_object*)pool_at(&s->scene_objects, index);
+}
+
+static LightSource* get_light_source(const GraphicsScene* s, int index)
+{
+    return (LightSource*)pool_at(&s->light_sources, index);
+}
+
+// Objects point into the per-model arrays, which are sized once for the
+// files found and live in the arena as long as the scene
+static void alloc_models(GraphicsScene* s, int cap)
+{
+    s->models_cap = cap;
+    s->model_file_paths = ARENA_PUSH_ARRAY(s->arena, ModelFilePath, cap);
+    s->model_meshes = ARENA_PUSH_ARRAY(s->arena, Mesh, cap);
+    s->model_vbs = ARENA_PUSH_ARRAY(s->arena, VertexBuffer, cap);
+    s->model_rt_bvhs = ARENA_PUSH_ARRAY(s->arena, RtMeshBvh, cap);
+    s->model_aabbs = ARENA_PUSH_ARRAY(s->arena, struct aabb, cap);
+    s->model_bspheres = ARENA_PUSH_ARRAY(s->arena, struct bsphere, cap);
+    s->model_obbs = ARENA_PUSH_ARRAY(s->arena, struct obb, cap);
+    s->model_kdops = ARENA_PUSH_ARRAY(s->arena, struct kdop, cap);
+    s->model_hulls = ARENA_PUSH_ARRAY(s->arena, Mesh, cap);
+    s->model_hull_vbs = ARENA_PUSH_ARRAY(s->arena, VertexBuffer, cap);
+    s->model_half_edges = ARENA_PUSH_ARRAY(s->arena, MeshHalfEdges, cap);
+    s->model_group_offsets = ARENA_PUSH_ARRAY(s->arena, int, cap + 1);
+    s->model_group_cursors = ARENA_PUSH_ARRAY(s->arena, int, cap);
+}
+
+static void set_scene_object_model(GraphicsScene* s,
+                                   struct scene_object* o,
+                                   int model_index)
+{
+    ASSERT(model_index >= 0 && model_index < s->models_count);
+    o->model = model_index;
+    o->mesh = &s->model_meshes[model_index];
+    o->vb = &s->model_vbs[model_index];
+    o->model_aabb = &s->model_aabbs[model_index];
+    o->model_bsphere = &s->model_bspheres[model_index];
+    o->model_obb = &s->model_obbs[model_index];
+    o->model_kdop = &s->model_kdops[model_index];
+}
+
+// Growing the pool moves the objects, so the tree leaves are pointed at the
+// new addresses. The per-frame scratch follows the pool capacity.
+static void reserve_scene_objects(GraphicsScene* s, int count)
+{
+    Pool* pool = &s->scene_objects;
+    if (pool_reserve(pool, count))
+    {
+        for (int i = 0; i < pool->count; i++)
+        {
+            struct scene_object* o = get_scene_object(s, i);
+            for (int j = 0; j < bv_type_count; j++)
+            {
+                if (o->leaves[j])
+                    o->leaves[j]->scene_object = o;
+            }
+        }
+    }
+
+    if (s->object_scratch_cap < pool->cap)
+    {
+        int cap = pool->cap;
+        s->visible_object_indices = (int*)mem_realloc(
+            MemTag_Misc, s->visible_object_indices, cap * sizeof(int));
+        s->visible_objects = (struct scene_object**)mem_realloc(
+            MemTag_Misc, s->visible_objects,
+            cap * sizeof(struct scene_object*));
+        s->occlusion_objects = (OcclusionObject*)mem_realloc(
+            MemTag_Misc, s->occlusion_objects, cap * sizeof(OcclusionObject));
+        s->object_scratch_cap = cap;
+    }
+}
+
+static struct scene_object* push_scene_object(GraphicsScene* s)
+{
+    reserve_scene_objects(s, s->scene_objects.count + 1);
+    pool_add(&s->scene_objects);
+    return get_scene_object(s, s->scene_objects.count - 1);
+}
+
+// Lights are placed and colored by their index every frame, so only the
+// count changes here
+static void set_light_sources_count(GraphicsScene* s, int count)
+{
+    Pool* pool = &s->light_sources;
+    pool_reserve(pool, count);
+    while (pool->count < count)
+        pool_add(pool);
+    while (pool->count > count)
+        pool_remove(pool, pool->count - 1);
+
+    if (s->point_lights_cap < pool->cap)
+    {
+        s->point_lights = (ExamplePhongLight*)mem_realloc(
+            MemTag_Misc, s->point_lights,
+            pool->cap * sizeof(ExamplePhongLight));
+        s->point_lights_cap = pool->cap;
+    }
+}
+
+static void collect_object_leaves_rec(struct node* tree, enum bv_type type)
+{
+    if (tree->type == node_type_leaf)
+    {
+        tree->scene_object->leaves[type] = tree;
+    }
+    else
+    {
+        collect_object_leaves_rec(tree->left, type);
+        collect_object_leaves_rec(tree->right, type);
+    }
+}
+
+// The debug trees are the object trees in bottom-up mode
+static void update_flat_bvh(GraphicsScene* s)
+{
+    for (int i = 0; i < bv_type_count; i++)
+    {
+        flat_bvh_from_tree(&s->object_flat_bvh[i], s->object_bvh[i],
+                           POOL_ITEMS(&s->scene_objects, struct scene_object),
+                           NULL);
+    }
+    for (int i = 0; i < bv_type_count; i++)
+    {
+        flat_bvh_from_tree(&s->debug_flat_bvh[i],
+                           (s->bvh_type == 0) ? s->object_bvh[i]
+                                              : s->point_bvh[i],
+                           POOL_ITEMS(&s->scene_objects, struct scene_object),
+                           s->scene_points);
+    }
+    s->kdop_lines_dirty = true;
+}
+
+// Only for object trees whose leaves were refit. A tree that was rotated on
+// the way is converted again, the others are refit in place.
+static void refit_object_flat_bvhs(GraphicsScene* s, const bool* rotated)
+{
+    struct scene_object* objects =
+        POOL_ITEMS(&s->scene_objects, struct scene_object);
+    for (int i = 0; i < bv_type_count; i++)
+    {
+        struct flat_bvh* flat_bvhs[2] = {&s->object_flat_bvh[i],
+                                         &s->debug_flat_bvh[i]};
+        int flat_bvhs_count = (s->bvh_type == 0) ? 2 : 1;
+        for (int j = 0; j < flat_bvhs_count; j++)
+        {
+            if (rotated[i])
+            {
+                flat_bvh_from_tree(flat_bvhs[j], s->object_bvh[i], objects,
+                                   NULL);
+                continue;
+            }
+            flat_bvh_begin_refit(flat_bvhs[j]);
+            for (int k = 0; k < s->scene_objects.count; k++)
+                flat_bvh_refit_upwards(flat_bvhs[j], objects[k].leaves[i]);
+        }
+    }
+    if (s->bvh_type == 0)
+        s->kdop_lines_dirty = true;
+}
+
+// Point trees have no incremental path, so they are rebuilt whenever the
+// scene changes
+static void reconstruct_point_bvh(GraphicsScene* s)
+{
+    mem_free(s->scene_points);
+    s->scene_points = NULL;
+    for (int i = 0; i < bv_type_count; i++)
+    {
+        tree_cleanup(s->point_bvh[i]);
+        s->point_bvh[i] = NULL;
+    }
+
+    if (s->bvh_type == 0)
+    {
+        for (int i = 0; i < bv_type_count; i++)
+            calc_bvh_stats(s->object_bvh[i], &s->bvh_stats[i]);
+    }
+    else
+    {
+        create_point_cloud(POOL_ITEMS(&s->scene_objects, struct scene_object),
+                           s->scene_objects.count, &s->scene_points,
+                           &s->scene_points_count);
+        for (int i = 0; i < bv_type_count; i++)
+        {
+            if (s->bvh_type == 1)
+            {
+                top_down_bv_tree(&s->point_bvh[i], s->scene_points,
+                                 s->scene_points_count, (enum bv_type)i,
+                                 &s->top_down_params, &s->bvh_stats[i]);
+            }
+            else
+            {
+                lbvh_bv_tree(&s->point_bvh[i], s->scene_points,
+                             s->scene_points_count, (enum bv_type)i,
+                             &s->top_down_params, &s->lbvh_params,
+                             &s->bvh_stats[i]);
+            }
+        }
+    }
+    update_flat_bvh(s);
+}
+
+// The viewer keeps its own copy of the cloud, reordered by the octree
+static void rebuild_point_viewer(GraphicsScene* s)
+{
+    struct point_viewer* v = &s->point_viewer;
+    double start_ms = a_get_time_ms();
+
+    float* points = NULL;
+    int points_count = 0;
+    create_point_cloud(POOL_ITEMS(&s->scene_objects, struct scene_object),
+                       s->scene_objects.count, &points, &points_count);
+    octree_build(&v->octree, points, points_count);
+    mem_free(points);
+
+    v->build_ms = a_get_time_ms() - start_ms;
+
+    // Everything resident belonged to the old tree
+    v->node_slots = (int*)mem_realloc(MemTag_Misc, v->node_slots,
+                                      v->octree.nodes_count * sizeof(int));
+    for (int i = 0; i < v->octree.nodes_count; i++)
+        v->node_slots[i] = -1;
+    for (int i = 0; i < POINT_VIEWER_SLOTS_COUNT; i++)
+    {
+        v->slot_nodes[i] = -1;
+        v->slot_frames[i] = 0;
+    }
+    v->selected_count = 0;
+}
+
+static void calc_object_box(const struct scene_object* o,
+                            float* min_bound,
+                            float* max_bound)
+{
+    struct bvolume bv = calc_object_bvolume(o, bv_type_aabb);
+    for (int i = 0; i < 3; i++)
+    {
+        min_bound[i] = bv.aabb.c[i] - bv.aabb.r[i];
+        max_bound[i] = bv.aabb.c[i] + bv.aabb.r[i];
+    }
+}
+
+static void count_grid_pairs(GraphicsScene* s)
+{
+    s->grid_pairs_count = grid_find_pairs(&s->object_grid, NULL, 0);
+}
+
+// The cell size follows the objects, so it's only derived again on rebuilds
+static void rebuild_object_grid(GraphicsScene* s)
+{
+    int count = s->scene_objects.count;
+    float(*mins)[3] =
+        (float(*)[3])mem_alloc(MemTag_Misc, count * sizeof(float[3]));
+    float(*maxs)[3] =
+        (float(*)[3])mem_alloc(MemTag_Misc, count * sizeof(float[3]));
+    for (int i = 0; i < count; i++)
+        calc_object_box(get_scene_object(s, i), mins[i], maxs[i]);
+
+    grid_cleanup(&s->object_grid);
+    grid_init(&s->object_grid, grid_calc_cell_size(mins, maxs, count),
+              s->scene_objects.cap);
+    for (int i = 0; i < count; i++)
+        grid_insert(&s->object_grid, i, mins[i], maxs[i]);
+    count_grid_pairs(s);
+
+    mem_free(maxs);
+    mem_free(mins);
+}
+
+static void reconstruct_bvh(GraphicsScene* s)
+{
+    transform_store_update(&s->transforms);
+    for (int i = 0; i < bv_type_count; i++)
+    {
+        double start_ms = a_get_time_ms();
+        tree_cleanup(s->object_bvh[i]);
+        s->object_bvh[i] = bottom_up_bv_tree(
+            POOL_ITEMS(&s->scene_objects, struct scene_object),
+            s->scene_objects.count, (enum bv_type)i);
+        collect_object_leaves_rec(s->object_bvh[i], (enum bv_type)i);
+        s->bvh_stats[i].build_ms = a_get_time_ms() - start_ms;
+    }
+    rebuild_object_grid(s);
+    reconstruct_point_bvh(s);
+    if (s->point_viewer.enabled)
+        rebuild_point_viewer(s);
+}
+
+// Mean of the longest box edge over all models
+static float calc_mean_model_size(const GraphicsScene* s)
+{
+    float model_size = 0;
+    for (int i = 0; i < s->models_count; i++)
+    {
+        const float* r = s->model_aabbs[i].r;
+        model_size += 2.f * fmaxf(r[0], fmaxf(r[1], r[2])) /
+                      (float)s->models_count;
+    }
+    return model_size;
+}
+
+// Half the edge of a cube holding count random models at the density of a
+// uniform scene
+static float calc_scatter_half_size(const GraphicsScene* s, int count)
+{
+    return calc_mean_model_size(s) * cbrtf((float)count) * 0.75f;
+}
+
+// A random model with a random yaw, the position is left to the caller
+static struct scene_object* push_random_scene_object(GraphicsScene* s)
+{
+    int index = s->scene_objects.count;
+    struct scene_object* o = push_scene_object(s);
+    set_scene_object_model(s, o, rand() % s->models_count);
+    o->transforms = &s->transforms;
+    o->transform = transform_store_add(&s->transforms, -1);
+    ASSERT(o->transform == index);
+    Quat rot = quat_rotate((FVec3){0, 1, 0}, (float)(rand() % 360));
+    transform_store_set_rot(&s->transforms, o->transform, rot);
+    return o;
+}
+
+static void add_random_scene_object(GraphicsScene* s)
+{
+    int index = s->scene_objects.count;
+    struct scene_object* o = push_random_scene_object(s);
+
+    // Placement tooling stand-in: retry spots until the box is clear
+    float min_bound[3];
+    float max_bound[3];
+    for (int attempt = 0; attempt < PLACEMENT_MAX_ATTEMPTS; attempt++)
+    {
+        FVec3 pos = {
+            (rand() % 25 - 12) * 0.1f,
+            (rand() % 25 - 12) * 0.1f,
+            (rand() % 25 - 12) * 0.1f,
+        };
+        transform_store_set_pos(&s->transforms, o->transform, pos);
+        transform_store_update(&s->transforms);
+        calc_object_box(o, min_bound, max_bound);
+        if (!s->place_without_overlaps ||
+            grid_query(&s->object_grid, min_bound, max_bound, NULL, 0) == 0)
+        {
+            break;
+        }
+    }
+    o->origin = transform_store_get_pos(&s->transforms, o->transform);
+
+    double start_ms = a_get_time_ms();
+    for (int i = 0; i < bv_type_count; i++)
+        o->leaves[i] = bvh_insert(&s->object_bvh[i], o, (enum bv_type)i);
+    s->bvh_update_ms = a_get_time_ms() - start_ms;
+
+    start_ms = a_get_time_ms();
+    if (s->object_grid.buckets_count == 0)
+    {
+        rebuild_object_grid(s);
+    }
+    else
+    {
+        grid_insert(&s->object_grid, index, min_bound, max_bound);
+        count_grid_pairs(s);
+    }
+    s->grid_update_ms = a_get_time_ms() - start_ms;
+
+    reconstruct_point_bvh(s);
+}
+
+// Swap-removes the object, so the last object's leaves are moved over
+static void remove_scene_object(GraphicsScene* s, int index)
+{
+    ASSERT(index >= 0 && index < s->scene_objects.count);
+    int last = s->scene_objects.count - 1;
+    struct scene_object* o = get_scene_object(s, index);
+
+    double start_ms = a_get_time_ms();
+    for (int i = 0; i < bv_type_count; i++)
+        bvh_remove(&s->object_bvh[i], o->leaves[i]);
+    s->bvh_update_ms = a_get_time_ms() - start_ms;
+
+    start_ms = a_get_time_ms();
+    grid_remove(&s->object_grid, index);
+    if (index != last)
+    {
+        float min_bound[3];
+        float max_bound[3];
+        calc_object_box(get_scene_object(s, last), min_bound, max_bound);
+        grid_remove(&s->object_grid, last);
+        grid_insert(&s->object_grid, index, min_bound, max_bound);
+    }
+    count_grid_pairs(s);
+    s->grid_update_ms = a_get_time_ms() - start_ms;
+
+    // Handles to the removed object go stale, the moved one keeps its own
+    pool_remove(&s->scene_objects, index);
+    transform_store_remove_swap(&s->transforms, index);
+    if (index != last)
+    {
+        o->transform = index;
+        for (int i = 0; i < bv_type_count; i++)
+            o->leaves[i]->scene_object = o;
+    }
+
+    reconstruct_point_bvh(s);
+}
+
+// Bulk adds skip the per-object inserts and build every tree once after.
+// Point trees and the viewer copy every vertex of every object, which
+// doesn't fit at these counts, so they're switched off.
+static void spawn_stress_objects(GraphicsScene* s, int count)
+{
+    double start_ms = a_get_time_ms();
+    int total = s->scene_objects.count + count;
+    reserve_scene_objects(s, total);
+    float half_size = calc_scatter_half_size(s, total);
+    for (int i = 0; i < count; i++)
+    {
+        struct scene_object* o = push_random_scene_object(s);
+        float pos[3];
+        for (int j = 0; j < 3; j++)
+            pos[j] = ((float)rand() / RAND_MAX * 2.f - 1.f) * half_size;
+        o->origin = (FVec3){pos[0], pos[1], pos[2]};
+        transform_store_set_pos(&s->transforms, o->transform, o->origin);
+    }
+    s->stress_spawn_ms = a_get_time_ms() - start_ms;
+
+    start_ms = a_get_time_ms();
+    s->bvh_type = 0;
+    s->point_viewer.enabled = false;
+    reconstruct_bvh(s);
+    s->stress_build_ms = a_get_time_ms() - start_ms;
+}
+
+// Drops objects from the back, nothing gets moved
+static void truncate_scene_objects(GraphicsScene* s, int count)
+{
+    ASSERT(count > 0);
+    while (s->scene_objects.count > count)
+    {
+        int last = s->scene_objects.count - 1;
+        pool_remove(&s->scene_objects, last);
+        transform_store_remove_swap(&s->transforms, last);
+    }
+    reconstruct_bvh(s);
+}
+
+// Bobs every object around its origin, see refit_moved_objects
+static void animate_scene_objects(GraphicsScene* s)
+{
+    for (int i = 0; i < s->scene_objects.count; i++)
+    {
+        const struct scene_object* o = get_scene_object(s, i);
+        FVec3 offset = {
+            0.3f * sinf(s->t * 0.7f + (float)i),
+            0.3f * sinf(s->t * 1.1f + (float)i * 1.7f),
+            0,
+        };
+        transform_store_set_pos(&s->transforms, o->transform,
+                                fvec3_add(o->origin, offset));
+    }
+}
+
+// Refits only the leaves of moved objects, reading the world matrices of the
+// transform store, so it runs after transform_store_update
+static void refit_moved_objects(GraphicsScene* s)
+{
+    double start_ms = a_get_time_ms();
+    bool rotated[bv_type_count] = {0};
+    for (int i = 0; i < s->scene_objects.count; i++)
+    {
+        const struct scene_object* o = get_scene_object(s, i);
+        for (int j = 0; j < bv_type_count; j++)
+        {
+            if (bvh_refit(o->leaves[j]))
+                rotated[j] = true;
+        }
+    }
+    refit_object_flat_bvhs(s, rotated);
+    s->bvh_update_ms = a_get_time_ms() - start_ms;
+
+    start_ms = a_get_time_ms();
+    for (int i = 0; i < s->scene_objects.count; i++)
+    {
+        float min_bound[3];
+        float max_bound[3];
+        calc_object_box(get_scene_object(s, i), min_bound, max_bound);
+        grid_move(&s->object_grid, i, min_bound, max_bound);
+    }
+    count_grid_pairs(s);
+    s->grid_update_ms = a_get_time_ms() - start_ms;
+
+    if (s->bvh_type == 0)
+    {
+        for (int i = 0; i < bv_type_count; i++)
+            calc_bvh_stats(s->object_bvh[i], &s->bvh_stats[i]);
+    }
+}
+
+// Scatters copies of the models at the density of a uniform scene and
+// compares the grid against the object BVHs on the same pair and box queries.
+// BVH pairs are counted on their own volumes, so tighter types report fewer.
+static void run_broadphase_bench(GraphicsScene* s)
+{
+    int count = s->broadphase_bench_objects_count;
+    struct scene_object* objects =
+        (struct scene_object*)mem_alloc(MemTag_Misc, count * sizeof(*objects));
+    struct transform_store transforms = {0};
+    float(*mins)[3] =
+        (float(*)[3])mem_alloc(MemTag_Misc, count * sizeof(float[3]));
+    float(*maxs)[3] =
+        (float(*)[3])mem_alloc(MemTag_Misc, count * sizeof(float[3]));
+
+    float model_size = calc_mean_model_size(s);
+    float half_size = calc_scatter_half_size(s, count);
+    for (int i = 0; i < count; i++)
+    {
+        struct scene_object* o = &objects[i];
+        *o = (struct scene_object){
+            .transforms = &transforms,
+            .transform = transform_store_add(&transforms, -1),
+        };
+        set_scene_object_model(s, o, rand() % s->models_count);
+        float pos[3];
+        for (int j = 0; j < 3; j++)
+            pos[j] = ((float)rand() / RAND_MAX * 2.f - 1.f) * half_size;
+        transform_store_set_pos(&transforms, o->transform,
+                                (FVec3){pos[0], pos[1], pos[2]});
+    }
+    transform_store_update(&transforms);
+    for (int i = 0; i < count; i++)
+        calc_object_box(&objects[i], mins[i], maxs[i]);
+
+    float(*query_mins)[3] = (float(*)[3])mem_alloc(
+        MemTag_Misc, BROADPHASE_BENCH_QUERIES_COUNT * sizeof(float[3]));
+    float(*query_maxs)[3] = (float(*)[3])mem_alloc(
+        MemTag_Misc, BROADPHASE_BENCH_QUERIES_COUNT * sizeof(float[3]));
+    for (int i = 0; i < BROADPHASE_BENCH_QUERIES_COUNT; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            float c = ((float)rand() / RAND_MAX * 2.f - 1.f) * half_size;
+            query_mins[i][j] = c - model_size;
+            query_maxs[i][j] = c + model_size;
+        }
+    }
+
+    struct broadphase_bench* bench = &s->broadphase_bench[0];
+    *bench = (struct broadphase_bench){0};
+    double start_ms = a_get_time_ms();
+    struct spatial_grid grid;
+    grid_init(&grid, grid_calc_cell_size(mins, maxs, count), count);
+    for (int i = 0; i < count; i++)
+        grid_insert(&grid, i, mins[i], maxs[i]);
+    bench->build_ms = a_get_time_ms() - start_ms;
+
+    start_ms = a_get_time_ms();
+    bench->pairs_count = grid_find_pairs(&grid, NULL, 0);
+    bench->pairs_ms = a_get_time_ms() - start_ms;
+
+    start_ms = a_get_time_ms();
+    for (int i = 0; i < BROADPHASE_BENCH_QUERIES_COUNT; i++)
+    {
+        bench->query_hits +=
+            grid_query(&grid, query_mins[i], query_maxs[i], NULL, 0);
+    }
+    bench->queries_ms = a_get_time_ms() - start_ms;
+    grid_cleanup(&grid);
+
+    for (int type = 0; type < bv_type_count; type++)
+    {
+        bench = &s->broadphase_bench[1 + type];
+        *bench = (struct broadphase_bench){0};
+        start_ms = a_get_time_ms();
+        struct node* tree =
+            bottom_up_bv_tree(objects, count, (enum bv_type)type);
+        struct flat_bvh bvh = {0};
+        flat_bvh_from_tree(&bvh, tree, objects, NULL);
+        bench->build_ms = a_get_time_ms() - start_ms;
+
+        // Every object overlaps itself, and every pair is found twice
+        start_ms = a_get_time_ms();
+        for (int i = 0; i < count; i++)
+        {
+            struct bvolume bv =
+                calc_object_bvolume(&objects[i], (enum bv_type)type);
+            bench->pairs_count += flat_bvh_count_overlaps(&bvh, &bv) - 1;
+        }
+        bench->pairs_count /= 2;
+        bench->pairs_ms = a_get_time_ms() - start_ms;
+
+        start_ms = a_get_time_ms();
+        for (int i = 0; i < BROADPHASE_BENCH_QUERIES_COUNT; i++)
+        {
+            struct bvolume bv = bvolume_from_bounds(
+                (enum bv_type)type, query_mins[i], query_maxs[i]);
+            bench->query_hits += flat_bvh_count_overlaps(&bvh, &bv);
+        }
+        bench->queries_ms = a_get_time_ms() - start_ms;
+
+        flat_bvh_cleanup(&bvh);
+        tree_cleanup(tree);
+    }
+
+    mem_free(query_maxs);
+    mem_free(query_mins);
+    mem_free(maxs);
+    mem_free(mins);
+    transform_store_cleanup(&transforms);
+    mem_free(objects);
+}
+
+static FILE_FOREACH_FN_DECL(count_model)
+{
+    ++*(int*)udata;
+}
+
+static FILE_FOREACH_FN_DECL(push_model)
+{
+    GraphicsScene* s = (GraphicsScene*)udata;
+    // Files that showed up after counting wait for the next load
+    if (s->models_count == s->models_cap)
+        return;
+    ModelFilePath* path = &s->model_file_paths[s->models_count];
+    path->abs_path_str = arena_push_str(s->arena, file_path->abs_path_str);
+    path->filename = path->abs_path_str +
+                     (file_path->filename - file_path->abs_path_str);
+    Mesh* mesh = &s->model_meshes[s->models_count];
+    rc_mesh_load_from_obj(mesh, path->abs_path_str);
     // Need to compute normals manually
     if (fvec3_length_sq(mesh->vertices[0].normal) == 0.f)
         rc_mesh_set_approximate_normals(mesh);
@@ -553,13 +3492,111 @@ static FILE_FOREACH_FN_DECL(push_model)
         v->pos = fvec3_mulf(v->pos, normalized_transform.scale);
         v->pos = fvec3_add(v->pos, normalized_transform.pos);
     }
+    rc_mesh_move_to_arena(mesh, s->arena);
 
-    VertexBuffer* vb = &s->model_vbs[s->models_count];
-    r_vb_init(vb, mesh, GL_TRIANGLES);
+    s->model_aabbs[s->models_count] =
+        calc_aabb((float*)&mesh->vertices[0].pos, mesh->vertices_count,
+                  0, sizeof(Vertex));
 
     ++s->models_count;
 }
 
+static JOB_FOR_FN_SIG(fit_model_bvolumes_job)
+{
+    GraphicsScene* s = (GraphicsScene*)udata;
+    for (int i = begin; i < end; i++)
+    {
+        float* positions = (float*)&s->model_meshes[i].vertices[0].pos;
+        int count = s->model_meshes[i].vertices_count;
+        s->model_bspheres[i] = calc_bsphere_fit(
+            s->top_down_params.sphere_fit, positions, count, 0, sizeof(Vertex));
+        s->model_obbs[i] = calc_obb(positions, count, 0, sizeof(Vertex));
+        s->model_kdops[i] = calc_kdop(26, positions, count, 0, sizeof(Vertex));
+    }
+}
+
+static void fit_model_bvolumes(GraphicsScene* s)
+{
+    double start_ms = a_get_time_ms();
+    j_parallel_for(s->models_count, 1, &fit_model_bvolumes_job, s);
+    s->model_fit_ms = a_get_time_ms() - start_ms;
+}
+
+static JOB_FOR_FN_SIG(build_model_hulls_job)
+{
+    GraphicsScene* s = (GraphicsScene*)udata;
+    for (int i = begin; i < end; i++)
+    {
+        rc_mesh_cleanup(&s->model_hulls[i]);
+        s->model_hulls[i] =
+            rc_mesh_convex_hull(&s->model_meshes[i], s->hull_max_vertices);
+    }
+}
+
+static void build_model_hulls(GraphicsScene* s)
+{
+    double start_ms = a_get_time_ms();
+    j_parallel_for(s->models_count, 1, &build_model_hulls_job, s);
+    s->hull_build_ms = a_get_time_ms() - start_ms;
+}
+
+static void upload_model_hull_vb(GraphicsScene* s, int i)
+{
+    if (s->model_hull_vbs[i].vao)
+        r_vb_cleanup(&s->model_hull_vbs[i]);
+    if (s->model_hulls[i].vertices_count > 0)
+        r_vb_init(&s->model_hull_vbs[i], &s->model_hulls[i], GL_TRIANGLES);
+}
+
+static void upload_model_hull_vbs(GraphicsScene* s)
+{
+    for (int i = 0; i < s->models_count; i++)
+        upload_model_hull_vb(s, i);
+}
+
+static void build_model_half_edges(GraphicsScene* s)
+{
+    double start_ms = a_get_time_ms();
+    for (int i = 0; i < s->models_count; i++)
+    {
+        rc_mesh_half_edges_build(&s->model_half_edges[i],
+                                 &s->model_meshes[i]);
+    }
+    s->half_edges_build_ms = a_get_time_ms() - start_ms;
+}
+
+// Signed tetrahedra against the origin, the mesh has to be closed
+static float calc_mesh_volume(const Mesh* mesh)
+{
+    float result = 0;
+    for (int i = 0; i < mesh->indices_count; i += 3)
+    {
+        FVec3 a = mesh->vertices[mesh->indices[i]].pos;
+        FVec3 b = mesh->vertices[mesh->indices[i + 1]].pos;
+        FVec3 c = mesh->vertices[mesh->indices[i + 2]].pos;
+        result += fvec3_dot(a, fvec3_cross(b, c)) / 6.f;
+    }
+    return result;
+}
+
+static JOB_FOR_FN_SIG(build_model_rt_bvhs)
+{
+    GraphicsScene* s = (GraphicsScene*)udata;
+    for (int i = begin; i < end; i++)
+        rt_mesh_bvh_build(&s->model_rt_bvhs[i], &s->model_meshes[i]);
+}
+
+// The jobs build on the heap, the arena is only pushed to from one thread.
+// Hulls stay on the heap, they are rebuilt when their vertex limit changes.
+static void move_model_data_to_arena(GraphicsScene* s)
+{
+    for (int i = 0; i < s->models_count; i++)
+    {
+        rt_mesh_bvh_move_to_arena(&s->model_rt_bvhs[i], s->arena);
+        rc_mesh_half_edges_move_to_arena(&s->model_half_edges[i], s->arena);
+    }
+}
+
 #if 0
 static void try_switch_model(GraphicsScene* s, int new_model_index)
 {
@@ -576,21 +3613,46 @@ static void try_switch_model(GraphicsScene* s, int new_model_index)
                     .scale = {s->model_scale, s->model_scale, s->model_scale},
                 },
         }};
-        free(s->scene_points);
-        tree_cleanup(s->bvh_aabb);
-        tree_cleanup(s->bvh_sphere);
+        mem_free(s->scene_points);
         create_point_cloud(scene_objects, ARRAY_LENGTH(scene_objects),
                            &s->scene_points, &s->scene_points_count);
-        top_down_bv_tree(&s->bvh_aabb, s->scene_points, s->scene_points_count,
-                         bv_type_aabb);
-        top_down_bv_tree(&s->bvh_sphere, s->scene_points, s->scene_points_count,
-                         bv_type_sphere);
+        for (int i = 0; i < bv_type_count; i++)
+        {
+            tree_cleanup(s->point_bvh[i]);
+            top_down_bv_tree(&s->point_bvh[i], s->scene_points,
+                             s->scene_points_count, (enum bv_type)i,
+                             &s->top_down_params, &s->bvh_stats[i]);
+        }
 
         s->current_model_index = new_model_index;
     }
 }
 #endif
 
+// Last frame's visibility is lost, so everything counts as visible once
+static void resize_occlusion_buffers(GraphicsScene* s, int cap)
+{
+    r_state_bind_buffer(GL_SHADER_STORAGE_BUFFER, s->occlusion_objects_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, 16 + cap * sizeof(OcclusionObject),
+                 NULL, GL_DYNAMIC_DRAW);
+
+    uint32_t* visibility =
+        (uint32_t*)mem_alloc(MemTag_Misc, cap * sizeof(uint32_t));
+    for (int i = 0; i < cap; i++)
+        visibility[i] = 1;
+    r_state_bind_buffer(GL_SHADER_STORAGE_BUFFER,
+                        s->occlusion_visibility_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, cap * sizeof(uint32_t), visibility,
+                 GL_DYNAMIC_COPY);
+    mem_free(visibility);
+
+    r_state_bind_buffer(GL_SHADER_STORAGE_BUFFER, s->occlusion_commands_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER,
+                 2 * cap * sizeof(DrawElementsIndirectCommand), NULL,
+                 GL_DYNAMIC_COPY);
+    s->occlusion_buffers_cap = cap;
+}
+
 static float get_channel_function1(float x, float period)
 {
     float coeff = (HIMATH_PI * 2.f) / period;
@@ -606,9 +3668,9 @@ static float get_channel_function2(float x, float period)
 static void update_light_colors(GraphicsScene* s)
 {
     // Smoothly interpolate from red to green to blue
-    for (int i = 0; i < s->light_sources_count; i++)
+    for (int i = 0; i < s->light_sources.count; i++)
     {
-        float period = (float)(s->light_sources_count - 1) * 0.666666f;
+        float period = (float)(s->light_sources.count - 1) * 0.666666f;
 
         float rx1 = HIMATH_CLAMP((float)i, 0, period * 0.5f);
         float rx2 = HIMATH_CLAMP((float)i, period, period * 1.5f);
@@ -620,50 +3682,141 @@ static void update_light_colors(GraphicsScene* s)
         float g = get_channel_function2(gx, period);
         float b = get_channel_function1(bx, period);
 
-        s->light_sources[i].color.x = r * s->light_intensity;
-        s->light_sources[i].color.y = g * s->light_intensity;
-        s->light_sources[i].color.z = b * s->light_intensity;
+        get_light_source(s, i)->color.x = r * s->light_intensity;
+        get_light_source(s, i)->color.y = g * s->light_intensity;
+        get_light_source(s, i)->color.z = b * s->light_intensity;
+    }
+}
+
+// Light volumes are tested against the G-buffer depth and stencil, but the
+// lighting shaders sample the G-buffer depth in the compact layout. Attaching
+// that texture to the light buffer as well would be a feedback loop, so the
+// light buffer gets its own copy before the volumes are drawn.
+static void copy_gbuffer_depth_stencil(const GraphicsScene* s)
+{
+    r_state_bind_framebuffer(GL_READ_FRAMEBUFFER, s->gbuffer.framebuffer);
+    r_state_bind_framebuffer(GL_DRAW_FRAMEBUFFER, s->light_framebuffer);
+    glBlitFramebuffer(0, 0, s->gbuffer.dim.x, s->gbuffer.dim.y, 0, 0,
+                      s->gbuffer.dim.x, s->gbuffer.dim.y,
+                      GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+}
+
+static void switch_gbuffer_layout(GraphicsScene* s, GBufferLayout layout)
+{
+    IVec2 dim = s->gbuffer.dim;
+    gbuffer_cleanup(&s->gbuffer);
+    gbuffer_init(&s->gbuffer, dim, layout);
+}
+
+typedef struct ShaderSource_
+{
+    uint* shader;
+    const char* name;
+    const char* variant; // NULL for the shader without a variant
+    bool is_compute;
+} ShaderSource;
+
+// In the order activate builds them
+static void get_shader_sources(GraphicsScene* s, ShaderSource* sources)
+{
+    int n = 0;
+    sources[n++] = (ShaderSource){&s->model_shader, "phong"};
+    sources[n++] = (ShaderSource){&s->normal_debug_shader, "visualize_normals"};
+    sources[n++] = (ShaderSource){&s->light_source_shader, "light_source"};
+    sources[n++] = (ShaderSource){&s->fsq_shader, "fsq"};
+    for (int i = 0; i < GBufferLayout_Count; i++)
+    {
+        const char* variant = gbuffer_layout_variants[i];
+        sources[n++] = (ShaderSource){&s->deferred_first_pass_shaders[i],
+                                      "phong_deferred_first_pass", variant};
+        sources[n++] = (ShaderSource){&s->deferred_second_pass_shaders[i],
+                                      "phong_deferred_second_pass", variant};
+        sources[n++] = (ShaderSource){&s->deferred_directional_shaders[i],
+                                      "phong_deferred_directional", variant};
+        sources[n++] = (ShaderSource){&s->light_volume_shaders[i],
+                                      "phong_deferred_light_volume", variant};
+        sources[n++] =
+            (ShaderSource){&s->first_pass_indirect_shaders[i],
+                           "phong_deferred_first_pass_indirect", variant};
+    }
+    sources[n++] =
+        (ShaderSource){&s->light_culling_shader, "light_culling", NULL, true};
+    sources[n++] =
+        (ShaderSource){&s->depth_pyramid_shader, "depth_pyramid", NULL, true};
+    sources[n++] = (ShaderSource){&s->occlusion_cull_shaders[0],
+                                  "occlusion_cull", "occlusion_phase1", true};
+    sources[n++] = (ShaderSource){&s->occlusion_cull_shaders[1],
+                                  "occlusion_cull", "occlusion_phase2", true};
+    ASSERT(n == GRAPHICS_SHADERS_COUNT);
+}
+
+static void read_shader_sources(Example* e, GraphicsScene* s)
+{
+    ShaderSource sources[GRAPHICS_SHADERS_COUNT];
+    get_shader_sources(s, sources);
+    for (int i = 0; i < GRAPHICS_SHADERS_COUNT; i++)
+    {
+        const ShaderSource* source = &sources[i];
+        s->shader_texts[i] =
+            source->is_compute
+                ? e_compute_shader_read_variant(e, source->name,
+                                                source->variant)
+                : e_shader_read_variant(e, source->name, source->variant);
     }
 }
 
-EXAMPLE_INIT_FN_SIG(graphics)
+// Everything that doesn't need the GL context, run on a worker when the
+// scene is switched to in the background
+EXAMPLE_PREPARE_FN_SIG(graphics)
 {
-    Example* e = e_example_make("graphics", GraphicsScene);
+    Example* e = e_example_alloc("graphics", GraphicsScene);
     GraphicsScene* s = (GraphicsScene*)e->scene;
+    s->arena = &e->arena;
 
     Path model_root_path = fs_path_make_working_dir();
     fs_path_append2(&model_root_path, "shared", "models");
+    int model_files_count = 0;
+    fs_for_each_files_with_ext(model_root_path, "obj", &count_model,
+                               &model_files_count);
+    alloc_models(s, model_files_count);
     fs_for_each_files_with_ext(model_root_path, "obj", &push_model, s);
     fs_path_cleanup(&model_root_path);
-
-    s->model_shader = e_shader_load(e, "phong");
-    s->normal_debug_shader = e_shader_load(e, "visualize_normals");
+    j_parallel_for(s->models_count, 1, &build_model_rt_bvhs, s);
+    rt_scene_init(&s->rt_scene);
+    pool_init(&s->scene_objects, sizeof(struct scene_object));
+    pool_init(&s->light_sources, sizeof(LightSource));
+
+    s->top_down_params.leaf_size = 500;
+    s->top_down_params.max_depth = 24;
+    s->top_down_params.sphere_fit = bsphere_fit_epos14;
+    s->lbvh_params.treelet_passes = 1;
+    s->broadphase_bench_objects_count = 10000;
+    fit_model_bvolumes(s);
+    build_model_hulls(s);
+    build_model_half_edges(s);
+    move_model_data_to_arena(s);
+    read_shader_sources(e, s);
 
     add_random_scene_object(s);
-    s->scene_objects[0].mesh = &s->model_meshes[0];
-    s->scene_objects[0].vb = &s->model_vbs[0];
-    s->scene_objects[0].transform.scale.x = 1;
-    s->scene_objects[0].transform.scale.y = 1;
-    s->scene_objects[0].transform.scale.z = 1;
-    s->scene_objects_count = 1;
+    set_scene_object_model(s, get_scene_object(s, 0), 0);
+    s->stress_objects_count = 10000;
 
     s->aabb_mesh = rc_mesh_make_cube();
-    r_vb_init(&s->aabb_vb, &s->aabb_mesh, GL_TRIANGLES);
+    rc_mesh_move_to_arena(&s->aabb_mesh, s->arena);
     s->bsphere_mesh = rc_mesh_make_sphere(0.5f, 32, 32);
-    r_vb_init(&s->bsphere_vb, &s->bsphere_mesh, GL_TRIANGLES);
+    rc_mesh_move_to_arena(&s->bsphere_mesh, s->arena);
 
     reconstruct_bvh(s);
 
     s->light_source_mesh = rc_mesh_make_sphere(0.05f, 32, 32);
-    r_vb_init(&s->light_source_vb, &s->light_source_mesh, GL_TRIANGLES);
-    s->light_sources_count = 8;
+    rc_mesh_move_to_arena(&s->light_source_mesh, s->arena);
+    s->requested_light_sources_count = 8;
+    set_light_sources_count(s, s->requested_light_sources_count);
 
     s->light_intensity = 0.4f;
 
     update_light_colors(s);
 
-    s->light_source_shader = e_shader_load(e, "light_source");
-
     s->orbit_speed_deg = 30;
     s->orbit_radius = 1;
 
@@ -679,67 +3832,177 @@ EXAMPLE_INIT_FN_SIG(graphics)
     s->fsq_mesh =
         rc_mesh_make_raw2(ARRAY_LENGTH(fsq_vertices), ARRAY_LENGTH(fsq_indices),
                           fsq_vertices, fsq_indices);
-    r_vb_init(&s->fsq_vb, &s->fsq_mesh, GL_TRIANGLES);
-    s->fsq_shader = e_shader_load(e, "fsq");
+    rc_mesh_move_to_arena(&s->fsq_mesh, s->arena);
 
-    s->gbuffer.dim = input->window_size;
-    glGenFramebuffers(1, &s->gbuffer.framebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, s->gbuffer.framebuffer);
+    s->light_linear = 0.09f;
+    s->light_quadratic = 0.032f;
+    s->light_cutoff = 0.25f;
 
-    glGenTextures(1, &s->gbuffer.position_texture);
-    glBindTexture(GL_TEXTURE_2D, s->gbuffer.position_texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, s->gbuffer.dim.x,
-                 s->gbuffer.dim.y, 0, GL_RGB, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
-                           s->gbuffer.position_texture, 0);
+    struct point_viewer* v = &s->point_viewer;
+    v->color_by_depth = true;
+    v->points_budget = 1000000;
+    v->max_error = 2;
+    v->uploads_per_frame = 32;
 
-    glGenTextures(1, &s->gbuffer.normal_texture);
-    glBindTexture(GL_TEXTURE_2D, s->gbuffer.normal_texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, s->gbuffer.dim.x,
-                 s->gbuffer.dim.y, 0, GL_RGB, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D,
-                           s->gbuffer.normal_texture, 0);
+    s->copy_depth = true;
+    s->frustum_culling = true;
+    s->orbits_count.x = 1;
+    s->orbits_count.y = 1;
 
-    glGenTextures(1, &s->gbuffer.albedo_texture);
-    glBindTexture(GL_TEXTURE_2D, s->gbuffer.albedo_texture);
+    return e;
+}
+
+static void init_render_targets(Example* e, GraphicsScene* s, IVec2 dim)
+{
+    gbuffer_init(&s->gbuffer, dim, GBufferLayout_Full);
+    s->fsq_target_texture = s->gbuffer.position_texture;
+    for (int i = 0; i < GBufferLayout_Count; i++)
+        r_gpu_timer_init(&s->gbuffer_timers[i]);
+
+    glGenBuffers(1, &s->point_lights_buffer);
+
+    s->light_tiles_count.x =
+        (s->gbuffer.dim.x + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+    s->light_tiles_count.y =
+        (s->gbuffer.dim.y + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+    glGenBuffers(1, &s->light_tiles_buffer);
+    r_state_bind_buffer(GL_SHADER_STORAGE_BUFFER, s->light_tiles_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER,
+                 s->light_tiles_count.x * s->light_tiles_count.y *
+                     (MAX_LIGHTS_PER_TILE + 1) * sizeof(uint32_t),
+                 NULL, GL_DYNAMIC_COPY);
+
+    // Light volumes accumulate here, depth tested against a copy of the
+    // G-buffer depth, see copy_gbuffer_depth_stencil
+    glGenFramebuffers(1, &s->light_framebuffer);
+    r_state_bind_framebuffer(GL_FRAMEBUFFER, s->light_framebuffer);
+    glGenTextures(1, &s->light_texture);
+    r_state_bind_texture(0, GL_TEXTURE_2D, s->light_texture);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, s->gbuffer.dim.x,
                  s->gbuffer.dim.y, 0, GL_RGBA, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D,
-                           s->gbuffer.albedo_texture, 0);
-
-    uint attachments[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1,
-                          GL_COLOR_ATTACHMENT2};
-    glDrawBuffers(3, attachments);
-
-    glGenRenderbuffers(1, &s->gbuffer.depth_stencil_buffer);
-    glBindRenderbuffer(GL_RENDERBUFFER, s->gbuffer.depth_stencil_buffer);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8,
-                          s->gbuffer.dim.x, s->gbuffer.dim.y);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
-                              GL_RENDERBUFFER, s->gbuffer.depth_stencil_buffer);
-    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           s->light_texture, 0);
+    s->light_depth_stencil_texture = gbuffer_attach_texture(
+        s->gbuffer.dim, GL_DEPTH_STENCIL_ATTACHMENT, GL_DEPTH24_STENCIL8,
+        GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8);
+    r_state_bind_framebuffer(GL_FRAMEBUFFER, 0);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    for (int i = 0; i < LightingMode_Count; i++)
+        r_gpu_timer_init(&s->lighting_timers[i]);
 
-    s->fsq_target_texture = s->gbuffer.position_texture;
+    r_queue_init(&s->queue, e->per_object_ubo, sizeof(ExamplePerObjectUBO));
+    depth_pyramid_init(&s->depth_pyramid, s->gbuffer.dim);
+}
 
-    s->deferred_first_pass_shader =
-        e_shader_load(e, "phong_deferred_first_pass");
+static void init_point_viewer_buffer(struct point_viewer* v)
+{
+    glGenVertexArrays(1, &v->vao);
+    r_state_bind_vertex_array(v->vao);
+    glGenBuffers(1, &v->vbo);
+    r_state_bind_buffer(GL_ARRAY_BUFFER, v->vbo);
+    glBufferData(GL_ARRAY_BUFFER,
+                 POINT_VIEWER_SLOTS_COUNT * OCTREE_NODE_POINTS_CAP *
+                     sizeof(float[3]),
+                 NULL, GL_DYNAMIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float[3]),
+                          (GLvoid*)0);
+    r_state_bind_vertex_array(0);
+    r_state_bind_buffer(GL_ARRAY_BUFFER, 0);
+}
 
-    s->deferred_second_pass_shader =
-        e_shader_load(e, "phong_deferred_second_pass");
+// Creates the next item of the current step, true once the step is complete
+static bool activate_next_item(Example* e, GraphicsScene* s, const Input* input)
+{
+    switch (s->activate_step)
+    {
+    case ActivateStep_ModelVbs:
+        if (s->activate_items_done < s->models_count)
+        {
+            int i = s->activate_items_done++;
+            r_vb_init(&s->model_vbs[i], &s->model_meshes[i], GL_TRIANGLES);
+        }
+        return s->activate_items_done == s->models_count;
+    case ActivateStep_HullVbs:
+        if (s->activate_items_done < s->models_count)
+            upload_model_hull_vb(s, s->activate_items_done++);
+        return s->activate_items_done == s->models_count;
+    case ActivateStep_ShapeVbs:
+        r_vb_init(&s->aabb_vb, &s->aabb_mesh, GL_TRIANGLES);
+        r_vb_init(&s->bsphere_vb, &s->bsphere_mesh, GL_TRIANGLES);
+        r_vb_init(&s->light_source_vb, &s->light_source_mesh, GL_TRIANGLES);
+        r_vb_init(&s->fsq_vb, &s->fsq_mesh, GL_TRIANGLES);
+        return true;
+    case ActivateStep_Shaders:
+    {
+        int program = s->activate_items_done / (SHADER_STAGES_COUNT + 1);
+        int stage = s->activate_items_done % (SHADER_STAGES_COUNT + 1);
+        if (stage == 0)
+            s->shader_stages_compiled = true;
+        if (stage < SHADER_STAGES_COUNT)
+        {
+            if (!rc_shader_compile_stage(&s->shader_texts[program], stage,
+                                         &s->shader_stages[stage]))
+            {
+                s->shader_stages_compiled = false;
+            }
+        }
+        else
+        {
+            ShaderSource sources[GRAPHICS_SHADERS_COUNT];
+            get_shader_sources(s, sources);
+            *sources[program].shader = rc_shader_link_stages(
+                s->shader_stages, s->shader_stages_compiled);
+            rc_shader_text_cleanup(&s->shader_texts[program]);
+        }
+        ++s->activate_items_done;
+        return s->activate_items_done == GRAPHICS_SHADER_ITEMS_COUNT;
+    }
+    case ActivateStep_RenderTargets:
+        init_render_targets(e, s, input->window_size);
+        return true;
+    case ActivateStep_OcclusionBuffers:
+        glGenBuffers(1, &s->occlusion_objects_buffer);
+        glGenBuffers(1, &s->occlusion_visibility_buffer);
+        glGenBuffers(1, &s->occlusion_commands_buffer);
+        resize_occlusion_buffers(s, s->scene_objects.cap);
+        return true;
+    case ActivateStep_PointViewer:
+        init_point_viewer_buffer(&s->point_viewer);
+        return true;
+    default:
+        ASSERT(false);
+        return true;
+    }
+}
 
-    s->copy_depth = true;
-    s->orbits_count.x = 1;
-    s->orbits_count.y = 1;
+// Model and hull buffers go up one at a time and shaders are built one stage
+// or link at a time, the budget is checked after each of them and after every
+// other step
+EXAMPLE_ACTIVATE_FN_SIG(graphics)
+{
+    Example* e = (Example*)udata;
+    GraphicsScene* s = (GraphicsScene*)e->scene;
+    double start_ms = a_get_time_ms();
 
-    return e;
+    if (!e->per_frame_ubo)
+        e_example_init_gpu(e);
+    while (s->activate_step < ActivateStep_Done)
+    {
+        if (activate_next_item(e, s, input))
+        {
+            ++s->activate_step;
+            s->activate_items_done = 0;
+        }
+        if (s->activate_step < ActivateStep_Done &&
+            a_get_time_ms() - start_ms > budget_ms)
+        {
+            return false;
+        }
+    }
+    return true;
 }
 
 EXAMPLE_CLEANUP_FN_SIG(graphics)
@@ -747,70 +4010,176 @@ EXAMPLE_CLEANUP_FN_SIG(graphics)
     Example* e = (Example*)udata;
     GraphicsScene* s = (GraphicsScene*)e->scene;
 
-    glDeleteProgram(s->deferred_second_pass_shader);
-    glDeleteProgram(s->deferred_first_pass_shader);
-    glDeleteFramebuffers(1, &s->gbuffer.framebuffer);
-    glDeleteRenderbuffers(1, &s->gbuffer.depth_stencil_buffer);
-    glDeleteTextures(1, &s->gbuffer.albedo_texture);
-    glDeleteTextures(1, &s->gbuffer.normal_texture);
-    glDeleteTextures(1, &s->gbuffer.position_texture);
+    r_queue_cleanup(&s->queue);
+
+    // Left over when the activation didn't finish
+    for (int i = 0; i < SHADER_STAGES_COUNT; i++)
+        glDeleteShader(s->shader_stages[i]);
+    for (int i = 0; i < GRAPHICS_SHADERS_COUNT; i++)
+        rc_shader_text_cleanup(&s->shader_texts[i]);
+
+    r_state_delete_buffers(1, &s->occlusion_commands_buffer);
+    r_state_delete_buffers(1, &s->occlusion_visibility_buffer);
+    r_state_delete_buffers(1, &s->occlusion_objects_buffer);
+    depth_pyramid_cleanup(&s->depth_pyramid);
+    glDeleteProgram(s->occlusion_cull_shaders[1]);
+    glDeleteProgram(s->occlusion_cull_shaders[0]);
+    glDeleteProgram(s->depth_pyramid_shader);
+    for (int i = 0; i < GBufferLayout_Count; i++)
+        glDeleteProgram(s->first_pass_indirect_shaders[i]);
+
+    for (int i = 0; i < LightingMode_Count; i++)
+        r_gpu_timer_cleanup(&s->lighting_timers[i]);
+    r_state_delete_framebuffers(1, &s->light_framebuffer);
+    r_state_delete_textures(1, &s->light_depth_stencil_texture);
+    r_state_delete_textures(1, &s->light_texture);
+
+    r_state_delete_buffers(1, &s->light_tiles_buffer);
+    r_state_delete_buffers(1, &s->point_lights_buffer);
+    glDeleteProgram(s->light_culling_shader);
+
+    for (int i = 0; i < GBufferLayout_Count; i++)
+    {
+        r_gpu_timer_cleanup(&s->gbuffer_timers[i]);
+        glDeleteProgram(s->light_volume_shaders[i]);
+        glDeleteProgram(s->deferred_directional_shaders[i]);
+        glDeleteProgram(s->deferred_second_pass_shaders[i]);
+        glDeleteProgram(s->deferred_first_pass_shaders[i]);
+    }
+    gbuffer_cleanup(&s->gbuffer);
 
     glDeleteProgram(s->fsq_shader);
     r_vb_cleanup(&s->fsq_vb);
-    rc_mesh_cleanup(&s->fsq_mesh);
 
     glDeleteProgram(s->light_source_shader);
     r_vb_cleanup(&s->light_source_vb);
-    rc_mesh_cleanup(&s->light_source_mesh);
+    r_vb_cleanup(&s->bsphere_vb);
+    r_vb_cleanup(&s->aabb_vb);
 
-    free(s->scene_points);
-    tree_cleanup(s->bvh_aabb);
-    tree_cleanup(s->bvh_sphere);
+    mem_free(s->scene_points);
+    for (int i = 0; i < bv_type_count; i++)
+    {
+        tree_cleanup(s->point_bvh[i]);
+        tree_cleanup(s->object_bvh[i]);
+        flat_bvh_cleanup(&s->object_flat_bvh[i]);
+        flat_bvh_cleanup(&s->debug_flat_bvh[i]);
+    }
+    grid_cleanup(&s->object_grid);
+    transform_store_cleanup(&s->transforms);
+    r_state_delete_buffers(1, &s->point_viewer.vbo);
+    r_state_delete_vertex_arrays(1, &s->point_viewer.vao);
+    octree_cleanup(&s->point_viewer.octree);
+    mem_free(s->point_viewer.node_slots);
+    if (s->kdop_lines_vb.vao)
+        r_vb_cleanup(&s->kdop_lines_vb);
 
     glDeleteProgram(s->model_shader);
     glDeleteProgram(s->normal_debug_shader);
 
+    rt_scene_cleanup(&s->rt_scene);
     for (int i = 0; i < s->models_count; i++)
     {
+        if (s->model_hull_vbs[i].vao)
+            r_vb_cleanup(&s->model_hull_vbs[i]);
+        rc_mesh_cleanup(&s->model_hulls[i]);
         r_vb_cleanup(&s->model_vbs[i]);
-        rc_mesh_cleanup(&s->model_meshes[i]);
-        fs_path_cleanup(&s->model_file_paths[i]);
     }
-    free(e);
+
+    pool_cleanup(&s->scene_objects);
+    mem_free(s->visible_object_indices);
+    mem_free(s->visible_objects);
+    mem_free(s->occlusion_objects);
+    pool_cleanup(&s->light_sources);
+    mem_free(s->point_lights);
+    e_example_destroy(e);
 }
 
 static void update_light_source_transforms(GraphicsScene* s)
 {
-    for (int i = 0; i < s->light_sources_count; i++)
+    for (int i = 0; i < s->light_sources.count; i++)
     {
-        float deg = ((360.f / (float)s->light_sources_count) * (float)i +
+        float deg = ((360.f / (float)s->light_sources.count) * (float)i +
                      s->t * s->orbit_speed_deg);
         float rad = degtorad(deg);
         FVec3 pos = {
             .x = cosf(rad) * s->orbit_radius,
             .z = sinf(rad) * s->orbit_radius,
         };
-        s->light_sources[i].pos = pos;
+        get_light_source(s, i)->pos = pos;
     }
 }
 
-void prepare_per_frame(Example* e, const GraphicsScene* s, const Input* input)
+// Distance at which the brightest channel of a light falls below cutoff
+static float calc_light_radius(FVec3 color,
+                               float linear,
+                               float quadratic,
+                               float cutoff)
 {
+    float intensity = HIMATH_MAX(color.x, HIMATH_MAX(color.y, color.z));
+    if (intensity <= cutoff)
+        return 0.01f;
+
+    // Solve 1 + linear * d + quadratic * d^2 = intensity / cutoff
+    float c = 1.f - intensity / cutoff;
+    float result = 0;
+    if (quadratic > 0.f)
+    {
+        result = (-linear + sqrtf(linear * linear - 4.f * quadratic * c)) /
+                 (2.f * quadratic);
+    }
+    else if (linear > 0.f)
+    {
+        result = -c / linear;
+    }
+    else
+    {
+        result = 100.f;
+    }
+    return result;
+}
+
+static void upload_point_lights(GraphicsScene* s)
+{
+    for (int i = 0; i < s->light_sources.count; i++)
+    {
+        FVec3 color = get_light_source(s, i)->color;
+        ExamplePhongLight* light = &s->point_lights[i];
+        light->type = ExamplePhongLightType_Point;
+        light->pos_or_dir = get_light_source(s, i)->pos;
+        light->ambient = fvec3_mulf(color, 0.1f);
+        light->diffuse = color;
+        light->specular = color;
+        light->linear = s->light_linear;
+        light->quadratic = s->light_quadratic;
+        light->radius = calc_light_radius(color, s->light_linear,
+                                          s->light_quadratic, s->light_cutoff);
+    }
+
+    // std430 layout: the count is padded to the alignment of the light array
+    GLsizeiptr header_size = 16;
+    GLsizeiptr lights_size =
+        s->light_sources.count * sizeof(*s->point_lights);
+    uint32_t header[4] = {(uint32_t)s->light_sources.count};
+
+    r_state_bind_buffer(GL_SHADER_STORAGE_BUFFER, s->point_lights_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, header_size + lights_size, NULL,
+                 GL_STREAM_DRAW);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, header_size, header);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, header_size, lights_size,
+                    s->point_lights);
+    r_state_bind_buffer_base(GL_SHADER_STORAGE_BUFFER, 0,
+                             s->point_lights_buffer);
+}
+
+void prepare_per_frame(Example* e, GraphicsScene* s, const Input* input)
+{
+    upload_point_lights(s);
+
+    // Point lights live in the storage buffer, only the directional light
+    // goes through the per frame block
     ExamplePerFrameUBO per_frame = {0};
-    per_frame.phong_lights_count = s->light_sources_count + 1;
-    for (int i = 0; i < s->light_sources_count; i++)
-    {
-        FVec3 color = s->light_sources[i].color;
-        per_frame.phong_lights[i].type = ExamplePhongLightType_Point;
-        per_frame.phong_lights[i].pos_or_dir = s->light_sources[i].pos;
-        per_frame.phong_lights[i].ambient = fvec3_mulf(color, 0.1f);
-        per_frame.phong_lights[i].diffuse = color;
-        per_frame.phong_lights[i].specular = color;
-        per_frame.phong_lights[i].linear = 0.09f;
-        per_frame.phong_lights[i].quadratic = 0.032f;
-    }
-    ExamplePhongLight* dir_light =
-        &per_frame.phong_lights[s->light_sources_count];
+    per_frame.phong_lights_count = 1;
+    ExamplePhongLight* dir_light = &per_frame.phong_lights[0];
     dir_light->type = ExamplePhongLightType_Directional;
     dir_light->pos_or_dir = (FVec3){1, -1, -1};
     dir_light->ambient = (FVec3){0.3f, 0.3f, 0.3f};
@@ -825,109 +4194,659 @@ void prepare_per_frame(Example* e, const GraphicsScene* s, const Input* input)
         (FVec3){0, 1, 0});
     per_frame.view_pos = s->cam.pos;
     e_apply_per_frame_ubo(e, &per_frame);
+
+    s->view_proj = mat4_mul(&per_frame.proj, &per_frame.view);
 }
 
-static void draw_deferred_objects(Example* e, GraphicsScene* s)
+static void copy_depth_buffer(const GraphicsScene* s, IVec2 window_size)
+{
+    // Copy depth buffer written from deferred rendering pass
+    r_state_bind_framebuffer(GL_READ_FRAMEBUFFER, s->gbuffer.framebuffer);
+    r_state_bind_framebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, s->gbuffer.dim.x, s->gbuffer.dim.y, 0, 0,
+                      window_size.x, window_size.y, GL_DEPTH_BUFFER_BIT,
+                      GL_NEAREST);
+    r_state_bind_framebuffer(GL_READ_FRAMEBUFFER, 0);
+    r_state_bind_framebuffer(GL_DRAW_FRAMEBUFFER, 0);
+}
+
+static void resolve_light_buffer(const GraphicsScene* s, IVec2 window_size)
 {
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    r_state_bind_framebuffer(GL_READ_FRAMEBUFFER, s->light_framebuffer);
+    r_state_bind_framebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, s->gbuffer.dim.x, s->gbuffer.dim.y, 0, 0,
+                      window_size.x, window_size.y, GL_COLOR_BUFFER_BIT,
+                      GL_NEAREST);
+    r_state_bind_framebuffer(GL_READ_FRAMEBUFFER, 0);
+    r_state_bind_framebuffer(GL_DRAW_FRAMEBUFFER, 0);
+}
 
-    // First pass
-    glBindFramebuffer(GL_FRAMEBUFFER, s->gbuffer.framebuffer);
-    glClearColor(0, 0, 0, 0);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_BACK);
-    glFrontFace(GL_CCW);
+// Bins the point lights into screen tiles using the depth bounds of each tile
+static void cull_lights(const GraphicsScene* s)
+{
+    r_state_use_program(s->light_culling_shader);
+    r_state_bind_texture(0, GL_TEXTURE_2D, s->gbuffer.depth_stencil_texture);
+    r_state_bind_buffer_base(GL_SHADER_STORAGE_BUFFER, 1,
+                             s->light_tiles_buffer);
+    glDispatchCompute(s->light_tiles_count.x, s->light_tiles_count.y, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
 
-    glUseProgram(s->deferred_first_pass_shader);
-    for (int i = 0; i < s->scene_objects_count; i++)
+static void build_depth_pyramid(const GraphicsScene* s)
+{
+    const DepthPyramid* p = &s->depth_pyramid;
+    r_state_use_program(s->depth_pyramid_shader);
+    for (int i = 0; i < p->levels_count; i++)
     {
-        struct scene_object* o = &s->scene_objects[i];
-        struct transform* t = &o->transform;
-        ExamplePerObjectUBO per_object = {0};
-        Mat4 trans_mat = mat4_translation(t->pos);
-        Mat4 scale_mat = mat4_scalev(t->scale);
-        per_object.model = mat4_mul(&trans_mat, &scale_mat);
-        e_apply_per_object_ubo(e, &per_object);
-        r_vb_draw(o->vb);
+        uint source = (i == 0) ? s->gbuffer.depth_stencil_texture
+                               : p->level_views[i - 1];
+        r_state_bind_texture(0, GL_TEXTURE_2D, source);
+        glBindImageTexture(0, p->texture, i, GL_FALSE, 0, GL_WRITE_ONLY,
+                           GL_R32F);
+
+        int w = HIMATH_MAX(p->dim.x >> i, 1);
+        int h = HIMATH_MAX(p->dim.y >> i, 1);
+        glDispatchCompute((w + 7) / 8, (h + 7) / 8, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT |
+                        GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
     }
+}
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+// Phase 1 emits draws for what was visible last frame. Phase 2 tests every
+// object against the pyramid of the phase 1 depth and emits the ones that
+// just became visible, so nothing pops in a frame late.
+static void run_occlusion_culling(const GraphicsScene* s, int phase)
+{
+    if (s->occlusion_objects_count == 0)
+        return;
 
-    // Second pass
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    r_state_use_program(s->occlusion_cull_shaders[phase - 1]);
+    if (phase == 2)
+        r_state_bind_texture(0, GL_TEXTURE_2D, s->depth_pyramid.texture);
+    r_state_bind_buffer_base(GL_SHADER_STORAGE_BUFFER, 2,
+                             s->occlusion_objects_buffer);
+    r_state_bind_buffer_base(GL_SHADER_STORAGE_BUFFER, 3,
+                             s->occlusion_visibility_buffer);
+    r_state_bind_buffer_base(GL_SHADER_STORAGE_BUFFER, 4,
+                             s->occlusion_commands_buffer);
+    glDispatchCompute((s->occlusion_objects_count + 63) / 64, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
 
-    switch (s->draw_mode)
+static RENDER_PASS_FN_SIG(begin_graphics_pass)
+{
+    GraphicsScene* s = (GraphicsScene*)udata;
+
+    switch (pass)
     {
-    case DrawMode_FinalScene: {
-        uint textures[] = {
-            s->gbuffer.position_texture,
-            s->gbuffer.normal_texture,
-            s->gbuffer.albedo_texture,
-        };
-        glBindTextures(0, ARRAY_LENGTH(textures), textures);
-        glUseProgram(s->deferred_second_pass_shader);
-        r_vb_draw(&s->fsq_vb);
-    }
-    break;
-    case DrawMode_PositionMap:
-        glBindTextures(0, 1, &s->gbuffer.position_texture);
-        glUseProgram(s->fsq_shader);
-        r_vb_draw(&s->fsq_vb);
+    case GraphicsPass_GBuffer:
+        r_gpu_timer_begin(&s->gbuffer_timers[s->gbuffer.layout]);
+        r_state_polygon_mode(GL_FILL);
+        r_state_bind_framebuffer(GL_FRAMEBUFFER, s->gbuffer.framebuffer);
+        r_state_clear_color(0, 0, 0, 0);
+        r_state_depth_mask(true);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT |
+                GL_STENCIL_BUFFER_BIT);
+        r_state_set_enabled(GL_DEPTH_TEST, true);
+        r_state_set_enabled(GL_CULL_FACE, true);
+        r_state_cull_face(GL_BACK);
+        r_state_front_face(GL_CCW);
+        // Mark covered pixels so light volumes skip the background
+        r_state_set_enabled(GL_STENCIL_TEST, true);
+        r_state_stencil_func(GL_ALWAYS, 1, 0xFF);
+        r_state_stencil_op(GL_KEEP, GL_KEEP, GL_REPLACE);
+        if (s->occlusion_culling)
+            run_occlusion_culling(s, 1);
+        break;
+    case GraphicsPass_GBufferLate:
+        if (s->occlusion_culling)
+        {
+            build_depth_pyramid(s);
+            run_occlusion_culling(s, 2);
+        }
         break;
-    case DrawMode_NormalMap:
-        glBindTextures(0, 1, &s->gbuffer.normal_texture);
-        glUseProgram(s->fsq_shader);
-        r_vb_draw(&s->fsq_vb);
+    case GraphicsPass_Lighting:
+        r_gpu_timer_end(&s->gbuffer_timers[s->gbuffer.layout]);
+        if (s->draw_mode == DrawMode_FinalScene)
+            r_gpu_timer_begin(&s->lighting_timers[s->lighting_mode]);
+        if (s->draw_mode == DrawMode_FinalScene &&
+            s->lighting_mode == LightingMode_Volumes)
+        {
+            copy_gbuffer_depth_stencil(s);
+            r_state_bind_framebuffer(GL_FRAMEBUFFER, s->light_framebuffer);
+            glClear(GL_COLOR_BUFFER_BIT);
+            r_state_set_enabled(GL_DEPTH_TEST, false);
+            r_state_stencil_func(GL_EQUAL, 1, 0xFF);
+            r_state_stencil_op(GL_KEEP, GL_KEEP, GL_KEEP);
+        }
+        else
+        {
+            if (s->draw_mode == DrawMode_FinalScene)
+                cull_lights(s);
+            r_state_set_enabled(GL_STENCIL_TEST, false);
+            r_state_bind_framebuffer(GL_FRAMEBUFFER, 0);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
+        break;
+    case GraphicsPass_LightVolumes:
+        // Back faces behind the scene surface cover exactly the pixels a
+        // light can reach, even with the camera inside the volume
+        r_state_set_enabled(GL_DEPTH_TEST, true);
+        r_state_depth_func(GL_GEQUAL);
+        r_state_depth_mask(false);
+        r_state_cull_face(GL_FRONT);
+        r_state_set_enabled(GL_BLEND, true);
+        r_state_blend_func(GL_ONE, GL_ONE);
+        break;
+    case GraphicsPass_DebugSolid:
+        if (s->draw_mode == DrawMode_FinalScene &&
+            s->lighting_mode == LightingMode_Volumes)
+        {
+            r_state_set_enabled(GL_BLEND, false);
+            r_state_set_enabled(GL_STENCIL_TEST, false);
+            r_state_depth_func(GL_LESS);
+            r_state_depth_mask(true);
+            r_state_cull_face(GL_BACK);
+            resolve_light_buffer(s, s->window_size);
+        }
+        if (s->draw_mode == DrawMode_FinalScene)
+            r_gpu_timer_end(&s->lighting_timers[s->lighting_mode]);
+        r_state_bind_framebuffer(GL_FRAMEBUFFER, 0);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        if (s->copy_depth)
+            copy_depth_buffer(s, s->window_size);
         break;
-    case DrawMode_AlbedoMap:
-        glBindTextures(0, 1, &s->gbuffer.albedo_texture);
-        glUseProgram(s->fsq_shader);
-        r_vb_draw(&s->fsq_vb);
+    case GraphicsPass_DebugWire:
+        r_state_set_enabled(GL_CULL_FACE, false);
+        r_state_polygon_mode(GL_LINE);
         break;
     }
+}
 
-    glClear(GL_DEPTH_BUFFER_BIT);
+// Normalized distance from the camera, used for the depth bits of sort keys
+static float calc_view_depth(const GraphicsScene* s, FVec3 pos)
+{
+    float result = fvec3_length(fvec3_sub(pos, s->cam.pos)) / 100.f;
+    return result;
 }
 
-static void copy_depth_buffer(const GraphicsScene* s, IVec2 window_size)
+static void cull_scene_objects(GraphicsScene* s)
 {
-    // Copy depth buffer written from deferred rendering pass
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, s->gbuffer.framebuffer);
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-    glBlitFramebuffer(0, 0, s->gbuffer.dim.x, s->gbuffer.dim.y, 0, 0,
-                      window_size.x, window_size.y, GL_DEPTH_BUFFER_BIT,
-                      GL_NEAREST);
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    FrustumCullStats stats = {0};
+    double start_ms = a_get_time_ms();
+
+    s->visible_objects_count = 0;
+    const struct flat_bvh* bvh = &s->object_flat_bvh[s->visible_bv_type];
+    if (s->frustum_culling && bvh->nodes_count > 0)
+    {
+        struct frustum frustum = calc_frustum(s->view_proj.m);
+        if (s->wide_bvh)
+        {
+            flat_bvh4_frustum_cull(bvh, &frustum, s->visible_object_indices,
+                                   &s->visible_objects_count, &stats);
+        }
+        else
+        {
+            flat_bvh_frustum_cull(bvh, &frustum, s->visible_object_indices,
+                                  &s->visible_objects_count, &stats);
+        }
+        for (int i = 0; i < s->visible_objects_count; i++)
+        {
+            s->visible_objects[i] =
+                get_scene_object(s, s->visible_object_indices[i]);
+        }
+    }
+    else
+    {
+        for (int i = 0; i < s->scene_objects.count; i++)
+            s->visible_objects[s->visible_objects_count++] =
+                get_scene_object(s, i);
+    }
+
+    stats.traversal_ms = (float)(a_get_time_ms() - start_ms);
+    stats.visible_count = s->visible_objects_count;
+    stats.culled_count = s->scene_objects.count - s->visible_objects_count;
+    s->cull_stats = stats;
+}
+
+// Casts a ray through the cursor against the triangles of every object. The
+// top level is rebuilt from the current transforms, the mesh trees are shared.
+static void pick_scene_object(GraphicsScene* s, const Input* input)
+{
+    double start_ms = a_get_time_ms();
+
+    rt_scene_clear(&s->rt_scene);
+    for (int i = 0; i < s->scene_objects.count; i++)
+    {
+        const struct scene_object* o = get_scene_object(s, i);
+        Mat4 model_mat = calc_object_world(o);
+        rt_scene_add_instance(&s->rt_scene, &s->model_rt_bvhs[o->model],
+                              &model_mat);
+    }
+    rt_scene_build(&s->rt_scene);
+
+    // Same projection as prepare_per_frame, mouse_pos starts at the top
+    float aspect = (float)input->window_size.x / (float)input->window_size.y;
+    float tan_half_fov = tanf(degtorad(60) * 0.5f);
+    float x = (2.f * (float)input->mouse_pos.x / (float)input->window_size.x -
+               1.f) *
+              tan_half_fov * aspect;
+    float y = (1.f - 2.f * (float)input->mouse_pos.y /
+                         (float)input->window_size.y) *
+              tan_half_fov;
+    FVec3 look = e_fpscam_get_look(&s->cam);
+    FVec3 right = fvec3_normalize(fvec3_cross(look, (FVec3){0, 1, 0}));
+    FVec3 up = fvec3_cross(right, look);
+    Ray ray = {
+        .origin = s->cam.pos,
+        .t_max = 100,
+        .dir = fvec3_add(look, fvec3_add(fvec3_mulf(right, x),
+                                         fvec3_mulf(up, y))),
+    };
+
+    s->picked_object = (PoolHandle){0};
+    if (rt_intersect(&s->rt_scene, &ray, &s->pick_hit))
+        s->picked_object = pool_handle(&s->scene_objects, s->pick_hit.instance);
+    int picked = pool_index(&s->scene_objects, s->picked_object);
+    s->pick_ms = a_get_time_ms() - start_ms;
+
+    for (int i = 0; i < bv_type_count; i++)
+    {
+        const struct flat_bvh* bvh = &s->object_flat_bvh[i];
+        flat_bvh_count_ray_hits(bvh, (const float*)&ray.origin,
+                                (const float*)&ray.dir, ray.t_max,
+                                &s->pick_ray_nodes[i], &s->pick_ray_leaves[i]);
+        s->pick_overlaps[i] = 0;
+        if (picked >= 0)
+        {
+            struct bvolume bv = calc_object_bvolume(get_scene_object(s, picked),
+                                                    (enum bv_type)i);
+            // Not counting the picked object itself
+            s->pick_overlaps[i] = flat_bvh_count_overlaps(bvh, &bv) - 1;
+        }
+    }
+}
+
+// Uploads the frustum-visible objects grouped by model and pushes one
+// multi-draw per model and phase. The compute passes fill in the commands.
+static void draw_occlusion_culled_objects(GraphicsScene* s)
+{
+    if (s->occlusion_buffers_cap < s->scene_objects.cap)
+        resize_occlusion_buffers(s, s->scene_objects.cap);
+
+    int* group_offsets = s->model_group_offsets;
+    memset(group_offsets, 0, (s->models_count + 1) * sizeof(int));
+    for (int i = 0; i < s->visible_objects_count; i++)
+        ++group_offsets[s->visible_objects[i]->model + 1];
+    for (int i = 0; i < s->models_count; i++)
+        group_offsets[i + 1] += group_offsets[i];
+
+    int* group_cursors = s->model_group_cursors;
+    memcpy(group_cursors, group_offsets, s->models_count * sizeof(int));
+    for (int i = 0; i < s->visible_objects_count; i++)
+    {
+        struct scene_object* o = s->visible_objects[i];
+        const struct aabb* model_aabb = &s->model_aabbs[o->model];
+        const Mat4* m = &s->transforms.worlds[o->transform];
+
+        int slot = group_cursors[o->model]++;
+        OcclusionObject* oo = &s->occlusion_objects[slot];
+        oo->model = *m;
+        transform_point(m, model_aabb->c, oo->aabb_center);
+        for (int j = 0; j < 3; j++)
+        {
+            oo->aabb_extent[j] = fabsf(m->m[j]) * model_aabb->r[0] +
+                                 fabsf(m->m[4 + j]) * model_aabb->r[1] +
+                                 fabsf(m->m[8 + j]) * model_aabb->r[2];
+        }
+        oo->object_id =
+            (uint32_t)(o - POOL_ITEMS(&s->scene_objects, struct scene_object));
+        oo->index_count = (uint32_t)o->vb->count;
+    }
+    s->occlusion_objects_count = s->visible_objects_count;
+
+    uint32_t header[4] = {(uint32_t)s->occlusion_objects_count};
+    r_state_bind_buffer(GL_SHADER_STORAGE_BUFFER, s->occlusion_objects_buffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(header), header);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(header),
+                    s->occlusion_objects_count * sizeof(OcclusionObject),
+                    s->occlusion_objects);
+
+    uint program = s->first_pass_indirect_shaders[s->gbuffer.layout];
+    for (int i = 0; i < s->models_count; i++)
+    {
+        int count = group_offsets[i + 1] - group_offsets[i];
+        if (count == 0)
+            continue;
+
+        const VertexBuffer* vb = &s->model_vbs[i];
+        for (int phase = 0; phase < 2; phase++)
+        {
+            int first = phase * s->occlusion_objects_count + group_offsets[i];
+            int pass = (phase == 0) ? GraphicsPass_GBuffer
+                                    : GraphicsPass_GBufferLate;
+            RenderCommand cmd = {
+                .key = r_queue_make_key(&(RenderKeyDesc){
+                    .pass = pass,
+                    .program = program,
+                    .vao = vb->vao,
+                }),
+                .program = program,
+                .vao = vb->vao,
+                .mode = vb->mode,
+                .indexed = true,
+                .indirect_buffer = s->occlusion_commands_buffer,
+                .indirect_offset =
+                    first * (int)sizeof(DrawElementsIndirectCommand),
+                .draw_count = count,
+            };
+            r_queue_push(&s->queue, &cmd, NULL);
+        }
+    }
+}
+
+static void draw_deferred_objects(Example* e, GraphicsScene* s)
+{
+    GBufferLayout layout = s->gbuffer.layout;
+    uint first_pass_shader = s->deferred_first_pass_shaders[layout];
+
+    if (s->occlusion_culling)
+    {
+        draw_occlusion_culled_objects(s);
+    }
+    else
+    {
+        // First pass, sorted front-to-back for early depth rejection
+        for (int i = 0; i < s->visible_objects_count; i++)
+        {
+            struct scene_object* o = s->visible_objects[i];
+            ExamplePerObjectUBO per_object = {0};
+            per_object.model = s->transforms.worlds[o->transform];
+            FVec3 pos = {per_object.model.m[12], per_object.model.m[13],
+                         per_object.model.m[14]};
+            uint64_t key = r_queue_make_key(&(RenderKeyDesc){
+                .pass = GraphicsPass_GBuffer,
+                .program = first_pass_shader,
+                .vao = o->vb->vao,
+                .depth = calc_view_depth(s, pos),
+            });
+            r_queue_push_vb(&s->queue, key, first_pass_shader, o->vb,
+                            NULL, 0, &per_object);
+        }
+    }
+
+    // Second pass
+    uint program = s->fsq_shader;
+    uint textures[3] = {0};
+    int textures_count = 1;
+
+    switch (s->draw_mode)
+    {
+    case DrawMode_FinalScene:
+        program = (s->lighting_mode == LightingMode_Volumes)
+                      ? s->deferred_directional_shaders[layout]
+                      : s->deferred_second_pass_shaders[layout];
+        textures[0] = gbuffer_position_source(&s->gbuffer);
+        textures[1] = s->gbuffer.normal_texture;
+        textures[2] = s->gbuffer.albedo_texture;
+        textures_count = 3;
+        break;
+    case DrawMode_PositionMap:
+        textures[0] = gbuffer_position_source(&s->gbuffer);
+        break;
+    case DrawMode_NormalMap: textures[0] = s->gbuffer.normal_texture; break;
+    case DrawMode_AlbedoMap: textures[0] = s->gbuffer.albedo_texture; break;
+    }
+
+    uint64_t key = r_queue_make_key(&(RenderKeyDesc){
+        .pass = GraphicsPass_Lighting,
+        .program = program,
+        .material = textures[0],
+        .vao = s->fsq_vb.vao,
+    });
+    r_queue_push_vb(&s->queue, key, program, &s->fsq_vb, textures,
+                    textures_count, NULL);
+
+    if (s->draw_mode == DrawMode_FinalScene &&
+        s->lighting_mode == LightingMode_Volumes)
+    {
+        RenderCommand cmd = {
+            .key = r_queue_make_key(&(RenderKeyDesc){
+                .pass = GraphicsPass_LightVolumes,
+                .program = s->light_volume_shaders[layout],
+                .material = textures[0],
+                .vao = s->bsphere_vb.vao,
+            }),
+            .program = s->light_volume_shaders[layout],
+            .vao = s->bsphere_vb.vao,
+            .mode = s->bsphere_vb.mode,
+            .indexed = true,
+            .count = (int)s->bsphere_vb.count,
+            .instances_count = s->light_sources.count,
+            .textures = {textures[0], textures[1], textures[2]},
+            .textures_count = textures_count,
+        };
+        r_queue_push(&s->queue, &cmd, NULL);
+    }
 }
 
 static void draw_debug_objects(Example* e, GraphicsScene* s)
 {
     // Draw light sources
-    for (int i = 0; i < s->light_sources_count; i++)
+    for (int i = 0; i < s->light_sources.count; i++)
     {
-        Mat4 trans_mat = mat4_translation(s->light_sources[i].pos);
+        Mat4 trans_mat = mat4_translation(get_light_source(s, i)->pos);
         ExamplePerObjectUBO per_object = {
             .model = trans_mat,
-            .color = s->light_sources[i].color,
+            .color = get_light_source(s, i)->color,
+        };
+        uint64_t key = r_queue_make_key(&(RenderKeyDesc){
+            .pass = GraphicsPass_DebugSolid,
+            .program = s->light_source_shader,
+            .vao = s->light_source_vb.vao,
+            .depth = calc_view_depth(s, get_light_source(s, i)->pos),
+        });
+        r_queue_push_vb(&s->queue, key, s->light_source_shader,
+                        &s->light_source_vb, NULL, 0, &per_object);
+    }
+
+    int picked = pool_index(&s->scene_objects, s->picked_object);
+    if (picked >= 0)
+    {
+        struct bvolume bv =
+            calc_object_bvolume(get_scene_object(s, picked), bv_type_aabb);
+        const struct aabb* aabb = &bv.aabb;
+        Mat4 trans_mat = mat4_translation((FVec3){aabb->c[0], aabb->c[1],
+                                                  aabb->c[2]});
+        Mat4 scale_mat = mat4_scalev(
+            (FVec3){aabb->r[0] * 2, aabb->r[1] * 2, aabb->r[2] * 2});
+        ExamplePerObjectUBO per_object = {
+            .model = mat4_mul(&trans_mat, &scale_mat),
+            .color = {1, 1, 0},
         };
-        e_apply_per_object_ubo(e, &per_object);
-        glUseProgram(s->light_source_shader);
-        r_vb_draw(&s->light_source_vb);
+        uint64_t key = r_queue_make_key(&(RenderKeyDesc){
+            .pass = GraphicsPass_DebugWire,
+            .program = s->light_source_shader,
+            .vao = s->aabb_vb.vao,
+        });
+        r_queue_push_vb(&s->queue, key, s->light_source_shader, &s->aabb_vb,
+                        NULL, 0, &per_object);
+    }
+
+    if (s->draw_hulls)
+    {
+        for (int i = 0; i < s->visible_objects_count; i++)
+        {
+            const struct scene_object* o = s->visible_objects[i];
+            const VertexBuffer* vb = &s->model_hull_vbs[o->model];
+            if (!vb->vao)
+                continue;
+            ExamplePerObjectUBO per_object = {
+                .model = s->transforms.worlds[o->transform],
+                .color = {0, 1, 0.5f},
+            };
+            uint64_t key = r_queue_make_key(&(RenderKeyDesc){
+                .pass = GraphicsPass_DebugWire,
+                .program = s->light_source_shader,
+                .vao = vb->vao,
+            });
+            r_queue_push_vb(&s->queue, key, s->light_source_shader, vb, NULL,
+                            0, &per_object);
+        }
     }
 
     switch (s->visible_bv_type)
     {
     case bv_type_aabb:
-        draw_bvh(e, s->bvh_aabb, s->light_source_shader, &s->aabb_vb,
-                 s->bvh_highlight_depth);
+        draw_bvh(&s->queue, &s->debug_flat_bvh[bv_type_aabb],
+                 s->light_source_shader, &s->aabb_vb, s->bvh_highlight_depth);
         break;
     case bv_type_sphere:
-        draw_bvh(e, s->bvh_sphere, s->light_source_shader, &s->bsphere_vb,
+        draw_bvh(&s->queue, &s->debug_flat_bvh[bv_type_sphere],
+                 s->light_source_shader, &s->bsphere_vb,
                  s->bvh_highlight_depth);
         break;
+    case bv_type_obb:
+        draw_bvh(&s->queue, &s->debug_flat_bvh[bv_type_obb],
+                 s->light_source_shader, &s->aabb_vb, s->bvh_highlight_depth);
+        break;
+    default:
+        if (s->kdop_lines_dirty ||
+            s->kdop_lines_depth != s->bvh_highlight_depth ||
+            s->kdop_lines_type != s->visible_bv_type)
+        {
+            build_kdop_lines_vb(&s->kdop_lines_vb,
+                                &s->debug_flat_bvh[s->visible_bv_type],
+                                s->bvh_highlight_depth);
+            s->kdop_lines_dirty = false;
+            s->kdop_lines_depth = s->bvh_highlight_depth;
+            s->kdop_lines_type = s->visible_bv_type;
+        }
+        if (s->kdop_lines_vb.vao)
+        {
+            ExamplePerObjectUBO per_object = {.model = mat4_identity(),
+                                              .color = {0.5f, 0.5f, 1}};
+            uint64_t key = r_queue_make_key(&(RenderKeyDesc){
+                .pass = GraphicsPass_DebugWire,
+                .program = s->light_source_shader,
+                .vao = s->kdop_lines_vb.vao,
+            });
+            r_queue_push_vb(&s->queue, key, s->light_source_shader,
+                            &s->kdop_lines_vb, NULL, 0, &per_object);
+        }
+        break;
+    }
+}
+
+// Free slots have never been drawn, so they come up as the oldest
+static int find_point_viewer_slot(const struct point_viewer* v)
+{
+    int result = -1;
+    for (int i = 0; i < POINT_VIEWER_SLOTS_COUNT; i++)
+    {
+        if (v->slot_frames[i] != v->frame &&
+            (result < 0 || v->slot_frames[i] < v->slot_frames[result]))
+        {
+            result = i;
+        }
+    }
+    return result;
+}
+
+static void stream_point_viewer_nodes(struct point_viewer* v)
+{
+    ++v->frame;
+    v->uploads_count = 0;
+    for (int i = 0; i < v->selected_count; i++)
+    {
+        int slot = v->node_slots[v->selected_nodes[i]];
+        if (slot >= 0)
+            v->slot_frames[slot] = v->frame;
+    }
+
+    // Selection order puts parents first, so a capped frame loses detail
+    // rather than leaving holes
+    r_state_bind_buffer(GL_ARRAY_BUFFER, v->vbo);
+    for (int i = 0; i < v->selected_count; i++)
+    {
+        int node_index = v->selected_nodes[i];
+        if (v->node_slots[node_index] >= 0)
+            continue;
+        if (v->uploads_count == v->uploads_per_frame)
+            break;
+        int slot = find_point_viewer_slot(v);
+        if (slot < 0)
+            break;
+
+        if (v->slot_nodes[slot] >= 0)
+            v->node_slots[v->slot_nodes[slot]] = -1;
+        const struct octree_node* n = &v->octree.nodes[node_index];
+        glBufferSubData(GL_ARRAY_BUFFER,
+                        (GLintptr)slot * OCTREE_NODE_POINTS_CAP *
+                            sizeof(float[3]),
+                        n->count * sizeof(float[3]),
+                        v->octree.points + n->first * 3);
+        v->slot_nodes[slot] = node_index;
+        v->slot_frames[slot] = v->frame;
+        v->node_slots[node_index] = slot;
+        ++v->uploads_count;
+    }
+    r_state_bind_buffer(GL_ARRAY_BUFFER, 0);
+}
+
+static void draw_point_viewer(GraphicsScene* s)
+{
+    static const FVec3 depth_colors[POINT_VIEWER_DEPTH_COLORS_COUNT] = {
+        {1, 0.3f, 0.3f}, {1, 0.6f, 0.2f}, {1, 1, 0.3f}, {0.4f, 1, 0.4f},
+        {0.3f, 1, 1},    {0.4f, 0.5f, 1}, {0.8f, 0.4f, 1}, {1, 1, 1},
+    };
+
+    struct point_viewer* v = &s->point_viewer;
+    double start_ms = a_get_time_ms();
+    struct frustum frustum = calc_frustum(s->view_proj.m);
+    float proj_scale =
+        (float)s->window_size.y / (2.f * tanf(degtorad(60) * 0.5f));
+    v->selected_count = octree_select(
+        &v->octree, &frustum, (float*)&s->cam.pos, proj_scale, v->max_error,
+        v->points_budget, v->selected_nodes, POINT_VIEWER_SLOTS_COUNT,
+        &v->select_stats);
+    v->select_ms = a_get_time_ms() - start_ms;
+
+    stream_point_viewer_nodes(v);
+
+    v->drawn_nodes_count = 0;
+    v->drawn_points_count = 0;
+    for (int i = 0; i < v->selected_count; i++)
+    {
+        int slot = v->node_slots[v->selected_nodes[i]];
+        if (slot < 0)
+            continue;
+
+        const struct octree_node* n = &v->octree.nodes[v->selected_nodes[i]];
+        ExamplePerObjectUBO per_object = {
+            .model = mat4_identity(),
+            .color = v->color_by_depth
+                         ? depth_colors[n->depth %
+                                        POINT_VIEWER_DEPTH_COLORS_COUNT]
+                         : (FVec3){0.8f, 0.8f, 0.8f},
+        };
+        FVec3 center = {n->center[0], n->center[1], n->center[2]};
+        RenderCommand cmd = {
+            .key = r_queue_make_key(&(RenderKeyDesc){
+                .pass = GraphicsPass_DebugSolid,
+                .program = s->light_source_shader,
+                .vao = v->vao,
+                .depth = calc_view_depth(s, center),
+            }),
+            .program = s->light_source_shader,
+            .vao = v->vao,
+            .mode = GL_POINTS,
+            .first = slot * OCTREE_NODE_POINTS_CAP,
+            .count = n->count,
+        };
+        r_queue_push(&s->queue, &cmd, &per_object);
+        ++v->drawn_nodes_count;
+        v->drawn_points_count += n->count;
     }
 }
 
@@ -966,7 +4885,7 @@ EXAMPLE_UPDATE_FN_SIG(graphics)
             if (igMenuItemBool("Position Map", NULL, false, true))
             {
                 s->draw_mode = DrawMode_PositionMap;
-                s->fsq_target_texture = s->gbuffer.position_texture;
+                s->fsq_target_texture = gbuffer_position_source(&s->gbuffer);
             }
             if (igMenuItemBool("Normal Map", NULL, false, true))
             {
@@ -983,25 +4902,263 @@ EXAMPLE_UPDATE_FN_SIG(graphics)
         if (igCollapsingHeader("Scene Setup", ImGuiTreeNodeFlags_DefaultOpen))
         {
             if (igButton("Add Random Object", (ImVec2){0}))
-            {
                 add_random_scene_object(s);
+            if (igButton("Remove Random Object", (ImVec2){0}) &&
+                s->scene_objects.count > 1)
+            {
+                remove_scene_object(s, rand() % s->scene_objects.count);
+            }
+            igSameLine(0, -1);
+            igCheckbox("Place without overlaps", &s->place_without_overlaps);
+            igCheckbox("Animate objects", &s->animate_objects);
+            igText("Objects %d, last BVH update %.4f ms",
+                   s->scene_objects.count, s->bvh_update_ms);
+            igText("Transforms updated %d in %.4f ms",
+                   s->transforms.updated_count, s->transform_update_ms);
+            int picked = pool_index(&s->scene_objects, s->picked_object);
+            if (picked >= 0)
+            {
+                igText("Picked object %d, triangle %d at t %.3f", picked,
+                       s->pick_hit.triangle,
+                       s->pick_hit.t);
+            }
+            else
+            {
+                igText("Left click an object to pick it");
+            }
+            igText("Last pick %.4f ms", s->pick_ms);
+            igText("Pick ray nodes/leaves entered, leaves overlapped");
+            for (int i = 0; i < bv_type_count; i++)
+            {
+                igText("  %-6s %4d/%-3d %3d", bv_type_names[i],
+                       s->pick_ray_nodes[i], s->pick_ray_leaves[i],
+                       s->pick_overlaps[i]);
             }
         }
         if (igCollapsingHeader("BVH", ImGuiTreeNodeFlags_DefaultOpen))
         {
             igSliderInt("Highlight Depth", &s->bvh_highlight_depth, 0, 10,
                         "%d");
-            igText("BV Type (0: AABB, 1: Sphere)");
+            igText("BV Type");
             igSliderInt("##BV type", (int*)&s->visible_bv_type, 0,
-                        bv_type_count - 1, "%d");
-            igText("BVH Type (0: bottom-up, 1: top-down)");
+                        bv_type_count - 1, bv_type_names[s->visible_bv_type]);
+            igText("BVH Type (0: bottom-up, 1: top-down, 2: LBVH)");
             int new_bvh_type = s->bvh_type;
-            igSliderInt("##BVH type", &new_bvh_type, 0, 1, "%d");
+            igSliderInt("##BVH type", &new_bvh_type, 0, 2, "%d");
             if (new_bvh_type != s->bvh_type)
             {
                 s->bvh_type = new_bvh_type;
                 reconstruct_bvh(s);
             }
+            if (s->bvh_type != 0)
+            {
+                bool rebuild = false;
+                rebuild |= igSliderInt("Leaf size",
+                                       &s->top_down_params.leaf_size, 1, 4096,
+                                       "%d");
+                if (s->bvh_type == 1)
+                {
+                    rebuild |= igSliderInt("Max depth",
+                                           &s->top_down_params.max_depth, 1,
+                                           40, "%d");
+                }
+                else
+                {
+                    rebuild |= igCheckbox("63-bit Morton codes",
+                                          &s->lbvh_params.wide_codes);
+                    rebuild |= igSliderInt("Treelet passes",
+                                           &s->lbvh_params.treelet_passes, 0,
+                                           LBVH_MAX_TREELET_PASSES, "%d");
+                }
+                if (rebuild)
+                    reconstruct_bvh(s);
+            }
+            igText("Sphere fit");
+            int new_sphere_fit = s->top_down_params.sphere_fit;
+            for (int i = 0; i < bsphere_fit_count; i++)
+            {
+                if (i > 0)
+                    igSameLine(0, -1);
+                igRadioButtonIntPtr(bsphere_fit_names[i], &new_sphere_fit, i);
+            }
+            if (new_sphere_fit != (int)s->top_down_params.sphere_fit)
+            {
+                s->top_down_params.sphere_fit =
+                    (enum bsphere_fit)new_sphere_fit;
+                fit_model_bvolumes(s);
+                reconstruct_bvh(s);
+            }
+            float volumes[4] = {0};
+            float kdop_volumes[3] = {0};
+            float hull_volume = 0;
+            int hull_vertices_count = 0;
+            int hull_faces_count = 0;
+            for (int i = 0; i < s->models_count; i++)
+            {
+                hull_volume += calc_mesh_volume(&s->model_hulls[i]);
+                hull_vertices_count += s->model_hulls[i].vertices_count;
+                hull_faces_count += s->model_hulls[i].indices_count / 3;
+                struct bsphere box_sphere = {.r = float3_length(
+                                                 s->model_aabbs[i].r)};
+                volumes[0] += aabb_volume(&s->model_aabbs[i]);
+                volumes[1] += bsphere_volume(&box_sphere);
+                volumes[2] += bsphere_volume(&s->model_bspheres[i]);
+                volumes[3] += obb_volume(&s->model_obbs[i]);
+                for (int j = 0; j < 3; j++)
+                {
+                    struct kdop kdop = kdop_restrict(
+                        &s->model_kdops[i],
+                        bv_type_kdop_k((enum bv_type)(bv_type_kdop14 + j)));
+                    kdop_volumes[j] += kdop_volume(&kdop);
+                }
+            }
+            igText("Model volumes: AABB %.2f, OBB %.2f", volumes[0],
+                   volumes[3]);
+            igText("  box spheres %.2f, fitted %.2f in %.3f ms", volumes[1],
+                   volumes[2], s->model_fit_ms);
+            igText("  14-DOP %.2f, 18-DOP %.2f, 26-DOP %.2f", kdop_volumes[0],
+                   kdop_volumes[1], kdop_volumes[2]);
+            igText("  hulls %.2f, %d vertices, %d faces in %.3f ms",
+                   hull_volume, hull_vertices_count, hull_faces_count,
+                   s->hull_build_ms);
+            if (igSliderInt("Hull vertices (0: exact)", &s->hull_max_vertices,
+                            0, 256, "%d"))
+            {
+                build_model_hulls(s);
+                upload_model_hull_vbs(s);
+            }
+            igCheckbox("Draw convex hulls", &s->draw_hulls);
+            for (int i = 0; i < bv_type_count; i++)
+            {
+                const struct bvh_stats* bvh_stats = &s->bvh_stats[i];
+                igText("%-6s %5d nodes, %5d leaves, depth %2d",
+                       bv_type_names[i],
+                       bvh_stats->nodes_count, bvh_stats->leaves_count,
+                       bvh_stats->depth);
+                igText("       SAH cost %.2f, built in %.3f ms",
+                       bvh_stats->sah_cost, bvh_stats->build_ms);
+            }
+
+            igCheckbox("Frustum culling", &s->frustum_culling);
+            igSameLine(0, -1);
+            igCheckbox("4-wide nodes", &s->wide_bvh);
+            const struct flat_bvh* flat_bvh =
+                &s->object_flat_bvh[s->visible_bv_type];
+            igText("Flat nodes %d x %d B, 4-wide nodes %d x %d B",
+                   flat_bvh->nodes_count, (int)sizeof(struct flat_node),
+                   flat_bvh->nodes4_count, (int)sizeof(struct flat_node4));
+            const FrustumCullStats* stats = &s->cull_stats;
+            igText("Visible %d, culled %d", stats->visible_count,
+                   stats->culled_count);
+            igText("Nodes visited %d, subtrees accepted %d",
+                   stats->nodes_visited, stats->subtrees_accepted);
+            igText("Traversal %.4f ms", stats->traversal_ms);
+
+            igCheckbox("Hi-Z occlusion culling", &s->occlusion_culling);
+            igText("Depth pyramid %dx%d, %d levels", s->depth_pyramid.dim.x,
+                   s->depth_pyramid.dim.y, s->depth_pyramid.levels_count);
+        }
+
+        if (igCollapsingHeader("Broadphase", 0))
+        {
+            const struct spatial_grid* grid = &s->object_grid;
+            igText("Grid cell %.3f, %d buckets, %d blocks of %d B",
+                   grid->cell_size, grid->buckets_count, grid->blocks_count,
+                   (int)sizeof(struct grid_block));
+            igText("Overlapping pairs %d, last grid update %.4f ms",
+                   s->grid_pairs_count, s->grid_update_ms);
+
+            igSliderInt("Objects##Broadphase",
+                        &s->broadphase_bench_objects_count, 1000, 20000, "%d");
+            if (igButton("Run benchmark", (ImVec2){0}))
+                run_broadphase_bench(s);
+            igText("       build ms  pairs  pairs ms  %d boxes ms",
+                   BROADPHASE_BENCH_QUERIES_COUNT);
+            for (int i = 0; i < 1 + bv_type_count; i++)
+            {
+                const struct broadphase_bench* bench = &s->broadphase_bench[i];
+                igText("%-6s %8.2f %6d %9.2f %8.2f",
+                       (i == 0) ? "Grid" : bv_type_names[i - 1],
+                       bench->build_ms, bench->pairs_count, bench->pairs_ms,
+                       bench->queries_ms);
+            }
+        }
+
+        if (igCollapsingHeader("Point Cloud Viewer", 0))
+        {
+            struct point_viewer* v = &s->point_viewer;
+            if (igCheckbox("Enabled##Point viewer", &v->enabled) &&
+                v->enabled)
+            {
+                rebuild_point_viewer(s);
+            }
+            igSameLine(0, -1);
+            igCheckbox("Color by depth", &v->color_by_depth);
+            igSliderInt("Point budget", &v->points_budget, 10000,
+                        POINT_VIEWER_SLOTS_COUNT * OCTREE_NODE_POINTS_CAP / 2,
+                        "%d");
+            igSliderFloat("Max error (px)", &v->max_error, 0.25f, 16, "%.2f",
+                          1);
+            igSliderInt("Uploads per frame", &v->uploads_per_frame, 1, 256,
+                        "%d");
+            const struct point_octree* octree = &v->octree;
+            igText("Octree %d points, %d nodes, depth %d", octree->points_count,
+                   octree->nodes_count, octree->depth);
+            igText("  dropped %d duplicates, built in %.2f ms",
+                   octree->dropped_points_count, v->build_ms);
+            const struct octree_select_stats* stats = &v->select_stats;
+            igText("Selected %d nodes, %d points%s in %.4f ms",
+                   stats->nodes_selected, stats->points_selected,
+                   stats->budget_reached ? " (budget)" : "", v->select_ms);
+            igText("Drawn %d nodes, %d points, %d uploads",
+                   v->drawn_nodes_count, v->drawn_points_count,
+                   v->uploads_count);
+        }
+
+        if (igCollapsingHeader("Models", 0))
+        {
+            igText("Half-edges built in %.3f ms", s->half_edges_build_ms);
+            for (int i = 0; i < s->models_count; i++)
+            {
+                const MeshHalfEdges* he = &s->model_half_edges[i];
+                igText("%s: %d triangles", s->model_file_paths[i].filename,
+                       he->half_edges_count / 3);
+                igText("  open edges %d, non-manifold edges %d, vertices %d",
+                       he->boundary_edges_count, he->non_manifold_edges_count,
+                       he->non_manifold_vertices_count);
+            }
+        }
+
+        if (igCollapsingHeader("Stress", 0))
+        {
+            igSliderInt("Objects to spawn", &s->stress_objects_count, 1,
+                        STRESS_MAX_OBJECTS_COUNT, "%d");
+            if (igButton("Spawn Objects", (ImVec2){0}))
+                spawn_stress_objects(s, s->stress_objects_count);
+            igSameLine(0, -1);
+            if (igButton("Keep One Object", (ImVec2){0}))
+                truncate_scene_objects(s, 1);
+            igSliderInt("Light sources", &s->requested_light_sources_count, 8,
+                        STRESS_MAX_LIGHT_SOURCES_COUNT, "%d");
+            igText("Objects %d, lights %d", s->scene_objects.count,
+                   s->light_sources.count);
+            igText("Last spawn %.3f ms, tree builds %.3f ms",
+                   s->stress_spawn_ms, s->stress_build_ms);
+            for (int i = 0; i < bv_type_count; i++)
+            {
+                igText("  %s tree build %.3f ms", bv_type_names[i],
+                       s->bvh_stats[i].build_ms);
+            }
+            igText("BVH refit %.3f ms, grid %.3f ms", s->bvh_update_ms,
+                   s->grid_update_ms);
+            igText("Transforms %.3f ms", s->transform_update_ms);
+            igText("Cull %.3f ms, submission %.3f ms, queue %.3f ms",
+                   s->cull_ms, s->submit_ms, s->queue_execute_ms);
+            const Arena* arena = s->arena;
+            igText("Arena live %.2f MB, peak %.2f MB, committed %.2f MB",
+                   arena->used / (1024.0 * 1024.0),
+                   arena->peak / (1024.0 * 1024.0),
+                   arena->committed / (1024.0 * 1024.0));
         }
 
         if (igCollapsingHeader("Misc", 0))
@@ -1012,33 +5169,138 @@ EXAMPLE_UPDATE_FN_SIG(graphics)
 
             igSliderFloat("Light intensity", &s->light_intensity, 0.4f, 1,
                           "%.3f", 1);
-            igSliderInt("Light sources count", &s->light_sources_count, 8, 100,
-                        "%d");
+            igSliderInt("Light sources count",
+                        &s->requested_light_sources_count, 8,
+                        MAX_LIGHT_SOURCES_SLIDER, "%d");
+            igSliderFloat("Light linear", &s->light_linear, 0, 1, "%.3f", 1);
+            igSliderFloat("Light quadratic", &s->light_quadratic, 0.001f, 2,
+                          "%.3f", 1);
+            igSliderFloat("Light cutoff", &s->light_cutoff, 0.01f, 1, "%.3f",
+                          1);
             igSliderFloat("Orbit radius", &s->orbit_radius, 1, 100, "%.3f", 1);
         }
+
+        if (igCollapsingHeader("Lighting", ImGuiTreeNodeFlags_DefaultOpen))
+        {
+            igRadioButtonIntPtr("Tiled full-screen",
+                                (int*)&s->lighting_mode, LightingMode_Tiled);
+            igRadioButtonIntPtr("Light volumes", (int*)&s->lighting_mode,
+                                LightingMode_Volumes);
+            // Only the mode in use is timed, the other one shows the last
+            // frame it ran
+            for (int i = 0; i < LightingMode_Count; i++)
+            {
+                bool timed = (i == (int)s->lighting_mode &&
+                              s->draw_mode == DrawMode_FinalScene);
+                igText("GPU %-7s %.3f ms%s, %d frames skipped",
+                       (i == LightingMode_Tiled) ? "tiled" : "volumes",
+                       s->lighting_timers[i].ms, timed ? "" : " (stale)",
+                       s->lighting_timers[i].skipped_count);
+            }
+        }
+
+        if (igCollapsingHeader("G-Buffer", ImGuiTreeNodeFlags_DefaultOpen))
+        {
+            int layout = s->gbuffer.layout;
+            igRadioButtonIntPtr("Full (position, RGB16F normal, RGBA16F)",
+                                &layout, GBufferLayout_Full);
+            igRadioButtonIntPtr("Compact (depth, octahedral normal, RGBA8)",
+                                &layout, GBufferLayout_Compact);
+            if (layout != (int)s->gbuffer.layout)
+                switch_gbuffer_layout(s, (GBufferLayout)layout);
+
+            for (int i = 0; i < GBufferLayout_Count; i++)
+            {
+                int pixel_size = gbuffer_layout_pixel_sizes[i];
+                float frame_mb = (float)(pixel_size * s->gbuffer.dim.x *
+                                         s->gbuffer.dim.y) /
+                                 (1024.f * 1024.f);
+                igText("%-8s %2d B/px, %6.2f MB/frame, GPU %.3f ms, %d skipped",
+                       (i == GBufferLayout_Full) ? "Full" : "Compact",
+                       pixel_size, frame_mb, s->gbuffer_timers[i].ms,
+                       s->gbuffer_timers[i].skipped_count);
+            }
+        }
+
+        if (igCollapsingHeader("Render Stats", 0))
+        {
+            r_state_draw_stats_gui();
+            igSeparator();
+            r_queue_draw_stats_gui(&s->queue);
+        }
+
+        if (igCollapsingHeader("Memory", 0))
+            mem_draw_stats_gui();
     }
     igEnd();
 
     e_fpscam_update(&s->cam, input, 5);
+    if (input->mouse_pressed[0] && !igGetIO()->WantCaptureMouse)
+        pick_scene_object(s, input);
 
+    set_light_sources_count(s, s->requested_light_sources_count);
     update_light_colors(s);
 
     s->t += input->dt;
 
+    if (s->animate_objects)
+        animate_scene_objects(s);
+    double transform_start_ms = a_get_time_ms();
+    transform_store_update(&s->transforms);
+    s->transform_update_ms = a_get_time_ms() - transform_start_ms;
+    if (s->animate_objects)
+        refit_moved_objects(s);
+
     update_light_source_transforms(s);
     prepare_per_frame(e, s, input);
+    s->window_size = input->window_size;
+    double start_ms = a_get_time_ms();
+    cull_scene_objects(s);
+    s->cull_ms = a_get_time_ms() - start_ms;
+
+    start_ms = a_get_time_ms();
     draw_deferred_objects(e, s);
-    if (s->copy_depth)
-        copy_depth_buffer(s, input->window_size);
     draw_debug_objects(e, s);
+    if (s->point_viewer.enabled)
+        draw_point_viewer(s);
+    s->submit_ms = a_get_time_ms() - start_ms;
+
+    start_ms = a_get_time_ms();
+    r_queue_execute(&s->queue, GraphicsPass_Count, &begin_graphics_pass, s);
+    s->queue_execute_ms = a_get_time_ms() - start_ms;
+}
+
+// Reloading prepares a fresh copy of the scene on a worker and activates it
+// under the budget, the current one keeps rendering until it's swapped out
+static void draw_scene_switch_gui(Scene* scene)
+{
+    if (igBegin("Scene", NULL, ImGuiWindowFlags_AlwaysAutoResize))
+    {
+        if (scene->load_state == SceneLoadState_Preparing)
+            igText("Preparing...");
+        else if (scene->load_state == SceneLoadState_Activating)
+            igText("Activating...");
+        else if (igButton("Reload scene", (ImVec2){0}))
+            s_switch_scene(scene, EXAMPLE_PRELOAD_LITERAL(graphics));
+        igText("Last load: %.1f ms", scene->last_load_ms);
+        float budget_ms = (float)scene->activate_budget_ms;
+        if (igSliderFloat("Activate budget (ms)", &budget_ms, 0.5f, 16, "%.1f",
+                          1))
+        {
+            scene->activate_budget_ms = budget_ms;
+        }
+    }
+    igEnd();
 }
 
 #define USER_INIT                                                              \
     Scene scene = {0};                                                         \
     s_init(&scene, &input);                                                    \
-    s_switch_scene(&scene, EXAMPLE_LITERAL(graphics));
+    s_switch_scene(&scene, EXAMPLE_PRELOAD_LITERAL(graphics));
 
-#define USER_UPDATE s_update(&scene);
+#define USER_UPDATE                                                            \
+    s_update(&scene);                                                          \
+    draw_scene_switch_gui(&scene);
 
 #define USER_CLEANUP s_cleanup(&scene);
 
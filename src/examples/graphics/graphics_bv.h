@@ -4,6 +4,8 @@
 #include <stdint.h>
 #include <math.h>
 #include <float.h>
+#include <stdbool.h>
+#include <emmintrin.h>
 
 static void float3_copy(float* dst, float* src)
 {
@@ -43,6 +45,121 @@ static void float3_divf(float* v, float s)
     v[2] /= s;
 }
 
+static float float3_dot(const float* a, const float* b)
+{
+    float result = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    return result;
+}
+
+static float float3_dist_sq(const float* a, const float* b)
+{
+    float d[3] = {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+    float result = float3_length_sq(d);
+    return result;
+}
+
+static void float3_cross_r(float* result, const float* a, const float* b)
+{
+    float r[3] = {
+        a[1] * b[2] - a[2] * b[1],
+        a[2] * b[0] - a[0] * b[2],
+        a[0] * b[1] - a[1] * b[0],
+    };
+    float3_copy(result, r);
+}
+
+// Point i of an array of structures
+#define BV_POINT(vertices, offset, stride, i)                                  \
+    ((float*)((uint8_t*)(vertices) + (offset) + (size_t)(i) * (stride)))
+
+// Reads x, y, z into the first three lanes. The fourth lane holds whatever
+// follows, only the last point of a packed array needs the safe copy.
+static __m128 bv_load_point(const float* p, bool last)
+{
+    if (!last)
+        return _mm_loadu_ps(p);
+    return _mm_setr_ps(p[0], p[1], p[2], 0);
+}
+
+static void bv_store3(float* dst, __m128 v)
+{
+    float lanes[4];
+    _mm_storeu_ps(lanes, v);
+    float3_copy(dst, lanes);
+}
+
+// Min/max reduction over strided points, one point per register
+static void calc_bounds(float* vertices,
+                        int vertices_count,
+                        int offset,
+                        int stride,
+                        float* min_bound,
+                        float* max_bound)
+{
+    bool packed = stride < (int)sizeof(float[4]);
+    __m128 min_v = bv_load_point(BV_POINT(vertices, offset, stride, 0),
+                                 packed && vertices_count == 1);
+    __m128 max_v = min_v;
+    for (int i = 1; i < vertices_count; i++)
+    {
+        __m128 p = bv_load_point(BV_POINT(vertices, offset, stride, i),
+                                 packed && i == vertices_count - 1);
+        min_v = _mm_min_ps(min_v, p);
+        max_v = _mm_max_ps(max_v, p);
+    }
+    bv_store3(min_bound, min_v);
+    bv_store3(max_bound, max_v);
+}
+
+static float bv_reduce_min4(__m128 v)
+{
+    v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+static float bv_reduce_max4(__m128 v)
+{
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+// Min/max reduction over separate x, y and z arrays, four points at a time
+static void calc_bounds_soa(const float* const* coords,
+                            int count,
+                            float* min_bound,
+                            float* max_bound)
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        const float* v = coords[axis];
+        float min_s = FLT_MAX;
+        float max_s = -FLT_MAX;
+        int i = 0;
+        if (count >= 4)
+        {
+            __m128 min_v = _mm_loadu_ps(v);
+            __m128 max_v = min_v;
+            for (i = 4; i + 4 <= count; i += 4)
+            {
+                __m128 x = _mm_loadu_ps(v + i);
+                min_v = _mm_min_ps(min_v, x);
+                max_v = _mm_max_ps(max_v, x);
+            }
+            min_s = bv_reduce_min4(min_v);
+            max_s = bv_reduce_max4(max_v);
+        }
+        for (; i < count; i++)
+        {
+            min_s = fminf(min_s, v[i]);
+            max_s = fmaxf(max_s, v[i]);
+        }
+        min_bound[axis] = min_s;
+        max_bound[axis] = max_s;
+    }
+}
+
 typedef struct aabb
 {
     float c[3];
@@ -52,25 +169,10 @@ typedef struct aabb
 static struct aabb
     calc_aabb(float* vertices, int vertices_count, int offset, int stride)
 {
-    float* p = (float*)((uint8_t*)vertices + offset);
     float max_bound[3];
-    float3_copy(max_bound, p);
     float min_bound[3];
-    float3_copy(min_bound, p);
-
-    for (int i = 1; i < vertices_count; i++)
-    {
-        p = (float*)((uint8_t*)p + stride);
-
-        for (int j = 0; j < 3; j++)
-        {
-            if (max_bound[j] < p[j])
-                max_bound[j] = p[j];
-
-            if (min_bound[j] > p[j])
-                min_bound[j] = p[j];
-        }
-    }
+    calc_bounds(vertices, vertices_count, offset, stride, min_bound,
+                max_bound);
 
     struct aabb result = {0};
     float3_add_r(result.c, max_bound, min_bound);
@@ -94,39 +196,1879 @@ typedef struct bsphere
     float r;
 } bsphere_t;
 
+static float bsphere_volume(struct bsphere* bsphere)
+{
+    float r = bsphere->r;
+    float result = 4.f / 3.f * 3.141592f * r * r * r;
+    return result;
+}
+
+typedef enum bsphere_fit
+{
+    bsphere_fit_box = 0, // Around the AABB, up to sqrt(3) too large
+    bsphere_fit_ritter,
+    bsphere_fit_epos6,
+    bsphere_fit_epos14,
+    bsphere_fit_epos26,
+    bsphere_fit_count,
+} bsphere_fit_t;
+
+static const char* bsphere_fit_names[bsphere_fit_count] = {
+    "Box", "Ritter", "EPOS-6", "EPOS-14", "EPOS-26",
+};
+
+// Directions of the EPOS-6, 14 and 26 variants (Larsson 2008), unnormalized
+// since only the order of the projections matters. SoA in groups of four,
+// the padding lanes repeat the last direction.
+#define EPOS_MAX_NORMALS_COUNT 13
+#define EPOS_NORMAL_GROUPS_COUNT 4
+static const float epos_normals[3][EPOS_NORMAL_GROUPS_COUNT * 4] = {
+    {1, 0, 0, 1, 1, 1, 1, 1, 1, 1, 0, 0, 1, 1, 1, 1},
+    {0, 1, 0, 1, 1, -1, -1, 1, -1, 0, 1, 1, 0, 0, 0, 0},
+    {0, 0, 1, 1, -1, 1, -1, 0, 0, 1, 1, -1, -1, -1, -1, -1},
+};
+
+static int bsphere_fit_normals_count(enum bsphere_fit fit)
+{
+    switch (fit)
+    {
+    case bsphere_fit_ritter:
+    case bsphere_fit_epos6: return 3;
+    case bsphere_fit_epos14: return 7;
+    default: return EPOS_MAX_NORMALS_COUNT;
+    }
+}
+
+// Indices of the points with the smallest and largest projection on each of
+// the first normals_count EPOS directions, four directions per instruction
+static void find_extremal_points(float* vertices,
+                                 int vertices_count,
+                                 int offset,
+                                 int stride,
+                                 int normals_count,
+                                 int* min_indices,
+                                 int* max_indices)
+{
+    int groups_count = (normals_count + 3) / 4;
+    __m128 nx[EPOS_NORMAL_GROUPS_COUNT];
+    __m128 ny[EPOS_NORMAL_GROUPS_COUNT];
+    __m128 nz[EPOS_NORMAL_GROUPS_COUNT];
+    __m128 min_d[EPOS_NORMAL_GROUPS_COUNT];
+    __m128 max_d[EPOS_NORMAL_GROUPS_COUNT];
+    __m128i min_i[EPOS_NORMAL_GROUPS_COUNT];
+    __m128i max_i[EPOS_NORMAL_GROUPS_COUNT];
+    for (int g = 0; g < groups_count; g++)
+    {
+        nx[g] = _mm_loadu_ps(&epos_normals[0][g * 4]);
+        ny[g] = _mm_loadu_ps(&epos_normals[1][g * 4]);
+        nz[g] = _mm_loadu_ps(&epos_normals[2][g * 4]);
+        min_d[g] = _mm_set1_ps(FLT_MAX);
+        max_d[g] = _mm_set1_ps(-FLT_MAX);
+        min_i[g] = _mm_setzero_si128();
+        max_i[g] = _mm_setzero_si128();
+    }
+
+    for (int i = 0; i < vertices_count; i++)
+    {
+        float* p = BV_POINT(vertices, offset, stride, i);
+        __m128 px = _mm_set1_ps(p[0]);
+        __m128 py = _mm_set1_ps(p[1]);
+        __m128 pz = _mm_set1_ps(p[2]);
+        __m128i index = _mm_set1_epi32(i);
+        for (int g = 0; g < groups_count; g++)
+        {
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, nx[g]),
+                                             _mm_mul_ps(py, ny[g])),
+                                  _mm_mul_ps(pz, nz[g]));
+            __m128i is_min = _mm_castps_si128(_mm_cmplt_ps(d, min_d[g]));
+            __m128i is_max = _mm_castps_si128(_mm_cmpgt_ps(d, max_d[g]));
+            min_d[g] = _mm_min_ps(min_d[g], d);
+            max_d[g] = _mm_max_ps(max_d[g], d);
+            min_i[g] = _mm_or_si128(_mm_and_si128(is_min, index),
+                                    _mm_andnot_si128(is_min, min_i[g]));
+            max_i[g] = _mm_or_si128(_mm_and_si128(is_max, index),
+                                    _mm_andnot_si128(is_max, max_i[g]));
+        }
+    }
+
+    for (int g = 0; g < groups_count; g++)
+    {
+        int32_t mins[4];
+        int32_t maxs[4];
+        _mm_storeu_si128((__m128i*)mins, min_i[g]);
+        _mm_storeu_si128((__m128i*)maxs, max_i[g]);
+        for (int j = 0; j < 4 && g * 4 + j < normals_count; j++)
+        {
+            min_indices[g * 4 + j] = mins[j];
+            max_indices[g * 4 + j] = maxs[j];
+        }
+    }
+}
+
+// A negative radius marks the empty sphere
+static bool bsphere_contains(const struct bsphere* s, const float* p)
+{
+    if (s->r < 0)
+        return false;
+    float r = s->r * 1.0001f + 1e-6f;
+    bool result = float3_dist_sq(p, s->c) <= r * r;
+    return result;
+}
+
+static void bsphere_set_radius_to_cover(struct bsphere* s,
+                                        const float** points,
+                                        int points_count)
+{
+    float r_sq = 0;
+    for (int i = 0; i < points_count; i++)
+        r_sq = fmaxf(r_sq, float3_dist_sq(points[i], s->c));
+    s->r = sqrtf(r_sq);
+}
+
+// Smallest sphere with up to four points on its surface. Degenerate
+// triangles and tetrahedra fall back to the smaller supports.
+static struct bsphere bsphere_from_support(const float** support,
+                                           int support_count)
+{
+    struct bsphere result = {.r = -1};
+    if (support_count == 0)
+        return result;
+
+    const float* o = support[0];
+    float3_copy(result.c, (float*)o);
+    if (support_count == 1)
+    {
+        result.r = 0;
+        return result;
+    }
+
+    float a[3];
+    float b[3];
+    float3_sub_r(a, (float*)support[1], (float*)o);
+    if (support_count == 2)
+    {
+        for (int i = 0; i < 3; i++)
+            result.c[i] = o[i] + a[i] * 0.5f;
+        result.r = float3_length(a) * 0.5f;
+        return result;
+    }
+
+    float3_sub_r(b, (float*)support[2], (float*)o);
+    float axb[3];
+    float3_cross_r(axb, a, b);
+    if (support_count == 3)
+    {
+        float denom = 2.f * float3_length_sq(axb);
+        if (denom <= FLT_EPSILON * float3_length_sq(a) * float3_length_sq(b))
+        {
+            // Collinear, the two farthest points span the sphere
+            struct bsphere best = bsphere_from_support(support, 2);
+            const float* pairs[2][2] = {{support[0], support[2]},
+                                        {support[1], support[2]}};
+            for (int i = 0; i < 2; i++)
+            {
+                struct bsphere s = bsphere_from_support(pairs[i], 2);
+                if (s.r > best.r)
+                    best = s;
+            }
+            return best;
+        }
+
+        float t0[3];
+        float t1[3];
+        float3_cross_r(t0, axb, a);
+        float3_cross_r(t1, b, axb);
+        float a_sq = float3_length_sq(a);
+        float b_sq = float3_length_sq(b);
+        for (int i = 0; i < 3; i++)
+            result.c[i] = o[i] + (b_sq * t0[i] + a_sq * t1[i]) / denom;
+        bsphere_set_radius_to_cover(&result, support, 3);
+        return result;
+    }
+
+    float c[3];
+    float3_sub_r(c, (float*)support[3], (float*)o);
+    float det = 2.f * float3_dot(c, axb);
+    float scale = float3_length(a) * float3_length(b) * float3_length(c);
+    if (fabsf(det) <= FLT_EPSILON * scale)
+    {
+        // Coplanar, the best sphere through three of them that holds the
+        // fourth
+        struct bsphere best = {.r = FLT_MAX};
+        for (int skip = 0; skip < 4; skip++)
+        {
+            const float* three[3];
+            int n = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                if (i != skip)
+                    three[n++] = support[i];
+            }
+            struct bsphere s = bsphere_from_support(three, 3);
+            if (s.r < best.r && bsphere_contains(&s, support[skip]))
+                best = s;
+        }
+        if (best.r == FLT_MAX)
+        {
+            best = bsphere_from_support(support, 3);
+            bsphere_set_radius_to_cover(&best, support, 4);
+        }
+        return best;
+    }
+
+    float bxc[3];
+    float cxa[3];
+    float3_cross_r(bxc, b, c);
+    float3_cross_r(cxa, c, a);
+    float a_sq = float3_length_sq(a);
+    float b_sq = float3_length_sq(b);
+    float c_sq = float3_length_sq(c);
+    for (int i = 0; i < 3; i++)
+    {
+        result.c[i] =
+            o[i] + (a_sq * bxc[i] + b_sq * cxa[i] + c_sq * axb[i]) / det;
+    }
+    bsphere_set_radius_to_cover(&result, support, 4);
+    return result;
+}
+
+static struct bsphere welzl_rec(const float** points,
+                                int points_count,
+                                const float** support,
+                                int support_count)
+{
+    struct bsphere result = bsphere_from_support(support, support_count);
+    if (support_count == 4)
+        return result;
+
+    for (int i = 0; i < points_count; i++)
+    {
+        if (!bsphere_contains(&result, points[i]))
+        {
+            support[support_count] = points[i];
+            result = welzl_rec(points, i, support, support_count + 1);
+        }
+    }
+    return result;
+}
+
+// Exact minimum sphere (Welzl 1991), expected linear time but recursive,
+// meant for small sets
+static struct bsphere calc_bsphere_welzl_ptrs(const float** points,
+                                              int points_count)
+{
+    const float* support[4];
+    struct bsphere result = welzl_rec(points, points_count, support, 0);
+    if (result.r < 0)
+        result.r = 0;
+    return result;
+}
+
+#define WELZL_MAX_POINTS_COUNT 64
+static struct bsphere calc_bsphere_welzl(float* vertices,
+                                         int vertices_count,
+                                         int offset,
+                                         int stride)
+{
+    const float* points[WELZL_MAX_POINTS_COUNT];
+    int points_count = (vertices_count < WELZL_MAX_POINTS_COUNT)
+                           ? vertices_count
+                           : WELZL_MAX_POINTS_COUNT;
+    for (int i = 0; i < points_count; i++)
+        points[i] = BV_POINT(vertices, offset, stride, i);
+    struct bsphere result = calc_bsphere_welzl_ptrs(points, points_count);
+    return result;
+}
+
+// Second pass of Ritter's method: every point outside grows the sphere just
+// enough to hold it and the old sphere
+static void bsphere_grow_to_cover(struct bsphere* s,
+                                  float* vertices,
+                                  int vertices_count,
+                                  int offset,
+                                  int stride)
+{
+    float r_sq = s->r * s->r;
+    for (int i = 0; i < vertices_count; i++)
+    {
+        float* p = BV_POINT(vertices, offset, stride, i);
+        float d_sq = float3_dist_sq(p, s->c);
+        if (d_sq <= r_sq)
+            continue;
+
+        float d = sqrtf(d_sq);
+        float r = (s->r + d) * 0.5f;
+        float t = (r - s->r) / d;
+        for (int j = 0; j < 3; j++)
+            s->c[j] += (p[j] - s->c[j]) * t;
+        s->r = r;
+        r_sq = r * r;
+    }
+    // Rounding in the center updates can leave points a hair outside
+    s->r *= 1.00001f;
+}
+
+// The first three directions are the axes, so their extremes give the AABB.
+// Growing can lose a few percent on box-like clouds where the sphere around
+// the AABB is already close to optimal.
+static void bsphere_keep_smaller_box_sphere(struct bsphere* s,
+                                            float* vertices,
+                                            int offset,
+                                            int stride,
+                                            const int* min_indices,
+                                            const int* max_indices)
+{
+    float min_bound[3];
+    float max_bound[3];
+    for (int i = 0; i < 3; i++)
+    {
+        min_bound[i] = BV_POINT(vertices, offset, stride, min_indices[i])[i];
+        max_bound[i] = BV_POINT(vertices, offset, stride, max_indices[i])[i];
+    }
+    float half[3];
+    float3_sub_r(half, max_bound, min_bound);
+    float r = float3_length(half) * 0.5f;
+    if (r < s->r)
+    {
+        float3_add_r(s->c, min_bound, max_bound);
+        float3_divf(s->c, 2);
+        s->r = r;
+    }
+}
+
+// Ritter 1990: the widest pair of axis extremes seeds the sphere
+static struct bsphere calc_bsphere_ritter(float* vertices,
+                                          int vertices_count,
+                                          int offset,
+                                          int stride)
+{
+    int min_indices[3];
+    int max_indices[3];
+    find_extremal_points(vertices, vertices_count, offset, stride, 3,
+                         min_indices, max_indices);
+    float* a = BV_POINT(vertices, offset, stride, min_indices[0]);
+    float* b = BV_POINT(vertices, offset, stride, max_indices[0]);
+    for (int i = 1; i < 3; i++)
+    {
+        float* p = BV_POINT(vertices, offset, stride, min_indices[i]);
+        float* q = BV_POINT(vertices, offset, stride, max_indices[i]);
+        if (float3_dist_sq(p, q) > float3_dist_sq(a, b))
+        {
+            a = p;
+            b = q;
+        }
+    }
+
+    const float* pair[2] = {a, b};
+    struct bsphere result = bsphere_from_support(pair, 2);
+    bsphere_grow_to_cover(&result, vertices, vertices_count, offset, stride);
+    bsphere_keep_smaller_box_sphere(&result, vertices, offset, stride,
+                                    min_indices, max_indices);
+    return result;
+}
+
+// Larsson's extremal points optimal sphere: the exact sphere of the extremes
+// along a few fixed directions, grown over the rest like Ritter. Small sets
+// go straight to Welzl.
+static struct bsphere calc_bsphere_epos(float* vertices,
+                                        int vertices_count,
+                                        int offset,
+                                        int stride,
+                                        int normals_count)
+{
+    if (vertices_count <= 2 * normals_count)
+        return calc_bsphere_welzl(vertices, vertices_count, offset, stride);
+
+    int min_indices[EPOS_MAX_NORMALS_COUNT];
+    int max_indices[EPOS_MAX_NORMALS_COUNT];
+    find_extremal_points(vertices, vertices_count, offset, stride,
+                         normals_count, min_indices, max_indices);
+    const float* extremes[2 * EPOS_MAX_NORMALS_COUNT];
+    for (int i = 0; i < normals_count; i++)
+    {
+        extremes[2 * i] = BV_POINT(vertices, offset, stride, min_indices[i]);
+        extremes[2 * i + 1] =
+            BV_POINT(vertices, offset, stride, max_indices[i]);
+    }
+
+    struct bsphere result =
+        calc_bsphere_welzl_ptrs(extremes, 2 * normals_count);
+    bsphere_grow_to_cover(&result, vertices, vertices_count, offset, stride);
+    bsphere_keep_smaller_box_sphere(&result, vertices, offset, stride,
+                                    min_indices, max_indices);
+    return result;
+}
+
+static struct bsphere calc_bsphere_fit(enum bsphere_fit fit,
+                                       float* vertices,
+                                       int vertices_count,
+                                       int offset,
+                                       int stride)
+{
+    struct bsphere result = {0};
+    switch (fit)
+    {
+    case bsphere_fit_box: {
+        struct aabb aabb = calc_aabb(vertices, vertices_count, offset, stride);
+        float3_copy(result.c, aabb.c);
+        result.r = float3_length(aabb.r);
+        break;
+    }
+    case bsphere_fit_ritter:
+        result = calc_bsphere_ritter(vertices, vertices_count, offset, stride);
+        break;
+    default:
+        result = calc_bsphere_epos(vertices, vertices_count, offset, stride,
+                                   bsphere_fit_normals_count(fit));
+        break;
+    }
+    return result;
+}
+
 static struct bsphere
     calc_bsphere(float* vertices, int vertices_count, int offset, int stride)
 {
-    struct aabb aabb = calc_aabb(vertices, vertices_count, offset, stride);
-    struct bsphere result = {0};
-    float3_copy(result.c, aabb.c);
-    result.r = float3_length(aabb.r);
+    struct bsphere result = calc_bsphere_fit(bsphere_fit_epos26, vertices,
+                                             vertices_count, offset, stride);
+    return result;
+}
+
+// Oriented box, axes are the rows of u
+typedef struct obb
+{
+    float c[3];
+    float u[3][3];
+    float e[3];
+} obb_t;
 
+static float obb_volume(const struct obb* obb)
+{
+    float result = obb->e[0] * obb->e[1] * obb->e[2] * 8;
     return result;
 }
 
-static float bsphere_volume(struct bsphere* bsphere)
+// Cyclic Jacobi rotations on a symmetric 3x3 matrix. The eigenvectors end up
+// in the columns of v.
+static void symmetric_eigen3(float a[3][3], float v[3][3])
 {
-    float r = bsphere->r;
-    float result = 4.f / 3.f * 3.141592f * r * r * r;
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+            v[i][j] = (i == j) ? 1.f : 0.f;
+    }
+
+    for (int sweep = 0; sweep < 16; sweep++)
+    {
+        float off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+        if (off < 1e-20f)
+            break;
+
+        for (int p = 0; p < 2; p++)
+        {
+            for (int q = p + 1; q < 3; q++)
+            {
+                if (fabsf(a[p][q]) < 1e-20f)
+                    continue;
+
+                float theta = (a[q][q] - a[p][p]) / (2.f * a[p][q]);
+                float t = 1.f / (fabsf(theta) + sqrtf(theta * theta + 1.f));
+                if (theta < 0)
+                    t = -t;
+                float c = 1.f / sqrtf(t * t + 1.f);
+                float s = t * c;
+
+                for (int k = 0; k < 3; k++)
+                {
+                    float akp = a[k][p];
+                    float akq = a[k][q];
+                    a[k][p] = c * akp - s * akq;
+                    a[k][q] = s * akp + c * akq;
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    float apk = a[p][k];
+                    float aqk = a[q][k];
+                    a[p][k] = c * apk - s * aqk;
+                    a[q][k] = s * apk + c * aqk;
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    float vkp = v[k][p];
+                    float vkq = v[k][q];
+                    v[k][p] = c * vkp - s * vkq;
+                    v[k][q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+}
+
+// Extents and center of the points along fixed axes, from a SIMD min/max over
+// the projections on all three axes at once
+static void obb_fit_axes(struct obb* obb,
+                         float* vertices,
+                         int vertices_count,
+                         int offset,
+                         int stride)
+{
+    __m128 ux = _mm_setr_ps(obb->u[0][0], obb->u[1][0], obb->u[2][0], 0);
+    __m128 uy = _mm_setr_ps(obb->u[0][1], obb->u[1][1], obb->u[2][1], 0);
+    __m128 uz = _mm_setr_ps(obb->u[0][2], obb->u[1][2], obb->u[2][2], 0);
+    __m128 min_v = _mm_set1_ps(FLT_MAX);
+    __m128 max_v = _mm_set1_ps(-FLT_MAX);
+    for (int i = 0; i < vertices_count; i++)
+    {
+        float* p = BV_POINT(vertices, offset, stride, i);
+        __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p[0]), ux),
+                                         _mm_mul_ps(_mm_set1_ps(p[1]), uy)),
+                              _mm_mul_ps(_mm_set1_ps(p[2]), uz));
+        min_v = _mm_min_ps(min_v, d);
+        max_v = _mm_max_ps(max_v, d);
+    }
+    float min_d[3];
+    float max_d[3];
+    bv_store3(min_d, min_v);
+    bv_store3(max_d, max_v);
+
+    float center_local[3];
+    for (int i = 0; i < 3; i++)
+    {
+        center_local[i] = (min_d[i] + max_d[i]) * 0.5f;
+        obb->e[i] = (max_d[i] - min_d[i]) * 0.5f;
+    }
+    for (int j = 0; j < 3; j++)
+    {
+        obb->c[j] = obb->u[0][j] * center_local[0] +
+                    obb->u[1][j] * center_local[1] +
+                    obb->u[2][j] * center_local[2];
+    }
+}
+
+// Axes along the principal components of the points
+static struct obb
+    calc_obb_pca(float* vertices, int vertices_count, int offset, int stride)
+{
+    double mean[3] = {0};
+    for (int i = 0; i < vertices_count; i++)
+    {
+        float* p = BV_POINT(vertices, offset, stride, i);
+        for (int j = 0; j < 3; j++)
+            mean[j] += p[j];
+    }
+    for (int j = 0; j < 3; j++)
+        mean[j] /= (double)vertices_count;
+
+    double cov[3][3] = {0};
+    for (int i = 0; i < vertices_count; i++)
+    {
+        float* p = BV_POINT(vertices, offset, stride, i);
+        double d[3] = {p[0] - mean[0], p[1] - mean[1], p[2] - mean[2]};
+        for (int j = 0; j < 3; j++)
+        {
+            for (int k = j; k < 3; k++)
+                cov[j][k] += d[j] * d[k];
+        }
+    }
+    float a[3][3];
+    for (int j = 0; j < 3; j++)
+    {
+        for (int k = j; k < 3; k++)
+            a[j][k] = a[k][j] = (float)(cov[j][k] / (double)vertices_count);
+    }
+
+    float v[3][3];
+    symmetric_eigen3(a, v);
+
+    struct obb result = {0};
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+            result.u[i][j] = v[j][i];
+    }
+    // Keep a right-handed frame
+    float3_cross_r(result.u[2], result.u[0], result.u[1]);
+
+    obb_fit_axes(&result, vertices, vertices_count, offset, stride);
     return result;
 }
 
-typedef enum bv_type
+static void obb_corners(const struct obb* obb, float corners[8][3])
 {
-    bv_type_aabb = 0,
-    bv_type_sphere,
-    bv_type_count,
-} bv_type_t;
+    for (int i = 0; i < 8; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            float v = obb->c[j];
+            for (int k = 0; k < 3; k++)
+            {
+                float s = (i & (1 << k)) ? obb->e[k] : -obb->e[k];
+                v += obb->u[k][j] * s;
+            }
+            corners[i][j] = v;
+        }
+    }
+}
 
-typedef struct bvolume
+static struct obb obb_from_aabb(const struct aabb* aabb)
 {
-    enum bv_type type;
-    union
+    struct obb result = {0};
+    for (int i = 0; i < 3; i++)
     {
-        struct aabb aabb;
-        struct bsphere sphere;
-    };
-} bvolume_t;
+        result.c[i] = aabb->c[i];
+        result.u[i][i] = 1.f;
+        result.e[i] = aabb->r[i];
+    }
+    return result;
+}
+
+// Half extents of the box around the OBB
+static void obb_aabb_extents(const struct obb* obb, float* r)
+{
+    for (int j = 0; j < 3; j++)
+    {
+        r[j] = obb->e[0] * fabsf(obb->u[0][j]) +
+               obb->e[1] * fabsf(obb->u[1][j]) +
+               obb->e[2] * fabsf(obb->u[2][j]);
+    }
+}
+
+// Principal axes of the points, or the axes of the world when they give the
+// smaller box. PCA is thrown off by uneven point density.
+static struct obb
+    calc_obb(float* vertices, int vertices_count, int offset, int stride)
+{
+    struct obb result = calc_obb_pca(vertices, vertices_count, offset, stride);
+    struct aabb aabb = calc_aabb(vertices, vertices_count, offset, stride);
+    if (aabb_volume(&aabb) < obb_volume(&result))
+        result = obb_from_aabb(&aabb);
+    return result;
+}
+
+// Discrete oriented polytope bounded by slabs along the EPOS directions. The
+// 14-DOP uses the axes and the corners, the 18-DOP the axes and the edges and
+// the 26-DOP all 13 of them. Slabs a DOP doesn't use, including the padding
+// lanes, stay unbounded so every test can run on all four groups.
+#define KDOP_SLABS_COUNT (EPOS_NORMAL_GROUPS_COUNT * 4)
+typedef struct kdop
+{
+    float min[KDOP_SLABS_COUNT];
+    float max[KDOP_SLABS_COUNT];
+    int k;
+} kdop_t;
+
+static bool kdop_slab_used(int k, int slab)
+{
+    if (slab < 3)
+        return true;
+    if (slab < 7)
+        return k != 18;
+    return k != 14;
+}
+
+static void kdop_clear_unused(struct kdop* kdop)
+{
+    for (int i = 0; i < KDOP_SLABS_COUNT; i++)
+    {
+        if (!kdop_slab_used(kdop->k, i))
+        {
+            kdop->min[i] = -FLT_MAX;
+            kdop->max[i] = FLT_MAX;
+        }
+    }
+}
+
+// Same slab min/max reduction as find_extremal_points, without the indices
+static struct kdop calc_kdop(int k,
+                             float* vertices,
+                             int vertices_count,
+                             int offset,
+                             int stride)
+{
+    __m128 nx[EPOS_NORMAL_GROUPS_COUNT];
+    __m128 ny[EPOS_NORMAL_GROUPS_COUNT];
+    __m128 nz[EPOS_NORMAL_GROUPS_COUNT];
+    __m128 min_d[EPOS_NORMAL_GROUPS_COUNT];
+    __m128 max_d[EPOS_NORMAL_GROUPS_COUNT];
+    for (int g = 0; g < EPOS_NORMAL_GROUPS_COUNT; g++)
+    {
+        nx[g] = _mm_loadu_ps(&epos_normals[0][g * 4]);
+        ny[g] = _mm_loadu_ps(&epos_normals[1][g * 4]);
+        nz[g] = _mm_loadu_ps(&epos_normals[2][g * 4]);
+        min_d[g] = _mm_set1_ps(FLT_MAX);
+        max_d[g] = _mm_set1_ps(-FLT_MAX);
+    }
+
+    for (int i = 0; i < vertices_count; i++)
+    {
+        float* p = BV_POINT(vertices, offset, stride, i);
+        __m128 px = _mm_set1_ps(p[0]);
+        __m128 py = _mm_set1_ps(p[1]);
+        __m128 pz = _mm_set1_ps(p[2]);
+        for (int g = 0; g < EPOS_NORMAL_GROUPS_COUNT; g++)
+        {
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, nx[g]),
+                                             _mm_mul_ps(py, ny[g])),
+                                  _mm_mul_ps(pz, nz[g]));
+            min_d[g] = _mm_min_ps(min_d[g], d);
+            max_d[g] = _mm_max_ps(max_d[g], d);
+        }
+    }
+
+    struct kdop result = {.k = k};
+    for (int g = 0; g < EPOS_NORMAL_GROUPS_COUNT; g++)
+    {
+        _mm_storeu_ps(result.min + g * 4, min_d[g]);
+        _mm_storeu_ps(result.max + g * 4, max_d[g]);
+    }
+    kdop_clear_unused(&result);
+    return result;
+}
+
+// The DOP around a box, its slabs touch the box corners
+static struct kdop
+    kdop_from_bounds(int k, const float* min_bound, const float* max_bound)
+{
+    struct kdop result = {.k = k};
+    for (int i = 0; i < KDOP_SLABS_COUNT; i++)
+    {
+        float min_d = 0;
+        float max_d = 0;
+        for (int j = 0; j < 3; j++)
+        {
+            float n = epos_normals[j][i];
+            min_d += n * ((n > 0) ? min_bound[j] : max_bound[j]);
+            max_d += n * ((n > 0) ? max_bound[j] : min_bound[j]);
+        }
+        result.min[i] = min_d;
+        result.max[i] = max_d;
+    }
+    kdop_clear_unused(&result);
+    return result;
+}
+
+// Fewer slabs of the same DOP. A tight 26-DOP makes tight 14 and 18-DOPs.
+static struct kdop kdop_restrict(const struct kdop* kdop, int k)
+{
+    struct kdop result = *kdop;
+    result.k = k;
+    kdop_clear_unused(&result);
+    return result;
+}
+
+static void kdop_merge(struct kdop* result,
+                       const struct kdop* a,
+                       const struct kdop* b)
+{
+    result->k = a->k;
+    for (int i = 0; i < KDOP_SLABS_COUNT; i += 4)
+    {
+        _mm_storeu_ps(result->min + i, _mm_min_ps(_mm_loadu_ps(a->min + i),
+                                                   _mm_loadu_ps(b->min + i)));
+        _mm_storeu_ps(result->max + i, _mm_max_ps(_mm_loadu_ps(a->max + i),
+                                                  _mm_loadu_ps(b->max + i)));
+    }
+}
+
+static void kdop_aabb(const struct kdop* kdop, struct aabb* aabb)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        aabb->c[i] = (kdop->min[i] + kdop->max[i]) * 0.5f;
+        aabb->r[i] = (kdop->max[i] - kdop->min[i]) * 0.5f;
+    }
+}
+
+// Faces of a DOP as convex polygons, counter-clockwise seen from outside
+#define KDOP_POLYTOPE_MAX_FACES (EPOS_MAX_NORMALS_COUNT * 2)
+#define KDOP_POLYTOPE_MAX_FACE_VERTICES 32
+typedef struct kdop_polytope
+{
+    float vertices[KDOP_POLYTOPE_MAX_FACES][KDOP_POLYTOPE_MAX_FACE_VERTICES][3];
+    int counts[KDOP_POLYTOPE_MAX_FACES];
+    int faces_count;
+} kdop_polytope_t;
+
+// Point where the plane crosses edge ab. The endpoints are put in a fixed
+// order first, so both faces sharing the edge get the same point.
+static void kdop_polytope_cut_edge(const float* a,
+                                   float da,
+                                   const float* b,
+                                   float db,
+                                   float* result)
+{
+    bool swap = (a[0] != b[0]) ? (a[0] > b[0])
+                               : (a[1] != b[1]) ? (a[1] > b[1]) : (a[2] > b[2]);
+    if (swap)
+    {
+        const float* p = a;
+        a = b;
+        b = p;
+        float d = da;
+        da = db;
+        db = d;
+    }
+    float t = da / (da - db);
+    for (int i = 0; i < 3; i++)
+        result[i] = a[i] + (b[i] - a[i]) * t;
+}
+
+// Keeps the part of the polytope where dot(n, x) <= h. The cap face is
+// stitched from the segment every cut face leaves on the plane, entry to
+// exit, which orders it counter-clockwise already. False when the polytope
+// is empty or runs out of space.
+static bool kdop_polytope_clip(struct kdop_polytope* p, const float* n, float h)
+{
+    bool any_outside = false;
+    bool any_inside = false;
+    for (int f = 0; f < p->faces_count; f++)
+    {
+        for (int i = 0; i < p->counts[f]; i++)
+        {
+            float d = float3_dot(n, p->vertices[f][i]) - h;
+            any_outside |= (d > 0);
+            any_inside |= (d <= 0);
+        }
+    }
+    if (!any_inside)
+        return false;
+    if (!any_outside)
+        return true;
+
+    float starts[KDOP_POLYTOPE_MAX_FACES][3];
+    float ends[KDOP_POLYTOPE_MAX_FACES][3];
+    int segments_count = 0;
+    int faces_count = 0;
+    for (int f = 0; f < p->faces_count; f++)
+    {
+        float(*v)[3] = p->vertices[f];
+        int count = p->counts[f];
+        float clipped[KDOP_POLYTOPE_MAX_FACE_VERTICES][3];
+        int clipped_count = 0;
+        bool has_entry = false;
+        bool has_exit = false;
+        float entry_point[3] = {0};
+        float exit_point[3] = {0};
+        for (int i = 0; i < count; i++)
+        {
+            const float* a = v[i];
+            const float* b = v[(i + 1) % count];
+            float da = float3_dot(n, a) - h;
+            float db = float3_dot(n, b) - h;
+            if (clipped_count + 2 > KDOP_POLYTOPE_MAX_FACE_VERTICES)
+                return false;
+            if (da <= 0)
+                float3_copy(clipped[clipped_count++], (float*)a);
+            if ((da <= 0) != (db <= 0))
+            {
+                float* x = clipped[clipped_count++];
+                kdop_polytope_cut_edge(a, da, b, db, x);
+                if (da <= 0)
+                {
+                    float3_copy(exit_point, x);
+                    has_exit = true;
+                }
+                else
+                {
+                    float3_copy(entry_point, x);
+                    has_entry = true;
+                }
+            }
+        }
+
+        // Faces the plane only touches at a vertex leave an empty segment
+        if (has_entry && has_exit &&
+            float3_dist_sq(entry_point, exit_point) >
+                (1.f + float3_length_sq(entry_point)) * 1e-10f)
+        {
+            float3_copy(starts[segments_count], entry_point);
+            float3_copy(ends[segments_count], exit_point);
+            ++segments_count;
+        }
+        if (clipped_count >= 3)
+        {
+            memcpy(p->vertices[faces_count], clipped,
+                   clipped_count * sizeof(float[3]));
+            p->counts[faces_count] = clipped_count;
+            ++faces_count;
+        }
+    }
+    p->faces_count = faces_count;
+
+    if (segments_count < 3)
+        return true;
+    if (faces_count == KDOP_POLYTOPE_MAX_FACES ||
+        segments_count > KDOP_POLYTOPE_MAX_FACE_VERTICES)
+    {
+        return false;
+    }
+
+    float(*cap)[3] = p->vertices[faces_count];
+    bool used[KDOP_POLYTOPE_MAX_FACES] = {true};
+    float3_copy(cap[0], starts[0]);
+    int cap_count = 1;
+    int current = 0;
+    while (cap_count < segments_count)
+    {
+        // Cuts through an existing vertex come from different edges and
+        // only match approximately
+        int next = -1;
+        float next_dist_sq = FLT_MAX;
+        for (int i = 0; i < segments_count; i++)
+        {
+            float dist_sq = float3_dist_sq(starts[i], ends[current]);
+            if (!used[i] && dist_sq < next_dist_sq)
+            {
+                next = i;
+                next_dist_sq = dist_sq;
+            }
+        }
+        if (next_dist_sq > (1.f + float3_length_sq(ends[current])) * 1e-8f)
+            return false;
+        used[next] = true;
+        float3_copy(cap[cap_count++], starts[next]);
+        current = next;
+    }
+    p->counts[faces_count] = cap_count;
+    ++p->faces_count;
+    return true;
+}
+
+// The box of the axis slabs, clipped by the diagonal slabs
+static bool calc_kdop_polytope(const struct kdop* kdop,
+                               struct kdop_polytope* p)
+{
+    static const int box_faces[6][4] = {
+        {0, 4, 6, 2}, {1, 3, 7, 5}, {0, 1, 5, 4},
+        {2, 6, 7, 3}, {0, 2, 3, 1}, {4, 5, 7, 6},
+    };
+    p->faces_count = 6;
+    for (int f = 0; f < 6; f++)
+    {
+        p->counts[f] = 4;
+        for (int i = 0; i < 4; i++)
+        {
+            int corner = box_faces[f][i];
+            for (int j = 0; j < 3; j++)
+            {
+                p->vertices[f][i][j] = (corner & (1 << j)) ? kdop->max[j]
+                                                            : kdop->min[j];
+            }
+        }
+    }
+
+    for (int i = 3; i < EPOS_MAX_NORMALS_COUNT; i++)
+    {
+        if (!kdop_slab_used(kdop->k, i))
+            continue;
+        float n[3] = {epos_normals[0][i], epos_normals[1][i],
+                      epos_normals[2][i]};
+        float neg_n[3] = {-n[0], -n[1], -n[2]};
+        if (!kdop_polytope_clip(p, n, kdop->max[i]) ||
+            !kdop_polytope_clip(p, neg_n, -kdop->min[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Exact measures of the polytope, or of the box of the axis slabs when the
+// clipping fails on degenerate input
+static void kdop_measure(const struct kdop* kdop,
+                         float* out_surface_area,
+                         float* out_volume)
+{
+    struct aabb aabb;
+    kdop_aabb(kdop, &aabb);
+
+    struct kdop_polytope p;
+    if (!calc_kdop_polytope(kdop, &p))
+    {
+        const float* r = aabb.r;
+        *out_surface_area = 8 * (r[0] * r[1] + r[1] * r[2] + r[2] * r[0]);
+        *out_volume = aabb_volume(&aabb);
+        return;
+    }
+
+    // Relative to the center, which keeps the cross products small
+    float surface_area = 0;
+    float volume = 0;
+    for (int f = 0; f < p.faces_count; f++)
+    {
+        float area[3] = {0};
+        float v0[3];
+        float3_sub_r(v0, p.vertices[f][0], aabb.c);
+        for (int i = 1; i + 1 < p.counts[f]; i++)
+        {
+            float a[3];
+            float b[3];
+            float cross[3];
+            float3_sub_r(a, p.vertices[f][i], p.vertices[f][0]);
+            float3_sub_r(b, p.vertices[f][i + 1], p.vertices[f][0]);
+            float3_cross_r(cross, a, b);
+            float3_add_r(area, area, cross);
+        }
+        surface_area += float3_length(area) * 0.5f;
+        volume += float3_dot(v0, area) * 0.5f;
+    }
+    *out_surface_area = surface_area;
+    *out_volume = fmaxf(volume / 3.f, 0.f);
+}
+
+static float kdop_volume(const struct kdop* kdop)
+{
+    float surface_area;
+    float volume;
+    kdop_measure(kdop, &surface_area, &volume);
+    return volume;
+}
+
+// Estimate for the SAH: the area of the axis box scaled by the mean ratio of
+// the diagonal slab widths to the box's widths along the same normals. Exact
+// for boxes and within ~25% for typical clouds, at a fraction of the cost of
+// kdop_measure, which the tree builders can't afford per candidate.
+static float kdop_surface_area(const struct kdop* kdop)
+{
+    float d[3];
+    for (int i = 0; i < 3; i++)
+        d[i] = kdop->max[i] - kdop->min[i];
+    float box_area = 2 * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+
+    float ratio_sum = 0;
+    int ratio_count = 0;
+    for (int i = 3; i < 13; i++)
+    {
+        if (!kdop_slab_used(kdop->k, i))
+            continue;
+        float box_width = fabsf(epos_normals[0][i]) * d[0] +
+                          fabsf(epos_normals[1][i]) * d[1] +
+                          fabsf(epos_normals[2][i]) * d[2];
+        if (box_width > 0)
+        {
+            float width = kdop->max[i] - kdop->min[i];
+            ratio_sum += fminf(width / box_width, 1.f);
+            ++ratio_count;
+        }
+    }
+    float result = box_area;
+    if (ratio_count > 0)
+        result *= ratio_sum / (float)ratio_count;
+    return result;
+}
+
+static float aabb_surface_area(const struct aabb* aabb)
+{
+    const float* r = aabb->r;
+    float result = 8 * (r[0] * r[1] + r[1] * r[2] + r[2] * r[0]);
+    return result;
+}
+
+static float bsphere_surface_area(const struct bsphere* bsphere)
+{
+    float r = bsphere->r;
+    float result = 4.f * 3.141592f * r * r;
+    return result;
+}
+
+static float obb_surface_area(const struct obb* obb)
+{
+    const float* e = obb->e;
+    float result = 8 * (e[0] * e[1] + e[1] * e[2] + e[2] * e[0]);
+    return result;
+}
+
+typedef enum bv_type
+{
+    bv_type_aabb = 0,
+    bv_type_sphere,
+    bv_type_obb,
+    bv_type_kdop14,
+    bv_type_kdop18,
+    bv_type_kdop26,
+    bv_type_count,
+} bv_type_t;
+
+static const char* bv_type_names[bv_type_count] = {
+    "AABB", "Sphere", "OBB", "14-DOP", "18-DOP", "26-DOP",
+};
+
+// 0 for the types that aren't DOPs
+static int bv_type_kdop_k(enum bv_type type)
+{
+    switch (type)
+    {
+    case bv_type_kdop14: return 14;
+    case bv_type_kdop18: return 18;
+    case bv_type_kdop26: return 26;
+    default: return 0;
+    }
+}
+
+typedef struct bvolume
+{
+    enum bv_type type;
+    union
+    {
+        struct aabb aabb;
+        struct bsphere sphere;
+        struct obb obb;
+        struct kdop kdop;
+    };
+} bvolume_t;
+
+static float bvolume_surface_area(const struct bvolume* bv)
+{
+    float result = 0;
+    switch (bv->type)
+    {
+    case bv_type_aabb:
+        result = aabb_surface_area(&bv->aabb);
+        break;
+    case bv_type_sphere:
+        result = bsphere_surface_area(&bv->sphere);
+        break;
+    case bv_type_obb:
+        result = obb_surface_area(&bv->obb);
+        break;
+    default:
+        result = kdop_surface_area(&bv->kdop);
+        break;
+    }
+    return result;
+}
+
+static float bvolume_volume(const struct bvolume* bv)
+{
+    float result = 0;
+    switch (bv->type)
+    {
+    case bv_type_aabb:
+        result = aabb_volume((struct aabb*)&bv->aabb);
+        break;
+    case bv_type_sphere:
+        result = bsphere_volume((struct bsphere*)&bv->sphere);
+        break;
+    case bv_type_obb:
+        result = obb_volume(&bv->obb);
+        break;
+    default:
+        result = kdop_volume(&bv->kdop);
+        break;
+    }
+    return result;
+}
+
+static void bvolume_center(const struct bvolume* bv, float* center)
+{
+    switch (bv->type)
+    {
+    case bv_type_aabb:
+        float3_copy(center, (float*)bv->aabb.c);
+        break;
+    case bv_type_sphere:
+        float3_copy(center, (float*)bv->sphere.c);
+        break;
+    case bv_type_obb:
+        float3_copy(center, (float*)bv->obb.c);
+        break;
+    default:
+        for (int i = 0; i < 3; i++)
+            center[i] = (bv->kdop.min[i] + bv->kdop.max[i]) * 0.5f;
+        break;
+    }
+}
+
+// The box around any volume
+static struct aabb bvolume_aabb(const struct bvolume* bv)
+{
+    struct aabb result;
+    switch (bv->type)
+    {
+    case bv_type_aabb:
+        result = bv->aabb;
+        break;
+    case bv_type_sphere:
+        float3_copy(result.c, (float*)bv->sphere.c);
+        result.r[0] = result.r[1] = result.r[2] = bv->sphere.r;
+        break;
+    case bv_type_obb:
+        float3_copy(result.c, (float*)bv->obb.c);
+        obb_aabb_extents(&bv->obb, result.r);
+        break;
+    default:
+        kdop_aabb(&bv->kdop, &result);
+        break;
+    }
+    return result;
+}
+
+// Smallest volume of the same type enclosing both. For OBBs the box is
+// refitted to the corners of both, which isn't the smallest but contains them.
+static struct bvolume merge_bvolumes(const struct bvolume* a,
+                                     const struct bvolume* b)
+{
+    struct bvolume result = {.type = a->type};
+    switch (a->type)
+    {
+    case bv_type_aabb:
+        for (int i = 0; i < 3; i++)
+        {
+            float min_v = fminf(a->aabb.c[i] - a->aabb.r[i],
+                                b->aabb.c[i] - b->aabb.r[i]);
+            float max_v = fmaxf(a->aabb.c[i] + a->aabb.r[i],
+                                b->aabb.c[i] + b->aabb.r[i]);
+            result.aabb.c[i] = (min_v + max_v) * 0.5f;
+            result.aabb.r[i] = (max_v - min_v) * 0.5f;
+        }
+        break;
+    case bv_type_sphere:
+    {
+        float d[3];
+        float3_sub_r(d, (float*)b->sphere.c, (float*)a->sphere.c);
+        float dist = float3_length(d);
+        float ra = a->sphere.r;
+        float rb = b->sphere.r;
+        if (dist + rb <= ra)
+        {
+            result.sphere = a->sphere;
+        }
+        else if (dist + ra <= rb)
+        {
+            result.sphere = b->sphere;
+        }
+        else
+        {
+            float r = (dist + ra + rb) * 0.5f;
+            float t = (r - ra) / dist;
+            for (int i = 0; i < 3; i++)
+                result.sphere.c[i] = a->sphere.c[i] + d[i] * t;
+            result.sphere.r = r;
+        }
+        break;
+    }
+    case bv_type_obb:
+    {
+        float corners[16][3];
+        obb_corners(&a->obb, corners);
+        obb_corners(&b->obb, corners + 8);
+        // Refit the corners along the axes of either child or of the world,
+        // the PCA solve is too slow for the refits on every move
+        struct obb candidates[3] = {a->obb, b->obb, {0}};
+        for (int i = 0; i < 3; i++)
+            candidates[2].u[i][i] = 1.f;
+        float best_volume = FLT_MAX;
+        for (int i = 0; i < 3; i++)
+        {
+            obb_fit_axes(&candidates[i], (float*)corners, 16, 0,
+                         sizeof(float[3]));
+            float volume = obb_volume(&candidates[i]);
+            if (volume < best_volume)
+            {
+                best_volume = volume;
+                result.obb = candidates[i];
+            }
+        }
+        break;
+    }
+    default:
+        kdop_merge(&result.kdop, &a->kdop, &b->kdop);
+        break;
+    }
+    return result;
+}
+
+// The box of the points, or the volume around that box
+static struct bvolume
+    bvolume_from_bounds(enum bv_type type, float* min_bound, float* max_bound)
+{
+    struct aabb aabb;
+    float3_add_r(aabb.c, max_bound, min_bound);
+    float3_divf(aabb.c, 2);
+    float3_sub_r(aabb.r, max_bound, min_bound);
+    float3_divf(aabb.r, 2);
+
+    struct bvolume result = {.type = type};
+    switch (type)
+    {
+    case bv_type_aabb:
+        result.aabb = aabb;
+        break;
+    case bv_type_sphere:
+        float3_copy(result.sphere.c, aabb.c);
+        result.sphere.r = float3_length(aabb.r);
+        break;
+    case bv_type_obb:
+        result.obb = obb_from_aabb(&aabb);
+        break;
+    default:
+        result.kdop =
+            kdop_from_bounds(bv_type_kdop_k(type), min_bound, max_bound);
+        break;
+    }
+    return result;
+}
+
+// Fitted to the points themselves, the top-down builder's node volumes
+static struct bvolume bvolume_from_points(enum bv_type type,
+                                          enum bsphere_fit sphere_fit,
+                                          float* vertices,
+                                          int vertices_count,
+                                          int offset,
+                                          int stride)
+{
+    struct bvolume result = {.type = type};
+    switch (type)
+    {
+    case bv_type_aabb:
+        result.aabb = calc_aabb(vertices, vertices_count, offset, stride);
+        break;
+    case bv_type_sphere:
+        result.sphere = calc_bsphere_fit(sphere_fit, vertices, vertices_count,
+                                         offset, stride);
+        break;
+    case bv_type_obb:
+        result.obb = calc_obb(vertices, vertices_count, offset, stride);
+        break;
+    default:
+        result.kdop = calc_kdop(bv_type_kdop_k(type), vertices, vertices_count,
+                                offset, stride);
+        break;
+    }
+    return result;
+}
+
+// Six planes stored as SoA in two groups of four, so one box or sphere is
+// tested against four planes per instruction. Lanes 6 and 7 hold a plane
+// that everything is inside of.
+typedef struct frustum
+{
+    float a[8];
+    float b[8];
+    float c[8];
+    float d[8];
+} frustum_t;
+
+#define FRUSTUM_PLANES_ALL 0x3F
+
+// Gribb/Hartmann extraction from a column-major view-projection matrix. The
+// planes follow GL clipping (-w <= z <= w) and point inwards.
+static struct frustum calc_frustum(const float* m)
+{
+    struct frustum result = {0};
+
+    // Rows of the matrix
+    float r[4][4];
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 4; j++)
+            r[i][j] = m[j * 4 + i];
+    }
+
+    // left, right, bottom, top, near, far
+    for (int i = 0; i < 6; i++)
+    {
+        float sign = (i % 2 == 0) ? 1.f : -1.f;
+        const float* row = r[i / 2];
+        float p[4];
+        for (int j = 0; j < 4; j++)
+            p[j] = r[3][j] + sign * row[j];
+
+        float length = float3_length(p);
+        result.a[i] = p[0] / length;
+        result.b[i] = p[1] / length;
+        result.c[i] = p[2] / length;
+        result.d[i] = p[3] / length;
+    }
+    for (int i = 6; i < 8; i++)
+        result.d[i] = 1.f;
+
+    return result;
+}
+
+// Signed distances of the center and the projected extent along the normals
+// of planes [group * 4, group * 4 + 4), folded into outside/inside bit masks
+static void frustum_classify4(const struct frustum* f,
+                              int group,
+                              __m128 cx,
+                              __m128 cy,
+                              __m128 cz,
+                              __m128 extent_x,
+                              __m128 extent_y,
+                              __m128 extent_z,
+                              bool box,
+                              int* out_outside,
+                              int* out_inside)
+{
+    __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 a = _mm_loadu_ps(f->a + group * 4);
+    __m128 b = _mm_loadu_ps(f->b + group * 4);
+    __m128 c = _mm_loadu_ps(f->c + group * 4);
+    __m128 d = _mm_loadu_ps(f->d + group * 4);
+
+    __m128 dist = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(a, cx), _mm_mul_ps(b, cy)),
+        _mm_add_ps(_mm_mul_ps(c, cz), d));
+
+    __m128 extent = extent_x;
+    if (box)
+    {
+        extent = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(_mm_and_ps(a, abs_mask), extent_x),
+                       _mm_mul_ps(_mm_and_ps(b, abs_mask), extent_y)),
+            _mm_mul_ps(_mm_and_ps(c, abs_mask), extent_z));
+    }
+
+    int shift = group * 4;
+    __m128 neg_extent = _mm_sub_ps(_mm_setzero_ps(), extent);
+    *out_outside |= _mm_movemask_ps(_mm_cmplt_ps(dist, neg_extent)) << shift;
+    *out_inside |= _mm_movemask_ps(_mm_cmpge_ps(dist, extent)) << shift;
+}
+
+// Signed distances of four volumes in SoA to a single plane, folded into
+// per-volume outside/inside bit masks
+static void frustum_classify_plane4(const struct frustum* f,
+                                    int plane,
+                                    __m128 cx,
+                                    __m128 cy,
+                                    __m128 cz,
+                                    __m128 extent_x,
+                                    __m128 extent_y,
+                                    __m128 extent_z,
+                                    bool box,
+                                    int* out_outside,
+                                    int* out_inside)
+{
+    __m128 a = _mm_set1_ps(f->a[plane]);
+    __m128 b = _mm_set1_ps(f->b[plane]);
+    __m128 c = _mm_set1_ps(f->c[plane]);
+    __m128 d = _mm_set1_ps(f->d[plane]);
+
+    __m128 dist = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(a, cx), _mm_mul_ps(b, cy)),
+        _mm_add_ps(_mm_mul_ps(c, cz), d));
+
+    __m128 extent = extent_x;
+    if (box)
+    {
+        __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+        extent = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(_mm_and_ps(a, abs_mask), extent_x),
+                       _mm_mul_ps(_mm_and_ps(b, abs_mask), extent_y)),
+            _mm_mul_ps(_mm_and_ps(c, abs_mask), extent_z));
+    }
+
+    *out_outside = _mm_movemask_ps(
+        _mm_cmplt_ps(dist, _mm_sub_ps(_mm_setzero_ps(), extent)));
+    *out_inside = _mm_movemask_ps(_mm_cmpge_ps(dist, extent));
+}
+
+// Upper bound on the largest dot(n, x) over the DOP, for four normals in
+// SoA. Any nonnegative mix of slab normals adding up to n bounds it by the
+// same mix of slab offsets (weak LP duality). Tried are the axis slabs alone
+// and each diagonal slab taking as much of n as it can, the axis slabs
+// covering the rest.
+static __m128 kdop_support4(const struct kdop* kdop,
+                            __m128 a,
+                            __m128 b,
+                            __m128 c)
+{
+    __m128 min_x = _mm_set1_ps(kdop->min[0]);
+    __m128 min_y = _mm_set1_ps(kdop->min[1]);
+    __m128 min_z = _mm_set1_ps(kdop->min[2]);
+    __m128 max_x = _mm_set1_ps(kdop->max[0]);
+    __m128 max_y = _mm_set1_ps(kdop->max[1]);
+    __m128 max_z = _mm_set1_ps(kdop->max[2]);
+#define KDOP_AXIS_SUPPORT4(x, y, z)                                            \
+    _mm_add_ps(_mm_add_ps(_mm_max_ps(_mm_mul_ps(x, max_x),                     \
+                                     _mm_mul_ps(x, min_x)),                    \
+                          _mm_max_ps(_mm_mul_ps(y, max_y),                     \
+                                     _mm_mul_ps(y, min_y))),                   \
+               _mm_max_ps(_mm_mul_ps(z, max_z), _mm_mul_ps(z, min_z)))
+
+    __m128 result = KDOP_AXIS_SUPPORT4(a, b, c);
+    for (int i = 3; i < EPOS_MAX_NORMALS_COUNT; i++)
+    {
+        if (!kdop_slab_used(kdop->k, i))
+            continue;
+
+        const float n[3] = {epos_normals[0][i], epos_normals[1][i],
+                            epos_normals[2][i]};
+        const __m128 components[3] = {a, b, c};
+        for (int s = 1; s >= -1; s -= 2)
+        {
+            __m128 alpha = _mm_set1_ps(FLT_MAX);
+            for (int j = 0; j < 3; j++)
+            {
+                if (n[j] != 0)
+                {
+                    alpha = _mm_min_ps(alpha, _mm_mul_ps(_mm_set1_ps(s * n[j]),
+                                                         components[j]));
+                }
+            }
+            alpha = _mm_max_ps(alpha, _mm_setzero_ps());
+
+            __m128 rx = _mm_sub_ps(a, _mm_mul_ps(alpha, _mm_set1_ps(s * n[0])));
+            __m128 ry = _mm_sub_ps(b, _mm_mul_ps(alpha, _mm_set1_ps(s * n[1])));
+            __m128 rz = _mm_sub_ps(c, _mm_mul_ps(alpha, _mm_set1_ps(s * n[2])));
+            float offset = (s > 0) ? kdop->max[i] : -kdop->min[i];
+            __m128 bound = _mm_add_ps(_mm_mul_ps(alpha, _mm_set1_ps(offset)),
+                                      KDOP_AXIS_SUPPORT4(rx, ry, rz));
+            result = _mm_min_ps(result, bound);
+        }
+    }
+#undef KDOP_AXIS_SUPPORT4
+    return result;
+}
+
+// Range of signed distances of an OBB or a DOP to planes
+// [group * 4, group * 4 + 4), folded into outside/inside bit masks
+static void frustum_classify_range4(const struct frustum* f,
+                                    int group,
+                                    const struct bvolume* bv,
+                                    int* out_outside,
+                                    int* out_inside)
+{
+    __m128 a = _mm_loadu_ps(f->a + group * 4);
+    __m128 b = _mm_loadu_ps(f->b + group * 4);
+    __m128 c = _mm_loadu_ps(f->c + group * 4);
+    __m128 d = _mm_loadu_ps(f->d + group * 4);
+
+    __m128 min_dist;
+    __m128 max_dist;
+    if (bv->type == bv_type_obb)
+    {
+        const struct obb* obb = &bv->obb;
+        __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+        __m128 dist = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(a, _mm_set1_ps(obb->c[0])),
+                       _mm_mul_ps(b, _mm_set1_ps(obb->c[1]))),
+            _mm_add_ps(_mm_mul_ps(c, _mm_set1_ps(obb->c[2])), d));
+        __m128 extent = _mm_setzero_ps();
+        for (int i = 0; i < 3; i++)
+        {
+            __m128 nu = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(a, _mm_set1_ps(obb->u[i][0])),
+                           _mm_mul_ps(b, _mm_set1_ps(obb->u[i][1]))),
+                _mm_mul_ps(c, _mm_set1_ps(obb->u[i][2])));
+            extent = _mm_add_ps(extent, _mm_mul_ps(_mm_and_ps(nu, abs_mask),
+                                                   _mm_set1_ps(obb->e[i])));
+        }
+        min_dist = _mm_sub_ps(dist, extent);
+        max_dist = _mm_add_ps(dist, extent);
+    }
+    else
+    {
+        __m128 zero = _mm_setzero_ps();
+        max_dist = _mm_add_ps(kdop_support4(&bv->kdop, a, b, c), d);
+        min_dist = _mm_sub_ps(
+            d, kdop_support4(&bv->kdop, _mm_sub_ps(zero, a),
+                             _mm_sub_ps(zero, b), _mm_sub_ps(zero, c)));
+    }
+
+    int shift = group * 4;
+    *out_outside |= _mm_movemask_ps(_mm_cmplt_ps(max_dist, _mm_setzero_ps()))
+                    << shift;
+    *out_inside |= _mm_movemask_ps(_mm_cmpge_ps(min_dist, _mm_setzero_ps()))
+                   << shift;
+}
+
+typedef enum frustum_result
+{
+    frustum_result_outside = -1,
+    frustum_result_intersect = 0,
+    frustum_result_inside = 1,
+} frustum_result_t;
+
+// Only planes in *plane_mask are tested. Planes the volume is completely
+// inside of are removed from the mask, children of the volume can skip them.
+static enum frustum_result frustum_test_bvolume(const struct frustum* f,
+                                                const struct bvolume* bv,
+                                                int* plane_mask)
+{
+    int outside = 0;
+    int inside = 0;
+    if (bv->type >= bv_type_obb)
+    {
+        if (*plane_mask & 0x0F)
+            frustum_classify_range4(f, 0, bv, &outside, &inside);
+        if (*plane_mask & 0xF0)
+            frustum_classify_range4(f, 1, bv, &outside, &inside);
+        if (outside & *plane_mask)
+            return frustum_result_outside;
+
+        *plane_mask &= ~inside;
+        return (*plane_mask == 0) ? frustum_result_inside
+                                  : frustum_result_intersect;
+    }
+
+    __m128 cx, cy, cz, ex, ey, ez;
+    bool box = (bv->type == bv_type_aabb);
+    if (box)
+    {
+        cx = _mm_set1_ps(bv->aabb.c[0]);
+        cy = _mm_set1_ps(bv->aabb.c[1]);
+        cz = _mm_set1_ps(bv->aabb.c[2]);
+        ex = _mm_set1_ps(bv->aabb.r[0]);
+        ey = _mm_set1_ps(bv->aabb.r[1]);
+        ez = _mm_set1_ps(bv->aabb.r[2]);
+    }
+    else
+    {
+        cx = _mm_set1_ps(bv->sphere.c[0]);
+        cy = _mm_set1_ps(bv->sphere.c[1]);
+        cz = _mm_set1_ps(bv->sphere.c[2]);
+        ex = ey = ez = _mm_set1_ps(bv->sphere.r);
+    }
+
+    if (*plane_mask & 0x0F)
+        frustum_classify4(f, 0, cx, cy, cz, ex, ey, ez, box, &outside, &inside);
+    if (*plane_mask & 0xF0)
+        frustum_classify4(f, 1, cx, cy, cz, ex, ey, ez, box, &outside, &inside);
+
+    if (outside & *plane_mask)
+        return frustum_result_outside;
+
+    *plane_mask &= ~inside;
+    return (*plane_mask == 0) ? frustum_result_inside
+                              : frustum_result_intersect;
+}
+
+// Narrows [t_near, t_far] by four slabs, with the ray origin and direction
+// already projected on their normals. Directions parallel to a slab are
+// nudged off zero so 0 * inf never turns into NaN.
+static void bv_ray_slabs4(__m128 org_d,
+                          __m128 dir_d,
+                          __m128 min_d,
+                          __m128 max_d,
+                          __m128* t_near,
+                          __m128* t_far)
+{
+    __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 tiny = _mm_set1_ps(1e-20f);
+    __m128 is_tiny = _mm_cmplt_ps(_mm_and_ps(dir_d, abs_mask), tiny);
+    __m128 nudged = _mm_or_ps(tiny, _mm_andnot_ps(abs_mask, dir_d));
+    dir_d = _mm_or_ps(_mm_and_ps(is_tiny, nudged),
+                      _mm_andnot_ps(is_tiny, dir_d));
+
+    __m128 inv_dir = _mm_div_ps(_mm_set1_ps(1.f), dir_d);
+    __m128 t0 = _mm_mul_ps(_mm_sub_ps(min_d, org_d), inv_dir);
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(max_d, org_d), inv_dir);
+    *t_near = _mm_max_ps(*t_near, _mm_min_ps(t0, t1));
+    *t_far = _mm_min_ps(*t_far, _mm_max_ps(t0, t1));
+}
+
+// Entry distance along dir in [0, t_max], in units of dir. Rays starting
+// inside the volume enter at 0.
+static bool bvolume_intersect_ray(const struct bvolume* bv,
+                                  const float* org,
+                                  const float* dir,
+                                  float t_max,
+                                  float* out_t)
+{
+    __m128 t_near = _mm_setzero_ps();
+    __m128 t_far = _mm_set1_ps(t_max);
+    switch (bv->type)
+    {
+    case bv_type_aabb:
+    {
+        const struct aabb* aabb = &bv->aabb;
+        __m128 c = _mm_setr_ps(aabb->c[0], aabb->c[1], aabb->c[2], 0);
+        __m128 r = _mm_setr_ps(aabb->r[0], aabb->r[1], aabb->r[2], FLT_MAX);
+        bv_ray_slabs4(_mm_setr_ps(org[0], org[1], org[2], 0),
+                      _mm_setr_ps(dir[0], dir[1], dir[2], 1), _mm_sub_ps(c, r),
+                      _mm_add_ps(c, r), &t_near, &t_far);
+        break;
+    }
+    case bv_type_sphere:
+    {
+        const struct bsphere* s = &bv->sphere;
+        float oc[3] = {org[0] - s->c[0], org[1] - s->c[1], org[2] - s->c[2]};
+        float a = float3_dot(dir, dir);
+        float b = float3_dot(oc, dir);
+        float c = float3_dot(oc, oc) - s->r * s->r;
+        float discriminant = b * b - a * c;
+        if (discriminant < 0 || a == 0)
+            return false;
+        float root = sqrtf(discriminant);
+        t_near = _mm_set1_ps(fmaxf((-b - root) / a, 0));
+        t_far = _mm_set1_ps(fminf((-b + root) / a, t_max));
+        break;
+    }
+    case bv_type_obb:
+    {
+        const struct obb* obb = &bv->obb;
+        __m128 ux = _mm_setr_ps(obb->u[0][0], obb->u[1][0], obb->u[2][0], 0);
+        __m128 uy = _mm_setr_ps(obb->u[0][1], obb->u[1][1], obb->u[2][1], 0);
+        __m128 uz = _mm_setr_ps(obb->u[0][2], obb->u[1][2], obb->u[2][2], 0);
+        __m128 org_d = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(_mm_set1_ps(org[0] - obb->c[0]), ux),
+                       _mm_mul_ps(_mm_set1_ps(org[1] - obb->c[1]), uy)),
+            _mm_mul_ps(_mm_set1_ps(org[2] - obb->c[2]), uz));
+        __m128 dir_d = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(_mm_set1_ps(dir[0]), ux),
+                       _mm_mul_ps(_mm_set1_ps(dir[1]), uy)),
+            _mm_mul_ps(_mm_set1_ps(dir[2]), uz));
+        __m128 e = _mm_setr_ps(obb->e[0], obb->e[1], obb->e[2], FLT_MAX);
+        bv_ray_slabs4(org_d, dir_d, _mm_sub_ps(_mm_setzero_ps(), e), e,
+                      &t_near, &t_far);
+        break;
+    }
+    default:
+        for (int g = 0; g < EPOS_NORMAL_GROUPS_COUNT; g++)
+        {
+            __m128 nx = _mm_loadu_ps(&epos_normals[0][g * 4]);
+            __m128 ny = _mm_loadu_ps(&epos_normals[1][g * 4]);
+            __m128 nz = _mm_loadu_ps(&epos_normals[2][g * 4]);
+            __m128 org_d = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(org[0]), nx),
+                           _mm_mul_ps(_mm_set1_ps(org[1]), ny)),
+                _mm_mul_ps(_mm_set1_ps(org[2]), nz));
+            __m128 dir_d = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(dir[0]), nx),
+                           _mm_mul_ps(_mm_set1_ps(dir[1]), ny)),
+                _mm_mul_ps(_mm_set1_ps(dir[2]), nz));
+            bv_ray_slabs4(org_d, dir_d, _mm_loadu_ps(bv->kdop.min + g * 4),
+                          _mm_loadu_ps(bv->kdop.max + g * 4), &t_near, &t_far);
+        }
+        break;
+    }
+
+    float near_t = bv_reduce_max4(t_near);
+    float far_t = bv_reduce_min4(t_far);
+    *out_t = near_t;
+    return near_t <= far_t;
+}
+
+// Separating axis test of two OBBs (Gottschalk 1996). The 15 axes go four
+// lanes at a time: the face axes of each box, then the edge cross products
+// of one axis of a against all three of b.
+static bool obbs_overlap(const struct obb* a, const struct obb* b)
+{
+    __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    // Keeps near-parallel edge pairs from reporting a separation
+    __m128 epsilon = _mm_set1_ps(1e-6f);
+
+    // rows[i] holds dot(a.u[i], b.u[j]) in lane j, cols[j] the same in lane i
+    __m128 rows[3];
+    __m128 abs_rows[3];
+    __m128 cols[3];
+    __m128 abs_cols[3];
+    __m128 aux = _mm_setr_ps(a->u[0][0], a->u[1][0], a->u[2][0], 0);
+    __m128 auy = _mm_setr_ps(a->u[0][1], a->u[1][1], a->u[2][1], 0);
+    __m128 auz = _mm_setr_ps(a->u[0][2], a->u[1][2], a->u[2][2], 0);
+    __m128 bux = _mm_setr_ps(b->u[0][0], b->u[1][0], b->u[2][0], 0);
+    __m128 buy = _mm_setr_ps(b->u[0][1], b->u[1][1], b->u[2][1], 0);
+    __m128 buz = _mm_setr_ps(b->u[0][2], b->u[1][2], b->u[2][2], 0);
+    for (int i = 0; i < 3; i++)
+    {
+        rows[i] = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a->u[i][0]), bux),
+                       _mm_mul_ps(_mm_set1_ps(a->u[i][1]), buy)),
+            _mm_mul_ps(_mm_set1_ps(a->u[i][2]), buz));
+        cols[i] = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(_mm_set1_ps(b->u[i][0]), aux),
+                       _mm_mul_ps(_mm_set1_ps(b->u[i][1]), auy)),
+            _mm_mul_ps(_mm_set1_ps(b->u[i][2]), auz));
+        abs_rows[i] = _mm_add_ps(_mm_and_ps(rows[i], abs_mask), epsilon);
+        abs_cols[i] = _mm_add_ps(_mm_and_ps(cols[i], abs_mask), epsilon);
+    }
+
+    float d[3] = {b->c[0] - a->c[0], b->c[1] - a->c[1], b->c[2] - a->c[2]};
+    __m128 dx = _mm_set1_ps(d[0]);
+    __m128 dy = _mm_set1_ps(d[1]);
+    __m128 dz = _mm_set1_ps(d[2]);
+    // Center offset in the frame of a, lane i, and of b, lane j
+    __m128 ta = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(dx, aux), _mm_mul_ps(dy, auy)),
+        _mm_mul_ps(dz, auz));
+    __m128 tb = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(dx, bux), _mm_mul_ps(dy, buy)),
+        _mm_mul_ps(dz, buz));
+    __m128 ea = _mm_setr_ps(a->e[0], a->e[1], a->e[2], 0);
+    __m128 eb = _mm_setr_ps(b->e[0], b->e[1], b->e[2], 0);
+
+    int separated = 0;
+    {
+        __m128 rb = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(_mm_set1_ps(b->e[0]), abs_cols[0]),
+                       _mm_mul_ps(_mm_set1_ps(b->e[1]), abs_cols[1])),
+            _mm_mul_ps(_mm_set1_ps(b->e[2]), abs_cols[2]));
+        separated |= _mm_movemask_ps(_mm_cmpgt_ps(_mm_and_ps(ta, abs_mask),
+                                                  _mm_add_ps(ea, rb)));
+    }
+    {
+        __m128 ra = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a->e[0]), abs_rows[0]),
+                       _mm_mul_ps(_mm_set1_ps(a->e[1]), abs_rows[1])),
+            _mm_mul_ps(_mm_set1_ps(a->e[2]), abs_rows[2]));
+        separated |= _mm_movemask_ps(_mm_cmpgt_ps(_mm_and_ps(tb, abs_mask),
+                                                  _mm_add_ps(ra, eb)));
+    }
+
+    float t[3];
+    bv_store3(t, ta);
+    // Lane j of the shuffles holds index (j + 1) % 3 and (j + 2) % 3
+#define OBB_NEXT1(v) _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1))
+#define OBB_NEXT2(v) _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 1, 0, 2))
+    for (int i = 0; i < 3; i++)
+    {
+        int i1 = (i + 1) % 3;
+        int i2 = (i + 2) % 3;
+        __m128 ra = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a->e[i1]), abs_rows[i2]),
+                               _mm_mul_ps(_mm_set1_ps(a->e[i2]), abs_rows[i1]));
+        __m128 rb = _mm_add_ps(
+            _mm_mul_ps(OBB_NEXT1(eb), OBB_NEXT2(abs_rows[i])),
+            _mm_mul_ps(OBB_NEXT2(eb), OBB_NEXT1(abs_rows[i])));
+        __m128 dist = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(t[i2]), rows[i1]),
+                                 _mm_mul_ps(_mm_set1_ps(t[i1]), rows[i2]));
+        separated |= _mm_movemask_ps(_mm_cmpgt_ps(_mm_and_ps(dist, abs_mask),
+                                                  _mm_add_ps(ra, rb)));
+    }
+#undef OBB_NEXT1
+#undef OBB_NEXT2
+
+    return (separated & 0x7) == 0;
+}
+
+// Both volumes have the same type. DOPs only compare their slabs, which
+// can miss separating axes that aren't slab normals.
+static bool bvolumes_overlap(const struct bvolume* a, const struct bvolume* b)
+{
+    switch (a->type)
+    {
+    case bv_type_aabb:
+    {
+        __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+        __m128 d = _mm_sub_ps(
+            _mm_setr_ps(a->aabb.c[0], a->aabb.c[1], a->aabb.c[2], 0),
+            _mm_setr_ps(b->aabb.c[0], b->aabb.c[1], b->aabb.c[2], 0));
+        __m128 r = _mm_add_ps(
+            _mm_setr_ps(a->aabb.r[0], a->aabb.r[1], a->aabb.r[2], 0),
+            _mm_setr_ps(b->aabb.r[0], b->aabb.r[1], b->aabb.r[2], 0));
+        return _mm_movemask_ps(_mm_cmpgt_ps(_mm_and_ps(d, abs_mask), r)) == 0;
+    }
+    case bv_type_sphere:
+    {
+        float r = a->sphere.r + b->sphere.r;
+        return float3_dist_sq(a->sphere.c, b->sphere.c) <= r * r;
+    }
+    case bv_type_obb:
+        return obbs_overlap(&a->obb, &b->obb);
+    default:
+    {
+        int separated = 0;
+        for (int i = 0; i < KDOP_SLABS_COUNT; i += 4)
+        {
+            __m128 a_min = _mm_loadu_ps(a->kdop.min + i);
+            __m128 a_max = _mm_loadu_ps(a->kdop.max + i);
+            __m128 b_min = _mm_loadu_ps(b->kdop.min + i);
+            __m128 b_max = _mm_loadu_ps(b->kdop.max + i);
+            separated |= _mm_movemask_ps(_mm_or_ps(_mm_cmpgt_ps(a_min, b_max),
+                                                   _mm_cmpgt_ps(b_min, a_max)));
+        }
+        return separated == 0;
+    }
+    }
+}
 
 #endif // GRAPHICS_BV_H
\ No newline at end of file
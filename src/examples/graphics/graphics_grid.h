@@ -0,0 +1,419 @@
+#ifndef GRAPHICS_GRID_H
+#define GRAPHICS_GRID_H
+#include "../../mem.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <stdbool.h>
+
+// Uniform grid over object AABBs, hashed into a power-of-two bucket table so
+// only the occupied cells cost memory. Cells that collide share a bucket,
+// every candidate is tested against the query box anyway.
+#define GRID_BLOCK_IDS_COUNT 14
+#define GRID_MIN_BUCKETS_COUNT 64
+// Buckets per object, each one covers up to 8 cells at the derived size
+#define GRID_BUCKETS_PER_OBJECT 8
+
+// A bucket's ids are stored inline in a 64-byte block, so short lists cost a
+// single line to scan. Longer lists chain into overflow blocks stored after
+// the bucket heads.
+typedef struct grid_block
+{
+    int count;
+    int next; // -1 at the end of the chain
+    int ids[GRID_BLOCK_IDS_COUNT];
+} grid_block_t;
+
+typedef struct grid_object
+{
+    float min[3];
+    float max[3];
+    int cell_min[3];
+    int cell_max[3];
+    bool used;
+} grid_object_t;
+
+typedef struct spatial_grid
+{
+    float cell_size;
+    float inv_cell_size;
+
+    int buckets_count;
+    struct grid_block* blocks;
+    int blocks_count;
+    int blocks_cap;
+    int free_block; // Overflow blocks left empty by removals
+
+    struct grid_object* objects;
+    uint32_t* stamps; // Last query that reported each object
+    int objects_cap;
+    uint32_t stamp;
+} spatial_grid_t;
+
+// Mean of the largest extent of each box, so a typical object overlaps at
+// most 2x2x2 cells while small ones don't end up in a crowd of them
+static float grid_calc_cell_size(const float (*mins)[3],
+                                 const float (*maxs)[3],
+                                 int count)
+{
+    double sum = 0;
+    for (int i = 0; i < count; i++)
+    {
+        float e = maxs[i][0] - mins[i][0];
+        e = fmaxf(e, maxs[i][1] - mins[i][1]);
+        e = fmaxf(e, maxs[i][2] - mins[i][2]);
+        sum += e;
+    }
+    float result = (count > 0) ? (float)(sum / count) : 1.f;
+    return (result > 0) ? result : 1.f;
+}
+
+static void grid_init(struct spatial_grid* grid,
+                      float cell_size,
+                      int objects_count_hint)
+{
+    *grid = (struct spatial_grid){0};
+    grid->cell_size = cell_size;
+    grid->inv_cell_size = 1.f / cell_size;
+
+    int buckets_count = GRID_MIN_BUCKETS_COUNT;
+    while (buckets_count < objects_count_hint * GRID_BUCKETS_PER_OBJECT)
+        buckets_count *= 2;
+    grid->buckets_count = buckets_count;
+    grid->blocks_cap = buckets_count + buckets_count / 4;
+    grid->blocks = (struct grid_block*)mem_alloc(
+        MemTag_Misc, grid->blocks_cap * sizeof(*grid->blocks));
+    for (int i = 0; i < buckets_count; i++)
+        grid->blocks[i] = (struct grid_block){.next = -1};
+    grid->blocks_count = buckets_count;
+    grid->free_block = -1;
+}
+
+static void grid_cleanup(struct spatial_grid* grid)
+{
+    mem_free(grid->blocks);
+    mem_free(grid->objects);
+    mem_free(grid->stamps);
+    *grid = (struct spatial_grid){0};
+}
+
+static int grid_cell(const struct spatial_grid* grid, float v)
+{
+    return (int)floorf(v * grid->inv_cell_size);
+}
+
+static int grid_bucket(const struct spatial_grid* grid, int x, int y, int z)
+{
+    uint32_t h = ((uint32_t)x * 73856093u) ^ ((uint32_t)y * 19349663u) ^
+                 ((uint32_t)z * 83492791u);
+    return (int)(h & (uint32_t)(grid->buckets_count - 1));
+}
+
+static int grid_alloc_block(struct spatial_grid* grid)
+{
+    int result = grid->free_block;
+    if (result >= 0)
+    {
+        grid->free_block = grid->blocks[result].next;
+    }
+    else
+    {
+        if (grid->blocks_count == grid->blocks_cap)
+        {
+            grid->blocks_cap *= 2;
+            grid->blocks = (struct grid_block*)mem_realloc(
+                MemTag_Misc, grid->blocks,
+                grid->blocks_cap * sizeof(*grid->blocks));
+        }
+        result = grid->blocks_count++;
+    }
+    grid->blocks[result] = (struct grid_block){.next = -1};
+    return result;
+}
+
+// Cells of one object can hash to the same bucket, it's only stored once
+static void grid_bucket_add(struct spatial_grid* grid, int bucket, int id)
+{
+    int index = bucket;
+    for (;;)
+    {
+        struct grid_block* b = &grid->blocks[index];
+        for (int i = 0; i < b->count; i++)
+        {
+            if (b->ids[i] == id)
+                return;
+        }
+        if (b->next < 0)
+            break;
+        index = b->next;
+    }
+
+    if (grid->blocks[index].count == GRID_BLOCK_IDS_COUNT)
+    {
+        int next = grid_alloc_block(grid);
+        grid->blocks[index].next = next;
+        index = next;
+    }
+    struct grid_block* b = &grid->blocks[index];
+    b->ids[b->count++] = id;
+}
+
+// Fills the hole with the last id of the chain and releases the last block
+// once it's empty, so every block but the last stays full
+static void grid_bucket_remove(struct spatial_grid* grid, int bucket, int id)
+{
+    struct grid_block* found = NULL;
+    int found_slot = 0;
+    int prev = -1;
+    int last = bucket;
+    for (;;)
+    {
+        struct grid_block* b = &grid->blocks[last];
+        for (int i = 0; i < b->count && !found; i++)
+        {
+            if (b->ids[i] == id)
+            {
+                found = b;
+                found_slot = i;
+            }
+        }
+        if (b->next < 0)
+            break;
+        prev = last;
+        last = b->next;
+    }
+    if (!found)
+        return;
+
+    struct grid_block* tail = &grid->blocks[last];
+    found->ids[found_slot] = tail->ids[--tail->count];
+    if (tail->count == 0 && prev >= 0)
+    {
+        grid->blocks[prev].next = -1;
+        tail->next = grid->free_block;
+        grid->free_block = last;
+    }
+}
+
+static void grid_update_cells(struct spatial_grid* grid, int id, bool add)
+{
+    const struct grid_object* o = &grid->objects[id];
+    for (int z = o->cell_min[2]; z <= o->cell_max[2]; z++)
+    {
+        for (int y = o->cell_min[1]; y <= o->cell_max[1]; y++)
+        {
+            for (int x = o->cell_min[0]; x <= o->cell_max[0]; x++)
+            {
+                int bucket = grid_bucket(grid, x, y, z);
+                if (add)
+                    grid_bucket_add(grid, bucket, id);
+                else
+                    grid_bucket_remove(grid, bucket, id);
+            }
+        }
+    }
+}
+
+static void grid_set_bounds(struct spatial_grid* grid,
+                            int id,
+                            const float* min,
+                            const float* max)
+{
+    struct grid_object* o = &grid->objects[id];
+    for (int i = 0; i < 3; i++)
+    {
+        o->min[i] = min[i];
+        o->max[i] = max[i];
+        o->cell_min[i] = grid_cell(grid, min[i]);
+        o->cell_max[i] = grid_cell(grid, max[i]);
+    }
+}
+
+static void grid_insert(struct spatial_grid* grid,
+                        int id,
+                        const float* min,
+                        const float* max)
+{
+    if (id >= grid->objects_cap)
+    {
+        int cap = grid->objects_cap ? grid->objects_cap : 64;
+        while (cap <= id)
+            cap *= 2;
+        grid->objects = (struct grid_object*)mem_realloc(
+            MemTag_Misc, grid->objects, cap * sizeof(*grid->objects));
+        grid->stamps = (uint32_t*)mem_realloc(
+            MemTag_Misc, grid->stamps, cap * sizeof(*grid->stamps));
+        memset(grid->objects + grid->objects_cap, 0,
+               (cap - grid->objects_cap) * sizeof(*grid->objects));
+        memset(grid->stamps + grid->objects_cap, 0,
+               (cap - grid->objects_cap) * sizeof(*grid->stamps));
+        grid->objects_cap = cap;
+    }
+    grid_set_bounds(grid, id, min, max);
+    grid->objects[id].used = true;
+    grid_update_cells(grid, id, true);
+}
+
+static void grid_remove(struct spatial_grid* grid, int id)
+{
+    if (id >= grid->objects_cap || !grid->objects[id].used)
+        return;
+    grid_update_cells(grid, id, false);
+    grid->objects[id].used = false;
+}
+
+// Buckets are only touched when the object crosses into other cells
+static void grid_move(struct spatial_grid* grid,
+                      int id,
+                      const float* min,
+                      const float* max)
+{
+    struct grid_object* o = &grid->objects[id];
+    bool same_cells = true;
+    for (int i = 0; i < 3; i++)
+    {
+        same_cells &= (o->cell_min[i] == grid_cell(grid, min[i]));
+        same_cells &= (o->cell_max[i] == grid_cell(grid, max[i]));
+    }
+    if (same_cells)
+    {
+        grid_set_bounds(grid, id, min, max);
+    }
+    else
+    {
+        grid_update_cells(grid, id, false);
+        grid_set_bounds(grid, id, min, max);
+        grid_update_cells(grid, id, true);
+    }
+}
+
+static bool grid_boxes_overlap(const float* a_min,
+                               const float* a_max,
+                               const float* b_min,
+                               const float* b_max)
+{
+    return a_min[0] <= b_max[0] && b_min[0] <= a_max[0] &&
+           a_min[1] <= b_max[1] && b_min[1] <= a_max[1] &&
+           a_min[2] <= b_max[2] && b_min[2] <= a_max[2];
+}
+
+// Writes up to ids_cap ids of the objects overlapping the box and returns
+// how many there are. Objects in several of the visited buckets are stamped
+// on the first report.
+static int grid_query(struct spatial_grid* grid,
+                      const float* min,
+                      const float* max,
+                      int* ids,
+                      int ids_cap)
+{
+    if (++grid->stamp == 0)
+    {
+        memset(grid->stamps, 0, grid->objects_cap * sizeof(*grid->stamps));
+        grid->stamp = 1;
+    }
+
+    int result = 0;
+    int cell_min[3];
+    int cell_max[3];
+    for (int i = 0; i < 3; i++)
+    {
+        cell_min[i] = grid_cell(grid, min[i]);
+        cell_max[i] = grid_cell(grid, max[i]);
+    }
+    for (int z = cell_min[2]; z <= cell_max[2]; z++)
+    {
+        for (int y = cell_min[1]; y <= cell_max[1]; y++)
+        {
+            for (int x = cell_min[0]; x <= cell_max[0]; x++)
+            {
+                int index = grid_bucket(grid, x, y, z);
+                while (index >= 0)
+                {
+                    const struct grid_block* b = &grid->blocks[index];
+                    for (int i = 0; i < b->count; i++)
+                    {
+                        int id = b->ids[i];
+                        const struct grid_object* o = &grid->objects[id];
+                        if (grid->stamps[id] == grid->stamp ||
+                            !grid_boxes_overlap(o->min, o->max, min, max))
+                        {
+                            continue;
+                        }
+                        grid->stamps[id] = grid->stamp;
+                        if (result < ids_cap)
+                            ids[result] = id;
+                        ++result;
+                    }
+                    index = b->next;
+                }
+            }
+        }
+    }
+    return result;
+}
+
+// An overlapping pair shares every cell of the overlap, so it's reported
+// only from the bucket of the cell holding the overlap's min corner
+static bool grid_owns_pair(const struct spatial_grid* grid,
+                           int bucket,
+                           const struct grid_object* a,
+                           const struct grid_object* b)
+{
+    int x = grid_cell(grid, fmaxf(a->min[0], b->min[0]));
+    int y = grid_cell(grid, fmaxf(a->min[1], b->min[1]));
+    int z = grid_cell(grid, fmaxf(a->min[2], b->min[2]));
+    return grid_bucket(grid, x, y, z) == bucket;
+}
+
+// Writes up to pairs_cap overlapping pairs, each once with the smaller id
+// first, and returns how many there are
+static int grid_find_pairs(const struct spatial_grid* grid,
+                           int (*pairs)[2],
+                           int pairs_cap)
+{
+    int result = 0;
+    for (int bucket = 0; bucket < grid->buckets_count; bucket++)
+    {
+        for (int i_block = bucket; i_block >= 0;
+             i_block = grid->blocks[i_block].next)
+        {
+            const struct grid_block* bi = &grid->blocks[i_block];
+            for (int i = 0; i < bi->count; i++)
+            {
+                const struct grid_object* a = &grid->objects[bi->ids[i]];
+                // Pairs within the block, then with the blocks after it
+                int j_block = i_block;
+                int j = i + 1;
+                while (j_block >= 0)
+                {
+                    const struct grid_block* bj = &grid->blocks[j_block];
+                    for (; j < bj->count; j++)
+                    {
+                        const struct grid_object* b =
+                            &grid->objects[bj->ids[j]];
+                        if (!grid_boxes_overlap(a->min, a->max, b->min,
+                                                b->max) ||
+                            !grid_owns_pair(grid, bucket, a, b))
+                        {
+                            continue;
+                        }
+                        if (result < pairs_cap)
+                        {
+                            int id_a = bi->ids[i];
+                            int id_b = bj->ids[j];
+                            pairs[result][0] = (id_a < id_b) ? id_a : id_b;
+                            pairs[result][1] = (id_a < id_b) ? id_b : id_a;
+                        }
+                        ++result;
+                    }
+                    j_block = bj->next;
+                    j = 0;
+                }
+            }
+        }
+    }
+    return result;
+}
+
+#endif // GRAPHICS_GRID_H
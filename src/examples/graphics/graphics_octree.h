@@ -0,0 +1,399 @@
+#ifndef GRAPHICS_OCTREE_H
+#define GRAPHICS_OCTREE_H
+#include "graphics_bv.h"
+#include "../../mem.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <float.h>
+#include <stdbool.h>
+
+// Additive LOD octree over a point cloud. Every node keeps at most one point
+// per cell of a sampling grid laid over its cube and hands the rest down to
+// its children, so drawing a node adds detail on top of its ancestors
+// instead of replacing them.
+#define OCTREE_SAMPLING_GRID_SIZE 16
+#define OCTREE_NODE_POINTS_CAP                                                 \
+    (OCTREE_SAMPLING_GRID_SIZE * OCTREE_SAMPLING_GRID_SIZE *                   \
+     OCTREE_SAMPLING_GRID_SIZE)
+// Duplicates never spread out, nodes this deep keep what fits and drop the rest
+#define OCTREE_MAX_DEPTH 20
+
+// Children are stored next to each other in octant order, child_mask tells
+// which octants exist. Octant bits are x = 4, y = 2, z = 1.
+typedef struct octree_node
+{
+    float center[3];
+    float half_size;
+    int first; // Into point_octree.points
+    int count;
+    int first_child; // -1 for leaves
+    uint8_t child_mask;
+    uint8_t depth;
+} octree_node_t;
+
+typedef struct octree_select_entry
+{
+    float error; // Projected point spacing in pixels
+    int node;
+    int plane_mask;
+} octree_select_entry_t;
+
+// The points are a reordered copy where every node owns a contiguous range,
+// so a node can be paged in or uploaded with a single read
+typedef struct point_octree
+{
+    struct octree_node* nodes;
+    int nodes_count;
+    int nodes_cap;
+    float* points;
+    int points_count;
+    int dropped_points_count;
+    int depth;
+
+    // Scratch of the build and the selection
+    uint32_t* stamps; // Per sampling grid cell
+    uint32_t stamp;
+    struct octree_select_entry* heap;
+} point_octree_t;
+
+typedef struct octree_select_stats
+{
+    int nodes_visited;
+    int nodes_selected;
+    int points_selected;
+    bool budget_reached;
+} octree_select_stats_t;
+
+static void octree_cleanup(struct point_octree* tree)
+{
+    mem_free(tree->heap);
+    mem_free(tree->stamps);
+    mem_free(tree->points);
+    mem_free(tree->nodes);
+    *tree = (struct point_octree){0};
+}
+
+static float octree_node_spacing(const struct octree_node* n)
+{
+    float result = 2.f * n->half_size / (float)OCTREE_SAMPLING_GRID_SIZE;
+    return result;
+}
+
+static int octree_push_nodes(struct point_octree* tree, int count)
+{
+    if (tree->nodes_count + count > tree->nodes_cap)
+    {
+        tree->nodes_cap = (tree->nodes_cap > 0) ? tree->nodes_cap * 2 : 64;
+        while (tree->nodes_count + count > tree->nodes_cap)
+            tree->nodes_cap *= 2;
+        tree->nodes = (struct octree_node*)mem_realloc(
+            MemTag_Bvh, tree->nodes, tree->nodes_cap * sizeof(*tree->nodes));
+    }
+    int result = tree->nodes_count;
+    tree->nodes_count += count;
+    return result;
+}
+
+static void octree_swap_points(float* points, int a, int b)
+{
+    float t[3];
+    memcpy(t, points + a * 3, sizeof(t));
+    memcpy(points + a * 3, points + b * 3, sizeof(t));
+    memcpy(points + b * 3, t, sizeof(t));
+}
+
+// Points below split first, returns where the upper half starts
+static int octree_partition(float* points,
+                            int begin,
+                            int end,
+                            int axis,
+                            float split)
+{
+    int i = begin;
+    int j = end - 1;
+    while (i <= j)
+    {
+        if (points[i * 3 + axis] < split)
+            ++i;
+        else
+            octree_swap_points(points, i, j--);
+    }
+    return i;
+}
+
+static int octree_sampling_cell(const struct octree_node* n, const float* p)
+{
+    float scale = (float)OCTREE_SAMPLING_GRID_SIZE / (2.f * n->half_size);
+    int result = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        int c = (int)((p[i] - (n->center[i] - n->half_size)) * scale);
+        c = (c < 0) ? 0 : c;
+        c = (c >= OCTREE_SAMPLING_GRID_SIZE) ? OCTREE_SAMPLING_GRID_SIZE - 1
+                                             : c;
+        result = result * OCTREE_SAMPLING_GRID_SIZE + c;
+    }
+    return result;
+}
+
+static void octree_build_rec(struct point_octree* tree, int index)
+{
+    struct octree_node n = tree->nodes[index];
+    if (n.depth > tree->depth)
+        tree->depth = n.depth;
+
+    if (n.count <= OCTREE_NODE_POINTS_CAP || n.depth == OCTREE_MAX_DEPTH)
+    {
+        if (n.count > OCTREE_NODE_POINTS_CAP)
+        {
+            tree->dropped_points_count += n.count - OCTREE_NODE_POINTS_CAP;
+            tree->nodes[index].count = OCTREE_NODE_POINTS_CAP;
+        }
+        return;
+    }
+
+    // The first point to land in a cell is kept and moved to the front
+    uint32_t stamp = ++tree->stamp;
+    int kept = n.first;
+    int end = n.first + n.count;
+    for (int i = n.first; i < end; i++)
+    {
+        int cell = octree_sampling_cell(&n, tree->points + i * 3);
+        if (tree->stamps[cell] != stamp)
+        {
+            tree->stamps[cell] = stamp;
+            octree_swap_points(tree->points, i, kept++);
+        }
+    }
+
+    // The rest is split into octants in place, x, then y, then z
+    int bounds[9];
+    bounds[0] = kept;
+    bounds[8] = end;
+    bounds[4] = octree_partition(tree->points, bounds[0], bounds[8], 0,
+                                 n.center[0]);
+    for (int i = 0; i < 8; i += 4)
+    {
+        bounds[i + 2] = octree_partition(tree->points, bounds[i],
+                                         bounds[i + 4], 1, n.center[1]);
+    }
+    for (int i = 0; i < 8; i += 2)
+    {
+        bounds[i + 1] = octree_partition(tree->points, bounds[i],
+                                         bounds[i + 2], 2, n.center[2]);
+    }
+
+    int children_count = 0;
+    uint8_t child_mask = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        if (bounds[i + 1] > bounds[i])
+        {
+            child_mask = (uint8_t)(child_mask | (1 << i));
+            ++children_count;
+        }
+    }
+
+    int first_child = octree_push_nodes(tree, children_count);
+    struct octree_node* node = &tree->nodes[index];
+    node->count = kept - n.first;
+    node->first_child = first_child;
+    node->child_mask = child_mask;
+
+    int child = first_child;
+    float quarter = n.half_size * 0.5f;
+    for (int i = 0; i < 8; i++)
+    {
+        if (!(child_mask & (1 << i)))
+            continue;
+        tree->nodes[child++] = (struct octree_node){
+            .center = {n.center[0] + ((i & 4) ? quarter : -quarter),
+                       n.center[1] + ((i & 2) ? quarter : -quarter),
+                       n.center[2] + ((i & 1) ? quarter : -quarter)},
+            .half_size = quarter,
+            .first = bounds[i],
+            .count = bounds[i + 1] - bounds[i],
+            .first_child = -1,
+            .depth = (uint8_t)(n.depth + 1),
+        };
+    }
+    for (int i = 0; i < children_count; i++)
+        octree_build_rec(tree, first_child + i);
+}
+
+static void octree_build(struct point_octree* tree,
+                         const float* points,
+                         int points_count)
+{
+    octree_cleanup(tree);
+    if (points_count == 0)
+        return;
+
+    tree->points_count = points_count;
+    tree->points =
+        (float*)mem_alloc(MemTag_Bvh, points_count * sizeof(float[3]));
+    memcpy(tree->points, points, points_count * sizeof(float[3]));
+    tree->stamps = (uint32_t*)mem_calloc(
+        MemTag_Bvh, OCTREE_NODE_POINTS_CAP, sizeof(uint32_t));
+
+    float min_bound[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float max_bound[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (int i = 0; i < points_count; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            min_bound[j] = fminf(min_bound[j], points[i * 3 + j]);
+            max_bound[j] = fmaxf(max_bound[j], points[i * 3 + j]);
+        }
+    }
+
+    // Cubic cells keep the sampling even along every axis
+    struct octree_node root = {.count = points_count, .first_child = -1};
+    for (int i = 0; i < 3; i++)
+    {
+        root.center[i] = (min_bound[i] + max_bound[i]) * 0.5f;
+        root.half_size =
+            fmaxf(root.half_size, (max_bound[i] - min_bound[i]) * 0.5f);
+    }
+    root.half_size = fmaxf(root.half_size * 1.001f, 1e-6f);
+
+    int root_index = octree_push_nodes(tree, 1);
+    tree->nodes[root_index] = root;
+    octree_build_rec(tree, 0);
+
+    tree->heap = (struct octree_select_entry*)mem_alloc(
+        MemTag_Bvh, tree->nodes_count * sizeof(*tree->heap));
+}
+
+static void octree_heap_push(struct octree_select_entry* heap,
+                             int* count,
+                             struct octree_select_entry e)
+{
+    int i = (*count)++;
+    while (i > 0)
+    {
+        int parent = (i - 1) / 2;
+        if (heap[parent].error >= e.error)
+            break;
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = e;
+}
+
+static struct octree_select_entry octree_heap_pop(
+    struct octree_select_entry* heap,
+    int* count)
+{
+    struct octree_select_entry result = heap[0];
+    struct octree_select_entry last = heap[--(*count)];
+    int i = 0;
+    for (;;)
+    {
+        int child = i * 2 + 1;
+        if (child >= *count)
+            break;
+        if (child + 1 < *count && heap[child + 1].error > heap[child].error)
+            ++child;
+        if (heap[child].error <= last.error)
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (*count > 0)
+        heap[i] = last;
+    return result;
+}
+
+// Tests the node's cube and queues it by the size its point spacing
+// projects to. proj_scale is the screen height over 2 * tan(fov_y / 2).
+static void octree_select_push(struct point_octree* tree,
+                               const struct frustum* frustum,
+                               const float* eye,
+                               float proj_scale,
+                               int index,
+                               int plane_mask,
+                               int* heap_count,
+                               struct octree_select_stats* stats)
+{
+    const struct octree_node* n = &tree->nodes[index];
+    ++stats->nodes_visited;
+
+    struct bvolume bv = {.type = bv_type_aabb};
+    for (int i = 0; i < 3; i++)
+    {
+        bv.aabb.c[i] = n->center[i];
+        bv.aabb.r[i] = n->half_size;
+    }
+    if (frustum_test_bvolume(frustum, &bv, &plane_mask) ==
+        frustum_result_outside)
+    {
+        return;
+    }
+
+    float d[3] = {n->center[0] - eye[0], n->center[1] - eye[1],
+                  n->center[2] - eye[2]};
+    float distance = float3_length(d) - n->half_size * 1.7320508f;
+    distance = fmaxf(distance, 1e-4f);
+
+    struct octree_select_entry e = {
+        .error = octree_node_spacing(n) * proj_scale / distance,
+        .node = index,
+        .plane_mask = plane_mask,
+    };
+    octree_heap_push(tree->heap, heap_count, e);
+}
+
+// Largest projected error first until the budget runs out. Children are only
+// queued once their parent is selected, so every node comes with its
+// ancestors. Returns the number of nodes written, highest error first.
+static int octree_select(struct point_octree* tree,
+                         const struct frustum* frustum,
+                         const float* eye,
+                         float proj_scale,
+                         float max_error,
+                         int points_budget,
+                         int* out_nodes,
+                         int out_nodes_cap,
+                         struct octree_select_stats* stats)
+{
+    *stats = (struct octree_select_stats){0};
+    if (tree->nodes_count == 0)
+        return 0;
+
+    int heap_count = 0;
+    octree_select_push(tree, frustum, eye, proj_scale, 0, FRUSTUM_PLANES_ALL,
+                       &heap_count, stats);
+
+    while (heap_count > 0)
+    {
+        struct octree_select_entry e = octree_heap_pop(tree->heap, &heap_count);
+        const struct octree_node* n = &tree->nodes[e.node];
+        if (stats->points_selected + n->count > points_budget ||
+            stats->nodes_selected == out_nodes_cap)
+        {
+            stats->budget_reached = true;
+            break;
+        }
+
+        out_nodes[stats->nodes_selected++] = e.node;
+        stats->points_selected += n->count;
+
+        if (e.error <= max_error || n->first_child < 0)
+            continue;
+        int child = n->first_child;
+        for (int i = 0; i < 8; i++)
+        {
+            if (n->child_mask & (1 << i))
+            {
+                octree_select_push(tree, frustum, eye, proj_scale, child++,
+                                   e.plane_mask, &heap_count, stats);
+            }
+        }
+    }
+    return stats->nodes_selected;
+}
+
+#endif // GRAPHICS_OCTREE_H
@@ -0,0 +1,361 @@
+#ifndef GRAPHICS_TRANSFORM_H
+#define GRAPHICS_TRANSFORM_H
+#include "../../debug.h"
+#include "../../job.h"
+#include "../../mem.h"
+#include <himath.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <emmintrin.h>
+
+#define TRANSFORM_MAX_DEPTH 32
+#define TRANSFORM_BATCH_SIZE 1024
+
+// Local transforms in SoA and the world matrices they compose to. Parents
+// are added before their children, so a child's index is always larger and
+// one pass in index order sees every parent before its children. Setters only
+// flag the entry, transform_store_update recomposes the flagged entries and
+// everything below them.
+typedef struct transform_store
+{
+    int count;
+    int cap;
+    float* pos[3];
+    float* rot[4]; // Quaternion, scalar first like Quat.e
+    float* scale[3];
+    int* parents; // -1 for roots
+    uint8_t* depths;
+    uint8_t* dirty;
+    Mat4* worlds; // Valid after transform_store_update
+
+    int* update_order; // Flagged entries sorted by depth, scratch
+    int updated_count;
+} transform_store_t;
+
+static void transform_store_cleanup(struct transform_store* ts)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        mem_free(ts->pos[i]);
+        mem_free(ts->scale[i]);
+    }
+    for (int i = 0; i < 4; i++)
+        mem_free(ts->rot[i]);
+    mem_free(ts->parents);
+    mem_free(ts->depths);
+    mem_free(ts->dirty);
+    mem_free(ts->worlds);
+    mem_free(ts->update_order);
+    *ts = (struct transform_store){0};
+}
+
+static void transform_store_grow(struct transform_store* ts)
+{
+    int cap = ts->cap ? ts->cap * 2 : 64;
+    for (int i = 0; i < 3; i++)
+    {
+        ts->pos[i] =
+            (float*)mem_realloc(MemTag_Misc, ts->pos[i], cap * sizeof(float));
+        ts->scale[i] =
+            (float*)mem_realloc(MemTag_Misc, ts->scale[i], cap * sizeof(float));
+    }
+    for (int i = 0; i < 4; i++)
+        ts->rot[i] =
+            (float*)mem_realloc(MemTag_Misc, ts->rot[i], cap * sizeof(float));
+    ts->parents =
+        (int*)mem_realloc(MemTag_Misc, ts->parents, cap * sizeof(int));
+    ts->depths =
+        (uint8_t*)mem_realloc(MemTag_Misc, ts->depths, cap * sizeof(uint8_t));
+    ts->dirty =
+        (uint8_t*)mem_realloc(MemTag_Misc, ts->dirty, cap * sizeof(uint8_t));
+    ts->worlds =
+        (Mat4*)mem_realloc(MemTag_Misc, ts->worlds, cap * sizeof(Mat4));
+    ts->update_order =
+        (int*)mem_realloc(MemTag_Misc, ts->update_order, cap * sizeof(int));
+    ts->cap = cap;
+}
+
+// Identity, flagged for the next update
+static int transform_store_add(struct transform_store* ts, int parent)
+{
+    ASSERT(parent < ts->count);
+    if (ts->count == ts->cap)
+        transform_store_grow(ts);
+
+    int index = ts->count++;
+    for (int i = 0; i < 3; i++)
+    {
+        ts->pos[i][index] = 0;
+        ts->scale[i][index] = 1;
+    }
+    ts->rot[0][index] = 1;
+    for (int i = 1; i < 4; i++)
+        ts->rot[i][index] = 0;
+    ts->parents[index] = parent;
+    ts->depths[index] =
+        (parent >= 0) ? (uint8_t)(ts->depths[parent] + 1) : 0;
+    ASSERT(ts->depths[index] < TRANSFORM_MAX_DEPTH);
+    ts->dirty[index] = 1;
+    return index;
+}
+
+// The last entry moves into index, neither of them may have children
+static void transform_store_remove_swap(struct transform_store* ts, int index)
+{
+    ASSERT(index >= 0 && index < ts->count);
+    int last = --ts->count;
+    if (index == last)
+        return;
+
+    ASSERT(ts->parents[last] < index);
+    for (int i = 0; i < 3; i++)
+    {
+        ts->pos[i][index] = ts->pos[i][last];
+        ts->scale[i][index] = ts->scale[i][last];
+    }
+    for (int i = 0; i < 4; i++)
+        ts->rot[i][index] = ts->rot[i][last];
+    ts->parents[index] = ts->parents[last];
+    ts->depths[index] = ts->depths[last];
+    ts->dirty[index] = ts->dirty[last];
+    ts->worlds[index] = ts->worlds[last];
+}
+
+static FVec3 transform_store_get_pos(const struct transform_store* ts,
+                                     int index)
+{
+    FVec3 result = {ts->pos[0][index], ts->pos[1][index], ts->pos[2][index]};
+    return result;
+}
+
+static FVec3 transform_store_get_scale(const struct transform_store* ts,
+                                       int index)
+{
+    FVec3 result = {ts->scale[0][index], ts->scale[1][index],
+                    ts->scale[2][index]};
+    return result;
+}
+
+static Quat transform_store_get_rot(const struct transform_store* ts,
+                                    int index)
+{
+    Quat result = {{ts->rot[0][index], ts->rot[1][index], ts->rot[2][index],
+                    ts->rot[3][index]}};
+    return result;
+}
+
+static void transform_store_set_pos(struct transform_store* ts,
+                                    int index,
+                                    FVec3 pos)
+{
+    ts->pos[0][index] = pos.x;
+    ts->pos[1][index] = pos.y;
+    ts->pos[2][index] = pos.z;
+    ts->dirty[index] = 1;
+}
+
+static void transform_store_set_scale(struct transform_store* ts,
+                                      int index,
+                                      FVec3 scale)
+{
+    ts->scale[0][index] = scale.x;
+    ts->scale[1][index] = scale.y;
+    ts->scale[2][index] = scale.z;
+    ts->dirty[index] = 1;
+}
+
+static void transform_store_set_rot(struct transform_store* ts,
+                                    int index,
+                                    Quat rot)
+{
+    for (int i = 0; i < 4; i++)
+        ts->rot[i][index] = rot.e[i];
+    ts->dirty[index] = 1;
+}
+
+// Composed from the locals up the parent chain, so it's current between
+// updates and safe to call from jobs
+static Mat4 transform_store_calc_world(const struct transform_store* ts,
+                                       int index)
+{
+    Mat4 result = mat4_transform(transform_store_get_pos(ts, index),
+                                 transform_store_get_scale(ts, index),
+                                 transform_store_get_rot(ts, index));
+    for (int parent = ts->parents[index]; parent >= 0;
+         parent = ts->parents[parent])
+    {
+        Mat4 parent_mat = mat4_transform(transform_store_get_pos(ts, parent),
+                                         transform_store_get_scale(ts, parent),
+                                         transform_store_get_rot(ts, parent));
+        result = mat4_mul(&parent_mat, &result);
+    }
+    return result;
+}
+
+// Runs of consecutive entries are the common case, everything moved. The
+// padded tail repeats its last entry and has to take the gather.
+static bool transform_indices_consecutive4(const int* indices)
+{
+    return indices[1] == indices[0] + 1 && indices[2] == indices[1] + 1 &&
+           indices[3] == indices[2] + 1;
+}
+
+static __m128 transform_gather4(const float* values,
+                                const int* indices,
+                                bool consecutive)
+{
+    if (consecutive)
+        return _mm_loadu_ps(values + indices[0]);
+    return _mm_setr_ps(values[indices[0]], values[indices[1]],
+                       values[indices[2]], values[indices[3]]);
+}
+
+// Translation * rotation * scale for four entries, one per lane, then
+// transposed into four column-major matrices
+static void transform_compose4(const struct transform_store* ts,
+                               const int* indices,
+                               Mat4* out)
+{
+    bool consecutive = transform_indices_consecutive4(indices);
+    __m128 w = transform_gather4(ts->rot[0], indices, consecutive);
+    __m128 x = transform_gather4(ts->rot[1], indices, consecutive);
+    __m128 y = transform_gather4(ts->rot[2], indices, consecutive);
+    __m128 z = transform_gather4(ts->rot[3], indices, consecutive);
+    __m128 one = _mm_set1_ps(1);
+    __m128 two = _mm_set1_ps(2);
+    __m128 x2 = _mm_mul_ps(x, two);
+    __m128 y2 = _mm_mul_ps(y, two);
+    __m128 z2 = _mm_mul_ps(z, two);
+    __m128 xx = _mm_mul_ps(x, x2);
+    __m128 yy = _mm_mul_ps(y, y2);
+    __m128 zz = _mm_mul_ps(z, z2);
+    __m128 xy = _mm_mul_ps(x, y2);
+    __m128 xz = _mm_mul_ps(x, z2);
+    __m128 yz = _mm_mul_ps(y, z2);
+    __m128 wx = _mm_mul_ps(w, x2);
+    __m128 wy = _mm_mul_ps(w, y2);
+    __m128 wz = _mm_mul_ps(w, z2);
+
+    __m128 sx = transform_gather4(ts->scale[0], indices, consecutive);
+    __m128 sy = transform_gather4(ts->scale[1], indices, consecutive);
+    __m128 sz = transform_gather4(ts->scale[2], indices, consecutive);
+    __m128 cols[4][4] = {
+        {
+            _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx),
+            _mm_mul_ps(_mm_add_ps(xy, wz), sx),
+            _mm_mul_ps(_mm_sub_ps(xz, wy), sx),
+            _mm_setzero_ps(),
+        },
+        {
+            _mm_mul_ps(_mm_sub_ps(xy, wz), sy),
+            _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy),
+            _mm_mul_ps(_mm_add_ps(yz, wx), sy),
+            _mm_setzero_ps(),
+        },
+        {
+            _mm_mul_ps(_mm_add_ps(xz, wy), sz),
+            _mm_mul_ps(_mm_sub_ps(yz, wx), sz),
+            _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz),
+            _mm_setzero_ps(),
+        },
+        {
+            transform_gather4(ts->pos[0], indices, consecutive),
+            transform_gather4(ts->pos[1], indices, consecutive),
+            transform_gather4(ts->pos[2], indices, consecutive),
+            one,
+        },
+    };
+    for (int c = 0; c < 4; c++)
+    {
+        _MM_TRANSPOSE4_PS(cols[c][0], cols[c][1], cols[c][2], cols[c][3]);
+        for (int lane = 0; lane < 4; lane++)
+            _mm_storeu_ps(&out[lane].m[c * 4], cols[c][lane]);
+    }
+}
+
+typedef struct transform_update_level
+{
+    struct transform_store* ts;
+    const int* indices;
+} transform_update_level_t;
+
+static JOB_FOR_FN_SIG(transform_update_job)
+{
+    struct transform_update_level* level =
+        (struct transform_update_level*)udata;
+    struct transform_store* ts = level->ts;
+    for (int i = begin; i < end; i += 4)
+    {
+        // The tail repeats its last entry to fill the lanes
+        int indices[4];
+        for (int lane = 0; lane < 4; lane++)
+            indices[lane] = level->indices[(i + lane < end) ? i + lane
+                                                            : end - 1];
+        Mat4 locals[4];
+        transform_compose4(ts, indices, locals);
+        for (int lane = 0; lane < 4 && i + lane < end; lane++)
+        {
+            int index = indices[lane];
+            int parent = ts->parents[index];
+            ts->worlds[index] =
+                (parent >= 0) ? mat4_mul(&ts->worlds[parent], &locals[lane])
+                              : locals[lane];
+            ts->dirty[index] = 0;
+        }
+    }
+}
+
+// Only flagged entries and their descendants are recomposed. Each depth is
+// one parallel pass, the parents it reads were finished by the one before.
+static int transform_store_update(struct transform_store* ts)
+{
+    int depth_offsets[TRANSFORM_MAX_DEPTH + 1] = {0};
+    for (int i = 0; i < ts->count; i++)
+    {
+        int parent = ts->parents[i];
+        if (parent >= 0 && ts->dirty[parent])
+            ts->dirty[i] = 1;
+        depth_offsets[ts->depths[i] + 1] += ts->dirty[i];
+    }
+    for (int i = 0; i < TRANSFORM_MAX_DEPTH; i++)
+        depth_offsets[i + 1] += depth_offsets[i];
+
+    int cursors[TRANSFORM_MAX_DEPTH];
+    memcpy(cursors, depth_offsets, sizeof(cursors));
+    for (int i = 0; i < ts->count; i++)
+    {
+        if (ts->dirty[i])
+            ts->update_order[cursors[ts->depths[i]]++] = i;
+    }
+
+    for (int depth = 0; depth < TRANSFORM_MAX_DEPTH; depth++)
+    {
+        int count = depth_offsets[depth + 1] - depth_offsets[depth];
+        if (count == 0)
+            continue;
+        struct transform_update_level level = {
+            .ts = ts,
+            .indices = ts->update_order + depth_offsets[depth],
+        };
+        j_parallel_for(count, TRANSFORM_BATCH_SIZE, &transform_update_job,
+                       &level);
+    }
+    ts->updated_count = depth_offsets[TRANSFORM_MAX_DEPTH];
+    return ts->updated_count;
+}
+
+// out may alias p
+static void transform_point(const Mat4* m, const float* p, float* out)
+{
+    float result[3];
+    for (int i = 0; i < 3; i++)
+    {
+        result[i] = m->m[i] * p[0] + m->m[4 + i] * p[1] +
+                    m->m[8 + i] * p[2] + m->m[12 + i];
+    }
+    memcpy(out, result, sizeof(result));
+}
+
+#endif // GRAPHICS_TRANSFORM_H
@@ -1,6 +1,8 @@
 #include "../../example.h"
 #include "../../debug.h"
 #include "../../filesystem.h"
+#include "../../mem.h"
+#include "../../pool.h"
 #include "../../resource.h"
 #include "../../renderer.h"
 #include "../../app.h"
@@ -35,7 +37,7 @@ static void image_init(Image* image, int w, int h, int max_color)
         .h = h,
         .max_color = max_color,
     };
-    image->pixels = calloc(w * h, sizeof(*image->pixels));
+    image->pixels = mem_calloc(MemTag_Image, w * h, sizeof(*image->pixels));
 
     glGenTextures(1, &image->texture);
     image_update_gl_texture(image);
@@ -64,7 +66,7 @@ static Image image_load_from_ppm(const char* filename)
         int w, h, max_color;
         fscanf(f, "%d%d%d\n", &w, &h, &max_color);
 
-        Pixel* pixels = malloc(w * h * sizeof(*pixels));
+        Pixel* pixels = mem_alloc(MemTag_Image, w * h * sizeof(*pixels));
 
         for (int i = 0; i < w * h; i++)
         {
@@ -102,11 +104,11 @@ static Image image_load_from_ppm(const char* filename)
 static void image_cleanup(Image* image)
 {
     if (image->pixels)
-        free(image->pixels);
+        mem_free(image->pixels);
     if (image->texture)
-        glDeleteTextures(1, &image->texture);
+        r_state_delete_textures(1, &image->texture);
     if (image->histogram)
-        free(image->histogram);
+        mem_free(image->histogram);
 
     *image = (Image){0};
 }
@@ -119,19 +121,19 @@ static bool image_is_valid(const Image* image)
 
 static void image_update_gl_texture(Image* image)
 {
-    glBindTexture(GL_TEXTURE_2D, image->texture);
+    r_state_bind_texture(0, GL_TEXTURE_2D, image->texture);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, image->w, image->h, 0, GL_RGBA,
                  GL_FLOAT, image->pixels);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    r_state_bind_texture(0, GL_TEXTURE_2D, 0);
 }
 
 static void image_update_histogram(Image* image)
 {
     if (image->histogram)
-        free(image->histogram);
+        mem_free(image->histogram);
 
-    image->histogram =
-        (int*)malloc((image->max_color + 1) * sizeof(*image->histogram));
+    image->histogram = (int*)mem_alloc(
+        MemTag_Image, (image->max_color + 1) * sizeof(*image->histogram));
     memset(image->histogram, 0,
            (image->max_color + 1) * sizeof(*image->histogram));
 
@@ -447,9 +449,12 @@ IMAGE_OPERATION_FN_DECL(image_operation_ccl)
 {
     Image result = {0};
 
-    int* parents = (int*)calloc(image->w * image->h, sizeof(*parents));
-    int* ranks = (int*)calloc(image->w * image->h, sizeof(*ranks));
-    int* labels = (int*)calloc(image->w * image->h, sizeof(*labels));
+    int* parents =
+        (int*)mem_calloc(MemTag_Image, image->w * image->h, sizeof(*parents));
+    int* ranks =
+        (int*)mem_calloc(MemTag_Image, image->w * image->h, sizeof(*ranks));
+    int* labels =
+        (int*)mem_calloc(MemTag_Image, image->w * image->h, sizeof(*labels));
 
     int current_label = 1;
 
@@ -516,8 +521,8 @@ IMAGE_OPERATION_FN_DECL(image_operation_ccl)
         labels[i] = disjoint_sets_find(parents, labels[i]);
     }
 
-    Pixel* label_colors =
-        (Pixel*)calloc(image->w * image->h, sizeof(*label_colors));
+    Pixel* label_colors = (Pixel*)mem_calloc(
+        MemTag_Image, image->w * image->h, sizeof(*label_colors));
 
     image_init(&result, image->w, image->h, 255);
     for (int i = 0; i < result.w * result.h; i++)
@@ -539,10 +544,10 @@ IMAGE_OPERATION_FN_DECL(image_operation_ccl)
     image_update_gl_texture(&result);
     image_update_histogram(&result);
 
-    free(label_colors);
-    free(labels);
-    free(ranks);
-    free(parents);
+    mem_free(label_colors);
+    mem_free(labels);
+    mem_free(ranks);
+    mem_free(parents);
 
     return result;
 }
@@ -563,6 +568,13 @@ ImageOperationMeta g_image_operation_meta[ImageOperationType_Count] = {
     {"CCL", &image_operation_ccl},
 };
 
+// Both strings are in the example arena
+typedef struct ImageFilePath_
+{
+    const char* abs_path_str;
+    const char* filename;
+} ImageFilePath;
+
 typedef struct ImageProcessing_
 {
     VertexBuffer vb;
@@ -572,8 +584,12 @@ typedef struct ImageProcessing_
     GLuint sampler_bilinear;
     GLuint current_sampler;
 
-    Path image_filepaths[100];
+    // Listed once by init, the images themselves are loaded on selection and
+    // replaced while the scene runs, so they stay on the heap
+    ImageFilePath* image_filepaths;
     int image_filepaths_count;
+    int image_filepaths_cap;
+    Arena* arena;
 
     int current_image_filepath_index;
     Image current_image;
@@ -583,11 +599,28 @@ typedef struct ImageProcessing_
     int other_image_filepath_index;
 } ImageProcessing;
 
+static const ImageFilePath* get_image_filepath(const ImageProcessing* s,
+                                               int index)
+{
+    ASSERT(index >= 0 && index < s->image_filepaths_count);
+    return &s->image_filepaths[index];
+}
+
+static FILE_FOREACH_FN_DECL(count_filepath)
+{
+    ++*(int*)udata;
+}
+
 static FILE_FOREACH_FN_DECL(append_filepath)
 {
     ImageProcessing* s = (ImageProcessing*)udata;
-    Path* p = &s->image_filepaths[s->image_filepaths_count++];
-    *p = fs_path_copy(*file_path);
+    // Files that showed up after counting wait for the next load
+    if (s->image_filepaths_count == s->image_filepaths_cap)
+        return;
+    ImageFilePath* path = &s->image_filepaths[s->image_filepaths_count++];
+    path->abs_path_str = arena_push_str(s->arena, file_path->abs_path_str);
+    path->filename = path->abs_path_str +
+                     (file_path->filename - file_path->abs_path_str);
 }
 
 EXAMPLE_INIT_FN_SIG(image_processing)
@@ -621,8 +654,13 @@ EXAMPLE_INIT_FN_SIG(image_processing)
 
     s->current_sampler = s->sampler_nearest;
 
+    s->arena = &e->arena;
     Path p = fs_path_make_working_dir();
     fs_path_append2(&p, "image_processing", "images");
+    fs_for_each_files_with_ext(p, "ppm", &count_filepath,
+                               &s->image_filepaths_cap);
+    s->image_filepaths =
+        ARENA_PUSH_ARRAY(s->arena, ImageFilePath, s->image_filepaths_cap);
     fs_for_each_files_with_ext(p, "ppm", &append_filepath, s);
     fs_path_cleanup(&p);
 
@@ -639,10 +677,8 @@ EXAMPLE_CLEANUP_FN_SIG(image_processing)
     image_operation_args_cleanup(&s->args);
     if (image_is_valid(&s->current_image))
         image_cleanup(&s->current_image);
-    for (int i = 0; i < s->image_filepaths_count; i++)
-        fs_path_cleanup(&s->image_filepaths[i]);
-    glDeleteSamplers(1, &s->sampler_bilinear);
-    glDeleteSamplers(1, &s->sampler_nearest);
+    r_state_delete_samplers(1, &s->sampler_bilinear);
+    r_state_delete_samplers(1, &s->sampler_nearest);
     glDeleteProgram(s->shader);
     r_vb_cleanup(&s->vb);
     e_example_destroy(e);
@@ -704,12 +740,12 @@ EXAMPLE_UPDATE_FN_SIG(image_processing)
             {
                 for (int i = 0; i < s->image_filepaths_count; i++)
                 {
-                    if (igSelectable(s->image_filepaths[i].filename,
+                    if (igSelectable(get_image_filepath(s, i)->filename,
                                      s->current_image_filepath_index == i,
                                      ImGuiSelectableFlags_None, (ImVec2){0}))
                     {
                         s->current_image = image_load_from_ppm(
-                            s->image_filepaths[i].abs_path_str);
+                            get_image_filepath(s, i)->abs_path_str);
                         s->current_image_filepath_index = i;
                     }
                 }
@@ -719,9 +755,10 @@ EXAMPLE_UPDATE_FN_SIG(image_processing)
         }
         else
         {
-            igSelectable(
-                s->image_filepaths[s->current_image_filepath_index].filename,
-                true, ImGuiSelectableFlags_None, (ImVec2){0});
+            const ImageFilePath* current =
+                get_image_filepath(s, s->current_image_filepath_index);
+            igSelectable(current->filename, true, ImGuiSelectableFlags_None,
+                         (ImVec2){0});
             igSeparator();
 
             if (s->args.type == ImageOperationType_Undefined)
@@ -777,14 +814,15 @@ EXAMPLE_UPDATE_FN_SIG(image_processing)
                         igSeparator();
                         for (int i = 0; i < s->image_filepaths_count; i++)
                         {
-                            if (igSelectable(s->image_filepaths[i].filename,
+                            const ImageFilePath* path =
+                                get_image_filepath(s, i);
+                            if (igSelectable(path->filename,
                                              s->other_image_filepath_index == i,
                                              ImGuiSelectableFlags_None,
                                              (ImVec2){0}))
                             {
                                 s->args.add_sub_prod.other =
-                                    image_load_from_ppm(
-                                        s->image_filepaths[i].abs_path_str);
+                                    image_load_from_ppm(path->abs_path_str);
                                 s->other_image_filepath_index = i;
                             }
                         }
@@ -792,8 +830,8 @@ EXAMPLE_UPDATE_FN_SIG(image_processing)
                     else
                     {
                         igSelectable(
-                            s->image_filepaths[s->other_image_filepath_index]
-                                .filename,
+                            get_image_filepath(s, s->other_image_filepath_index)
+                                ->filename,
                             true, ImGuiSelectableFlags_None, (ImVec2){0});
                     }
                     igPopID();
@@ -878,12 +916,12 @@ EXAMPLE_UPDATE_FN_SIG(image_processing)
 
     igEnd();
 
-    glBindTexture(GL_TEXTURE_2D, s->current_image.texture);
+    r_state_bind_texture(0, GL_TEXTURE_2D, s->current_image.texture);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    r_state_bind_texture(0, GL_TEXTURE_2D, 0);
     igBegin("Test Image", NULL, 0);
     if (!image_is_valid(&s->current_image))
     {
@@ -900,13 +938,13 @@ EXAMPLE_UPDATE_FN_SIG(image_processing)
     }
     igEnd();
 
-    glViewport(0, 0, input->window_size.x, input->window_size.y);
+    r_state_viewport(0, 0, input->window_size.x, input->window_size.y);
     glClear(GL_COLOR_BUFFER_BIT);
-    glUseProgram(s->shader);
+    r_state_use_program(s->shader);
     if (image_is_valid(&s->current_image))
     {
-        glBindTextureUnit(0, s->current_image.texture);
-        glBindSampler(0, s->current_sampler);
+        r_state_bind_texture(0, GL_TEXTURE_2D, s->current_image.texture);
+        r_state_bind_sampler(0, s->current_sampler);
         r_vb_draw(&s->vb);
     }
 }
@@ -9,19 +9,40 @@
 
 typedef struct ImagingScene_
 {
-    ImageKeyValue image_keyvalues[100];
+    // Keys and pixels are in the example arena, like the array itself
+    ImageKeyValue* image_keyvalues;
     int images_count;
+    int images_cap;
+    Arena* arena;
 
     GUIState gui;
 } ImagingScene;
 
+// The pixels are moved into the arena, value doesn't own them afterwards
 void push_image(ImagingScene* s, const char* key, Image* value)
 {
-    ImageKeyValue* kv = &s->image_keyvalues[s->images_count];
-    kv->key = histr_makestr(key);
+    // Files that showed up after counting wait for the next load
+    if (s->images_count == s->images_cap)
+    {
+        image_cleanup(value);
+        return;
+    }
+
+    int pixels_count = value->size.x * value->size.y;
+    Pixel* pixels = ARENA_PUSH_ARRAY(s->arena, Pixel, pixels_count);
+    ASSERT(pixels);
+    memcpy(pixels, value->pixels, pixels_count * sizeof(*pixels));
+    image_cleanup(value);
+    value->pixels = pixels;
+
+    ImageKeyValue* kv = &s->image_keyvalues[s->images_count++];
+    kv->key = arena_push_str(s->arena, key);
     kv->value = *value;
+}
 
-    ++s->images_count;
+static FILE_FOREACH_FN_DECL(count_image)
+{
+    ++*(int*)udata;
 }
 
 static FILE_FOREACH_FN_DECL(load_and_append_image)
@@ -39,10 +60,14 @@ EXAMPLE_INIT_FN_SIG(imaging)
 
     GUIState* gui = &s->gui;
     gui_init(gui);
+    s->arena = &e->arena;
 
     {
         Path path = fs_path_make_working_dir();
         fs_path_append2(&path, "image_processing", "images");
+        fs_for_each_files_with_ext(path, "ppm", &count_image, &s->images_cap);
+        s->image_keyvalues =
+            ARENA_PUSH_ARRAY(s->arena, ImageKeyValue, s->images_cap);
         fs_for_each_files_with_ext(path, "ppm", &load_and_append_image, s);
         fs_path_cleanup(&path);
     }
@@ -53,17 +78,6 @@ EXAMPLE_INIT_FN_SIG(imaging)
 EXAMPLE_CLEANUP_FN_SIG(imaging)
 {
     Example* e = (Example*)udata;
-    ImagingScene* s = (ImagingScene*)e->scene;
-
-    GUIState* gui = &s->gui;
-
-    for (int i = 0; i < s->images_count; i++)
-    {
-        ImageKeyValue* kv = &s->image_keyvalues[i];
-        histr_destroy(kv->key);
-        image_cleanup(&kv->value);
-    }
-
     e_example_destroy(e);
 }
 
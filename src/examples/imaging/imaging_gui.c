@@ -74,7 +74,7 @@ void gui_reset(GUIState* gui)
         OpState* op_state = &gui->selected_op.states[i];
         image_cleanup(&op_state->result_image);
         if (op_state->result_gl_texture > 0)
-            glDeleteTextures(1, &op_state->result_gl_texture);
+            r_state_delete_textures(1, &op_state->result_gl_texture);
     }
 
     gui->selected_op.count = 0;
@@ -24,7 +24,7 @@ typedef struct Image_
 
 typedef struct ImageKeyValue_
 {
-    histr_String key;
+    const char* key;
     Image value;
 } ImageKeyValue;
 
@@ -62,7 +62,7 @@ Image image_load_from_ppm(const char* filename)
         int w, h, max_color;
         fscanf(f, "%d%d%d\n", &w, &h, &max_color);
 
-        Pixel* pixels = malloc(w * h * sizeof(*pixels));
+        Pixel* pixels = mem_alloc(MemTag_Image, w * h * sizeof(*pixels));
 
         for (int i = 0; i < w * h; i++)
         {
@@ -96,8 +96,8 @@ Image image_copy(const Image* image)
     Image result = {0};
     result.size = image->size;
     result.max_color = image->max_color;
-    result.pixels =
-        (Pixel*)malloc(result.size.x * result.size.y * sizeof(*result.pixels));
+    result.pixels = (Pixel*)mem_alloc(
+        MemTag_Image, result.size.x * result.size.y * sizeof(*result.pixels));
     memcpy(result.pixels, image->pixels,
            result.size.x * result.size.y * sizeof(*result.pixels));
     return result;
@@ -105,30 +105,31 @@ Image image_copy(const Image* image)
 
 uint image_make_gl_texture(const Image* image)
 {
-    FVec4* rgba32f_pixels =
-        (FVec4*)malloc(image->size.x * image->size.y * sizeof(*rgba32f_pixels));
+    FVec4* rgba32f_pixels = (FVec4*)mem_alloc(
+        MemTag_Image,
+        image->size.x * image->size.y * sizeof(*rgba32f_pixels));
     for (int i = 0; i < image->size.x * image->size.y; i++)
         rgba32f_pixels[i] = pixel_to_fvec4(image, image->pixels[i]);
 
     uint texture = 0;
     glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    r_state_bind_texture(0, GL_TEXTURE_2D, texture);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, image->size.x, image->size.y, 0,
                  GL_RGBA, GL_FLOAT, rgba32f_pixels);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    r_state_bind_texture(0, GL_TEXTURE_2D, 0);
 
-    free(rgba32f_pixels);
+    mem_free(rgba32f_pixels);
 
     return texture;
 }
 
 void image_cleanup(Image* image)
 {
-    free(image->pixels);
+    mem_free(image->pixels);
     image->pixels = NULL;
 }
 
@@ -317,10 +318,12 @@ void image_ccl(Image* image,
                uint16_t neighbor_bits,
                int background_max_intensity)
 {
-    int* parents =
-        (int*)calloc(image->size.x * image->size.y, sizeof(*parents));
-    int* ranks = (int*)calloc(image->size.x * image->size.y, sizeof(*ranks));
-    int* labels = (int*)calloc(image->size.x * image->size.y, sizeof(*labels));
+    int* parents = (int*)mem_calloc(
+        MemTag_Image, image->size.x * image->size.y, sizeof(*parents));
+    int* ranks = (int*)mem_calloc(
+        MemTag_Image, image->size.x * image->size.y, sizeof(*ranks));
+    int* labels = (int*)mem_calloc(
+        MemTag_Image, image->size.x * image->size.y, sizeof(*labels));
 
     int current_label = 1;
 
@@ -387,8 +390,8 @@ void image_ccl(Image* image,
         labels[i] = disjoint_sets_find(parents, labels[i]);
     }
 
-    Pixel* label_colors =
-        (Pixel*)calloc(image->size.x * image->size.y, sizeof(*label_colors));
+    Pixel* label_colors = (Pixel*)mem_calloc(
+        MemTag_Image, image->size.x * image->size.y, sizeof(*label_colors));
 
     for (int i = 0; i < image->size.x * image->size.y; i++)
     {
@@ -407,10 +410,10 @@ void image_ccl(Image* image,
         image->pixels[i] = *label_color;
     }
 
-    free(label_colors);
-    free(labels);
-    free(ranks);
-    free(parents);
+    mem_free(label_colors);
+    mem_free(labels);
+    mem_free(ranks);
+    mem_free(parents);
 }
 
 void image_equalize_histogram(Image* image)
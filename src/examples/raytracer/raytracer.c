@@ -0,0 +1,715 @@
+#include "../../all.h"
+#include <emmintrin.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#define TRACER_TILE_SIZE 16
+#define TRACER_MAX_BOUNCES 8
+#define TRACER_SPHERES_COUNT 40
+#define TRACER_MESHES_COUNT 3
+#define TRACER_RAY_EPSILON 1e-3f
+#define TRACER_FAR 1000.f
+
+// Packets are 2x2 pixel quads, lanes are laid out row by row
+#define TRACER_QUAD_SIZE 2
+
+typedef struct TracerMesh_
+{
+    Mesh mesh;
+    RtMeshBvh bvh;
+} TracerMesh;
+
+typedef struct TracerTile_
+{
+    int x;
+    int y;
+    int w;
+    int h;
+} TracerTile;
+
+// Everything the tile jobs read, no GL state so it renders headless too
+typedef struct Tracer_
+{
+    RayTracerGlobalUniform uniform;
+    FVec3 sphere_albedos[TRACER_SPHERES_COUNT];
+
+    TracerMesh meshes[TRACER_MESHES_COUNT]; // Meshes and BVHs live in the arena
+    int meshes_count;
+    RtScene rt_scene; // One instance per mesh, in the same order
+    FVec3 mesh_albedo;
+
+    IVec2 dim;
+    FVec3* accum;
+    uint32_t* pixels; // RGBA8, bottom row first like GL textures
+    int samples_count;
+    int max_bounces;
+
+    TracerTile* tiles;
+    int tiles_count;
+    int64_t* tile_rays_counts;
+
+    int64_t last_rays_count;
+    double last_ms;
+    int64_t total_rays_count;
+    double total_ms;
+} Tracer;
+
+typedef struct RayTracerScene_
+{
+    Tracer tracer;
+    ExampleFpsCamera cam;
+    float render_scale;
+    bool paused;
+
+    uint texture;
+    Mesh fsq_mesh;
+    VertexBuffer fsq_vb;
+    uint fsq_shader;
+} RayTracerScene;
+
+static uint32_t tracer_rand(uint32_t* state)
+{
+    // xorshift32
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static float tracer_randf(uint32_t* state)
+{
+    return (float)(tracer_rand(state) >> 8) * (1.f / 16777216.f);
+}
+
+static uint32_t tracer_hash(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x ? x : 1;
+}
+
+static void tracer_add_mesh(Tracer* t, Arena* arena, const char* filename)
+{
+    ASSERT(t->meshes_count < TRACER_MESHES_COUNT);
+    TracerMesh* m = &t->meshes[t->meshes_count++];
+
+    Path path = fs_path_make_working_dir();
+    fs_path_append3(&path, "shared", "models", filename);
+    ASSERT(rc_mesh_load_from_obj(&m->mesh, path.abs_path_str));
+    fs_path_cleanup(&path);
+
+    // Fit into a unit cube resting on the ground
+    NormalizedTransform normalized_transform =
+        rc_mesh_calc_normalized_transform(&m->mesh);
+    float min_y = FLT_MAX;
+    for (int i = 0; i < m->mesh.vertices_count; i++)
+    {
+        Vertex* v = &m->mesh.vertices[i];
+        v->pos = fvec3_mulf(v->pos, normalized_transform.scale);
+        v->pos = fvec3_add(v->pos, normalized_transform.pos);
+        min_y = HIMATH_MIN(min_y, v->pos.y);
+    }
+    for (int i = 0; i < m->mesh.vertices_count; i++)
+        m->mesh.vertices[i].pos.y -= min_y;
+    rc_mesh_move_to_arena(&m->mesh, arena);
+    rt_mesh_bvh_build(&m->bvh, &m->mesh);
+    rt_mesh_bvh_move_to_arena(&m->bvh, arena);
+}
+
+// The meshes are loaded into arena, which has to outlive the tracer
+static void tracer_init(Tracer* t, Arena* arena)
+{
+    *t = (Tracer){0};
+    t->max_bounces = 4;
+    t->mesh_albedo = (FVec3){0.8f, 0.75f, 0.7f};
+
+    // A large sphere as the ground, small ones scattered around the meshes
+    RayTracerGlobalUniform* u = &t->uniform;
+    ASSERT(TRACER_SPHERES_COUNT <= ARRAY_LENGTH(u->spheres));
+    u->spheres[u->spheres_count] =
+        (RayTracerSphere){.c = {0, -1000, 0}, .r = 1000};
+    t->sphere_albedos[u->spheres_count++] = (FVec3){0.5f, 0.5f, 0.5f};
+    uint32_t seed = 12345;
+    while (u->spheres_count < TRACER_SPHERES_COUNT)
+    {
+        float r = 0.1f + 0.2f * tracer_randf(&seed);
+        float angle = 2.f * HIMATH_PI * tracer_randf(&seed);
+        float dist = 1.5f + 4.f * tracer_randf(&seed);
+        u->spheres[u->spheres_count] = (RayTracerSphere){
+            .c = {cosf(angle) * dist, r, sinf(angle) * dist},
+            .r = r,
+        };
+        t->sphere_albedos[u->spheres_count++] = (FVec3){
+            0.2f + 0.7f * tracer_randf(&seed),
+            0.2f + 0.7f * tracer_randf(&seed),
+            0.2f + 0.7f * tracer_randf(&seed),
+        };
+    }
+
+    tracer_add_mesh(t, arena, "bunny.obj");
+    tracer_add_mesh(t, arena, "cup.obj");
+    tracer_add_mesh(t, arena, "rhino.obj");
+
+    rt_scene_init(&t->rt_scene);
+    for (int i = 0; i < t->meshes_count; i++)
+    {
+        Mat4 transform = mat4_translation((FVec3){(float)(i - 1) * 1.2f, 0, 0});
+        rt_scene_add_instance(&t->rt_scene, &t->meshes[i].bvh, &transform);
+    }
+    rt_scene_build(&t->rt_scene);
+}
+
+static void tracer_cleanup(Tracer* t)
+{
+    mem_free(t->accum);
+    mem_free(t->pixels);
+    mem_free(t->tiles);
+    mem_free(t->tile_rays_counts);
+    rt_scene_cleanup(&t->rt_scene);
+    *t = (Tracer){0};
+}
+
+static void tracer_reset(Tracer* t)
+{
+    t->samples_count = 0;
+    t->total_rays_count = 0;
+    t->total_ms = 0;
+    if (t->accum)
+        memset(t->accum, 0, t->dim.x * t->dim.y * sizeof(*t->accum));
+}
+
+static void tracer_resize(Tracer* t, IVec2 dim)
+{
+    if (t->dim.x == dim.x && t->dim.y == dim.y)
+        return;
+
+    t->dim = dim;
+    int pixels_count = dim.x * dim.y;
+    t->accum = (FVec3*)mem_realloc(
+        MemTag_Image, t->accum, pixels_count * sizeof(*t->accum));
+    t->pixels = (uint32_t*)mem_realloc(
+        MemTag_Image, t->pixels, pixels_count * sizeof(*t->pixels));
+    memset(t->pixels, 0, pixels_count * sizeof(*t->pixels));
+
+    IVec2 tiles_count = {
+        (dim.x + TRACER_TILE_SIZE - 1) / TRACER_TILE_SIZE,
+        (dim.y + TRACER_TILE_SIZE - 1) / TRACER_TILE_SIZE,
+    };
+    t->tiles_count = tiles_count.x * tiles_count.y;
+    t->tiles = (TracerTile*)mem_realloc(MemTag_Image, t->tiles,
+                                        t->tiles_count * sizeof(*t->tiles));
+    t->tile_rays_counts = (int64_t*)mem_realloc(
+        MemTag_Image, t->tile_rays_counts,
+        t->tiles_count * sizeof(*t->tile_rays_counts));
+    for (int y = 0; y < tiles_count.y; y++)
+    {
+        for (int x = 0; x < tiles_count.x; x++)
+        {
+            TracerTile* tile = &t->tiles[y * tiles_count.x + x];
+            tile->x = x * TRACER_TILE_SIZE;
+            tile->y = y * TRACER_TILE_SIZE;
+            tile->w = HIMATH_MIN(TRACER_TILE_SIZE, dim.x - tile->x);
+            tile->h = HIMATH_MIN(TRACER_TILE_SIZE, dim.y - tile->y);
+        }
+    }
+
+    tracer_reset(t);
+}
+
+// Closest sphere for every active lane, directions must be normalized.
+// Uses the discriminant form of Hearn and Baker, which stays precise for
+// the large ground sphere.
+static void tracer_intersect_spheres4(const Tracer* t,
+                                      const Ray* rays,
+                                      float* out_t,
+                                      int* out_sphere)
+{
+    float org[3][RT_PACKET_SIZE];
+    float dir[3][RT_PACKET_SIZE];
+    float t_max[RT_PACKET_SIZE];
+    for (int lane = 0; lane < RT_PACKET_SIZE; lane++)
+    {
+        org[0][lane] = rays[lane].origin.x;
+        org[1][lane] = rays[lane].origin.y;
+        org[2][lane] = rays[lane].origin.z;
+        dir[0][lane] = rays[lane].dir.x;
+        dir[1][lane] = rays[lane].dir.y;
+        dir[2][lane] = rays[lane].dir.z;
+        t_max[lane] = rays[lane].t_max;
+    }
+    __m128 ox = _mm_loadu_ps(org[0]);
+    __m128 oy = _mm_loadu_ps(org[1]);
+    __m128 oz = _mm_loadu_ps(org[2]);
+    __m128 dx = _mm_loadu_ps(dir[0]);
+    __m128 dy = _mm_loadu_ps(dir[1]);
+    __m128 dz = _mm_loadu_ps(dir[2]);
+    __m128 t_best = _mm_loadu_ps(t_max);
+    __m128i best = _mm_set1_epi32(-1);
+    __m128 t_min = _mm_set1_ps(TRACER_RAY_EPSILON);
+
+    const RayTracerGlobalUniform* u = &t->uniform;
+    for (int i = 0; i < u->spheres_count; i++)
+    {
+        const RayTracerSphere* sphere = &u->spheres[i];
+        __m128 fx = _mm_sub_ps(ox, _mm_set1_ps(sphere->c.x));
+        __m128 fy = _mm_sub_ps(oy, _mm_set1_ps(sphere->c.y));
+        __m128 fz = _mm_sub_ps(oz, _mm_set1_ps(sphere->c.z));
+        __m128 b = _mm_add_ps(_mm_mul_ps(fx, dx), _mm_mul_ps(fy, dy));
+        b = _mm_add_ps(b, _mm_mul_ps(fz, dz));
+        // Distance from the center to the closest point of the line
+        __m128 lx = _mm_sub_ps(fx, _mm_mul_ps(b, dx));
+        __m128 ly = _mm_sub_ps(fy, _mm_mul_ps(b, dy));
+        __m128 lz = _mm_sub_ps(fz, _mm_mul_ps(b, dz));
+        __m128 l_sq =
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, lx), _mm_mul_ps(ly, ly)),
+                       _mm_mul_ps(lz, lz));
+        __m128 disc = _mm_sub_ps(_mm_set1_ps(sphere->r * sphere->r), l_sq);
+        __m128 hit = _mm_cmpge_ps(disc, _mm_setzero_ps());
+        if (!_mm_movemask_ps(hit))
+            continue;
+
+        __m128 sq = _mm_sqrt_ps(_mm_max_ps(disc, _mm_setzero_ps()));
+        __m128 t0 = _mm_sub_ps(_mm_sub_ps(_mm_setzero_ps(), b), sq);
+        __m128 t1 = _mm_add_ps(_mm_sub_ps(_mm_setzero_ps(), b), sq);
+        // Far root when the origin is inside, or right on the surface
+        __m128 near_ok = _mm_cmpgt_ps(t0, t_min);
+        __m128 th = _mm_or_ps(_mm_and_ps(near_ok, t0),
+                              _mm_andnot_ps(near_ok, t1));
+        hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpgt_ps(th, t_min),
+                                         _mm_cmplt_ps(th, t_best)));
+
+        t_best = _mm_or_ps(_mm_and_ps(hit, th), _mm_andnot_ps(hit, t_best));
+        __m128i hit_i = _mm_castps_si128(hit);
+        best = _mm_or_si128(_mm_and_si128(hit_i, _mm_set1_epi32(i)),
+                            _mm_andnot_si128(hit_i, best));
+    }
+
+    _mm_storeu_ps(out_t, t_best);
+    _mm_storeu_si128((__m128i*)out_sphere, best);
+}
+
+static FVec3 tracer_sky(FVec3 dir)
+{
+    float a = 0.5f * (dir.y + 1.f);
+    FVec3 result = fvec3_add(fvec3_mulf((FVec3){1, 1, 1}, 1.f - a),
+                             fvec3_mulf((FVec3){0.5f, 0.7f, 1.f}, a));
+    return result;
+}
+
+static FVec3 tracer_mesh_normal(const Tracer* t, const RayHit* hit)
+{
+    const Mesh* mesh = &t->meshes[hit->instance].mesh;
+    FVec3 v[3];
+    for (int i = 0; i < 3; i++)
+    {
+        int index = hit->triangle * 3 + i;
+        if (mesh->indices_count > 0)
+            index = (int)mesh->indices[index];
+        // Instances only translate
+        v[i] = mesh->vertices[index].pos;
+    }
+    FVec3 result = fvec3_normalize(
+        fvec3_cross(fvec3_sub(v[1], v[0]), fvec3_sub(v[2], v[0])));
+    return result;
+}
+
+// Cosine-weighted around n
+static FVec3 tracer_sample_diffuse(FVec3 n, uint32_t* seed)
+{
+    float z = 2.f * tracer_randf(seed) - 1.f;
+    float a = 2.f * HIMATH_PI * tracer_randf(seed);
+    float r = sqrtf(HIMATH_MAX(0.f, 1.f - z * z));
+    FVec3 on_sphere = {r * cosf(a), r * sinf(a), z};
+    FVec3 dir = fvec3_add(n, on_sphere);
+    float len_sq = fvec3_length_sq(dir);
+    FVec3 result = (len_sq > 1e-8f) ? fvec3_mulf(dir, 1.f / sqrtf(len_sq)) : n;
+    return result;
+}
+
+// Traces one sample for each pixel of a 2x2 quad, returns the rays traced
+static int tracer_trace_quad(const Tracer* t,
+                             int px,
+                             int py,
+                             uint32_t* seed,
+                             FVec3* out_radiance)
+{
+    const RayTracerView* view = &t->uniform.view;
+    FVec3 look = fvec3_normalize(view->look);
+    FVec3 right = fvec3_normalize(fvec3_cross(look, (FVec3){0, 1, 0}));
+    FVec3 up = fvec3_cross(right, look);
+
+    Ray rays[RT_PACKET_SIZE];
+    FVec3 throughput[RT_PACKET_SIZE];
+    for (int lane = 0; lane < RT_PACKET_SIZE; lane++)
+    {
+        int x = px + lane % TRACER_QUAD_SIZE;
+        int y = py + lane / TRACER_QUAD_SIZE;
+        out_radiance[lane] = (FVec3){0};
+        throughput[lane] = (FVec3){1, 1, 1};
+        rays[lane] = (Ray){.origin = view->eye, .t_max = 0};
+        if (x >= t->dim.x || y >= t->dim.y)
+            continue;
+
+        // Jittered inside the pixel, the accumulation antialiases
+        float sx = ((float)x + tracer_randf(seed)) / (float)t->dim.x - 0.5f;
+        float sy = ((float)y + tracer_randf(seed)) / (float)t->dim.y - 0.5f;
+        FVec3 dir = fvec3_add(
+            fvec3_mulf(look, view->dist),
+            fvec3_add(fvec3_mulf(right, sx * view->dims.x),
+                      fvec3_mulf(up, sy * view->dims.y)));
+        rays[lane].dir = fvec3_normalize(dir);
+        rays[lane].t_max = TRACER_FAR;
+    }
+
+    int rays_count = 0;
+    for (int bounce = 0; bounce <= t->max_bounces; bounce++)
+    {
+        int active_count = 0;
+        for (int lane = 0; lane < RT_PACKET_SIZE; lane++)
+            active_count += (rays[lane].t_max > 0);
+        if (active_count == 0)
+            break;
+        rays_count += active_count;
+
+        float sphere_t[RT_PACKET_SIZE];
+        int sphere_index[RT_PACKET_SIZE];
+        tracer_intersect_spheres4(t, rays, sphere_t, sphere_index);
+
+        // Meshes only need to beat the closest sphere
+        Ray mesh_rays[RT_PACKET_SIZE];
+        for (int lane = 0; lane < RT_PACKET_SIZE; lane++)
+        {
+            mesh_rays[lane] = rays[lane];
+            if (rays[lane].t_max > 0)
+                mesh_rays[lane].t_max = sphere_t[lane];
+        }
+        RayHit mesh_hits[RT_PACKET_SIZE];
+        rt_intersect_packet(&t->rt_scene, mesh_rays, mesh_hits);
+
+        for (int lane = 0; lane < RT_PACKET_SIZE; lane++)
+        {
+            Ray* ray = &rays[lane];
+            if (ray->t_max <= 0)
+                continue;
+
+            FVec3 n;
+            FVec3 albedo;
+            float hit_t;
+            if (mesh_hits[lane].instance >= 0)
+            {
+                hit_t = mesh_hits[lane].t;
+                n = tracer_mesh_normal(t, &mesh_hits[lane]);
+                albedo = t->mesh_albedo;
+            }
+            else if (sphere_index[lane] >= 0)
+            {
+                const RayTracerSphere* sphere =
+                    &t->uniform.spheres[sphere_index[lane]];
+                hit_t = sphere_t[lane];
+                FVec3 p = fvec3_add(ray->origin, fvec3_mulf(ray->dir, hit_t));
+                n = fvec3_mulf(fvec3_sub(p, sphere->c), 1.f / sphere->r);
+                albedo = t->sphere_albedos[sphere_index[lane]];
+            }
+            else
+            {
+                FVec3 sky = fvec3_mul(throughput[lane], tracer_sky(ray->dir));
+                out_radiance[lane] = fvec3_add(out_radiance[lane], sky);
+                ray->t_max = 0;
+                continue;
+            }
+
+            if (bounce == t->max_bounces)
+            {
+                ray->t_max = 0;
+                continue;
+            }
+
+            // Shade both sides of the meshes
+            if (fvec3_dot(n, ray->dir) > 0)
+                n = fvec3_negate(n);
+            FVec3 p = fvec3_add(ray->origin, fvec3_mulf(ray->dir, hit_t));
+            throughput[lane] = fvec3_mul(throughput[lane], albedo);
+            ray->origin = fvec3_add(p, fvec3_mulf(n, TRACER_RAY_EPSILON));
+            ray->dir = tracer_sample_diffuse(n, seed);
+            ray->t_max = TRACER_FAR;
+        }
+    }
+    return rays_count;
+}
+
+static uint32_t tracer_encode_pixel(FVec3 c)
+{
+    // Gamma 2 is close enough for a preview
+    uint32_t r = (uint32_t)(sqrtf(HIMATH_CLAMP(c.x, 0.f, 1.f)) * 255.f + 0.5f);
+    uint32_t g = (uint32_t)(sqrtf(HIMATH_CLAMP(c.y, 0.f, 1.f)) * 255.f + 0.5f);
+    uint32_t b = (uint32_t)(sqrtf(HIMATH_CLAMP(c.z, 0.f, 1.f)) * 255.f + 0.5f);
+    return r | (g << 8) | (b << 16) | (0xFFu << 24);
+}
+
+static JOB_FOR_FN_SIG(tracer_render_tiles)
+{
+    Tracer* t = (Tracer*)udata;
+    float inv_samples = 1.f / (float)(t->samples_count + 1);
+    for (int i = begin; i < end; i++)
+    {
+        const TracerTile* tile = &t->tiles[i];
+        uint32_t seed = tracer_hash((uint32_t)i * 9781u +
+                                    (uint32_t)t->samples_count * 6271u);
+        int64_t rays_count = 0;
+        for (int y = tile->y; y < tile->y + tile->h; y += TRACER_QUAD_SIZE)
+        {
+            for (int x = tile->x; x < tile->x + tile->w; x += TRACER_QUAD_SIZE)
+            {
+                FVec3 radiance[RT_PACKET_SIZE];
+                rays_count += tracer_trace_quad(t, x, y, &seed, radiance);
+                for (int lane = 0; lane < RT_PACKET_SIZE; lane++)
+                {
+                    int lx = x + lane % TRACER_QUAD_SIZE;
+                    int ly = y + lane / TRACER_QUAD_SIZE;
+                    if (lx >= tile->x + tile->w || ly >= tile->y + tile->h)
+                        continue;
+                    int index = ly * t->dim.x + lx;
+                    t->accum[index] =
+                        fvec3_add(t->accum[index], radiance[lane]);
+                    t->pixels[index] = tracer_encode_pixel(
+                        fvec3_mulf(t->accum[index], inv_samples));
+                }
+            }
+        }
+        t->tile_rays_counts[i] = rays_count;
+    }
+}
+
+// Adds one sample per pixel
+static void tracer_render_sample(Tracer* t)
+{
+    double start_ms = a_get_time_ms();
+    j_parallel_for(t->tiles_count, 1, &tracer_render_tiles, t);
+    ++t->samples_count;
+
+    t->last_ms = a_get_time_ms() - start_ms;
+    t->last_rays_count = 0;
+    for (int i = 0; i < t->tiles_count; i++)
+        t->last_rays_count += t->tile_rays_counts[i];
+    t->total_ms += t->last_ms;
+    t->total_rays_count += t->last_rays_count;
+}
+
+static double tracer_calc_mrays(int64_t rays_count, double ms)
+{
+    double result = (ms > 0) ? (double)rays_count / (ms * 1000.0) : 0;
+    return result;
+}
+
+static void tracer_write_ppm(const Tracer* t, const char* filename)
+{
+    FILE* f = fopen(filename, "wb");
+    if (!f)
+    {
+        fprintf(stderr, "Couldn't open %s\n", filename);
+        return;
+    }
+
+    fprintf(f, "P6\n%d %d\n255\n", t->dim.x, t->dim.y);
+    for (int y = t->dim.y - 1; y >= 0; y--)
+    {
+        for (int x = 0; x < t->dim.x; x++)
+        {
+            uint32_t p = t->pixels[y * t->dim.x + x];
+            uint8_t rgb[3] = {
+                (uint8_t)p,
+                (uint8_t)(p >> 8),
+                (uint8_t)(p >> 16),
+            };
+            fwrite(rgb, 1, sizeof(rgb), f);
+        }
+    }
+    fclose(f);
+    printf("Wrote %s, %d samples\n", filename, t->samples_count);
+}
+
+static void tracer_set_view(Tracer* t, FVec3 eye, FVec3 look, float fov_y_deg)
+{
+    RayTracerView view = {
+        .eye = eye,
+        .look = look,
+        .dist = 1,
+    };
+    view.dims.y = 2.f * tanf(degtorad(fov_y_deg) * 0.5f);
+    view.dims.x = view.dims.y * (float)t->dim.x / (float)t->dim.y;
+
+    const RayTracerView* old = &t->uniform.view;
+    bool changed = memcmp(&old->eye, &view.eye, sizeof(FVec3)) != 0 ||
+                   memcmp(&old->look, &view.look, sizeof(FVec3)) != 0 ||
+                   old->dims.x != view.dims.x || old->dims.y != view.dims.y;
+    t->uniform.view = view;
+    if (changed)
+        tracer_reset(t);
+}
+
+static void write_output_ppm(const Tracer* t)
+{
+    Path path = fs_path_make_working_dir();
+    fs_path_append2(&path, "raytracer", "output.ppm");
+    tracer_write_ppm(t, path.abs_path_str);
+    fs_path_cleanup(&path);
+}
+
+EXAMPLE_INIT_FN_SIG(raytracer)
+{
+    Example* e = e_example_make("raytracer", RayTracerScene);
+    RayTracerScene* s = (RayTracerScene*)e->scene;
+
+    tracer_init(&s->tracer, &e->arena);
+    s->render_scale = 0.5f;
+    s->cam.pos = (FVec3){0, 1, 4};
+    s->cam.pitch_deg = -10;
+
+    Vertex fsq_vertices[4] = {
+        {{-1, -1, 0}, {0, 0}},
+        {{1, -1, 0}, {1, 0}},
+        {{1, 1, 0}, {1, 1}},
+        {{-1, 1, 0}, {0, 1}},
+    };
+    uint fsq_indices[6] = {0, 1, 2, 2, 3, 0};
+    s->fsq_mesh =
+        rc_mesh_make_raw2(ARRAY_LENGTH(fsq_vertices), ARRAY_LENGTH(fsq_indices),
+                          fsq_vertices, fsq_indices);
+    r_vb_init(&s->fsq_vb, &s->fsq_mesh, GL_TRIANGLES);
+    s->fsq_shader = e_shader_load(e, "fsq");
+
+    glGenTextures(1, &s->texture);
+    r_state_bind_texture(0, GL_TEXTURE_2D, s->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    return e;
+}
+
+EXAMPLE_CLEANUP_FN_SIG(raytracer)
+{
+    Example* e = (Example*)udata;
+    RayTracerScene* s = (RayTracerScene*)e->scene;
+
+    r_state_delete_textures(1, &s->texture);
+    glDeleteProgram(s->fsq_shader);
+    r_vb_cleanup(&s->fsq_vb);
+    rc_mesh_cleanup(&s->fsq_mesh);
+    tracer_cleanup(&s->tracer);
+
+    e_example_destroy(e);
+}
+
+EXAMPLE_UPDATE_FN_SIG(raytracer)
+{
+    Example* e = (Example*)udata;
+    RayTracerScene* s = (RayTracerScene*)e->scene;
+    Tracer* t = &s->tracer;
+
+    bool status = false;
+    igSetNextWindowSize((ImVec2){350, 0}, ImGuiCond_Once);
+    igSetNextWindowPos((ImVec2){0, 0}, ImGuiCond_Once, (ImVec2){0, 0});
+    if (igBegin("Ray Tracer", &status, ImGuiWindowFlags_NoSavedSettings))
+    {
+        igSliderFloat("Render scale", &s->render_scale, 0.125f, 1, "%.3f", 1);
+        if (igSliderInt("Max bounces", &t->max_bounces, 0,
+                        TRACER_MAX_BOUNCES, "%d"))
+        {
+            tracer_reset(t);
+        }
+        igCheckbox("Pause", &s->paused);
+        igText("%dx%d, %d tiles, %d samples", t->dim.x, t->dim.y,
+               t->tiles_count, t->samples_count);
+        igText("Last sample %.2f ms, %.2f Mrays/s", t->last_ms,
+               tracer_calc_mrays(t->last_rays_count, t->last_ms));
+        igText("Average %.2f Mrays/s on %d threads",
+               tracer_calc_mrays(t->total_rays_count, t->total_ms),
+               j_get_workers_count() + 1);
+        if (igButton("Write PPM", (ImVec2){0}))
+            write_output_ppm(t);
+        if (igCollapsingHeader("Memory", 0))
+            mem_draw_stats_gui();
+    }
+    igEnd();
+
+    e_fpscam_update(&s->cam, input, 2);
+
+    IVec2 dim = {
+        HIMATH_MAX(1, (int)((float)input->window_size.x * s->render_scale)),
+        HIMATH_MAX(1, (int)((float)input->window_size.y * s->render_scale)),
+    };
+    bool resized = (dim.x != t->dim.x || dim.y != t->dim.y);
+    tracer_resize(t, dim);
+    tracer_set_view(t, s->cam.pos, e_fpscam_get_look(&s->cam), 60);
+    if (!s->paused)
+        tracer_render_sample(t);
+
+    r_state_bind_texture(0, GL_TEXTURE_2D, s->texture);
+    if (resized)
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, dim.x, dim.y, 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, t->pixels);
+    }
+    else
+    {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, dim.x, dim.y, GL_RGBA,
+                        GL_UNSIGNED_BYTE, t->pixels);
+    }
+
+    r_state_bind_framebuffer(GL_FRAMEBUFFER, 0);
+    r_state_viewport(0, 0, input->window_size.x, input->window_size.y);
+    r_state_set_enabled(GL_DEPTH_TEST, false);
+    r_state_use_program(s->fsq_shader);
+    r_vb_draw(&s->fsq_vb);
+}
+
+#ifdef RAYTRACER_HEADLESS
+// Offline render straight to data/raytracer/output.ppm, no window needed
+int main(void)
+{
+    j_init(0);
+    Arena arena;
+    if (!arena_init(&arena, EXAMPLE_ARENA_RESERVE_SIZE))
+    {
+        fprintf(stderr, "Failed to reserve the arena\n");
+        return 1;
+    }
+
+    Tracer t;
+    tracer_init(&t, &arena);
+    tracer_resize(&t, (IVec2){1280, 720});
+    tracer_set_view(&t, (FVec3){0, 1, 4},
+                    fvec3_normalize((FVec3){0, -0.17f, -1}), 60);
+    for (int i = 0; i < 64; i++)
+        tracer_render_sample(&t);
+    printf("%d samples in %.1f ms, %.2f Mrays/s\n", t.samples_count, t.total_ms,
+           tracer_calc_mrays(t.total_rays_count, t.total_ms));
+    write_output_ppm(&t);
+
+    tracer_cleanup(&t);
+    arena_release(&arena);
+    j_cleanup();
+    return 0;
+}
+#endif
+
+#define USER_INIT                                                              \
+    Scene scene = {0};                                                         \
+    s_init(&scene, &input);                                                    \
+    s_switch_scene(&scene, EXAMPLE_LITERAL(raytracer));
+
+#define USER_UPDATE s_update(&scene);
+
+#define USER_CLEANUP s_cleanup(&scene);
+
+//#include "../../win32_main.inl"
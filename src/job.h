@@ -0,0 +1,39 @@
+#ifndef JOB_H
+#define JOB_H
+#include <stdbool.h>
+
+#define JOB_FN_SIG(name) void name(void* udata)
+typedef JOB_FN_SIG(JobFn);
+
+#define JOB_FOR_FN_SIG(name) void name(int begin, int end, void* udata)
+typedef JOB_FOR_FN_SIG(JobForFn);
+
+// Incremented by j_run and decremented once the job has finished
+typedef struct JobCounter_
+{
+    volatile long value;
+} JobCounter;
+
+// 0 workers spawns one worker per logical core, minus the calling thread
+void j_init(int workers_count);
+void j_cleanup();
+int j_get_workers_count();
+
+// Runs inline when the queue is full or no workers were spawned. Called from
+// a background job it queues a background job instead, so the sub-jobs of a
+// long job stay off the threads that wait for frame work.
+void j_run(JobFn* fn, void* udata, JobCounter* counter);
+// Left to the workers, j_wait never picks it up on the calling thread, so a
+// long job can't stall a frame. Runs inline when no workers were spawned.
+void j_run_background(JobFn* fn, void* udata, JobCounter* counter);
+// Executes queued jobs on the calling thread until counter reaches zero.
+// Background jobs are only picked up while waiting inside one.
+void j_wait(JobCounter* counter);
+bool j_is_done(const JobCounter* counter);
+// Returns the incremented value, for jobs that meet at a shared node
+long j_atomic_increment(volatile long* value);
+
+// Splits [0, count) into batches of batch_size and waits for all of them
+void j_parallel_for(int count, int batch_size, JobForFn* fn, void* udata);
+
+#endif // JOB_H
@@ -0,0 +1,273 @@
+#include "job.h"
+#include "debug.h"
+#include "mem.h"
+#include <stdlib.h>
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+#define J_MAX_WORKERS_COUNT 64
+#define J_QUEUE_CAP 4096
+// Also holds the sub-jobs of background jobs, see j_run
+#define J_BACKGROUND_QUEUE_CAP 4096
+
+typedef struct Job_
+{
+    JobFn* fn;
+    void* udata;
+    JobCounter* counter;
+    bool background;
+} Job;
+
+typedef struct JobSystem_
+{
+    HANDLE workers[J_MAX_WORKERS_COUNT];
+    int workers_count;
+
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE not_empty;
+    Job queue[J_QUEUE_CAP];
+    int head;
+    int count;
+    // Popped by workers only once the main queue is empty
+    Job background_queue[J_BACKGROUND_QUEUE_CAP];
+    int background_head;
+    int background_count;
+    bool quit;
+} JobSystem;
+
+static JobSystem s_jobs;
+// Set while the thread runs a background job
+static __declspec(thread) bool s_in_background;
+
+// Expects the lock to be held
+static bool j_pop_locked(Job* job, bool allow_background)
+{
+    if (s_jobs.count > 0)
+    {
+        *job = s_jobs.queue[s_jobs.head];
+        s_jobs.head = (s_jobs.head + 1) % J_QUEUE_CAP;
+        --s_jobs.count;
+        return true;
+    }
+    if (allow_background && s_jobs.background_count > 0)
+    {
+        *job = s_jobs.background_queue[s_jobs.background_head];
+        s_jobs.background_head =
+            (s_jobs.background_head + 1) % J_BACKGROUND_QUEUE_CAP;
+        --s_jobs.background_count;
+        return true;
+    }
+    return false;
+}
+
+static bool j_try_pop(Job* job, bool allow_background)
+{
+    EnterCriticalSection(&s_jobs.lock);
+    bool result = j_pop_locked(job, allow_background);
+    LeaveCriticalSection(&s_jobs.lock);
+    return result;
+}
+
+static void j_execute(const Job* job)
+{
+    bool was_in_background = s_in_background;
+    s_in_background = job->background;
+    job->fn(job->udata);
+    s_in_background = was_in_background;
+    if (job->counter)
+        InterlockedDecrement(&job->counter->value);
+}
+
+static DWORD WINAPI j_worker_proc(LPVOID param)
+{
+    for (;;)
+    {
+        EnterCriticalSection(&s_jobs.lock);
+        while (s_jobs.count == 0 && s_jobs.background_count == 0 &&
+               !s_jobs.quit)
+        {
+            SleepConditionVariableCS(&s_jobs.not_empty, &s_jobs.lock, INFINITE);
+        }
+        if (s_jobs.quit)
+        {
+            LeaveCriticalSection(&s_jobs.lock);
+            break;
+        }
+        Job job;
+        j_pop_locked(&job, true);
+        LeaveCriticalSection(&s_jobs.lock);
+
+        j_execute(&job);
+    }
+    return 0;
+}
+
+void j_init(int workers_count)
+{
+    if (workers_count <= 0)
+    {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        workers_count = (int)info.dwNumberOfProcessors - 1;
+    }
+    if (workers_count > J_MAX_WORKERS_COUNT)
+        workers_count = J_MAX_WORKERS_COUNT;
+
+    InitializeCriticalSection(&s_jobs.lock);
+    InitializeConditionVariable(&s_jobs.not_empty);
+
+    for (int i = 0; i < workers_count; i++)
+    {
+        HANDLE thread = CreateThread(NULL, 0, &j_worker_proc, NULL, 0, NULL);
+        ASSERT(thread);
+        s_jobs.workers[s_jobs.workers_count++] = thread;
+    }
+    PRINTLN("Job system: %d workers", s_jobs.workers_count);
+}
+
+void j_cleanup()
+{
+    EnterCriticalSection(&s_jobs.lock);
+    s_jobs.quit = true;
+    LeaveCriticalSection(&s_jobs.lock);
+    WakeAllConditionVariable(&s_jobs.not_empty);
+
+    WaitForMultipleObjects(s_jobs.workers_count, s_jobs.workers, TRUE,
+                           INFINITE);
+    for (int i = 0; i < s_jobs.workers_count; i++)
+        CloseHandle(s_jobs.workers[i]);
+
+    DeleteCriticalSection(&s_jobs.lock);
+    s_jobs = (JobSystem){0};
+}
+
+int j_get_workers_count()
+{
+    return s_jobs.workers_count;
+}
+
+void j_run(JobFn* fn, void* udata, JobCounter* counter)
+{
+    if (s_in_background)
+    {
+        j_run_background(fn, udata, counter);
+        return;
+    }
+
+    Job job = {.fn = fn, .udata = udata, .counter = counter};
+    if (counter)
+        InterlockedIncrement(&counter->value);
+
+    bool queued = false;
+    if (s_jobs.workers_count > 0)
+    {
+        EnterCriticalSection(&s_jobs.lock);
+        if (s_jobs.count < J_QUEUE_CAP)
+        {
+            int tail = (s_jobs.head + s_jobs.count) % J_QUEUE_CAP;
+            s_jobs.queue[tail] = job;
+            ++s_jobs.count;
+            queued = true;
+        }
+        LeaveCriticalSection(&s_jobs.lock);
+    }
+
+    if (queued)
+        WakeConditionVariable(&s_jobs.not_empty);
+    else
+        j_execute(&job);
+}
+
+void j_run_background(JobFn* fn, void* udata, JobCounter* counter)
+{
+    Job job = {
+        .fn = fn, .udata = udata, .counter = counter, .background = true};
+    if (counter)
+        InterlockedIncrement(&counter->value);
+
+    bool queued = false;
+    if (s_jobs.workers_count > 0)
+    {
+        EnterCriticalSection(&s_jobs.lock);
+        if (s_jobs.background_count < J_BACKGROUND_QUEUE_CAP)
+        {
+            int tail = (s_jobs.background_head + s_jobs.background_count) %
+                       J_BACKGROUND_QUEUE_CAP;
+            s_jobs.background_queue[tail] = job;
+            ++s_jobs.background_count;
+            queued = true;
+        }
+        LeaveCriticalSection(&s_jobs.lock);
+    }
+
+    if (queued)
+        WakeConditionVariable(&s_jobs.not_empty);
+    else
+        j_execute(&job);
+}
+
+void j_wait(JobCounter* counter)
+{
+    while (!j_is_done(counter))
+    {
+        Job job;
+        if (j_try_pop(&job, s_in_background))
+            j_execute(&job);
+        else
+            YieldProcessor();
+    }
+}
+
+bool j_is_done(const JobCounter* counter)
+{
+    return InterlockedCompareExchange((volatile LONG*)&counter->value, 0, 0) ==
+           0;
+}
+
+long j_atomic_increment(volatile long* value)
+{
+    return InterlockedIncrement((volatile LONG*)value);
+}
+
+typedef struct JobForBatch_
+{
+    JobForFn* fn;
+    void* udata;
+    int begin;
+    int end;
+} JobForBatch;
+
+static JOB_FN_SIG(j_for_batch_job)
+{
+    JobForBatch* batch = (JobForBatch*)udata;
+    batch->fn(batch->begin, batch->end, batch->udata);
+}
+
+void j_parallel_for(int count, int batch_size, JobForFn* fn, void* udata)
+{
+    if (count <= 0)
+        return;
+    if (batch_size <= 0)
+        batch_size = 1;
+
+    int batches_count = (count + batch_size - 1) / batch_size;
+    if (batches_count == 1 || s_jobs.workers_count == 0)
+    {
+        fn(0, count, udata);
+        return;
+    }
+
+    JobForBatch* batches =
+        (JobForBatch*)mem_alloc(MemTag_Misc, batches_count * sizeof(*batches));
+    JobCounter counter = {0};
+    for (int i = 0; i < batches_count; i++)
+    {
+        int begin = i * batch_size;
+        int end = begin + batch_size < count ? begin + batch_size : count;
+        batches[i] = (JobForBatch){
+            .fn = fn, .udata = udata, .begin = begin, .end = end};
+        j_run(&j_for_batch_job, &batches[i], &counter);
+    }
+    j_wait(&counter);
+    mem_free(batches);
+}
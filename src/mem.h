@@ -0,0 +1,60 @@
+#ifndef MEM_H
+#define MEM_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum MemTag_
+{
+    MemTag_Misc = 0,
+    MemTag_Mesh,
+    MemTag_Image,
+    MemTag_Bvh,
+    MemTag_String,
+    MemTag_Gui,
+    MemTag_Shader,
+    MemTag_Count,
+} MemTag;
+
+// Bucket 0 counts sizes up to 16 bytes and each next one doubles the limit,
+// the last bucket takes everything above 64 MiB
+#define MEM_HISTOGRAM_BUCKETS_COUNT 24
+
+// Works like realloc: a NULL ptr allocates and a 0 size frees. The tracking
+// header is part of size, so the backend sees slightly larger blocks.
+#define MEM_BACKEND_FN_SIG(name) void* name(void* udata, void* ptr, size_t size)
+typedef MEM_BACKEND_FN_SIG(MemBackendFn);
+
+typedef struct MemStats_
+{
+    int64_t live_bytes;
+    int64_t peak_bytes;
+    int64_t live_count;
+    int64_t allocs_count; // Since startup, reallocations included
+    int64_t frame_allocs_count; // In the last finished frame
+    int64_t frame_alloc_bytes;
+    int64_t max_frame_allocs_count;
+    int64_t size_histogram[MEM_HISTOGRAM_BUCKETS_COUNT];
+} MemStats;
+
+// Blocks go back to the backend that allocated them, so this is only
+// allowed before the first allocation
+void mem_set_backend(MemBackendFn* fn, void* udata);
+
+// Safe to call from any thread, blocks remember their tag and size
+void* mem_alloc(MemTag tag, size_t size);
+void* mem_calloc(MemTag tag, size_t count, size_t size);
+// The block is counted under tag from now on
+void* mem_realloc(MemTag tag, void* ptr, size_t size);
+void mem_free(void* ptr);
+
+// Rolls the per-frame counters, called once at the top of the frame
+void mem_begin_frame();
+MemStats mem_get_stats(MemTag tag);
+MemStats mem_get_total_stats();
+const char* mem_get_tag_name(MemTag tag);
+void mem_draw_stats_gui();
+// Anything still live is listed as a leak
+bool mem_write_report(const char* filename);
+
+#endif // MEM_H
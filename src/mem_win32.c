@@ -0,0 +1,316 @@
+#include "mem.h"
+#include "debug.h"
+#include "renderer.h"
+#include "util.h"
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+// 16 bytes keeps the alignment the backend gives to the block behind it
+typedef struct MemHeader_
+{
+    size_t size;
+    size_t tag;
+} MemHeader;
+
+// Bumped from any thread
+typedef struct MemCounters_
+{
+    volatile LONG64 live_bytes;
+    volatile LONG64 peak_bytes;
+    volatile LONG64 live_count;
+    volatile LONG64 allocs_count;
+    volatile LONG64 frame_allocs_count;
+    volatile LONG64 frame_alloc_bytes;
+    volatile LONG64 size_histogram[MEM_HISTOGRAM_BUCKETS_COUNT];
+} MemCounters;
+
+// Only touched by mem_begin_frame on the main thread
+typedef struct MemFrameCounts_
+{
+    int64_t allocs_count;
+    int64_t alloc_bytes;
+    int64_t max_allocs_count;
+} MemFrameCounts;
+
+static MEM_BACKEND_FN_SIG(mem_heap_backend)
+{
+    if (size == 0)
+    {
+        free(ptr);
+        return NULL;
+    }
+    return realloc(ptr, size);
+}
+
+static MemBackendFn* g_backend = &mem_heap_backend;
+static void* g_backend_udata;
+// The one past the last tag sums up all of them
+static MemCounters g_counters[MemTag_Count + 1];
+static MemFrameCounts g_frame_counts[MemTag_Count + 1];
+
+static const char* g_tag_names[MemTag_Count + 1] = {
+    "Misc", "Mesh", "Image", "BVH", "String", "GUI", "Shader", "Total",
+};
+
+void mem_set_backend(MemBackendFn* fn, void* udata)
+{
+    ASSERT(g_counters[MemTag_Count].allocs_count == 0);
+    g_backend = fn;
+    g_backend_udata = udata;
+}
+
+static int mem_size_bucket(size_t size)
+{
+    int bucket = size > 1 ? 64 - count_leading_zeros64(size - 1) - 4 : 0;
+    if (bucket < 0)
+        bucket = 0;
+    if (bucket > MEM_HISTOGRAM_BUCKETS_COUNT - 1)
+        bucket = MEM_HISTOGRAM_BUCKETS_COUNT - 1;
+    return bucket;
+}
+
+static void mem_count_alloc(MemCounters* c, size_t size, int bucket)
+{
+    LONG64 live = InterlockedAdd64(&c->live_bytes, (LONG64)size);
+    InterlockedIncrement64(&c->live_count);
+    InterlockedIncrement64(&c->allocs_count);
+    InterlockedIncrement64(&c->frame_allocs_count);
+    InterlockedAdd64(&c->frame_alloc_bytes, (LONG64)size);
+    InterlockedIncrement64(&c->size_histogram[bucket]);
+
+    LONG64 peak = c->peak_bytes;
+    while (live > peak)
+    {
+        LONG64 prev = InterlockedCompareExchange64(&c->peak_bytes, live, peak);
+        if (prev == peak)
+            break;
+        peak = prev;
+    }
+}
+
+static void mem_count_free(MemCounters* c, size_t size)
+{
+    InterlockedAdd64(&c->live_bytes, -(LONG64)size);
+    InterlockedDecrement64(&c->live_count);
+}
+
+void* mem_alloc(MemTag tag, size_t size)
+{
+    return mem_realloc(tag, NULL, size);
+}
+
+void* mem_calloc(MemTag tag, size_t count, size_t size)
+{
+    if (size != 0 && count > SIZE_MAX / size)
+        return NULL;
+
+    void* result = mem_alloc(tag, count * size);
+    if (result)
+        memset(result, 0, count * size);
+    return result;
+}
+
+// A 0 size still gets a block of its own, like malloc(0) does on MSVC
+void* mem_realloc(MemTag tag, void* ptr, size_t size)
+{
+    ASSERT(tag >= 0 && tag < MemTag_Count);
+    if (size > SIZE_MAX - sizeof(MemHeader))
+        return NULL;
+
+    MemHeader* header = ptr ? (MemHeader*)ptr - 1 : NULL;
+    MemHeader old = header ? *header : (MemHeader){0};
+    header = (MemHeader*)g_backend(g_backend_udata, header,
+                                   sizeof(MemHeader) + size);
+    // The old block is left alone and stays counted
+    if (!header)
+        return NULL;
+
+    if (ptr)
+    {
+        mem_count_free(&g_counters[old.tag], old.size);
+        mem_count_free(&g_counters[MemTag_Count], old.size);
+    }
+    int bucket = mem_size_bucket(size);
+    mem_count_alloc(&g_counters[tag], size, bucket);
+    mem_count_alloc(&g_counters[MemTag_Count], size, bucket);
+    header->size = size;
+    header->tag = (size_t)tag;
+    return header + 1;
+}
+
+void mem_free(void* ptr)
+{
+    if (!ptr)
+        return;
+
+    MemHeader* header = (MemHeader*)ptr - 1;
+    ASSERT(header->tag < MemTag_Count);
+    mem_count_free(&g_counters[header->tag], header->size);
+    mem_count_free(&g_counters[MemTag_Count], header->size);
+    g_backend(g_backend_udata, header, 0);
+}
+
+void mem_begin_frame()
+{
+    for (int i = 0; i <= MemTag_Count; i++)
+    {
+        MemFrameCounts* f = &g_frame_counts[i];
+        f->allocs_count =
+            InterlockedExchange64(&g_counters[i].frame_allocs_count, 0);
+        f->alloc_bytes =
+            InterlockedExchange64(&g_counters[i].frame_alloc_bytes, 0);
+        if (f->allocs_count > f->max_allocs_count)
+            f->max_allocs_count = f->allocs_count;
+    }
+}
+
+static MemStats mem_make_stats(int index)
+{
+    const MemCounters* c = &g_counters[index];
+    const MemFrameCounts* f = &g_frame_counts[index];
+    MemStats result = {
+        .live_bytes = c->live_bytes,
+        .peak_bytes = c->peak_bytes,
+        .live_count = c->live_count,
+        .allocs_count = c->allocs_count,
+        .frame_allocs_count = f->allocs_count,
+        .frame_alloc_bytes = f->alloc_bytes,
+        .max_frame_allocs_count = f->max_allocs_count,
+    };
+    for (int i = 0; i < MEM_HISTOGRAM_BUCKETS_COUNT; i++)
+        result.size_histogram[i] = c->size_histogram[i];
+    return result;
+}
+
+MemStats mem_get_stats(MemTag tag)
+{
+    ASSERT(tag >= 0 && tag < MemTag_Count);
+    return mem_make_stats(tag);
+}
+
+MemStats mem_get_total_stats()
+{
+    return mem_make_stats(MemTag_Count);
+}
+
+const char* mem_get_tag_name(MemTag tag)
+{
+    ASSERT(tag >= 0 && tag < MemTag_Count);
+    return g_tag_names[tag];
+}
+
+static void mem_format_bytes(char* buf, size_t buf_size, int64_t bytes)
+{
+    if (bytes < 1024)
+        snprintf(buf, buf_size, "%lld B", (long long)bytes);
+    else if (bytes < 1024 * 1024)
+        snprintf(buf, buf_size, "%.1f KB", (double)bytes / 1024.0);
+    else
+        snprintf(buf, buf_size, "%.1f MB", (double)bytes / (1024.0 * 1024.0));
+}
+
+static void mem_format_bucket(char* buf, size_t buf_size, int bucket)
+{
+    char limit[32];
+    bool is_last = bucket == MEM_HISTOGRAM_BUCKETS_COUNT - 1;
+    mem_format_bytes(limit, sizeof(limit),
+                     (int64_t)16 << (is_last ? bucket - 1 : bucket));
+    snprintf(buf, buf_size, is_last ? "> %s" : "<= %s", limit);
+}
+
+void mem_draw_stats_gui()
+{
+    igText("%-7s %10s %10s %8s %6s %6s %10s", "Tag", "Live", "Peak",
+           "Blocks", "Frame", "Max", "Frame size");
+    for (int i = 0; i <= MemTag_Count; i++)
+    {
+        MemStats stats = mem_make_stats(i);
+        char live[32];
+        char peak[32];
+        char frame_bytes[32];
+        mem_format_bytes(live, sizeof(live), stats.live_bytes);
+        mem_format_bytes(peak, sizeof(peak), stats.peak_bytes);
+        mem_format_bytes(frame_bytes, sizeof(frame_bytes),
+                         stats.frame_alloc_bytes);
+        igText("%-7s %10s %10s %8lld %6lld %6lld %10s", g_tag_names[i], live,
+               peak, (long long)stats.live_count,
+               (long long)stats.frame_allocs_count,
+               (long long)stats.max_frame_allocs_count, frame_bytes);
+    }
+
+    static int histogram_index = MemTag_Count;
+    igCombo("Sizes of", &histogram_index, g_tag_names, MemTag_Count + 1, -1);
+    MemStats stats = mem_make_stats(histogram_index);
+    float values[MEM_HISTOGRAM_BUCKETS_COUNT];
+    for (int i = 0; i < MEM_HISTOGRAM_BUCKETS_COUNT; i++)
+        values[i] = (float)stats.size_histogram[i];
+    igPlotHistogramFloatPtr("16 B to 64 MB", values,
+                            MEM_HISTOGRAM_BUCKETS_COUNT, 0, NULL, 0, FLT_MAX,
+                            (ImVec2){0, 80}, sizeof(float));
+}
+
+bool mem_write_report(const char* filename)
+{
+    FILE* f = fopen(filename, "w");
+    if (!f)
+    {
+        PRINTLN("Can't write the memory report to %s", filename);
+        return false;
+    }
+
+    fprintf(f, "%-7s %12s %12s %10s %12s %10s\n", "Tag", "Live", "Peak",
+            "Blocks", "Allocations", "Max/frame");
+    for (int i = 0; i <= MemTag_Count; i++)
+    {
+        MemStats stats = mem_make_stats(i);
+        char live[32];
+        char peak[32];
+        mem_format_bytes(live, sizeof(live), stats.live_bytes);
+        mem_format_bytes(peak, sizeof(peak), stats.peak_bytes);
+        fprintf(f, "%-7s %12s %12s %10lld %12lld %10lld\n", g_tag_names[i],
+                live, peak, (long long)stats.live_count,
+                (long long)stats.allocs_count,
+                (long long)stats.max_frame_allocs_count);
+    }
+
+    for (int i = 0; i < MemTag_Count; i++)
+    {
+        MemStats stats = mem_make_stats(i);
+        if (stats.allocs_count == 0)
+            continue;
+
+        fprintf(f, "\n%s allocation sizes\n", g_tag_names[i]);
+        for (int j = 0; j < MEM_HISTOGRAM_BUCKETS_COUNT; j++)
+        {
+            if (stats.size_histogram[j] == 0)
+                continue;
+            char bucket[32];
+            mem_format_bucket(bucket, sizeof(bucket), j);
+            fprintf(f, "  %-10s %10lld\n", bucket,
+                    (long long)stats.size_histogram[j]);
+        }
+    }
+
+    MemStats total = mem_get_total_stats();
+    if (total.live_count > 0)
+    {
+        fprintf(f, "\nLeaked at exit\n");
+        for (int i = 0; i < MemTag_Count; i++)
+        {
+            MemStats stats = mem_make_stats(i);
+            if (stats.live_count == 0)
+                continue;
+            char live[32];
+            mem_format_bytes(live, sizeof(live), stats.live_bytes);
+            fprintf(f, "  %-7s %lld blocks, %s\n", g_tag_names[i],
+                    (long long)stats.live_count, live);
+        }
+    }
+
+    fclose(f);
+    return true;
+}
@@ -0,0 +1,110 @@
+#include "pool.h"
+#include "debug.h"
+#include "mem.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define POOL_MIN_CAP 64
+
+void pool_init(Pool* pool, int item_size)
+{
+    ASSERT(item_size > 0);
+    *pool = (Pool){
+        .item_size = item_size,
+        .free_slot = -1,
+    };
+}
+
+void pool_cleanup(Pool* pool)
+{
+    mem_free(pool->items);
+    mem_free(pool->item_slots);
+    mem_free(pool->slot_items);
+    mem_free(pool->slot_generations);
+    pool_init(pool, pool->item_size);
+}
+
+// Slots are only created when no free one is left, so there are never more
+// of them than items at the highest count and the same capacity does
+bool pool_reserve(Pool* pool, int cap)
+{
+    if (cap <= pool->cap)
+        return false;
+
+    int new_cap = pool->cap ? pool->cap : POOL_MIN_CAP;
+    while (new_cap < cap)
+        new_cap *= 2;
+
+    void* old_items = pool->items;
+    pool->items = mem_realloc(MemTag_Misc, pool->items,
+                              (size_t)new_cap * pool->item_size);
+    pool->item_slots = (int*)mem_realloc(MemTag_Misc, pool->item_slots,
+                                         new_cap * sizeof(int));
+    pool->slot_items = (int*)mem_realloc(MemTag_Misc, pool->slot_items,
+                                         new_cap * sizeof(int));
+    pool->slot_generations =
+        (uint32_t*)mem_realloc(MemTag_Misc, pool->slot_generations,
+                               new_cap * sizeof(uint32_t));
+    pool->cap = new_cap;
+    return pool->items != old_items && old_items != NULL;
+}
+
+PoolHandle pool_add(Pool* pool)
+{
+    pool_reserve(pool, pool->count + 1);
+
+    int slot = pool->free_slot;
+    if (slot >= 0)
+    {
+        pool->free_slot = pool->slot_items[slot];
+    }
+    else
+    {
+        slot = pool->slots_count++;
+        pool->slot_generations[slot] = 1;
+    }
+
+    int index = pool->count++;
+    memset(pool_at(pool, index), 0, pool->item_size);
+    pool->item_slots[index] = slot;
+    pool->slot_items[slot] = index;
+    return (PoolHandle){slot, pool->slot_generations[slot]};
+}
+
+void pool_remove(Pool* pool, int index)
+{
+    ASSERT(index >= 0 && index < pool->count);
+    int slot = pool->item_slots[index];
+    int last = --pool->count;
+    if (index != last)
+    {
+        memcpy(pool_at(pool, index), pool_at(pool, last), pool->item_size);
+        int moved_slot = pool->item_slots[last];
+        pool->item_slots[index] = moved_slot;
+        pool->slot_items[moved_slot] = index;
+    }
+
+    // Handles to the removed item go stale now, 0 is skipped on wrapping
+    if (++pool->slot_generations[slot] == 0)
+        pool->slot_generations[slot] = 1;
+    pool->slot_items[slot] = pool->free_slot;
+    pool->free_slot = slot;
+}
+
+int pool_index(const Pool* pool, PoolHandle handle)
+{
+    if (handle.generation == 0 || handle.slot < 0 ||
+        handle.slot >= pool->slots_count ||
+        pool->slot_generations[handle.slot] != handle.generation)
+    {
+        return -1;
+    }
+    return pool->slot_items[handle.slot];
+}
+
+PoolHandle pool_handle(const Pool* pool, int index)
+{
+    ASSERT(index >= 0 && index < pool->count);
+    int slot = pool->item_slots[index];
+    return (PoolHandle){slot, pool->slot_generations[slot]};
+}
@@ -0,0 +1,51 @@
+#ifndef POOL_H
+#define POOL_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Generation 0 is never handed out, so a zeroed handle is always stale
+typedef struct PoolHandle_
+{
+    int slot;
+    uint32_t generation;
+} PoolHandle;
+
+// Items are kept dense so they can be walked and uploaded as one array, and
+// removal swaps the last item into the hole. Handles go through a slot table
+// and keep naming the same item across removals. Item addresses change when
+// the pool grows or an item is moved, only handles are stable.
+typedef struct Pool_
+{
+    void* items;
+    int item_size;
+    int count;
+    int cap;
+
+    int* item_slots; // Slot of each item
+    int* slot_items; // Item of each slot, next free slot when unused
+    uint32_t* slot_generations;
+    int slots_count;
+    int free_slot; // -1 when none
+} Pool;
+
+#define POOL_ITEMS(pool, type) ((type*)(pool)->items)
+
+void pool_init(Pool* pool, int item_size);
+void pool_cleanup(Pool* pool);
+// Returns true when the items moved
+bool pool_reserve(Pool* pool, int cap);
+// The new item is zeroed and placed last, at index count - 1
+PoolHandle pool_add(Pool* pool);
+// Moves the last item into index
+void pool_remove(Pool* pool, int index);
+// -1 when the item was removed
+int pool_index(const Pool* pool, PoolHandle handle);
+PoolHandle pool_handle(const Pool* pool, int index);
+
+static inline void* pool_at(const Pool* pool, int index)
+{
+    return (char*)pool->items + (size_t)index * pool->item_size;
+}
+
+#endif // POOL_H
@@ -1,9 +1,21 @@
 #include "renderer.h"
 #include "app.h"
+#include "mem.h"
 #include <cimgui/cimgui_impl.h>
 
+static void* r_gui_alloc(size_t size, void* udata)
+{
+    return mem_alloc(MemTag_Gui, size);
+}
+
+static void r_gui_free(void* ptr, void* udata)
+{
+    mem_free(ptr);
+}
+
 void r_gui_init()
 {
+    igSetAllocatorFunctions(&r_gui_alloc, &r_gui_free, NULL);
     igCreateContext(NULL);
     ImGui_ImplOpenGL3_Init(NULL);
 }
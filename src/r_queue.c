@@ -0,0 +1,272 @@
+#include "renderer.h"
+#include "debug.h"
+#include "mem.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define R_QUEUE_PASS_SHIFT 60
+#define R_QUEUE_PROGRAM_SHIFT 50
+#define R_QUEUE_MATERIAL_SHIFT 38
+#define R_QUEUE_VAO_SHIFT 26
+#define R_QUEUE_DEPTH_MAX 0xFFFFFF
+
+#define R_QUEUE_INITIAL_CAP 64
+
+uint64_t r_queue_make_key(const RenderKeyDesc* desc)
+{
+    float depth = HIMATH_CLAMP(desc->depth, 0.f, 1.f);
+    uint64_t depth_bits = (uint64_t)(depth * (float)R_QUEUE_DEPTH_MAX);
+    if (desc->back_to_front)
+        depth_bits = R_QUEUE_DEPTH_MAX - depth_bits;
+
+    uint64_t result = ((uint64_t)(desc->pass & 0xF) << R_QUEUE_PASS_SHIFT) |
+                      ((uint64_t)(desc->program & 0x3FF)
+                       << R_QUEUE_PROGRAM_SHIFT) |
+                      ((uint64_t)(desc->material & 0xFFF)
+                       << R_QUEUE_MATERIAL_SHIFT) |
+                      ((uint64_t)(desc->vao & 0xFFF) << R_QUEUE_VAO_SHIFT) |
+                      depth_bits;
+    return result;
+}
+
+void r_queue_init(RenderQueue* q, GLuint uniform_buffer, int uniform_size)
+{
+    *q = (RenderQueue){
+        .uniform_buffer = uniform_buffer,
+        .uniform_size = uniform_size,
+    };
+}
+
+void r_queue_cleanup(RenderQueue* q)
+{
+    mem_free(q->commands);
+    mem_free(q->uniform_data);
+    mem_free(q->items);
+    mem_free(q->items_temp);
+    *q = (RenderQueue){0};
+}
+
+static void r_queue_grow(RenderQueue* q)
+{
+    int new_cap = q->commands_cap ? q->commands_cap * 2 : R_QUEUE_INITIAL_CAP;
+    q->commands = (RenderCommand*)mem_realloc(MemTag_Misc, q->commands,
+                                              new_cap * sizeof(*q->commands));
+    if (q->uniform_size > 0)
+    {
+        q->uniform_data =
+            (uint8_t*)mem_realloc(MemTag_Misc, q->uniform_data,
+                                  new_cap * q->uniform_size);
+    }
+    q->items = (RenderQueueItem*)mem_realloc(MemTag_Misc, q->items,
+                                             new_cap * sizeof(*q->items));
+    q->items_temp = (RenderQueueItem*)mem_realloc(
+        MemTag_Misc, q->items_temp, new_cap * sizeof(*q->items_temp));
+    q->commands_cap = new_cap;
+}
+
+void r_queue_push(RenderQueue* q,
+                  const RenderCommand* cmd,
+                  const void* uniform_data)
+{
+    ASSERT(cmd->textures_count <= RENDER_QUEUE_MAX_TEXTURES);
+
+    if (q->commands_count == q->commands_cap)
+        r_queue_grow(q);
+
+    int index = q->commands_count++;
+    RenderCommand* dst = &q->commands[index];
+    *dst = *cmd;
+    dst->uniform_offset = -1;
+    if (uniform_data && q->uniform_size > 0)
+    {
+        dst->uniform_offset = index * q->uniform_size;
+        memcpy(q->uniform_data + dst->uniform_offset, uniform_data,
+               q->uniform_size);
+    }
+
+    q->items[index] = (RenderQueueItem){.key = cmd->key, .index = index};
+}
+
+void r_queue_push_vb(RenderQueue* q,
+                     uint64_t key,
+                     GLuint program,
+                     const VertexBuffer* vb,
+                     const GLuint* textures,
+                     int textures_count,
+                     const void* uniform_data)
+{
+    RenderCommand cmd = {
+        .key = key,
+        .program = program,
+        .vao = vb->vao,
+        .mode = vb->mode,
+        .indexed = (vb->ebo != 0),
+        .count = (int)vb->count,
+        .textures_count = textures_count,
+    };
+    for (int i = 0; i < textures_count; i++)
+        cmd.textures[i] = textures[i];
+
+    r_queue_push(q, &cmd, uniform_data);
+}
+
+// LSD radix sort over 8-bit digits. Digits that are identical across every
+// key (unused passes, programs shared by the whole queue...) are skipped, so
+// a typical frame only pays for a few of the eight passes.
+static void r_queue_sort(RenderQueue* q)
+{
+    int count = q->commands_count;
+    RenderQueueItem* src = q->items;
+    RenderQueueItem* dst = q->items_temp;
+
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        int histogram[256] = {0};
+        for (int i = 0; i < count; i++)
+            ++histogram[(src[i].key >> shift) & 0xFF];
+
+        if (histogram[(src[0].key >> shift) & 0xFF] == count)
+            continue;
+
+        int offset = 0;
+        for (int i = 0; i < 256; i++)
+        {
+            int c = histogram[i];
+            histogram[i] = offset;
+            offset += c;
+        }
+
+        for (int i = 0; i < count; i++)
+            dst[histogram[(src[i].key >> shift) & 0xFF]++] = src[i];
+
+        RenderQueueItem* temp = src;
+        src = dst;
+        dst = temp;
+    }
+
+    q->items = src;
+    q->items_temp = dst;
+}
+
+static void r_queue_execute_command(RenderQueue* q,
+                                    const RenderCommand* cmd,
+                                    const RenderCommand* prev,
+                                    RenderQueueStats* stats)
+{
+    if (!prev || cmd->program != prev->program)
+        ++stats->program_changes;
+    r_state_use_program(cmd->program);
+
+    if (!prev || cmd->vao != prev->vao)
+        ++stats->vao_changes;
+    r_state_bind_vertex_array(cmd->vao);
+
+    if (cmd->textures_count > 0)
+    {
+        if (!prev || prev->textures_count != cmd->textures_count ||
+            memcmp(prev->textures, cmd->textures,
+                   cmd->textures_count * sizeof(GLuint)) != 0)
+        {
+            ++stats->texture_changes;
+        }
+        r_state_bind_textures(0, cmd->textures_count, cmd->textures);
+    }
+
+    if (cmd->uniform_offset >= 0)
+    {
+        r_state_bind_buffer(GL_UNIFORM_BUFFER, q->uniform_buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, q->uniform_size,
+                        q->uniform_data + cmd->uniform_offset);
+    }
+
+    if (cmd->indirect_buffer)
+    {
+        ASSERT(cmd->indexed);
+        r_state_bind_buffer(GL_DRAW_INDIRECT_BUFFER, cmd->indirect_buffer);
+        glMultiDrawElementsIndirect(cmd->mode, GL_UNSIGNED_INT,
+                                    (GLvoid*)(intptr_t)cmd->indirect_offset,
+                                    cmd->draw_count, 0);
+    }
+    else if (cmd->indexed)
+    {
+        GLvoid* offset = (GLvoid*)(cmd->first * sizeof(uint32_t));
+        if (cmd->instances_count > 0)
+        {
+            glDrawElementsInstanced(cmd->mode, cmd->count, GL_UNSIGNED_INT,
+                                    offset, cmd->instances_count);
+        }
+        else
+        {
+            glDrawElements(cmd->mode, cmd->count, GL_UNSIGNED_INT, offset);
+        }
+    }
+    else
+    {
+        if (cmd->instances_count > 0)
+        {
+            glDrawArraysInstanced(cmd->mode, cmd->first, cmd->count,
+                                  cmd->instances_count);
+        }
+        else
+        {
+            glDrawArrays(cmd->mode, cmd->first, cmd->count);
+        }
+    }
+}
+
+void r_queue_execute(RenderQueue* q,
+                     int passes_count,
+                     RenderPassFn* pass_fn,
+                     void* udata)
+{
+    RenderQueueStats stats = {.commands_count = q->commands_count};
+
+    if (q->commands_count > 0)
+        r_queue_sort(q);
+
+    const RenderCommand* prev = NULL;
+    int i = 0;
+
+    if (pass_fn)
+    {
+        for (int pass = 0; pass < passes_count; pass++)
+        {
+            pass_fn(pass, udata);
+            ++stats.pass_changes;
+            // Fixed-function state may change under the commands
+            prev = NULL;
+
+            for (; i < q->commands_count; i++)
+            {
+                const RenderCommand* cmd = &q->commands[q->items[i].index];
+                if ((int)(cmd->key >> R_QUEUE_PASS_SHIFT) != pass)
+                    break;
+                r_queue_execute_command(q, cmd, prev, &stats);
+                prev = cmd;
+            }
+        }
+        ASSERT(i == q->commands_count);
+    }
+    else
+    {
+        for (; i < q->commands_count; i++)
+        {
+            const RenderCommand* cmd = &q->commands[q->items[i].index];
+            r_queue_execute_command(q, cmd, prev, &stats);
+            prev = cmd;
+        }
+    }
+
+    q->last_stats = stats;
+    q->commands_count = 0;
+}
+
+void r_queue_draw_stats_gui(const RenderQueue* q)
+{
+    const RenderQueueStats* stats = &q->last_stats;
+    igText("Commands        %5d", stats->commands_count);
+    igText("Pass changes    %5d", stats->pass_changes);
+    igText("Program changes %5d", stats->program_changes);
+    igText("VAO changes     %5d", stats->vao_changes);
+    igText("Texture changes %5d", stats->texture_changes);
+}
@@ -0,0 +1,510 @@
+#include "renderer.h"
+#include "util.h"
+#include <string.h>
+
+#define R_STATE_UNKNOWN 0xFFFFFFFFu
+#define R_STATE_MAX_TEXTURE_UNITS 16
+#define R_STATE_MAX_BUFFER_INDICES 16
+
+typedef enum RenderStateBufferSlot_
+{
+    RenderStateBufferSlot_Array = 0,
+    RenderStateBufferSlot_ElementArray,
+    RenderStateBufferSlot_Uniform,
+    RenderStateBufferSlot_ShaderStorage,
+    RenderStateBufferSlot_DrawIndirect,
+    RenderStateBufferSlot_DispatchIndirect,
+    RenderStateBufferSlot_Count,
+} RenderStateBufferSlot;
+
+typedef enum RenderStateCap_
+{
+    RenderStateCap_DepthTest = 0,
+    RenderStateCap_CullFace,
+    RenderStateCap_Blend,
+    RenderStateCap_ScissorTest,
+    RenderStateCap_StencilTest,
+    RenderStateCap_DepthClamp,
+    RenderStateCap_Count,
+} RenderStateCap;
+
+// Every field is filled with 0xFF bytes when the cache is invalidated. That
+// turns names into R_STATE_UNKNOWN, ints into -1 and floats into NaN, none of
+// which compare equal to a value the caller could pass in.
+typedef struct RenderStateCache_
+{
+    GLuint program;
+    GLuint vao;
+    GLuint buffers[RenderStateBufferSlot_Count];
+    GLuint uniform_buffer_bases[R_STATE_MAX_BUFFER_INDICES];
+    GLuint shader_storage_buffer_bases[R_STATE_MAX_BUFFER_INDICES];
+    GLuint active_texture_unit;
+    GLuint textures[R_STATE_MAX_TEXTURE_UNITS];
+    GLuint samplers[R_STATE_MAX_TEXTURE_UNITS];
+    GLuint read_framebuffer;
+    GLuint draw_framebuffer;
+
+    GLuint caps[RenderStateCap_Count];
+    GLuint polygon_mode;
+    GLuint cull_face;
+    GLuint front_face;
+    GLuint depth_func;
+    GLuint depth_mask;
+    GLuint blend_src;
+    GLuint blend_dst;
+    GLuint stencil_func;
+    GLint stencil_ref;
+    GLuint stencil_mask;
+    GLuint stencil_fail_op;
+    GLuint stencil_depth_fail_op;
+    GLuint stencil_pass_op;
+    int viewport[4];
+    int scissor[4];
+    float clear_color[4];
+} RenderStateCache;
+
+static RenderStateCache g_state;
+static RenderStateStats g_stats;
+static RenderStateStats g_last_frame_stats;
+
+static const char* g_call_names[RenderStateCall_Count] = {
+    "Program",     "Vertex Array", "Buffer",         "Texture",
+    "Sampler",     "Framebuffer",  "Fixed Function",
+};
+
+static bool r_state_update(GLuint* cached, GLuint value, RenderStateCall call)
+{
+    bool result = (*cached != value);
+    if (result)
+    {
+        *cached = value;
+        ++g_stats.issued[call];
+    }
+    else
+    {
+        ++g_stats.skipped[call];
+    }
+    return result;
+}
+
+static bool r_state_update4i(int* cached, const int* value)
+{
+    bool result = (memcmp(cached, value, 4 * sizeof(int)) != 0);
+    if (result)
+    {
+        memcpy(cached, value, 4 * sizeof(int));
+        ++g_stats.issued[RenderStateCall_FixedFunction];
+    }
+    else
+    {
+        ++g_stats.skipped[RenderStateCall_FixedFunction];
+    }
+    return result;
+}
+
+static int r_state_get_buffer_slot(GLenum target)
+{
+    int result = -1;
+    switch (target)
+    {
+    case GL_ARRAY_BUFFER: result = RenderStateBufferSlot_Array; break;
+    case GL_ELEMENT_ARRAY_BUFFER:
+        result = RenderStateBufferSlot_ElementArray;
+        break;
+    case GL_UNIFORM_BUFFER: result = RenderStateBufferSlot_Uniform; break;
+    case GL_SHADER_STORAGE_BUFFER:
+        result = RenderStateBufferSlot_ShaderStorage;
+        break;
+    case GL_DRAW_INDIRECT_BUFFER:
+        result = RenderStateBufferSlot_DrawIndirect;
+        break;
+    case GL_DISPATCH_INDIRECT_BUFFER:
+        result = RenderStateBufferSlot_DispatchIndirect;
+        break;
+    }
+    return result;
+}
+
+static int r_state_get_cap_slot(GLenum cap)
+{
+    int result = -1;
+    switch (cap)
+    {
+    case GL_DEPTH_TEST: result = RenderStateCap_DepthTest; break;
+    case GL_CULL_FACE: result = RenderStateCap_CullFace; break;
+    case GL_BLEND: result = RenderStateCap_Blend; break;
+    case GL_SCISSOR_TEST: result = RenderStateCap_ScissorTest; break;
+    case GL_STENCIL_TEST: result = RenderStateCap_StencilTest; break;
+    case GL_DEPTH_CLAMP: result = RenderStateCap_DepthClamp; break;
+    }
+    return result;
+}
+
+void r_state_invalidate()
+{
+    memset(&g_state, 0xFF, sizeof(g_state));
+}
+
+void r_state_begin_frame()
+{
+    g_last_frame_stats = g_stats;
+    g_stats = (RenderStateStats){0};
+}
+
+const RenderStateStats* r_state_get_last_frame_stats()
+{
+    return &g_last_frame_stats;
+}
+
+void r_state_draw_stats_gui()
+{
+    const RenderStateStats* stats = &g_last_frame_stats;
+    int total_issued = 0;
+    int total_skipped = 0;
+    for (int i = 0; i < RenderStateCall_Count; i++)
+    {
+        igText("%-14s issued %5d  skipped %5d", g_call_names[i],
+               stats->issued[i], stats->skipped[i]);
+        total_issued += stats->issued[i];
+        total_skipped += stats->skipped[i];
+    }
+    igText("%-14s issued %5d  skipped %5d", "Total", total_issued,
+           total_skipped);
+}
+
+void r_state_use_program(GLuint program)
+{
+    if (r_state_update(&g_state.program, program, RenderStateCall_Program))
+        glUseProgram(program);
+}
+
+void r_state_bind_vertex_array(GLuint vao)
+{
+    if (r_state_update(&g_state.vao, vao, RenderStateCall_VertexArray))
+    {
+        glBindVertexArray(vao);
+        // The element array binding belongs to the vertex array object
+        g_state.buffers[RenderStateBufferSlot_ElementArray] = R_STATE_UNKNOWN;
+    }
+}
+
+void r_state_bind_buffer(GLenum target, GLuint buffer)
+{
+    int slot = r_state_get_buffer_slot(target);
+    if (slot < 0)
+    {
+        ++g_stats.issued[RenderStateCall_Buffer];
+        glBindBuffer(target, buffer);
+    }
+    else if (r_state_update(&g_state.buffers[slot], buffer,
+                            RenderStateCall_Buffer))
+    {
+        glBindBuffer(target, buffer);
+    }
+}
+
+void r_state_bind_buffer_base(GLenum target, GLuint index, GLuint buffer)
+{
+    GLuint* bases = NULL;
+    if (target == GL_UNIFORM_BUFFER)
+        bases = g_state.uniform_buffer_bases;
+    else if (target == GL_SHADER_STORAGE_BUFFER)
+        bases = g_state.shader_storage_buffer_bases;
+
+    if (!bases || index >= R_STATE_MAX_BUFFER_INDICES)
+    {
+        ++g_stats.issued[RenderStateCall_Buffer];
+        glBindBufferBase(target, index, buffer);
+        int slot = r_state_get_buffer_slot(target);
+        if (slot >= 0)
+            g_state.buffers[slot] = buffer;
+    }
+    else if (r_state_update(&bases[index], buffer, RenderStateCall_Buffer))
+    {
+        glBindBufferBase(target, index, buffer);
+        // Indexed binds also replace the generic binding point
+        g_state.buffers[r_state_get_buffer_slot(target)] = buffer;
+    }
+}
+
+void r_state_bind_texture(GLuint unit, GLenum target, GLuint texture)
+{
+    if (unit >= R_STATE_MAX_TEXTURE_UNITS)
+    {
+        ++g_stats.issued[RenderStateCall_Texture];
+        glBindTextureUnit(unit, texture);
+    }
+    else if (r_state_update(&g_state.textures[unit], texture,
+                            RenderStateCall_Texture))
+    {
+        if (g_state.active_texture_unit != unit)
+        {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            g_state.active_texture_unit = unit;
+        }
+        glBindTexture(target, texture);
+    }
+}
+
+void r_state_bind_textures(GLuint first, int count, const GLuint* textures)
+{
+    bool dirty = (first + count > R_STATE_MAX_TEXTURE_UNITS);
+    for (int i = 0; !dirty && i < count; i++)
+    {
+        GLuint texture = textures ? textures[i] : 0;
+        dirty = (g_state.textures[first + i] != texture);
+    }
+
+    if (dirty)
+    {
+        ++g_stats.issued[RenderStateCall_Texture];
+        glBindTextures(first, count, textures);
+        for (int i = 0; i < count && first + i < R_STATE_MAX_TEXTURE_UNITS; i++)
+            g_state.textures[first + i] = textures ? textures[i] : 0;
+    }
+    else
+    {
+        ++g_stats.skipped[RenderStateCall_Texture];
+    }
+}
+
+void r_state_bind_sampler(GLuint unit, GLuint sampler)
+{
+    if (unit >= R_STATE_MAX_TEXTURE_UNITS)
+    {
+        ++g_stats.issued[RenderStateCall_Sampler];
+        glBindSampler(unit, sampler);
+    }
+    else if (r_state_update(&g_state.samplers[unit], sampler,
+                            RenderStateCall_Sampler))
+    {
+        glBindSampler(unit, sampler);
+    }
+}
+
+void r_state_bind_framebuffer(GLenum target, GLuint framebuffer)
+{
+    switch (target)
+    {
+    case GL_FRAMEBUFFER:
+        if ((g_state.read_framebuffer != framebuffer) ||
+            (g_state.draw_framebuffer != framebuffer))
+        {
+            ++g_stats.issued[RenderStateCall_Framebuffer];
+            glBindFramebuffer(target, framebuffer);
+            g_state.read_framebuffer = framebuffer;
+            g_state.draw_framebuffer = framebuffer;
+        }
+        else
+        {
+            ++g_stats.skipped[RenderStateCall_Framebuffer];
+        }
+        break;
+    case GL_READ_FRAMEBUFFER:
+        if (r_state_update(&g_state.read_framebuffer, framebuffer,
+                           RenderStateCall_Framebuffer))
+            glBindFramebuffer(target, framebuffer);
+        break;
+    case GL_DRAW_FRAMEBUFFER:
+        if (r_state_update(&g_state.draw_framebuffer, framebuffer,
+                           RenderStateCall_Framebuffer))
+            glBindFramebuffer(target, framebuffer);
+        break;
+    }
+}
+
+void r_state_set_enabled(GLenum cap, bool enabled)
+{
+    int slot = r_state_get_cap_slot(cap);
+    if ((slot < 0) || r_state_update(&g_state.caps[slot], (GLuint)enabled,
+                                     RenderStateCall_FixedFunction))
+    {
+        if (slot < 0)
+            ++g_stats.issued[RenderStateCall_FixedFunction];
+
+        if (enabled)
+            glEnable(cap);
+        else
+            glDisable(cap);
+    }
+}
+
+void r_state_polygon_mode(GLenum mode)
+{
+    if (r_state_update(&g_state.polygon_mode, mode,
+                       RenderStateCall_FixedFunction))
+        glPolygonMode(GL_FRONT_AND_BACK, mode);
+}
+
+void r_state_cull_face(GLenum mode)
+{
+    if (r_state_update(&g_state.cull_face, mode, RenderStateCall_FixedFunction))
+        glCullFace(mode);
+}
+
+void r_state_front_face(GLenum mode)
+{
+    if (r_state_update(&g_state.front_face, mode,
+                       RenderStateCall_FixedFunction))
+        glFrontFace(mode);
+}
+
+void r_state_depth_func(GLenum func)
+{
+    if (r_state_update(&g_state.depth_func, func,
+                       RenderStateCall_FixedFunction))
+        glDepthFunc(func);
+}
+
+void r_state_depth_mask(bool enabled)
+{
+    if (r_state_update(&g_state.depth_mask, (GLuint)enabled,
+                       RenderStateCall_FixedFunction))
+        glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+}
+
+void r_state_blend_func(GLenum src, GLenum dst)
+{
+    if ((g_state.blend_src != src) || (g_state.blend_dst != dst))
+    {
+        ++g_stats.issued[RenderStateCall_FixedFunction];
+        glBlendFunc(src, dst);
+        g_state.blend_src = src;
+        g_state.blend_dst = dst;
+    }
+    else
+    {
+        ++g_stats.skipped[RenderStateCall_FixedFunction];
+    }
+}
+
+void r_state_stencil_func(GLenum func, GLint ref, GLuint mask)
+{
+    if ((g_state.stencil_func != func) || (g_state.stencil_ref != ref) ||
+        (g_state.stencil_mask != mask))
+    {
+        ++g_stats.issued[RenderStateCall_FixedFunction];
+        glStencilFunc(func, ref, mask);
+        g_state.stencil_func = func;
+        g_state.stencil_ref = ref;
+        g_state.stencil_mask = mask;
+    }
+    else
+    {
+        ++g_stats.skipped[RenderStateCall_FixedFunction];
+    }
+}
+
+void r_state_stencil_op(GLenum fail, GLenum depth_fail, GLenum pass)
+{
+    if ((g_state.stencil_fail_op != fail) ||
+        (g_state.stencil_depth_fail_op != depth_fail) ||
+        (g_state.stencil_pass_op != pass))
+    {
+        ++g_stats.issued[RenderStateCall_FixedFunction];
+        glStencilOp(fail, depth_fail, pass);
+        g_state.stencil_fail_op = fail;
+        g_state.stencil_depth_fail_op = depth_fail;
+        g_state.stencil_pass_op = pass;
+    }
+    else
+    {
+        ++g_stats.skipped[RenderStateCall_FixedFunction];
+    }
+}
+
+void r_state_viewport(int x, int y, int w, int h)
+{
+    int viewport[4] = {x, y, w, h};
+    if (r_state_update4i(g_state.viewport, viewport))
+        glViewport(x, y, w, h);
+}
+
+void r_state_scissor(int x, int y, int w, int h)
+{
+    int scissor[4] = {x, y, w, h};
+    if (r_state_update4i(g_state.scissor, scissor))
+        glScissor(x, y, w, h);
+}
+
+void r_state_clear_color(float r, float g, float b, float a)
+{
+    float* c = g_state.clear_color;
+    if ((c[0] != r) || (c[1] != g) || (c[2] != b) || (c[3] != a))
+    {
+        ++g_stats.issued[RenderStateCall_FixedFunction];
+        glClearColor(r, g, b, a);
+        c[0] = r;
+        c[1] = g;
+        c[2] = b;
+        c[3] = a;
+    }
+    else
+    {
+        ++g_stats.skipped[RenderStateCall_FixedFunction];
+    }
+}
+
+static void r_state_forget(GLuint* cached, int cached_count, GLuint name)
+{
+    for (int i = 0; i < cached_count; i++)
+    {
+        if (cached[i] == name)
+            cached[i] = R_STATE_UNKNOWN;
+    }
+}
+
+void r_state_delete_vertex_arrays(int n, const GLuint* vaos)
+{
+    for (int i = 0; i < n; i++)
+    {
+        if (g_state.vao == vaos[i])
+        {
+            g_state.vao = R_STATE_UNKNOWN;
+            g_state.buffers[RenderStateBufferSlot_ElementArray] =
+                R_STATE_UNKNOWN;
+        }
+    }
+    glDeleteVertexArrays(n, vaos);
+}
+
+void r_state_delete_buffers(int n, const GLuint* buffers)
+{
+    for (int i = 0; i < n; i++)
+    {
+        r_state_forget(g_state.buffers, ARRAY_LENGTH(g_state.buffers),
+                       buffers[i]);
+        r_state_forget(g_state.uniform_buffer_bases,
+                       ARRAY_LENGTH(g_state.uniform_buffer_bases), buffers[i]);
+        r_state_forget(g_state.shader_storage_buffer_bases,
+                       ARRAY_LENGTH(g_state.shader_storage_buffer_bases),
+                       buffers[i]);
+    }
+    glDeleteBuffers(n, buffers);
+}
+
+void r_state_delete_textures(int n, const GLuint* textures)
+{
+    for (int i = 0; i < n; i++)
+        r_state_forget(g_state.textures, ARRAY_LENGTH(g_state.textures),
+                       textures[i]);
+    glDeleteTextures(n, textures);
+}
+
+void r_state_delete_samplers(int n, const GLuint* samplers)
+{
+    for (int i = 0; i < n; i++)
+        r_state_forget(g_state.samplers, ARRAY_LENGTH(g_state.samplers),
+                       samplers[i]);
+    glDeleteSamplers(n, samplers);
+}
+
+void r_state_delete_framebuffers(int n, const GLuint* framebuffers)
+{
+    for (int i = 0; i < n; i++)
+    {
+        r_state_forget(&g_state.read_framebuffer, 1, framebuffers[i]);
+        r_state_forget(&g_state.draw_framebuffer, 1, framebuffers[i]);
+    }
+    glDeleteFramebuffers(n, framebuffers);
+}
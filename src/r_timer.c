@@ -0,0 +1,48 @@
+#include "renderer.h"
+
+void r_gpu_timer_init(GpuTimer* timer)
+{
+    *timer = (GpuTimer){0};
+    glGenQueries(GPU_TIMER_QUERIES_COUNT, timer->queries);
+}
+
+void r_gpu_timer_cleanup(GpuTimer* timer)
+{
+    glDeleteQueries(GPU_TIMER_QUERIES_COUNT, timer->queries);
+    *timer = (GpuTimer){0};
+}
+
+void r_gpu_timer_begin(GpuTimer* timer)
+{
+    GLuint query = timer->queries[timer->current];
+    if (timer->pending[timer->current])
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            // Reusing the query would throw its result away, so this frame
+            // goes unmeasured and the same query is tried again next time
+            ++timer->skipped_count;
+            return;
+        }
+
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+        timer->ms = (float)((double)ns / 1000000.0);
+        timer->pending[timer->current] = false;
+    }
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    timer->running = true;
+}
+
+void r_gpu_timer_end(GpuTimer* timer)
+{
+    if (!timer->running)
+        return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    timer->running = false;
+    timer->pending[timer->current] = true;
+    timer->current = (timer->current + 1) % GPU_TIMER_QUERIES_COUNT;
+}
@@ -9,10 +9,10 @@ void r_vb_init(VertexBuffer* vb, const Mesh* mesh, GLenum mode)
 
     ASSERT(mesh->vertices);
     glGenVertexArrays(1, &vb->vao);
-    glBindVertexArray(vb->vao);
+    r_state_bind_vertex_array(vb->vao);
 
     glGenBuffers(1, &vb->vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vb->vbo);
+    r_state_bind_buffer(GL_ARRAY_BUFFER, vb->vbo);
     glBufferData(GL_ARRAY_BUFFER, mesh->vertices_count * sizeof(Vertex),
                  mesh->vertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
@@ -24,11 +24,11 @@ void r_vb_init(VertexBuffer* vb, const Mesh* mesh, GLenum mode)
     glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
                           (GLvoid*)offsetof(Vertex, normal));
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    r_state_bind_buffer(GL_ARRAY_BUFFER, 0);
     if (mesh->indices)
     {
         glGenBuffers(1, &vb->ebo);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vb->ebo);
+        r_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, vb->ebo);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER,
                      mesh->indices_count * sizeof(uint), mesh->indices,
                      GL_STATIC_DRAW);
@@ -38,25 +38,25 @@ void r_vb_init(VertexBuffer* vb, const Mesh* mesh, GLenum mode)
     {
         vb->count = mesh->vertices_count;
     }
-    glBindVertexArray(0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    r_state_bind_vertex_array(0);
+    r_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
     vb->mode = mode;
 }
 
 void r_vb_cleanup(VertexBuffer* vb)
 {
-    glDeleteVertexArrays(1, &vb->vao);
-    glDeleteBuffers(1, &vb->vbo);
+    r_state_delete_vertex_arrays(1, &vb->vao);
+    r_state_delete_buffers(1, &vb->vbo);
     if (vb->ebo != 0)
-        glDeleteBuffers(1, &vb->ebo);
+        r_state_delete_buffers(1, &vb->ebo);
 
     *vb = (VertexBuffer){0};
 }
 
 void r_vb_draw(const VertexBuffer* vb)
 {
-    glBindVertexArray(vb->vao);
+    r_state_bind_vertex_array(vb->vao);
     if (vb->ebo != 0)
         glDrawElements(vb->mode, vb->count, GL_UNSIGNED_INT, NULL);
     else
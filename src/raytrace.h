@@ -0,0 +1,109 @@
+#ifndef RAYTRACE_H
+#define RAYTRACE_H
+#include <himath.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct Mesh_ Mesh;
+typedef struct Arena_ Arena;
+
+#define RT_PACKET_SIZE 4
+// Builds stop splitting at this depth, so the fixed traversal stacks of
+// RT_MAX_DEPTH + 2 entries can't overflow
+#define RT_MAX_DEPTH 62
+
+typedef struct Ray_
+{
+    FVec3 origin;
+    float t_max;
+    FVec3 dir; // Doesn't need to be normalized, t is in units of dir
+} Ray;
+
+typedef struct RayHit_
+{
+    float t;
+    float u; // Barycentric weights of the triangle's second and third vertex
+    float v;
+    int instance; // -1 when nothing was hit
+    int triangle;
+} RayHit;
+
+// 32 bytes, depth-first so the left child of an inner node follows it
+typedef struct RtNode_
+{
+    float min[3];
+    int32_t offset; // Right child of an inner node, first primitive of a leaf
+    float max[3];
+    int32_t count; // Primitives of a leaf, 0 for inner nodes
+} RtNode;
+
+typedef struct RtTriangle_
+{
+    float v0[3];
+    float v1[3];
+    float v2[3];
+    int index; // Triangle index in the source mesh
+} RtTriangle;
+
+// Bottom level, in mesh space. Triangles are stored in leaf order.
+typedef struct RtMeshBvh_
+{
+    RtNode* nodes;
+    int nodes_count;
+    RtTriangle* triangles;
+    int triangles_count;
+} RtMeshBvh;
+
+typedef struct RtInstance_
+{
+    const RtMeshBvh* bvh;
+    Mat4 transform;
+    Mat4 inv_transform;
+} RtInstance;
+
+// Top level over mesh instances, rebuild it after instances moved
+typedef struct RtScene_
+{
+    RtInstance* instances;
+    int instances_count;
+    int instances_cap;
+    RtNode* nodes;
+    int nodes_count;
+    int* instance_indices; // Leaf order
+} RtScene;
+
+void rt_mesh_bvh_build(RtMeshBvh* bvh, const Mesh* mesh);
+void rt_mesh_bvh_cleanup(RtMeshBvh* bvh);
+// Like rc_mesh_move_to_arena, a moved BVH must not be cleaned up on its own
+void rt_mesh_bvh_move_to_arena(RtMeshBvh* bvh, Arena* arena);
+
+void rt_scene_init(RtScene* scene);
+void rt_scene_cleanup(RtScene* scene);
+void rt_scene_clear(RtScene* scene);
+// transform must be affine
+int rt_scene_add_instance(RtScene* scene,
+                          const RtMeshBvh* bvh,
+                          const Mat4* transform);
+void rt_scene_build(RtScene* scene);
+
+// Closest hit
+bool rt_intersect(const RtScene* scene, const Ray* ray, RayHit* hit);
+// Any hit before t_max
+bool rt_occluded(const RtScene* scene, const Ray* ray);
+
+// Packets of RT_PACKET_SIZE rays traversed together. Rays with t_max <= 0
+// are inactive.
+void rt_intersect_packet(const RtScene* scene, const Ray* rays, RayHit* hits);
+void rt_occluded_packet(const RtScene* scene, const Ray* rays, bool* occluded);
+
+// Streams split into packets and spread over the job system
+void rt_intersect_batch(const RtScene* scene,
+                        const Ray* rays,
+                        RayHit* hits,
+                        int rays_count);
+void rt_occluded_batch(const RtScene* scene,
+                       const Ray* rays,
+                       bool* occluded,
+                       int rays_count);
+
+#endif // RAYTRACE_H
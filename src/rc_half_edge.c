@@ -0,0 +1,189 @@
+#include "resource.h"
+#include "debug.h"
+#include "mem.h"
+#include "job.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define RC_HALF_EDGE_BATCH_SIZE 4096
+
+// Destination next to the half-edge so a bucket scan stays in one cache line
+typedef struct RcHalfEdgeOut_
+{
+    int half_edge;
+    uint to;
+} RcHalfEdgeOut;
+
+// Outgoing half-edges bucketed by their origin vertex, a counting sort so the
+// twin of a -> b is found among the few edges leaving b
+typedef struct RcHalfEdgeBuilder_
+{
+    const uint* indices;
+    int* offsets; // vertices_count + 1
+    RcHalfEdgeOut* outgoing;
+    bool* non_manifold_vertices;
+    MeshHalfEdges* he;
+} RcHalfEdgeBuilder;
+
+static JOB_FOR_FN_SIG(rc_half_edge_twins_job)
+{
+    RcHalfEdgeBuilder* b = (RcHalfEdgeBuilder*)udata;
+    const uint* indices = b->indices;
+    for (int h = begin; h < end; h++)
+    {
+        uint from = indices[h];
+        uint to = indices[rc_half_edge_next(h)];
+        if (from == to)
+        {
+            b->he->twins[h] = -2;
+            continue;
+        }
+
+        // Same direction, only h itself on a manifold edge
+        int same_count = 0;
+        for (int i = b->offsets[from]; i < b->offsets[from + 1]; i++)
+            same_count += b->outgoing[i].to == to;
+
+        int twin = -1;
+        int opposite_count = 0;
+        for (int i = b->offsets[to]; i < b->offsets[to + 1]; i++)
+        {
+            if (b->outgoing[i].to == from)
+            {
+                twin = b->outgoing[i].half_edge;
+                ++opposite_count;
+            }
+        }
+
+        if (same_count != 1 || opposite_count > 1)
+            b->he->twins[h] = -2;
+        else
+            b->he->twins[h] = twin;
+    }
+}
+
+// Starts the ring at an open edge when there is one, a ring that can't be
+// walked around all outgoing edges from there is more than one fan
+static JOB_FOR_FN_SIG(rc_half_edge_vertices_job)
+{
+    RcHalfEdgeBuilder* b = (RcHalfEdgeBuilder*)udata;
+    const MeshHalfEdges* he = b->he;
+    for (int v = begin; v < end; v++)
+    {
+        int first = b->offsets[v];
+        int valence = b->offsets[v + 1] - first;
+        if (valence == 0)
+        {
+            he->vertex_edges[v] = -1;
+            continue;
+        }
+
+        int start = b->outgoing[first].half_edge;
+        for (int i = first; i < first + valence; i++)
+        {
+            if (he->twins[b->outgoing[i].half_edge] < 0)
+            {
+                start = b->outgoing[i].half_edge;
+                break;
+            }
+        }
+        he->vertex_edges[v] = start;
+
+        int steps = 0;
+        int h = start;
+        do
+        {
+            ++steps;
+            h = rc_half_edge_ring_next(he, h);
+        } while (h >= 0 && h != start && steps <= valence);
+        b->non_manifold_vertices[v] = (steps != valence);
+    }
+}
+
+void rc_mesh_half_edges_build(MeshHalfEdges* he, const Mesh* mesh)
+{
+    ASSERT(mesh->indices_count % 3 == 0);
+    *he = (MeshHalfEdges){
+        .half_edges_count = mesh->indices_count,
+        .vertices_count = mesh->vertices_count,
+    };
+    he->twins =
+        (int*)mem_alloc(MemTag_Mesh, mesh->indices_count * sizeof(int));
+    he->vertex_edges =
+        (int*)mem_alloc(MemTag_Mesh, mesh->vertices_count * sizeof(int));
+
+    RcHalfEdgeBuilder b = {
+        .indices = mesh->indices,
+        .he = he,
+    };
+    b.offsets =
+        (int*)mem_calloc(MemTag_Mesh, mesh->vertices_count + 1, sizeof(int));
+    b.outgoing = (RcHalfEdgeOut*)mem_alloc(
+        MemTag_Mesh, mesh->indices_count * sizeof(RcHalfEdgeOut));
+    b.non_manifold_vertices =
+        (bool*)mem_calloc(MemTag_Mesh, mesh->vertices_count, sizeof(bool));
+
+    for (int h = 0; h < mesh->indices_count; h++)
+    {
+        ASSERT(mesh->indices[h] < (uint)mesh->vertices_count);
+        ++b.offsets[mesh->indices[h] + 1];
+    }
+    for (int v = 0; v < mesh->vertices_count; v++)
+        b.offsets[v + 1] += b.offsets[v];
+    // Filling advances each bucket start to the next one, shifted back after
+    for (int h = 0; h < mesh->indices_count; h++)
+    {
+        b.outgoing[b.offsets[mesh->indices[h]]++] = (RcHalfEdgeOut){
+            .half_edge = h,
+            .to = mesh->indices[rc_half_edge_next(h)],
+        };
+    }
+    memmove(b.offsets + 1, b.offsets, mesh->vertices_count * sizeof(int));
+    b.offsets[0] = 0;
+
+    j_parallel_for(mesh->indices_count, RC_HALF_EDGE_BATCH_SIZE,
+                   &rc_half_edge_twins_job, &b);
+    j_parallel_for(mesh->vertices_count, RC_HALF_EDGE_BATCH_SIZE,
+                   &rc_half_edge_vertices_job, &b);
+
+    for (int h = 0; h < mesh->indices_count; h++)
+    {
+        he->boundary_edges_count += he->twins[h] == -1;
+        he->non_manifold_edges_count += he->twins[h] == -2;
+    }
+    for (int v = 0; v < mesh->vertices_count; v++)
+        he->non_manifold_vertices_count += b.non_manifold_vertices[v];
+
+    mem_free(b.non_manifold_vertices);
+    mem_free(b.outgoing);
+    mem_free(b.offsets);
+}
+
+void rc_mesh_half_edges_cleanup(MeshHalfEdges* he)
+{
+    mem_free(he->twins);
+    mem_free(he->vertex_edges);
+    *he = (MeshHalfEdges){0};
+}
+
+void rc_mesh_half_edges_move_to_arena(MeshHalfEdges* he, Arena* arena)
+{
+    MeshHalfEdges moved = *he;
+    moved.twins = NULL;
+    moved.vertex_edges = NULL;
+    if (he->twins)
+    {
+        moved.twins = ARENA_PUSH_ARRAY(arena, int, he->half_edges_count);
+        ASSERT(moved.twins);
+        memcpy(moved.twins, he->twins, he->half_edges_count * sizeof(int));
+    }
+    if (he->vertex_edges)
+    {
+        moved.vertex_edges = ARENA_PUSH_ARRAY(arena, int, he->vertices_count);
+        ASSERT(moved.vertex_edges);
+        memcpy(moved.vertex_edges, he->vertex_edges,
+               he->vertices_count * sizeof(int));
+    }
+    rc_mesh_half_edges_cleanup(he);
+    *he = moved;
+}
@@ -0,0 +1,721 @@
+#include "resource.h"
+#include "debug.h"
+#include "mem.h"
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#define RC_HULL_INITIAL_FACES_CAP 64
+
+// Triangles are wound counter-clockwise seen from outside. neighbors[i] is
+// the face across the edge v[i] -> v[(i + 1) % 3].
+typedef struct RcHullFace_
+{
+    int v[3];
+    int neighbors[3];
+    float n[3];
+    float d;
+    int outside; // Head of the points above this face, -1 when empty
+    int furthest;
+    float furthest_dist;
+    uint visible_stamp;
+    bool alive;
+} RcHullFace;
+
+typedef struct RcHullEdge_
+{
+    int face;
+    int edge;
+} RcHullEdge;
+
+typedef struct RcHullVisit_
+{
+    int face;
+    int first_edge;
+    int i;
+} RcHullVisit;
+
+typedef struct RcHullBuilder_
+{
+    const Vertex* vertices;
+    int vertices_count;
+    float eps;
+
+    // Per input vertex
+    int* next_outside;
+    int* face_refs; // Faces using the vertex, it's on the hull while nonzero
+    uint* vertex_stamps;
+    int hull_vertices_count;
+    int dropped; // Eyes left out, linked through next_outside
+
+    RcHullFace* faces;
+    int faces_count;
+    int faces_cap;
+    int* free_faces;
+    int free_faces_count;
+    uint stamp;
+
+    // Scratch, grown as needed and reused every step
+    int* pending; // Faces that may have points above them
+    int pending_count;
+    int pending_cap;
+    int* visible;
+    int visible_count;
+    int visible_cap;
+    RcHullVisit* visits;
+    int visits_cap;
+    RcHullEdge* horizon;
+    int horizon_count;
+    int horizon_cap;
+    int* new_faces;
+    int new_faces_cap;
+} RcHullBuilder;
+
+static void* rc_hull_reserve(void* data, int* cap, int count, int size)
+{
+    if (count <= *cap)
+        return data;
+    int new_cap = (*cap > 0) ? *cap * 2 : RC_HULL_INITIAL_FACES_CAP;
+    while (new_cap < count)
+        new_cap *= 2;
+    *cap = new_cap;
+    return mem_realloc(MemTag_Mesh, data, (size_t)new_cap * size);
+}
+
+static const float* rc_hull_point(const RcHullBuilder* b, int index)
+{
+    return &b->vertices[index].pos.x;
+}
+
+static float rc_hull_face_dist(const RcHullFace* f, const float* p)
+{
+    float result = f->n[0] * p[0] + f->n[1] * p[1] + f->n[2] * p[2] - f->d;
+    return result;
+}
+
+static bool rc_hull_calc_plane(RcHullFace* f,
+                               const float* p0,
+                               const float* p1,
+                               const float* p2)
+{
+    // Sliver faces are common on dense hulls, their normals need the range
+    double e0[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    double e1[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    double n[3] = {
+        e0[1] * e1[2] - e0[2] * e1[1],
+        e0[2] * e1[0] - e0[0] * e1[2],
+        e0[0] * e1[1] - e0[1] * e1[0],
+    };
+    double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (length <= 0)
+        return false;
+    for (int i = 0; i < 3; i++)
+        f->n[i] = (float)(n[i] / length);
+    f->d = f->n[0] * p0[0] + f->n[1] * p0[1] + f->n[2] * p0[2];
+    return true;
+}
+
+static int rc_hull_alloc_face(RcHullBuilder* b, int v0, int v1, int v2)
+{
+    int index;
+    if (b->free_faces_count > 0)
+    {
+        index = b->free_faces[--b->free_faces_count];
+    }
+    else
+    {
+        int faces_cap = b->faces_cap;
+        b->faces = (RcHullFace*)rc_hull_reserve(
+            b->faces, &b->faces_cap, b->faces_count + 1, sizeof(RcHullFace));
+        if (b->faces_cap != faces_cap)
+        {
+            b->free_faces = (int*)mem_realloc(
+                MemTag_Mesh, b->free_faces,
+                b->faces_cap * sizeof(*b->free_faces));
+        }
+        index = b->faces_count++;
+    }
+
+    RcHullFace* f = &b->faces[index];
+    *f = (RcHullFace){
+        .v = {v0, v1, v2},
+        .neighbors = {-1, -1, -1},
+        .outside = -1,
+        .furthest = -1,
+        .alive = true,
+    };
+    rc_hull_calc_plane(f, rc_hull_point(b, v0), rc_hull_point(b, v1),
+                       rc_hull_point(b, v2));
+    for (int i = 0; i < 3; i++)
+    {
+        if (b->face_refs[f->v[i]]++ == 0)
+            ++b->hull_vertices_count;
+    }
+    return index;
+}
+
+static void rc_hull_free_face(RcHullBuilder* b, int index)
+{
+    RcHullFace* f = &b->faces[index];
+    for (int i = 0; i < 3; i++)
+    {
+        if (--b->face_refs[f->v[i]] == 0)
+            --b->hull_vertices_count;
+    }
+    f->alive = false;
+    f->outside = -1;
+    b->free_faces[b->free_faces_count++] = index;
+}
+
+static void rc_hull_push_pending(RcHullBuilder* b, int face)
+{
+    b->pending = (int*)rc_hull_reserve(b->pending, &b->pending_cap,
+                                       b->pending_count + 1, sizeof(int));
+    b->pending[b->pending_count++] = face;
+}
+
+// Returns false when the point is on or below every face
+static bool rc_hull_assign_point(RcHullBuilder* b,
+                                 const int* faces,
+                                 int faces_count,
+                                 int point)
+{
+    const float* p = rc_hull_point(b, point);
+    for (int i = 0; i < faces_count; i++)
+    {
+        RcHullFace* f = &b->faces[faces[i]];
+        float dist = rc_hull_face_dist(f, p);
+        if (dist > b->eps)
+        {
+            if (f->outside < 0)
+                rc_hull_push_pending(b, faces[i]);
+            b->next_outside[point] = f->outside;
+            f->outside = point;
+            if (dist > f->furthest_dist || f->furthest < 0)
+            {
+                f->furthest = point;
+                f->furthest_dist = dist;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+static int rc_hull_find_edge(const RcHullFace* f, int from, int to)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        if (f->v[i] == from && f->v[(i + 1) % 3] == to)
+            return i;
+    }
+    return -1;
+}
+
+// Extreme points along the axes, then the points furthest from the line and
+// from the plane through them. Returns false for flat or degenerate input.
+static bool rc_hull_init_simplex(RcHullBuilder* b)
+{
+    int extremes[6] = {0};
+    for (int i = 1; i < b->vertices_count; i++)
+    {
+        const float* p = rc_hull_point(b, i);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (p[axis] < rc_hull_point(b, extremes[axis * 2])[axis])
+                extremes[axis * 2] = i;
+            if (p[axis] > rc_hull_point(b, extremes[axis * 2 + 1])[axis])
+                extremes[axis * 2 + 1] = i;
+        }
+    }
+
+    float max_abs = 0;
+    int simplex[4] = {0};
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float lo = rc_hull_point(b, extremes[axis * 2])[axis];
+        float hi = rc_hull_point(b, extremes[axis * 2 + 1])[axis];
+        b->eps += fmaxf(fabsf(lo), fabsf(hi));
+        if (hi - lo > max_abs)
+        {
+            max_abs = hi - lo;
+            simplex[0] = extremes[axis * 2];
+            simplex[1] = extremes[axis * 2 + 1];
+        }
+    }
+    // Scaled to the coordinates like qhull does
+    b->eps *= 3 * FLT_EPSILON;
+    if (max_abs <= b->eps)
+        return false;
+
+    const float* a = rc_hull_point(b, simplex[0]);
+    float ab[3];
+    for (int i = 0; i < 3; i++)
+        ab[i] = rc_hull_point(b, simplex[1])[i] - a[i];
+    float ab_length_sq = ab[0] * ab[0] + ab[1] * ab[1] + ab[2] * ab[2];
+    float best = 0;
+    for (int i = 0; i < b->vertices_count; i++)
+    {
+        const float* p = rc_hull_point(b, i);
+        float ap[3] = {p[0] - a[0], p[1] - a[1], p[2] - a[2]};
+        float c[3] = {
+            ap[1] * ab[2] - ap[2] * ab[1],
+            ap[2] * ab[0] - ap[0] * ab[2],
+            ap[0] * ab[1] - ap[1] * ab[0],
+        };
+        float dist_sq =
+            (c[0] * c[0] + c[1] * c[1] + c[2] * c[2]) / ab_length_sq;
+        if (dist_sq > best)
+        {
+            best = dist_sq;
+            simplex[2] = i;
+        }
+    }
+    if (sqrtf(best) <= b->eps)
+        return false;
+
+    RcHullFace base = {.v = {simplex[0], simplex[1], simplex[2]}};
+    rc_hull_calc_plane(&base, rc_hull_point(b, simplex[0]),
+                       rc_hull_point(b, simplex[1]),
+                       rc_hull_point(b, simplex[2]));
+    best = 0;
+    for (int i = 0; i < b->vertices_count; i++)
+    {
+        float dist = fabsf(rc_hull_face_dist(&base, rc_hull_point(b, i)));
+        if (dist > best)
+        {
+            best = dist;
+            simplex[3] = i;
+        }
+    }
+    if (best <= b->eps)
+        return false;
+
+    // The base faces away from the apex, the sides are flipped to face away
+    // from the vertex they leave out
+    if (rc_hull_face_dist(&base, rc_hull_point(b, simplex[3])) > 0)
+    {
+        int t = simplex[1];
+        simplex[1] = simplex[2];
+        simplex[2] = t;
+    }
+    int faces[4];
+    faces[0] = rc_hull_alloc_face(b, simplex[0], simplex[1], simplex[2]);
+    for (int i = 0; i < 3; i++)
+    {
+        int v0 = simplex[i];
+        int v1 = simplex[(i + 1) % 3];
+        faces[i + 1] = rc_hull_alloc_face(b, v1, v0, simplex[3]);
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        RcHullFace* f = &b->faces[faces[i]];
+        for (int e = 0; e < 3; e++)
+        {
+            int from = f->v[e];
+            int to = f->v[(e + 1) % 3];
+            for (int j = 0; j < 4; j++)
+            {
+                if (j != i && rc_hull_find_edge(&b->faces[faces[j]], to,
+                                                from) >= 0)
+                {
+                    f->neighbors[e] = faces[j];
+                }
+            }
+            ASSERT(f->neighbors[e] >= 0);
+        }
+    }
+    for (int i = 0; i < b->vertices_count; i++)
+    {
+        if (b->face_refs[i] == 0)
+            rc_hull_assign_point(b, faces, 4, i);
+    }
+    return true;
+}
+
+// Whether the fan face from the edge to the eye would fold over the face
+// behind the edge. Happens when sliver faces leave the eye within rounding of
+// a nearly coplanar neighbor.
+static bool rc_hull_is_concave(const RcHullBuilder* b,
+                               const RcHullFace* f,
+                               int edge,
+                               const RcHullFace* n,
+                               const float* eye)
+{
+    int v0 = f->v[edge];
+    int v1 = f->v[(edge + 1) % 3];
+    int apex = n->v[0];
+    for (int i = 1; i < 3 && (apex == v0 || apex == v1); i++)
+        apex = n->v[i];
+
+    RcHullFace fan = {0};
+    if (!rc_hull_calc_plane(&fan, rc_hull_point(b, v0), rc_hull_point(b, v1),
+                            eye))
+    {
+        return true;
+    }
+    float dist = rc_hull_face_dist(&fan, rc_hull_point(b, apex));
+    float cos_angle =
+        fan.n[0] * n->n[0] + fan.n[1] * n->n[1] + fan.n[2] * n->n[2];
+    return dist > b->eps || (dist >= -b->eps && cos_angle < 0);
+}
+
+// Depth-first over the faces the eye sees. Each face continues after the
+// edge it was entered through, so the horizon comes out as a closed loop.
+static void rc_hull_find_horizon(RcHullBuilder* b,
+                                 int face,
+                                 const float* eye,
+                                 bool remove_concave)
+{
+    uint stamp = ++b->stamp;
+    b->visible_count = 0;
+    b->horizon_count = 0;
+
+    int visits_count = 0;
+    b->visits = (RcHullVisit*)rc_hull_reserve(b->visits, &b->visits_cap, 1,
+                                              sizeof(RcHullVisit));
+    b->visits[visits_count++] = (RcHullVisit){.face = face};
+    b->faces[face].visible_stamp = stamp;
+
+    while (visits_count > 0)
+    {
+        RcHullVisit* visit = &b->visits[visits_count - 1];
+        if (visit->i == 3)
+        {
+            b->visible = (int*)rc_hull_reserve(b->visible, &b->visible_cap,
+                                               b->visible_count + 1,
+                                               sizeof(int));
+            b->visible[b->visible_count++] = visit->face;
+            --visits_count;
+            continue;
+        }
+
+        int edge = (visit->first_edge + visit->i++) % 3;
+        const RcHullFace* f = &b->faces[visit->face];
+        int neighbor = f->neighbors[edge];
+        RcHullFace* n = &b->faces[neighbor];
+        if (n->visible_stamp == stamp)
+            continue;
+
+        if (rc_hull_face_dist(n, eye) > b->eps ||
+            (remove_concave && rc_hull_is_concave(b, f, edge, n, eye)))
+        {
+            n->visible_stamp = stamp;
+            int back_edge = rc_hull_find_edge(n, f->v[(edge + 1) % 3],
+                                              f->v[edge]);
+            ASSERT(back_edge >= 0);
+            b->visits = (RcHullVisit*)rc_hull_reserve(
+                b->visits, &b->visits_cap, visits_count + 1,
+                sizeof(RcHullVisit));
+            b->visits[visits_count++] = (RcHullVisit){
+                .face = neighbor,
+                .first_edge = (back_edge + 1) % 3,
+            };
+        }
+        else
+        {
+            b->horizon = (RcHullEdge*)rc_hull_reserve(
+                b->horizon, &b->horizon_cap, b->horizon_count + 1,
+                sizeof(RcHullEdge));
+            b->horizon[b->horizon_count++] = (RcHullEdge){visit->face, edge};
+        }
+    }
+}
+
+// Removing concave faces can leave a visible region that is not a disk, the
+// horizon then touches itself or splits into several loops
+static bool rc_hull_is_horizon_loop(RcHullBuilder* b)
+{
+    uint stamp = ++b->stamp;
+    for (int i = 0; i < b->horizon_count; i++)
+    {
+        const RcHullEdge* h = &b->horizon[i];
+        const RcHullEdge* next = &b->horizon[(i + 1) % b->horizon_count];
+        int v = b->faces[h->face].v[(h->edge + 1) % 3];
+        if (v != b->faces[next->face].v[next->edge] ||
+            b->vertex_stamps[v] == stamp)
+        {
+            return false;
+        }
+        b->vertex_stamps[v] = stamp;
+    }
+    return true;
+}
+
+// The eye is within rounding of the faces around it, it is left out rather
+// than folding the hull
+static void rc_hull_drop_furthest(RcHullBuilder* b, int face)
+{
+    RcHullFace* f = &b->faces[face];
+    int* link = &f->outside;
+    while (*link != f->furthest)
+        link = &b->next_outside[*link];
+    *link = b->next_outside[f->furthest];
+    b->next_outside[f->furthest] = b->dropped;
+    b->dropped = f->furthest;
+
+    f->furthest = -1;
+    f->furthest_dist = 0;
+    for (int point = f->outside; point >= 0; point = b->next_outside[point])
+    {
+        float dist = rc_hull_face_dist(f, rc_hull_point(b, point));
+        if (dist > f->furthest_dist || f->furthest < 0)
+        {
+            f->furthest = point;
+            f->furthest_dist = dist;
+        }
+    }
+    if (f->outside >= 0)
+        rc_hull_push_pending(b, face);
+}
+
+static void rc_hull_add_point(RcHullBuilder* b, int face)
+{
+    int eye_index = b->faces[face].furthest;
+    const float* eye = rc_hull_point(b, eye_index);
+    rc_hull_find_horizon(b, face, eye, true);
+    if (!rc_hull_is_horizon_loop(b))
+    {
+        // Only the faces the eye sees, but not at the cost of a fold
+        rc_hull_find_horizon(b, face, eye, false);
+        for (int i = 0; i < b->horizon_count; i++)
+        {
+            const RcHullFace* f = &b->faces[b->horizon[i].face];
+            int edge = b->horizon[i].edge;
+            if (rc_hull_is_concave(b, f, edge, &b->faces[f->neighbors[edge]],
+                                   eye))
+            {
+                rc_hull_drop_furthest(b, face);
+                return;
+            }
+        }
+    }
+
+    // A fan of new faces from the horizon to the eye
+    b->new_faces = (int*)rc_hull_reserve(b->new_faces, &b->new_faces_cap,
+                                         b->horizon_count, sizeof(int));
+    for (int i = 0; i < b->horizon_count; i++)
+    {
+        RcHullEdge h = b->horizon[i];
+        int v0 = b->faces[h.face].v[h.edge];
+        int v1 = b->faces[h.face].v[(h.edge + 1) % 3];
+        int outer = b->faces[h.face].neighbors[h.edge];
+
+        int index = rc_hull_alloc_face(b, v0, v1, eye_index);
+        b->new_faces[i] = index;
+        b->faces[index].neighbors[0] = outer;
+        RcHullFace* o = &b->faces[outer];
+        o->neighbors[rc_hull_find_edge(o, v1, v0)] = index;
+    }
+    for (int i = 0; i < b->horizon_count; i++)
+    {
+        int next = b->new_faces[(i + 1) % b->horizon_count];
+        ASSERT(b->faces[b->new_faces[i]].v[1] == b->faces[next].v[0]);
+        b->faces[b->new_faces[i]].neighbors[1] = next;
+        b->faces[next].neighbors[2] = b->new_faces[i];
+    }
+
+    // Points above the removed faces are either above a new one or inside
+    for (int i = 0; i < b->visible_count; i++)
+    {
+        RcHullFace* f = &b->faces[b->visible[i]];
+        int point = f->outside;
+        while (point >= 0)
+        {
+            int next = b->next_outside[point];
+            if (point != eye_index)
+            {
+                rc_hull_assign_point(b, b->new_faces, b->horizon_count,
+                                     point);
+            }
+            point = next;
+        }
+        rc_hull_free_face(b, b->visible[i]);
+    }
+
+    // Vertices of removed concave faces are outside points again
+    for (int i = 0; i < b->visible_count; i++)
+    {
+        const RcHullFace* f = &b->faces[b->visible[i]];
+        for (int j = 0; j < 3; j++)
+        {
+            if (b->face_refs[f->v[j]] == 0 && f->v[j] != eye_index)
+            {
+                rc_hull_assign_point(b, b->new_faces, b->horizon_count,
+                                     f->v[j]);
+            }
+        }
+    }
+}
+
+static void rc_hull_cleanup(RcHullBuilder* b)
+{
+    mem_free(b->new_faces);
+    mem_free(b->horizon);
+    mem_free(b->visits);
+    mem_free(b->visible);
+    mem_free(b->pending);
+    mem_free(b->free_faces);
+    mem_free(b->faces);
+    mem_free(b->face_refs);
+    mem_free(b->vertex_stamps);
+    mem_free(b->next_outside);
+}
+
+// Points still outside when the budget stopped the build, and dropped eyes,
+// decide how far the hull is scaled about its centroid to contain them. They
+// are gathered relative to the centroid so every face is one pass over flat
+// arrays.
+static float rc_hull_calc_cover_scale(const RcHullBuilder* b, const float* c)
+{
+    int count = 0;
+    for (int i = 0; i < b->faces_count; i++)
+    {
+        if (!b->faces[i].alive)
+            continue;
+        for (int point = b->faces[i].outside; point >= 0;
+             point = b->next_outside[point])
+        {
+            ++count;
+        }
+    }
+    for (int point = b->dropped; point >= 0; point = b->next_outside[point])
+        ++count;
+
+    float* xs = (float*)mem_alloc(MemTag_Mesh, 3 * count * sizeof(float));
+    float* ys = xs + count;
+    float* zs = ys + count;
+    int k = 0;
+    for (int i = 0; i < b->faces_count; i++)
+    {
+        if (!b->faces[i].alive)
+            continue;
+        for (int point = b->faces[i].outside; point >= 0;
+             point = b->next_outside[point])
+        {
+            const float* p = rc_hull_point(b, point);
+            xs[k] = p[0] - c[0];
+            ys[k] = p[1] - c[1];
+            zs[k] = p[2] - c[2];
+            ++k;
+        }
+    }
+    for (int point = b->dropped; point >= 0; point = b->next_outside[point])
+    {
+        const float* p = rc_hull_point(b, point);
+        xs[k] = p[0] - c[0];
+        ys[k] = p[1] - c[1];
+        zs[k] = p[2] - c[2];
+        ++k;
+    }
+
+    float result = 1;
+    for (int i = 0; i < b->faces_count; i++)
+    {
+        const RcHullFace* f = &b->faces[i];
+        float inner = f->d - (f->n[0] * c[0] + f->n[1] * c[1] + f->n[2] * c[2]);
+        if (!f->alive || inner <= 0)
+            continue;
+        float max_dist = 0;
+        for (int j = 0; j < count; j++)
+        {
+            float dist = f->n[0] * xs[j] + f->n[1] * ys[j] + f->n[2] * zs[j];
+            max_dist = (dist > max_dist) ? dist : max_dist;
+        }
+        if (max_dist > result * inner)
+            result = max_dist / inner;
+    }
+    mem_free(xs);
+    return result;
+}
+
+Mesh rc_mesh_convex_hull(const Mesh* mesh, int max_vertices_count)
+{
+    Mesh result = {0};
+    if (mesh->vertices_count < 4)
+        return result;
+
+    RcHullBuilder b = {
+        .vertices = mesh->vertices,
+        .vertices_count = mesh->vertices_count,
+        .dropped = -1,
+    };
+    b.next_outside =
+        (int*)mem_alloc(MemTag_Mesh, mesh->vertices_count * sizeof(int));
+    b.face_refs =
+        (int*)mem_calloc(MemTag_Mesh, mesh->vertices_count, sizeof(int));
+    b.vertex_stamps =
+        (uint*)mem_calloc(MemTag_Mesh, mesh->vertices_count, sizeof(uint));
+
+    if (rc_hull_init_simplex(&b))
+    {
+        while (b.pending_count > 0)
+        {
+            if (max_vertices_count > 0 &&
+                b.hull_vertices_count >= max_vertices_count)
+            {
+                break;
+            }
+            int face = b.pending[--b.pending_count];
+            if (b.faces[face].alive && b.faces[face].outside >= 0)
+                rc_hull_add_point(&b, face);
+        }
+
+        // Reference counts turn into the new vertex indices
+        int* hull_indices = b.face_refs;
+        int faces_count = 0;
+        for (int i = 0; i < b.faces_count; i++)
+            faces_count += b.faces[i].alive;
+        result = rc_mesh_make_raw(b.hull_vertices_count, faces_count * 3);
+        memset(result.vertices, 0,
+               result.vertices_count * sizeof(*result.vertices));
+        int vi = 0;
+        for (int i = 0; i < mesh->vertices_count; i++)
+        {
+            if (hull_indices[i] > 0)
+            {
+                hull_indices[i] = vi;
+                result.vertices[vi++].pos = mesh->vertices[i].pos;
+            }
+            else
+            {
+                hull_indices[i] = -1;
+            }
+        }
+        ASSERT(vi == b.hull_vertices_count);
+        int ii = 0;
+        for (int i = 0; i < b.faces_count; i++)
+        {
+            if (!b.faces[i].alive)
+                continue;
+            for (int j = 0; j < 3; j++)
+                result.indices[ii++] = (uint)hull_indices[b.faces[i].v[j]];
+        }
+
+        if (b.pending_count > 0 || b.dropped >= 0)
+        {
+            float c[3] = {0};
+            for (int i = 0; i < result.vertices_count; i++)
+            {
+                c[0] += result.vertices[i].pos.x;
+                c[1] += result.vertices[i].pos.y;
+                c[2] += result.vertices[i].pos.z;
+            }
+            for (int i = 0; i < 3; i++)
+                c[i] /= (float)result.vertices_count;
+            float scale = rc_hull_calc_cover_scale(&b, c);
+            FVec3 center = {c[0], c[1], c[2]};
+            for (int i = 0; i < result.vertices_count; i++)
+            {
+                FVec3 d = fvec3_sub(result.vertices[i].pos, center);
+                result.vertices[i].pos =
+                    fvec3_add(center, fvec3_mulf(d, scale));
+            }
+        }
+        rc_mesh_set_approximate_normals(&result);
+    }
+
+    rc_hull_cleanup(&b);
+    return result;
+}
@@ -1,5 +1,6 @@
 #include "resource.h"
 #include "debug.h"
+#include "mem.h"
 #include "util.h"
 #include <tinyobj_loader_c.h>
 #include <stdio.h>
@@ -10,25 +11,53 @@
 void rc_mesh_cleanup(Mesh* mesh)
 {
     if (mesh->vertices)
-        free(mesh->vertices);
+        mem_free(mesh->vertices);
     if (mesh->indices)
-        free(mesh->indices);
+        mem_free(mesh->indices);
 
     *mesh = (Mesh){0};
 }
 
+void rc_mesh_move_to_arena(Mesh* mesh, Arena* arena)
+{
+    Vertex* vertices = ARENA_PUSH_ARRAY(arena, Vertex, mesh->vertices_count);
+    ASSERT(vertices);
+    memcpy(vertices, mesh->vertices, mesh->vertices_count * sizeof(Vertex));
+    // A push of 0 bytes still returns a pointer, and readers take any non-NULL
+    // indices as an indexed mesh
+    uint* indices = NULL;
+    if (mesh->indices_count > 0)
+    {
+        indices = ARENA_PUSH_ARRAY(arena, uint, mesh->indices_count);
+        ASSERT(indices);
+        memcpy(indices, mesh->indices, mesh->indices_count * sizeof(uint));
+    }
+    ASSERT(!indices == !mesh->indices);
+
+    Mesh moved = {
+        .vertices_count = mesh->vertices_count,
+        .vertices = vertices,
+        .indices_count = mesh->indices_count,
+        .indices = indices,
+    };
+    rc_mesh_cleanup(mesh);
+    *mesh = moved;
+}
+
 Mesh rc_mesh_make_raw(int vertices_count, int indices_count)
 {
     Mesh result = {0};
     if (vertices_count > 0)
     {
         result.vertices =
-            (Vertex*)malloc(vertices_count * sizeof(*result.vertices));
+            (Vertex*)mem_alloc(MemTag_Mesh,
+                               vertices_count * sizeof(*result.vertices));
         result.vertices_count = vertices_count;
     }
     if (indices_count > 0)
     {
-        result.indices = (uint*)malloc(indices_count * sizeof(*result.indices));
+        result.indices = (uint*)mem_alloc(
+            MemTag_Mesh, indices_count * sizeof(*result.indices));
         result.indices_count = indices_count;
     }
     return result;
@@ -120,9 +149,11 @@ Mesh rc_mesh_make_sphere(float radius, int slices_count, int stacks_count)
     if (slices_count > 2 && stacks_count > 1)
     {
         const int vertices_count = (stacks_count - 2) * slices_count + 2;
-        Vertex* vertices = (Vertex*)malloc(vertices_count * sizeof(*vertices));
+        Vertex* vertices = (Vertex*)mem_alloc(
+            MemTag_Mesh, vertices_count * sizeof(*vertices));
         const int indices_count = (stacks_count - 2) * slices_count * 6;
-        uint* indices = (uint*)malloc(indices_count * sizeof(*indices));
+        uint* indices =
+            (uint*)mem_alloc(MemTag_Mesh, indices_count * sizeof(*indices));
 
         const float d_phi = degtorad(180) / (float)stacks_count;
         const float d_theta = degtorad(360) / (float)slices_count;
@@ -220,7 +251,7 @@ bool rc_mesh_load_from_obj(Mesh* mesh, const char* filename)
         fseek(f, 0, SEEK_END);
         size_t fsize = ftell(f);
         rewind(f);
-        char* data = (char*)malloc((fsize + 1) * sizeof(char));
+        char* data = (char*)mem_alloc(MemTag_Mesh, (fsize + 1) * sizeof(char));
         if (data)
         {
             fsize = fread(data, sizeof(char), fsize, f);
@@ -239,7 +270,8 @@ bool rc_mesh_load_from_obj(Mesh* mesh, const char* filename)
             if (parse_result == TINYOBJ_SUCCESS)
             {
                 Vertex* vertices =
-                    (Vertex*)malloc(attrib.num_faces * sizeof(*vertices));
+                    (Vertex*)mem_alloc(MemTag_Mesh,
+                                       attrib.num_faces * sizeof(*vertices));
                 if (vertices)
                 {
                     int vertices_count = 0;
@@ -249,7 +281,8 @@ bool rc_mesh_load_from_obj(Mesh* mesh, const char* filename)
                     if ((attrib.num_texcoords == 0) &&
                         (attrib.num_normals == 0))
                     {
-                        uint* indices = (uint*)malloc(
+                        uint* indices = (uint*)mem_alloc(
+                            MemTag_Mesh,
                             attrib.num_face_num_verts * 3 * sizeof(uint));
                         int indices_count = 0;
 
@@ -362,7 +395,7 @@ bool rc_mesh_load_from_obj(Mesh* mesh, const char* filename)
                 tinyobj_attrib_free(&attrib);
             }
 
-            free(data);
+            mem_free(data);
         }
     }
 
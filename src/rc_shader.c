@@ -1,5 +1,6 @@
 #include "resource.h"
 #include "debug.h"
+#include "mem.h"
 #include <histr.h>
 #include <stdlib.h>
 #include <string.h>
@@ -18,7 +19,7 @@ char* rc_read_text_file_all(const char* filename)
             long size = ftell(f);
             rewind(f);
 
-            char* buf = (char*)malloc(size + 1);
+            char* buf = (char*)mem_alloc(MemTag_Shader, size + 1);
             ASSERT(size >= 0);
             size = (long)fread(buf, 1, (size_t)size, f);
             buf[size] = '\0';
@@ -48,7 +49,7 @@ histr_String rc_read_multiple_text_files_at_once(const char** filenames,
             if (text)
             {
                 histr_append(result, text);
-                free(text);
+                mem_free(text);
             }
             else
             {
@@ -63,72 +64,111 @@ histr_String rc_read_multiple_text_files_at_once(const char** filenames,
     return result;
 }
 
+ShaderText rc_shader_read_files(ShaderLoadDesc vs_desc,
+                                ShaderLoadDesc fs_desc,
+                                ShaderLoadDesc gs_desc,
+                                ShaderLoadDesc cs_desc)
+{
+    ShaderLoadDesc descs[SHADER_STAGES_COUNT] = {vs_desc, fs_desc, gs_desc,
+                                                 cs_desc};
+    ShaderText result = {0};
+    for (int i = 0; i < SHADER_STAGES_COUNT; i++)
+    {
+        result.stages[i] = rc_read_multiple_text_files_at_once(
+            descs[i].filenames, descs[i].filenames_count);
+    }
+    return result;
+}
+
+void rc_shader_text_cleanup(ShaderText* text)
+{
+    for (int i = 0; i < SHADER_STAGES_COUNT; i++)
+        histr_destroy(text->stages[i]);
+    *text = (ShaderText){0};
+}
+
 GLuint rc_shader_load_from_files(ShaderLoadDesc vs_desc,
                                  ShaderLoadDesc fs_desc,
                                  ShaderLoadDesc gs_desc,
                                  ShaderLoadDesc cs_desc)
 {
-    histr_String vs_src = rc_read_multiple_text_files_at_once(
-        vs_desc.filenames, vs_desc.filenames_count);
-    histr_String fs_src = rc_read_multiple_text_files_at_once(
-        fs_desc.filenames, fs_desc.filenames_count);
-    histr_String gs_src = rc_read_multiple_text_files_at_once(
-        gs_desc.filenames, gs_desc.filenames_count);
-    histr_String cs_src = rc_read_multiple_text_files_at_once(
-        cs_desc.filenames, cs_desc.filenames_count);
-
-    GLuint result = rc_shader_load_from_source(vs_src, fs_src, gs_src, cs_src);
-
-    histr_destroy(vs_src);
-    histr_destroy(fs_src);
-    histr_destroy(gs_src);
-    histr_destroy(cs_src);
+    ShaderText text = rc_shader_read_files(vs_desc, fs_desc, gs_desc, cs_desc);
+    GLuint result =
+        rc_shader_load_from_source(text.stages[0], text.stages[1],
+                                   text.stages[2], text.stages[3]);
+    rc_shader_text_cleanup(&text);
 
     return result;
 }
 
+static const GLenum g_shader_stage_types[SHADER_STAGES_COUNT] = {
+    GL_VERTEX_SHADER,
+    GL_FRAGMENT_SHADER,
+    GL_GEOMETRY_SHADER,
+    GL_COMPUTE_SHADER,
+};
+
+static const char* g_shader_stage_names[SHADER_STAGES_COUNT] = {
+    "vertex",
+    "fragment",
+    "geometry",
+    "compute",
+};
+
+static bool rc_shader_compile_src(int stage, const char* src, GLuint* out)
+{
+    *out = 0;
+    if (!src || src[0] == '\0')
+        return true;
+
+    PRINTLN("Compiling %s shader...", g_shader_stage_names[stage]);
+    *out = rc_shader_compile(g_shader_stage_types[stage], &src, 1);
+    return *out != 0;
+}
+
 GLuint rc_shader_load_from_source(const char* vs_src,
                                   const char* fs_src,
                                   const char* gs_src,
                                   const char* cs_src)
+{
+    const char* srcs[SHADER_STAGES_COUNT] = {vs_src, fs_src, gs_src, cs_src};
+    GLuint shaders[SHADER_STAGES_COUNT] = {0};
+    bool compiled = true;
+    for (int i = 0; i < SHADER_STAGES_COUNT; i++)
+    {
+        if (!rc_shader_compile_src(i, srcs[i], &shaders[i]))
+            compiled = false;
+    }
+
+    return rc_shader_link_stages(shaders, compiled);
+}
+
+bool rc_shader_compile_stage(const ShaderText* text,
+                             int stage,
+                             GLuint* out_shader)
+{
+    ASSERT(stage >= 0 && stage < SHADER_STAGES_COUNT);
+    return rc_shader_compile_src(stage, text->stages[stage], out_shader);
+}
+
+GLuint rc_shader_link_stages(GLuint* shaders, bool compiled)
 {
     GLuint result = 0;
 
     int shaders_count = 0;
-    GLuint shaders[4] = {0};
-
-    if (vs_src && vs_src[0] != '\0')
-    {
-        PRINTLN("Compiling vertex shader...");
-        shaders[shaders_count++] =
-            rc_shader_compile(GL_VERTEX_SHADER, &vs_src, 1);
-    }
-    if (fs_src && fs_src[0] != '\0')
-    {
-        PRINTLN("Compiling fragment shader...");
-        shaders[shaders_count++] =
-            rc_shader_compile(GL_FRAGMENT_SHADER, &fs_src, 1);
-    }
-    if (gs_src && gs_src[0] != '\0')
-    {
-        PRINTLN("Compiling geometry shader...");
-        shaders[shaders_count++] =
-            rc_shader_compile(GL_GEOMETRY_SHADER, &gs_src, 1);
-    }
-    if (cs_src && cs_src[0] != '\0')
+    GLuint present[SHADER_STAGES_COUNT];
+    for (int i = 0; i < SHADER_STAGES_COUNT; i++)
     {
-        PRINTLN("Compiling compute shader...");
-        shaders[shaders_count++] =
-            rc_shader_compile(GL_COMPUTE_SHADER, &cs_src, 1);
+        if (shaders[i])
+            present[shaders_count++] = shaders[i];
+        shaders[i] = 0;
     }
 
-    if (shaders_count > 0)
-    {
-        result = rc_shader_link(shaders, shaders_count);
+    if (compiled && shaders_count > 0)
+        result = rc_shader_link(present, shaders_count);
 
-        for (int i = 0; i < shaders_count; ++i)
-            glDeleteShader(shaders[i]);
-    }
+    for (int i = 0; i < shaders_count; ++i)
+        glDeleteShader(present[i]);
 
     return result;
 }
@@ -156,10 +196,11 @@ static GLuint
         if (info_log_length > 0)
         {
             GLchar* log_buffer =
-                (GLchar*)malloc((info_log_length + 1) * sizeof(GLchar));
+                (GLchar*)mem_alloc(MemTag_Shader,
+                                   (info_log_length + 1) * sizeof(GLchar));
             glGetShaderInfoLog(shader, info_log_length, NULL, log_buffer);
             PRINT(log_buffer);
-            free(log_buffer);
+            mem_free(log_buffer);
         }
 
         glDeleteShader(shader);
@@ -196,10 +237,11 @@ static GLuint rc_shader_link(GLuint* shaders, int shaders_count)
         if (info_log_length > 0)
         {
             GLchar* log_buffer =
-                (GLchar*)malloc((info_log_length + 1) * sizeof(GLchar));
+                (GLchar*)mem_alloc(MemTag_Shader,
+                                   (info_log_length + 1) * sizeof(GLchar));
             glGetProgramInfoLog(program, info_log_length, NULL, log_buffer);
             PRINT(log_buffer);
-            free(log_buffer);
+            mem_free(log_buffer);
         }
 
         glDeleteProgram(program);
@@ -3,6 +3,7 @@
 #include <himath.h>
 #include <glad/gl.h>
 #include <stdint.h>
+#include <stdbool.h>
 #define CIMGUI_DEFINE_ENUMS_AND_STRUCTS
 #include <cimgui/cimgui.h>
 
@@ -57,6 +58,175 @@ void r_vb_init(VertexBuffer* vb, const Mesh* mesh, GLenum mode);
 void r_vb_cleanup(VertexBuffer* vb);
 void r_vb_draw(const VertexBuffer* vb);
 
+typedef enum RenderStateCall_
+{
+    RenderStateCall_Program = 0,
+    RenderStateCall_VertexArray,
+    RenderStateCall_Buffer,
+    RenderStateCall_Texture,
+    RenderStateCall_Sampler,
+    RenderStateCall_Framebuffer,
+    RenderStateCall_FixedFunction,
+    RenderStateCall_Count,
+} RenderStateCall;
+
+typedef struct RenderStateStats_
+{
+    int issued[RenderStateCall_Count];
+    int skipped[RenderStateCall_Count];
+} RenderStateStats;
+
+// Shadows bound GL objects and fixed-function state so that redundant calls
+// never reach the driver. Every bind in the renderer and the examples must go
+// through these, otherwise the cache goes stale.
+void r_state_invalidate();
+void r_state_begin_frame();
+const RenderStateStats* r_state_get_last_frame_stats();
+void r_state_draw_stats_gui();
+
+void r_state_use_program(GLuint program);
+void r_state_bind_vertex_array(GLuint vao);
+void r_state_bind_buffer(GLenum target, GLuint buffer);
+void r_state_bind_buffer_base(GLenum target, GLuint index, GLuint buffer);
+void r_state_bind_texture(GLuint unit, GLenum target, GLuint texture);
+void r_state_bind_textures(GLuint first, int count, const GLuint* textures);
+void r_state_bind_sampler(GLuint unit, GLuint sampler);
+void r_state_bind_framebuffer(GLenum target, GLuint framebuffer);
+
+void r_state_set_enabled(GLenum cap, bool enabled);
+void r_state_polygon_mode(GLenum mode);
+void r_state_cull_face(GLenum mode);
+void r_state_front_face(GLenum mode);
+void r_state_depth_func(GLenum func);
+void r_state_depth_mask(bool enabled);
+void r_state_blend_func(GLenum src, GLenum dst);
+void r_state_stencil_func(GLenum func, GLint ref, GLuint mask);
+void r_state_stencil_op(GLenum fail, GLenum depth_fail, GLenum pass);
+void r_state_viewport(int x, int y, int w, int h);
+void r_state_scissor(int x, int y, int w, int h);
+void r_state_clear_color(float r, float g, float b, float a);
+
+// Deleting a bound object silently reverts its binding to 0 and frees the name
+// for reuse, so deletions have to scrub the cache as well.
+void r_state_delete_vertex_arrays(int n, const GLuint* vaos);
+void r_state_delete_buffers(int n, const GLuint* buffers);
+void r_state_delete_textures(int n, const GLuint* textures);
+void r_state_delete_samplers(int n, const GLuint* samplers);
+void r_state_delete_framebuffers(int n, const GLuint* framebuffers);
+
+#define RENDER_QUEUE_MAX_TEXTURES 4
+
+// Sort key layout, most significant bits first:
+// pass (4) | program (10) | material (12) | vao (12) | unused (2) | depth (24)
+// GL names are truncated to their field width. A collision only costs an
+// extra state change, the command itself always carries the real names.
+typedef struct RenderKeyDesc_
+{
+    int pass;
+    GLuint program;
+    GLuint material; // Identifies the texture set, 0 if there is none
+    GLuint vao;
+    float depth; // View distance normalized to [0, 1]
+    bool back_to_front;
+} RenderKeyDesc;
+
+typedef struct RenderCommand_
+{
+    uint64_t key;
+    GLuint program;
+    GLuint vao;
+    GLenum mode;
+    bool indexed;
+    int first;
+    int count;
+    int instances_count; // 0 for a regular draw
+    // When set, draw_count indexed commands are read from indirect_buffer at
+    // indirect_offset instead of using first/count
+    GLuint indirect_buffer;
+    int indirect_offset;
+    int draw_count;
+    GLuint textures[RENDER_QUEUE_MAX_TEXTURES];
+    int textures_count;
+    int uniform_offset; // -1 if the command has no per-object data
+} RenderCommand;
+
+typedef struct RenderQueueItem_
+{
+    uint64_t key;
+    int index;
+} RenderQueueItem;
+
+typedef struct RenderQueueStats_
+{
+    int commands_count;
+    int pass_changes;
+    int program_changes;
+    int vao_changes;
+    int texture_changes;
+} RenderQueueStats;
+
+#define RENDER_PASS_FN_SIG(name) void name(int pass, void* udata)
+typedef RENDER_PASS_FN_SIG(RenderPassFn);
+
+typedef struct RenderQueue_
+{
+    GLuint uniform_buffer;
+    int uniform_size;
+
+    RenderCommand* commands;
+    int commands_count;
+    int commands_cap;
+
+    uint8_t* uniform_data;
+    RenderQueueItem* items;
+    RenderQueueItem* items_temp;
+
+    RenderQueueStats last_stats;
+} RenderQueue;
+
+uint64_t r_queue_make_key(const RenderKeyDesc* desc);
+void r_queue_init(RenderQueue* q, GLuint uniform_buffer, int uniform_size);
+void r_queue_cleanup(RenderQueue* q);
+void r_queue_push(RenderQueue* q,
+                  const RenderCommand* cmd,
+                  const void* uniform_data);
+void r_queue_push_vb(RenderQueue* q,
+                     uint64_t key,
+                     GLuint program,
+                     const VertexBuffer* vb,
+                     const GLuint* textures,
+                     int textures_count,
+                     const void* uniform_data);
+// Sorts and draws everything pushed since the last call, then empties the
+// queue. pass_fn is invoked at the start of each of the passes_count passes,
+// even the ones without any command, so it can bind targets and clear them.
+// Without pass_fn the pass bits only affect the order.
+void r_queue_execute(RenderQueue* q,
+                     int passes_count,
+                     RenderPassFn* pass_fn,
+                     void* udata);
+void r_queue_draw_stats_gui(const RenderQueue* q);
+
+#define GPU_TIMER_QUERIES_COUNT 4
+
+// GL_TIME_ELAPSED queries in a small ring so reading a result never waits for
+// the GPU. The reported time lags a few frames behind.
+typedef struct GpuTimer_
+{
+    GLuint queries[GPU_TIMER_QUERIES_COUNT];
+    bool pending[GPU_TIMER_QUERIES_COUNT];
+    int current;
+    bool running; // Between a begin that started a query and its end
+    float ms;
+    // Frames left unmeasured because the oldest query of the ring wasn't done
+    int skipped_count;
+} GpuTimer;
+
+void r_gpu_timer_init(GpuTimer* timer);
+void r_gpu_timer_cleanup(GpuTimer* timer);
+void r_gpu_timer_begin(GpuTimer* timer);
+void r_gpu_timer_end(GpuTimer* timer);
+
 void r_gui_init();
 void r_gui_cleanup();
 void r_gui_new_frame(const Input* input);
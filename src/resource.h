@@ -1,6 +1,7 @@
 #ifndef RESOURCE_H
 #define RESOURCE_H
 
+#include "arena.h"
 #include "primitive.h"
 #include "renderer.h"
 #include <glad/gl.h>
@@ -14,6 +15,30 @@ typedef struct ShaderLoadDesc_
     int filenames_count;
 } ShaderLoadDesc;
 
+#define SHADER_STAGES_COUNT 4
+
+// Source text of one program in the order vertex, fragment, geometry and
+// compute, NULL for the stages it doesn't have
+typedef struct ShaderText_
+{
+    char* stages[SHADER_STAGES_COUNT];
+} ShaderText;
+
+// Only reads files, so it doesn't need the GL context
+ShaderText rc_shader_read_files(ShaderLoadDesc vs_desc,
+                                ShaderLoadDesc fs_desc,
+                                ShaderLoadDesc gs_desc,
+                                ShaderLoadDesc cs_desc);
+void rc_shader_text_cleanup(ShaderText* text);
+// rc_shader_load_from_source in steps for callers on a time budget. Each
+// stage compiles on its own, out_shader is 0 for a missing stage and false is
+// returned when it doesn't compile. The link takes one shader per stage,
+// deletes them and zeroes the array, 0 when compiled is false or it fails.
+bool rc_shader_compile_stage(const ShaderText* text,
+                             int stage,
+                             GLuint* out_shader);
+GLuint rc_shader_link_stages(GLuint* shaders, bool compiled);
+
 GLuint rc_shader_load_from_files(ShaderLoadDesc vs_desc,
                                  ShaderLoadDesc fs_desc,
                                  ShaderLoadDesc gs_desc,
@@ -35,6 +60,9 @@ typedef struct Mesh_
 } Mesh;
 
 void rc_mesh_cleanup(Mesh* mesh);
+// The loader's buffers are swapped for arena copies, a moved mesh goes away
+// with the arena and must not be cleaned up on its own
+void rc_mesh_move_to_arena(Mesh* mesh, Arena* arena);
 Mesh rc_mesh_make_raw(int vertices_count, int indices_count);
 // TODO: what a stupid naming..
 Mesh rc_mesh_make_raw2(int vertices_count,
@@ -46,6 +74,52 @@ Mesh rc_mesh_make_cube();
 Mesh rc_mesh_make_sphere(float radius, int slices_count, int stacks_count);
 bool rc_mesh_load_from_obj(Mesh* mesh, const char* filename);
 void rc_mesh_set_approximate_normals(Mesh* mesh);
+// Quickhull over the vertex positions, an indexed mesh with counter-clockwise
+// faces. With max_vertices_count > 0 the build stops at that many vertices
+// and the hull is scaled about its centroid until it contains every input
+// vertex again, which also covers points left out to avoid folds on nearly
+// coplanar input. Empty when the vertices are flat.
+Mesh rc_mesh_convex_hull(const Mesh* mesh, int max_vertices_count);
+
+// Index based half-edges over the triangles of an indexed mesh. Half-edge h
+// runs from indices[h] to the next corner of triangle h / 3, so only the
+// twins are stored.
+typedef struct MeshHalfEdges_
+{
+    int* twins; // Per index, -1 on open edges, -2 on non-manifold ones
+    // Per vertex, an outgoing half-edge that starts the vertex ring. It's an
+    // open one on the boundary, -1 when no triangle uses the vertex.
+    int* vertex_edges;
+    int half_edges_count;
+    int vertices_count;
+    int boundary_edges_count;
+    int non_manifold_edges_count; // Shared by more than two or flipped faces
+    int non_manifold_vertices_count; // The ring isn't a single fan
+} MeshHalfEdges;
+
+// Linear time, the twin and vertex passes are spread over the job system
+void rc_mesh_half_edges_build(MeshHalfEdges* he, const Mesh* mesh);
+void rc_mesh_half_edges_cleanup(MeshHalfEdges* he);
+// Like rc_mesh_move_to_arena, moved half-edges must not be cleaned up
+void rc_mesh_half_edges_move_to_arena(MeshHalfEdges* he, Arena* arena);
+
+static inline int rc_half_edge_next(int h)
+{
+    return (h % 3 == 2) ? h - 2 : h + 1;
+}
+
+static inline int rc_half_edge_prev(int h)
+{
+    return (h % 3 == 0) ? h + 2 : h - 1;
+}
+
+// Next outgoing half-edge counter-clockwise around the origin vertex, -1 past
+// the boundary. Walk from vertex_edges until it returns to the first one.
+static inline int rc_half_edge_ring_next(const MeshHalfEdges* he, int h)
+{
+    int twin = he->twins[rc_half_edge_prev(h)];
+    return (twin >= 0) ? twin : -1;
+}
 
 typedef struct NormalizedTransform_
 {
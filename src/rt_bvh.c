@@ -0,0 +1,430 @@
+#include "raytrace.h"
+#include "arena.h"
+#include "resource.h"
+#include "debug.h"
+#include "mem.h"
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+
+#define RT_BINS_COUNT 16
+#define RT_MAX_LEAF_SIZE 8
+#define RT_TRAVERSAL_COST 1.f
+#define RT_INTERSECT_COST 1.f
+
+typedef struct RtBuildPrim_
+{
+    float min[3];
+    float max[3];
+    float c[3];
+    int index;
+} RtBuildPrim;
+
+typedef struct RtBin_
+{
+    float min[3];
+    float max[3];
+    int count;
+} RtBin;
+
+typedef struct RtBuilder_
+{
+    RtNode* nodes;
+    int nodes_count;
+    RtBuildPrim* prims;
+} RtBuilder;
+
+static void rt_bounds_reset(float* min, float* max)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        min[i] = FLT_MAX;
+        max[i] = -FLT_MAX;
+    }
+}
+
+static void rt_bounds_grow(float* min,
+                           float* max,
+                           const float* other_min,
+                           const float* other_max)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        if (min[i] > other_min[i])
+            min[i] = other_min[i];
+        if (max[i] < other_max[i])
+            max[i] = other_max[i];
+    }
+}
+
+static float rt_bounds_area(const float* min, const float* max)
+{
+    float d[3];
+    for (int i = 0; i < 3; i++)
+        d[i] = max[i] - min[i];
+    float result = 2 * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+    return result;
+}
+
+static int rt_bin_index(float v, float min, float scale)
+{
+    int result = (int)((v - min) * scale);
+    return (result < RT_BINS_COUNT) ? result : RT_BINS_COUNT - 1;
+}
+
+static void rt_make_leaf(RtNode* node, int first, int count)
+{
+    node->offset = first;
+    node->count = count;
+}
+
+// Binned SAH over primitive centroids, nodes are emitted depth-first. Past
+// RT_MAX_DEPTH the rest goes into one leaf, however many there are.
+static int rt_build_rec(RtBuilder* b, int first, int count, int depth)
+{
+    int index = b->nodes_count++;
+    RtBuildPrim* prims = b->prims + first;
+
+    float min[3];
+    float max[3];
+    float c_min[3];
+    float c_max[3];
+    rt_bounds_reset(min, max);
+    rt_bounds_reset(c_min, c_max);
+    for (int i = 0; i < count; i++)
+    {
+        rt_bounds_grow(min, max, prims[i].min, prims[i].max);
+        rt_bounds_grow(c_min, c_max, prims[i].c, prims[i].c);
+    }
+    RtNode* node = &b->nodes[index];
+    memcpy(node->min, min, sizeof(min));
+    memcpy(node->max, max, sizeof(max));
+
+    if (count == 1 || depth == RT_MAX_DEPTH)
+    {
+        rt_make_leaf(node, first, count);
+        return index;
+    }
+
+    float best_cost = FLT_MAX;
+    int best_axis = -1;
+    int best_bin = -1;
+    float scale[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float extent = c_max[axis] - c_min[axis];
+        if (extent <= 0)
+            continue;
+        scale[axis] = RT_BINS_COUNT / extent;
+
+        RtBin bins[RT_BINS_COUNT];
+        for (int i = 0; i < RT_BINS_COUNT; i++)
+        {
+            rt_bounds_reset(bins[i].min, bins[i].max);
+            bins[i].count = 0;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            int bi = rt_bin_index(prims[i].c[axis], c_min[axis], scale[axis]);
+            rt_bounds_grow(bins[bi].min, bins[bi].max, prims[i].min,
+                           prims[i].max);
+            ++bins[bi].count;
+        }
+
+        // Right side of the plane in front of bin i covers [i, bins count)
+        float right_areas[RT_BINS_COUNT];
+        int right_counts[RT_BINS_COUNT];
+        RtBin acc;
+        rt_bounds_reset(acc.min, acc.max);
+        acc.count = 0;
+        for (int i = RT_BINS_COUNT - 1; i > 0; i--)
+        {
+            rt_bounds_grow(acc.min, acc.max, bins[i].min, bins[i].max);
+            acc.count += bins[i].count;
+            right_counts[i] = acc.count;
+            right_areas[i] = acc.count ? rt_bounds_area(acc.min, acc.max) : 0;
+        }
+
+        rt_bounds_reset(acc.min, acc.max);
+        acc.count = 0;
+        for (int i = 1; i < RT_BINS_COUNT; i++)
+        {
+            rt_bounds_grow(acc.min, acc.max, bins[i - 1].min, bins[i - 1].max);
+            acc.count += bins[i - 1].count;
+            if (acc.count == 0 || right_counts[i] == 0)
+                continue;
+
+            float cost = rt_bounds_area(acc.min, acc.max) * acc.count +
+                         right_areas[i] * right_counts[i];
+            if (best_cost > cost)
+            {
+                best_cost = cost;
+                best_axis = axis;
+                best_bin = i;
+            }
+        }
+    }
+
+    int k = count / 2;
+    if (best_axis >= 0)
+    {
+        float split_cost =
+            RT_TRAVERSAL_COST +
+            RT_INTERSECT_COST * best_cost / rt_bounds_area(min, max);
+        float leaf_cost = RT_INTERSECT_COST * count;
+        if (split_cost >= leaf_cost && count <= RT_MAX_LEAF_SIZE)
+        {
+            rt_make_leaf(node, first, count);
+            return index;
+        }
+
+        int i = 0;
+        int j = count - 1;
+        while (i <= j)
+        {
+            int bi = rt_bin_index(prims[i].c[best_axis], c_min[best_axis],
+                                  scale[best_axis]);
+            if (bi < best_bin)
+            {
+                ++i;
+            }
+            else
+            {
+                RtBuildPrim temp = prims[i];
+                prims[i] = prims[j];
+                prims[j] = temp;
+                --j;
+            }
+        }
+        k = i;
+    }
+    else if (count <= RT_MAX_LEAF_SIZE)
+    {
+        // Every centroid is the same, no plane separates them
+        rt_make_leaf(node, first, count);
+        return index;
+    }
+
+    node->count = 0;
+    rt_build_rec(b, first, k, depth + 1);
+    int right = rt_build_rec(b, first + k, count - k, depth + 1);
+    b->nodes[index].offset = right;
+    return index;
+}
+
+static RtNode* rt_build(RtBuildPrim* prims, int prims_count, int* out_count)
+{
+    RtBuilder b = {
+        .nodes = (RtNode*)mem_alloc(
+            MemTag_Bvh, (2 * prims_count - 1) * sizeof(RtNode)),
+        .prims = prims,
+    };
+    rt_build_rec(&b, 0, prims_count, 0);
+    *out_count = b.nodes_count;
+    return b.nodes;
+}
+
+static void rt_triangle_vertex(const Mesh* mesh, int i, float* out)
+{
+    int vi = mesh->indices ? (int)mesh->indices[i] : i;
+    const FVec3* p = &mesh->vertices[vi].pos;
+    out[0] = p->x;
+    out[1] = p->y;
+    out[2] = p->z;
+}
+
+void rt_mesh_bvh_build(RtMeshBvh* bvh, const Mesh* mesh)
+{
+    *bvh = (RtMeshBvh){0};
+    int count =
+        (mesh->indices ? mesh->indices_count : mesh->vertices_count) / 3;
+    if (count == 0)
+        return;
+
+    RtTriangle* triangles =
+        (RtTriangle*)mem_alloc(MemTag_Bvh, count * sizeof(*triangles));
+    RtBuildPrim* prims =
+        (RtBuildPrim*)mem_alloc(MemTag_Bvh, count * sizeof(*prims));
+    for (int i = 0; i < count; i++)
+    {
+        RtTriangle* tri = &triangles[i];
+        rt_triangle_vertex(mesh, i * 3 + 0, tri->v0);
+        rt_triangle_vertex(mesh, i * 3 + 1, tri->v1);
+        rt_triangle_vertex(mesh, i * 3 + 2, tri->v2);
+        tri->index = i;
+
+        RtBuildPrim* p = &prims[i];
+        rt_bounds_reset(p->min, p->max);
+        rt_bounds_grow(p->min, p->max, tri->v0, tri->v0);
+        rt_bounds_grow(p->min, p->max, tri->v1, tri->v1);
+        rt_bounds_grow(p->min, p->max, tri->v2, tri->v2);
+        for (int j = 0; j < 3; j++)
+            p->c[j] = (p->min[j] + p->max[j]) * 0.5f;
+        p->index = i;
+    }
+
+    bvh->nodes = rt_build(prims, count, &bvh->nodes_count);
+
+    // Leaves reference contiguous triangles
+    bvh->triangles =
+        (RtTriangle*)mem_alloc(MemTag_Bvh, count * sizeof(*bvh->triangles));
+    bvh->triangles_count = count;
+    for (int i = 0; i < count; i++)
+        bvh->triangles[i] = triangles[prims[i].index];
+
+    mem_free(prims);
+    mem_free(triangles);
+}
+
+void rt_mesh_bvh_cleanup(RtMeshBvh* bvh)
+{
+    mem_free(bvh->nodes);
+    mem_free(bvh->triangles);
+    *bvh = (RtMeshBvh){0};
+}
+
+void rt_mesh_bvh_move_to_arena(RtMeshBvh* bvh, Arena* arena)
+{
+    RtMeshBvh moved = {
+        .nodes_count = bvh->nodes_count,
+        .triangles_count = bvh->triangles_count,
+    };
+    if (bvh->nodes_count > 0)
+    {
+        moved.nodes = ARENA_PUSH_ARRAY(arena, RtNode, bvh->nodes_count);
+        moved.triangles =
+            ARENA_PUSH_ARRAY(arena, RtTriangle, bvh->triangles_count);
+        ASSERT(moved.nodes && moved.triangles);
+        memcpy(moved.nodes, bvh->nodes, bvh->nodes_count * sizeof(RtNode));
+        memcpy(moved.triangles, bvh->triangles,
+               bvh->triangles_count * sizeof(RtTriangle));
+    }
+    rt_mesh_bvh_cleanup(bvh);
+    *bvh = moved;
+}
+
+void rt_scene_init(RtScene* scene)
+{
+    *scene = (RtScene){0};
+}
+
+void rt_scene_cleanup(RtScene* scene)
+{
+    mem_free(scene->instances);
+    mem_free(scene->nodes);
+    mem_free(scene->instance_indices);
+    *scene = (RtScene){0};
+}
+
+void rt_scene_clear(RtScene* scene)
+{
+    scene->instances_count = 0;
+    scene->nodes_count = 0;
+}
+
+// Inverse of an affine column-major matrix, the last row must be 0 0 0 1
+static Mat4 rt_affine_inverse(const Mat4* m)
+{
+    const float* a = m->m;
+    float c00 = a[5] * a[10] - a[9] * a[6];
+    float c01 = a[8] * a[6] - a[4] * a[10];
+    float c02 = a[4] * a[9] - a[8] * a[5];
+    float det = a[0] * c00 + a[1] * c01 + a[2] * c02;
+    ASSERT(det != 0);
+    float inv_det = 1.f / det;
+
+    Mat4 result = {0};
+    float* r = result.m;
+    r[0] = c00 * inv_det;
+    r[4] = c01 * inv_det;
+    r[8] = c02 * inv_det;
+    r[1] = (a[9] * a[2] - a[1] * a[10]) * inv_det;
+    r[5] = (a[0] * a[10] - a[8] * a[2]) * inv_det;
+    r[9] = (a[8] * a[1] - a[0] * a[9]) * inv_det;
+    r[2] = (a[1] * a[6] - a[5] * a[2]) * inv_det;
+    r[6] = (a[4] * a[2] - a[0] * a[6]) * inv_det;
+    r[10] = (a[0] * a[5] - a[4] * a[1]) * inv_det;
+    for (int i = 0; i < 3; i++)
+    {
+        r[12 + i] =
+            -(r[i] * a[12] + r[4 + i] * a[13] + r[8 + i] * a[14]);
+    }
+    r[15] = 1;
+    return result;
+}
+
+int rt_scene_add_instance(RtScene* scene,
+                          const RtMeshBvh* bvh,
+                          const Mat4* transform)
+{
+    if (scene->instances_count == scene->instances_cap)
+    {
+        scene->instances_cap = scene->instances_cap ? scene->instances_cap * 2
+                                                    : 16;
+        scene->instances = (RtInstance*)mem_realloc(
+            MemTag_Bvh, scene->instances,
+            scene->instances_cap * sizeof(RtInstance));
+    }
+
+    int index = scene->instances_count++;
+    scene->instances[index] = (RtInstance){
+        .bvh = bvh,
+        .transform = *transform,
+        .inv_transform = rt_affine_inverse(transform),
+    };
+    return index;
+}
+
+void rt_scene_build(RtScene* scene)
+{
+    mem_free(scene->nodes);
+    mem_free(scene->instance_indices);
+    scene->nodes = NULL;
+    scene->instance_indices = NULL;
+    scene->nodes_count = 0;
+
+    int count = 0;
+    RtBuildPrim* prims =
+        (RtBuildPrim*)mem_alloc(MemTag_Bvh,
+                                scene->instances_count * sizeof(*prims));
+    for (int i = 0; i < scene->instances_count; i++)
+    {
+        const RtInstance* inst = &scene->instances[i];
+        if (inst->bvh->nodes_count == 0)
+            continue;
+
+        // World box of the eight corners of the mesh box
+        const RtNode* root = &inst->bvh->nodes[0];
+        const float* m = inst->transform.m;
+        RtBuildPrim* p = &prims[count++];
+        rt_bounds_reset(p->min, p->max);
+        for (int corner = 0; corner < 8; corner++)
+        {
+            float v[3] = {
+                (corner & 1) ? root->max[0] : root->min[0],
+                (corner & 2) ? root->max[1] : root->min[1],
+                (corner & 4) ? root->max[2] : root->min[2],
+            };
+            float w[3];
+            for (int j = 0; j < 3; j++)
+            {
+                w[j] = m[j] * v[0] + m[4 + j] * v[1] + m[8 + j] * v[2] +
+                       m[12 + j];
+            }
+            rt_bounds_grow(p->min, p->max, w, w);
+        }
+        for (int j = 0; j < 3; j++)
+            p->c[j] = (p->min[j] + p->max[j]) * 0.5f;
+        p->index = i;
+    }
+
+    if (count > 0)
+    {
+        scene->nodes = rt_build(prims, count, &scene->nodes_count);
+        scene->instance_indices =
+            (int*)mem_alloc(MemTag_Bvh, count * sizeof(int));
+        for (int i = 0; i < count; i++)
+            scene->instance_indices[i] = prims[i].index;
+    }
+    mem_free(prims);
+}
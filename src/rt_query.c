@@ -0,0 +1,703 @@
+#include "raytrace.h"
+#include "debug.h"
+#include "job.h"
+#include <emmintrin.h>
+#include <math.h>
+#include <float.h>
+
+// Each inner node popped pushes at most two children
+#define RT_STACK_SIZE (RT_MAX_DEPTH + 2)
+#define RT_BATCH_PACKETS_COUNT 64
+
+// Boxes are widened by a few ulps so rays through shared edges and corners
+// reach every leaf the watertight triangle test could report (Ize 2013)
+#define RT_BOX_T_SCALE 1.0000004f
+#define RT_MIN_DIR 1e-20f
+
+// Ray in the space of the structure being traversed, with the shear of the
+// watertight test (Woop, Benthin, Wald 2013)
+typedef struct RtRay_
+{
+    float org[3];
+    float dir[3];
+    float inv_dir[3];
+    int kx, ky, kz;
+    float sx, sy, sz;
+} RtRay;
+
+typedef struct RtPacket_
+{
+    float lane_org[3][RT_PACKET_SIZE];
+    float lane_dir[3][RT_PACKET_SIZE];
+    __m128 org[3];
+    __m128 inv_dir[3];
+    __m128 kx_is[2]; // Lane masks for kx == 0 and kx == 1, likewise below
+    __m128 ky_is[2];
+    __m128 kz_is[2];
+    __m128 sx, sy, sz;
+} RtPacket;
+
+static void rt_ray_init(RtRay* r, const float* org, const float* dir)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        r->org[i] = org[i];
+        r->dir[i] = dir[i];
+        // Axis-parallel rays get a huge finite slope instead of infinity, a
+        // 0 * inf NaN would reject the boxes the origin lies on
+        float d = (fabsf(dir[i]) < RT_MIN_DIR) ? copysignf(RT_MIN_DIR, dir[i])
+                                               : dir[i];
+        r->inv_dir[i] = 1.f / d;
+    }
+
+    // Largest dimension becomes z, swapping x and y keeps the winding
+    int kz = 0;
+    if (fabsf(dir[1]) > fabsf(dir[kz]))
+        kz = 1;
+    if (fabsf(dir[2]) > fabsf(dir[kz]))
+        kz = 2;
+    int kx = (kz + 1) % 3;
+    int ky = (kx + 1) % 3;
+    if (dir[kz] < 0)
+    {
+        int temp = kx;
+        kx = ky;
+        ky = temp;
+    }
+    r->kx = kx;
+    r->ky = ky;
+    r->kz = kz;
+    r->sx = dir[kx] / dir[kz];
+    r->sy = dir[ky] / dir[kz];
+    r->sz = 1.f / dir[kz];
+}
+
+static void rt_transform_point(const Mat4* m, const float* p, float* out)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        out[i] = m->m[i] * p[0] + m->m[4 + i] * p[1] + m->m[8 + i] * p[2] +
+                 m->m[12 + i];
+    }
+}
+
+static void rt_transform_vector(const Mat4* m, const float* v, float* out)
+{
+    for (int i = 0; i < 3; i++)
+        out[i] = m->m[i] * v[0] + m->m[4 + i] * v[1] + m->m[8 + i] * v[2];
+}
+
+static bool rt_intersect_box(const RtRay* r,
+                             const RtNode* node,
+                             float t_max,
+                             float* out_t)
+{
+    float t_near = 0;
+    float t_far = t_max;
+    for (int i = 0; i < 3; i++)
+    {
+        float t0 = (node->min[i] - r->org[i]) * r->inv_dir[i];
+        float t1 = (node->max[i] - r->org[i]) * r->inv_dir[i];
+        t_near = fmaxf(t_near, fminf(t0, t1));
+        t_far = fminf(t_far, fmaxf(t0, t1) * RT_BOX_T_SCALE);
+    }
+    *out_t = t_near;
+    return t_near <= t_far;
+}
+
+static bool rt_intersect_triangle(const RtRay* r,
+                                  const RtTriangle* tri,
+                                  float t_max,
+                                  RayHit* hit)
+{
+    float a[3];
+    float b[3];
+    float c[3];
+    for (int i = 0; i < 3; i++)
+    {
+        a[i] = tri->v0[i] - r->org[i];
+        b[i] = tri->v1[i] - r->org[i];
+        c[i] = tri->v2[i] - r->org[i];
+    }
+
+    float ax = a[r->kx] - r->sx * a[r->kz];
+    float ay = a[r->ky] - r->sy * a[r->kz];
+    float bx = b[r->kx] - r->sx * b[r->kz];
+    float by = b[r->ky] - r->sy * b[r->kz];
+    float cx = c[r->kx] - r->sx * c[r->kz];
+    float cy = c[r->ky] - r->sy * c[r->kz];
+
+    // Scaled barycentrics, an edge the ray passes exactly through belongs to
+    // both triangles sharing it
+    float u = cx * by - cy * bx;
+    float v = ax * cy - ay * cx;
+    float w = bx * ay - by * ax;
+    if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0))
+        return false;
+
+    float det = u + v + w;
+    if (det == 0)
+        return false;
+
+    float az = r->sz * a[r->kz];
+    float bz = r->sz * b[r->kz];
+    float cz = r->sz * c[r->kz];
+    float t_scaled = u * az + v * bz + w * cz;
+    if (det > 0 ? (t_scaled <= 0 || t_scaled >= t_max * det)
+                : (t_scaled >= 0 || t_scaled <= t_max * det))
+    {
+        return false;
+    }
+
+    float inv_det = 1.f / det;
+    hit->t = t_scaled * inv_det;
+    hit->u = v * inv_det;
+    hit->v = w * inv_det;
+    hit->triangle = tri->index;
+    return true;
+}
+
+typedef struct RtStackEntry_
+{
+    int node;
+    float t;
+} RtStackEntry;
+
+// Closest-first traversal. Returns true on any hit, stops at the first one
+// when any_hit is set. hit->t bounds the search and is updated on hits.
+static bool rt_traverse(const RtNode* nodes,
+                        const RtRay* r,
+                        bool any_hit,
+                        RayHit* hit,
+                        const RtTriangle* triangles,
+                        const RtScene* scene)
+{
+    bool result = false;
+    float t;
+    if (!rt_intersect_box(r, &nodes[0], hit->t, &t))
+        return false;
+
+    RtStackEntry stack[RT_STACK_SIZE];
+    int stack_count = 0;
+    stack[stack_count++] = (RtStackEntry){0, t};
+    while (stack_count > 0)
+    {
+        RtStackEntry e = stack[--stack_count];
+        if (e.t > hit->t)
+            continue;
+
+        const RtNode* node = &nodes[e.node];
+        if (node->count > 0)
+        {
+            for (int i = node->offset; i < node->offset + node->count; i++)
+            {
+                if (triangles)
+                {
+                    RayHit tri_hit;
+                    if (rt_intersect_triangle(r, &triangles[i], hit->t,
+                                              &tri_hit))
+                    {
+                        hit->t = tri_hit.t;
+                        hit->u = tri_hit.u;
+                        hit->v = tri_hit.v;
+                        hit->triangle = tri_hit.triangle;
+                        result = true;
+                    }
+                }
+                else
+                {
+                    // Top level leaf, continue in the instance's mesh space
+                    int instance_index = scene->instance_indices[i];
+                    const RtInstance* inst = &scene->instances[instance_index];
+                    float org[3];
+                    float dir[3];
+                    rt_transform_point(&inst->inv_transform, r->org, org);
+                    rt_transform_vector(&inst->inv_transform, r->dir, dir);
+                    RtRay local;
+                    rt_ray_init(&local, org, dir);
+                    if (rt_traverse(inst->bvh->nodes, &local, any_hit, hit,
+                                    inst->bvh->triangles, NULL))
+                    {
+                        hit->instance = instance_index;
+                        result = true;
+                    }
+                }
+
+                if (result && any_hit)
+                    return true;
+            }
+            continue;
+        }
+
+        int left = e.node + 1;
+        int right = node->offset;
+        float t_left;
+        float t_right;
+        bool hit_left = rt_intersect_box(r, &nodes[left], hit->t, &t_left);
+        bool hit_right = rt_intersect_box(r, &nodes[right], hit->t, &t_right);
+        ASSERT(stack_count + 2 <= RT_STACK_SIZE);
+        if (hit_left && hit_right)
+        {
+            // Nearer child goes last so it is popped first
+            if (t_left < t_right)
+            {
+                stack[stack_count++] = (RtStackEntry){right, t_right};
+                stack[stack_count++] = (RtStackEntry){left, t_left};
+            }
+            else
+            {
+                stack[stack_count++] = (RtStackEntry){left, t_left};
+                stack[stack_count++] = (RtStackEntry){right, t_right};
+            }
+        }
+        else if (hit_left)
+        {
+            stack[stack_count++] = (RtStackEntry){left, t_left};
+        }
+        else if (hit_right)
+        {
+            stack[stack_count++] = (RtStackEntry){right, t_right};
+        }
+    }
+    return result;
+}
+
+static bool rt_query(const RtScene* scene,
+                     const Ray* ray,
+                     bool any_hit,
+                     RayHit* hit)
+{
+    *hit = (RayHit){.t = ray->t_max, .instance = -1, .triangle = -1};
+    if (scene->nodes_count == 0 || ray->t_max <= 0)
+        return false;
+
+    RtRay r;
+    rt_ray_init(&r, &ray->origin.x, &ray->dir.x);
+    return rt_traverse(scene->nodes, &r, any_hit, hit, NULL, scene);
+}
+
+bool rt_intersect(const RtScene* scene, const Ray* ray, RayHit* hit)
+{
+    return rt_query(scene, ray, false, hit);
+}
+
+bool rt_occluded(const RtScene* scene, const Ray* ray)
+{
+    RayHit hit;
+    return rt_query(scene, ray, true, &hit);
+}
+
+static __m128 rt_select3(const __m128* is, __m128 v0, __m128 v1, __m128 v2)
+{
+    __m128 result = _mm_or_ps(
+        _mm_or_ps(_mm_and_ps(is[0], v0), _mm_and_ps(is[1], v1)),
+        _mm_andnot_ps(_mm_or_ps(is[0], is[1]), v2));
+    return result;
+}
+
+static void rt_packet_init(RtPacket* p,
+                           const float org[3][RT_PACKET_SIZE],
+                           const float dir[3][RT_PACKET_SIZE])
+{
+    float inv_dir[3][RT_PACKET_SIZE];
+    int32_t k_is[3][2][RT_PACKET_SIZE];
+    float shear[3][RT_PACKET_SIZE];
+    for (int lane = 0; lane < RT_PACKET_SIZE; lane++)
+    {
+        float lane_org[3] = {org[0][lane], org[1][lane], org[2][lane]};
+        float lane_dir[3] = {dir[0][lane], dir[1][lane], dir[2][lane]};
+        RtRay r;
+        rt_ray_init(&r, lane_org, lane_dir);
+
+        int k[3] = {r.kx, r.ky, r.kz};
+        for (int i = 0; i < 3; i++)
+        {
+            p->lane_org[i][lane] = org[i][lane];
+            p->lane_dir[i][lane] = dir[i][lane];
+            inv_dir[i][lane] = r.inv_dir[i];
+            k_is[i][0][lane] = (k[i] == 0) ? -1 : 0;
+            k_is[i][1][lane] = (k[i] == 1) ? -1 : 0;
+        }
+        shear[0][lane] = r.sx;
+        shear[1][lane] = r.sy;
+        shear[2][lane] = r.sz;
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        p->org[i] = _mm_loadu_ps(p->lane_org[i]);
+        p->inv_dir[i] = _mm_loadu_ps(inv_dir[i]);
+    }
+    __m128* k_masks[3] = {p->kx_is, p->ky_is, p->kz_is};
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 2; j++)
+        {
+            k_masks[i][j] =
+                _mm_castsi128_ps(_mm_loadu_si128((__m128i*)k_is[i][j]));
+        }
+    }
+    p->sx = _mm_loadu_ps(shear[0]);
+    p->sy = _mm_loadu_ps(shear[1]);
+    p->sz = _mm_loadu_ps(shear[2]);
+}
+
+// Lanes whose t bound is negative are inactive and never report a hit
+static int rt_intersect_box4(const RtPacket* p,
+                             const RtNode* node,
+                             __m128 t_max,
+                             __m128* out_t)
+{
+    __m128 scale = _mm_set1_ps(RT_BOX_T_SCALE);
+    __m128 t_near = _mm_setzero_ps();
+    __m128 t_far = t_max;
+    for (int i = 0; i < 3; i++)
+    {
+        __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node->min[i]), p->org[i]),
+                               p->inv_dir[i]);
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node->max[i]), p->org[i]),
+                               p->inv_dir[i]);
+        t_near = _mm_max_ps(_mm_min_ps(t0, t1), t_near);
+        t_far = _mm_min_ps(_mm_mul_ps(_mm_max_ps(t0, t1), scale), t_far);
+    }
+    *out_t = t_near;
+    return _mm_movemask_ps(_mm_cmple_ps(t_near, t_far));
+}
+
+static int rt_intersect_triangle4(const RtPacket* p,
+                                  const RtTriangle* tri,
+                                  __m128 t_max,
+                                  __m128* out_t,
+                                  __m128* out_u,
+                                  __m128* out_v)
+{
+    const float* verts[3] = {tri->v0, tri->v1, tri->v2};
+    __m128 x[3];
+    __m128 y[3];
+    __m128 z[3];
+    for (int i = 0; i < 3; i++)
+    {
+        __m128 vx = _mm_sub_ps(_mm_set1_ps(verts[i][0]), p->org[0]);
+        __m128 vy = _mm_sub_ps(_mm_set1_ps(verts[i][1]), p->org[1]);
+        __m128 vz = _mm_sub_ps(_mm_set1_ps(verts[i][2]), p->org[2]);
+        __m128 vkx = rt_select3(p->kx_is, vx, vy, vz);
+        __m128 vky = rt_select3(p->ky_is, vx, vy, vz);
+        __m128 vkz = rt_select3(p->kz_is, vx, vy, vz);
+        x[i] = _mm_sub_ps(vkx, _mm_mul_ps(p->sx, vkz));
+        y[i] = _mm_sub_ps(vky, _mm_mul_ps(p->sy, vkz));
+        z[i] = _mm_mul_ps(p->sz, vkz);
+    }
+
+    __m128 u = _mm_sub_ps(_mm_mul_ps(x[2], y[1]), _mm_mul_ps(y[2], x[1]));
+    __m128 v = _mm_sub_ps(_mm_mul_ps(x[0], y[2]), _mm_mul_ps(y[0], x[2]));
+    __m128 w = _mm_sub_ps(_mm_mul_ps(x[1], y[0]), _mm_mul_ps(y[1], x[0]));
+
+    __m128 zero = _mm_setzero_ps();
+    __m128 any_neg = _mm_or_ps(
+        _mm_or_ps(_mm_cmplt_ps(u, zero), _mm_cmplt_ps(v, zero)),
+        _mm_cmplt_ps(w, zero));
+    __m128 any_pos = _mm_or_ps(
+        _mm_or_ps(_mm_cmpgt_ps(u, zero), _mm_cmpgt_ps(v, zero)),
+        _mm_cmpgt_ps(w, zero));
+    __m128 det = _mm_add_ps(_mm_add_ps(u, v), w);
+    __m128 valid = _mm_andnot_ps(_mm_and_ps(any_neg, any_pos),
+                                 _mm_cmpneq_ps(det, zero));
+    if (_mm_movemask_ps(valid) == 0)
+        return 0;
+
+    __m128 t_scaled = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(u, z[0]), _mm_mul_ps(v, z[1])),
+        _mm_mul_ps(w, z[2]));
+    __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.f), det);
+    __m128 t = _mm_mul_ps(t_scaled, inv_det);
+    valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpgt_ps(t, zero),
+                                         _mm_cmplt_ps(t, t_max)));
+
+    *out_t = t;
+    *out_u = _mm_mul_ps(v, inv_det);
+    *out_v = _mm_mul_ps(w, inv_det);
+    return _mm_movemask_ps(valid);
+}
+
+static __m128 rt_blend(int mask, __m128 a, __m128 b)
+{
+    __m128i bits = _mm_set_epi32((mask & 8) ? -1 : 0, (mask & 4) ? -1 : 0,
+                                 (mask & 2) ? -1 : 0, (mask & 1) ? -1 : 0);
+    __m128 m = _mm_castsi128_ps(bits);
+    return _mm_or_ps(_mm_and_ps(m, b), _mm_andnot_ps(m, a));
+}
+
+typedef struct RtPacketState_
+{
+    __m128 t; // Per-lane search bound, negative for finished lanes
+    RayHit* hits;
+    int active_mask;
+    bool any_hit;
+} RtPacketState;
+
+// Returns the mask of lanes that hit something
+static int rt_traverse_packet(const RtNode* nodes,
+                              const RtPacket* p,
+                              RtPacketState* state,
+                              const RtTriangle* triangles,
+                              const RtScene* scene)
+{
+    int result = 0;
+    __m128 t_near;
+    if (!(rt_intersect_box4(p, &nodes[0], state->t, &t_near) &
+          state->active_mask))
+    {
+        return 0;
+    }
+
+    int stack[RT_STACK_SIZE];
+    int stack_count = 0;
+    stack[stack_count++] = 0;
+    while (stack_count > 0 && state->active_mask)
+    {
+        int index = stack[--stack_count];
+        const RtNode* node = &nodes[index];
+        if (!(rt_intersect_box4(p, node, state->t, &t_near) &
+              state->active_mask))
+        {
+            continue;
+        }
+
+        if (node->count == 0)
+        {
+            ASSERT(stack_count + 2 <= RT_STACK_SIZE);
+            // Visit first the child the first active lane reaches first
+            __m128 t_left;
+            __m128 t_right;
+            int mask_left =
+                rt_intersect_box4(p, &nodes[index + 1], state->t, &t_left) &
+                state->active_mask;
+            int mask_right =
+                rt_intersect_box4(p, &nodes[node->offset], state->t,
+                                  &t_right) &
+                state->active_mask;
+            float lefts[RT_PACKET_SIZE];
+            float rights[RT_PACKET_SIZE];
+            _mm_storeu_ps(lefts, t_left);
+            _mm_storeu_ps(rights, t_right);
+            int lane = 0;
+            while (!(state->active_mask & (1 << lane)))
+                ++lane;
+            bool left_first = (mask_left & (1 << lane)) &&
+                              (!(mask_right & (1 << lane)) ||
+                               lefts[lane] <= rights[lane]);
+            if (left_first)
+            {
+                if (mask_right)
+                    stack[stack_count++] = node->offset;
+                stack[stack_count++] = index + 1;
+            }
+            else
+            {
+                if (mask_left)
+                    stack[stack_count++] = index + 1;
+                if (mask_right)
+                    stack[stack_count++] = node->offset;
+            }
+            continue;
+        }
+
+        for (int i = node->offset; i < node->offset + node->count; i++)
+        {
+            int hit_mask = 0;
+            if (triangles)
+            {
+                __m128 t;
+                __m128 u;
+                __m128 v;
+                hit_mask = rt_intersect_triangle4(p, &triangles[i], state->t,
+                                                  &t, &u, &v) &
+                           state->active_mask;
+                if (!hit_mask)
+                    continue;
+
+                float ts[RT_PACKET_SIZE];
+                float us[RT_PACKET_SIZE];
+                float vs[RT_PACKET_SIZE];
+                _mm_storeu_ps(ts, t);
+                _mm_storeu_ps(us, u);
+                _mm_storeu_ps(vs, v);
+                for (int lane = 0; lane < RT_PACKET_SIZE; lane++)
+                {
+                    if (!(hit_mask & (1 << lane)))
+                        continue;
+                    RayHit* hit = &state->hits[lane];
+                    hit->t = ts[lane];
+                    hit->u = us[lane];
+                    hit->v = vs[lane];
+                    hit->triangle = triangles[i].index;
+                }
+                state->t = rt_blend(hit_mask, state->t, t);
+            }
+            else
+            {
+                int instance_index = scene->instance_indices[i];
+                const RtInstance* inst = &scene->instances[instance_index];
+                float org[3][RT_PACKET_SIZE];
+                float dir[3][RT_PACKET_SIZE];
+                for (int lane = 0; lane < RT_PACKET_SIZE; lane++)
+                {
+                    float lane_org[3] = {p->lane_org[0][lane],
+                                         p->lane_org[1][lane],
+                                         p->lane_org[2][lane]};
+                    float lane_dir[3] = {p->lane_dir[0][lane],
+                                         p->lane_dir[1][lane],
+                                         p->lane_dir[2][lane]};
+                    float local_org[3];
+                    float local_dir[3];
+                    rt_transform_point(&inst->inv_transform, lane_org,
+                                       local_org);
+                    rt_transform_vector(&inst->inv_transform, lane_dir,
+                                        local_dir);
+                    for (int j = 0; j < 3; j++)
+                    {
+                        org[j][lane] = local_org[j];
+                        dir[j][lane] = local_dir[j];
+                    }
+                }
+                RtPacket local;
+                rt_packet_init(&local, org, dir);
+                hit_mask = rt_traverse_packet(inst->bvh->nodes, &local, state,
+                                              inst->bvh->triangles, NULL);
+                for (int lane = 0; lane < RT_PACKET_SIZE; lane++)
+                {
+                    if (hit_mask & (1 << lane))
+                        state->hits[lane].instance = instance_index;
+                }
+            }
+
+            result |= hit_mask;
+            if (state->any_hit && hit_mask)
+            {
+                state->active_mask &= ~hit_mask;
+                state->t = rt_blend(hit_mask, state->t, _mm_set1_ps(-1.f));
+                if (!state->active_mask)
+                    return result;
+            }
+        }
+    }
+    return result;
+}
+
+static int rt_query_packet(const RtScene* scene,
+                           const Ray* rays,
+                           bool any_hit,
+                           RayHit* hits)
+{
+    float org[3][RT_PACKET_SIZE];
+    float dir[3][RT_PACKET_SIZE];
+    float t[RT_PACKET_SIZE];
+    int active_mask = 0;
+    for (int lane = 0; lane < RT_PACKET_SIZE; lane++)
+    {
+        const Ray* ray = &rays[lane];
+        hits[lane] =
+            (RayHit){.t = ray->t_max, .instance = -1, .triangle = -1};
+        org[0][lane] = ray->origin.x;
+        org[1][lane] = ray->origin.y;
+        org[2][lane] = ray->origin.z;
+        dir[0][lane] = ray->dir.x;
+        dir[1][lane] = ray->dir.y;
+        dir[2][lane] = ray->dir.z;
+        t[lane] = (ray->t_max > 0) ? ray->t_max : -1.f;
+        if (ray->t_max > 0)
+            active_mask |= 1 << lane;
+    }
+    if (scene->nodes_count == 0 || !active_mask)
+        return 0;
+
+    RtPacket p;
+    rt_packet_init(&p, org, dir);
+    RtPacketState state = {
+        .t = _mm_loadu_ps(t),
+        .hits = hits,
+        .active_mask = active_mask,
+        .any_hit = any_hit,
+    };
+    return rt_traverse_packet(scene->nodes, &p, &state, NULL, scene);
+}
+
+void rt_intersect_packet(const RtScene* scene, const Ray* rays, RayHit* hits)
+{
+    rt_query_packet(scene, rays, false, hits);
+}
+
+void rt_occluded_packet(const RtScene* scene, const Ray* rays, bool* occluded)
+{
+    RayHit hits[RT_PACKET_SIZE];
+    int mask = rt_query_packet(scene, rays, true, hits);
+    for (int lane = 0; lane < RT_PACKET_SIZE; lane++)
+        occluded[lane] = (mask & (1 << lane)) != 0;
+}
+
+typedef struct RtBatch_
+{
+    const RtScene* scene;
+    const Ray* rays;
+    RayHit* hits;
+    bool* occluded;
+    int rays_count;
+} RtBatch;
+
+static JOB_FOR_FN_SIG(rt_batch_job)
+{
+    RtBatch* batch = (RtBatch*)udata;
+    for (int packet = begin; packet < end; packet++)
+    {
+        int first = packet * RT_PACKET_SIZE;
+        int count = batch->rays_count - first;
+        if (count > RT_PACKET_SIZE)
+            count = RT_PACKET_SIZE;
+
+        // The tail packet is padded with inactive rays
+        Ray rays[RT_PACKET_SIZE] = {0};
+        for (int i = 0; i < count; i++)
+            rays[i] = batch->rays[first + i];
+
+        if (batch->hits)
+        {
+            RayHit hits[RT_PACKET_SIZE];
+            rt_intersect_packet(batch->scene, rays, hits);
+            for (int i = 0; i < count; i++)
+                batch->hits[first + i] = hits[i];
+        }
+        else
+        {
+            bool occluded[RT_PACKET_SIZE];
+            rt_occluded_packet(batch->scene, rays, occluded);
+            for (int i = 0; i < count; i++)
+                batch->occluded[first + i] = occluded[i];
+        }
+    }
+}
+
+void rt_intersect_batch(const RtScene* scene,
+                        const Ray* rays,
+                        RayHit* hits,
+                        int rays_count)
+{
+    RtBatch batch = {
+        .scene = scene, .rays = rays, .hits = hits, .rays_count = rays_count};
+    int packets_count = (rays_count + RT_PACKET_SIZE - 1) / RT_PACKET_SIZE;
+    j_parallel_for(packets_count, RT_BATCH_PACKETS_COUNT, &rt_batch_job,
+                   &batch);
+}
+
+void rt_occluded_batch(const RtScene* scene,
+                       const Ray* rays,
+                       bool* occluded,
+                       int rays_count)
+{
+    RtBatch batch = {.scene = scene,
+                     .rays = rays,
+                     .occluded = occluded,
+                     .rays_count = rays_count};
+    int packets_count = (rays_count + RT_PACKET_SIZE - 1) / RT_PACKET_SIZE;
+    j_parallel_for(packets_count, RT_BATCH_PACKETS_COUNT, &rt_batch_job,
+                   &batch);
+}
@@ -1,28 +1,89 @@
 #include "scene.h"
 #include "app.h"
+#include "debug.h"
+#include <stddef.h>
 
 void s_init(Scene* scene, const Input* input)
 {
     scene->input = input;
+    scene->activate_budget_ms = SCENE_DEFAULT_ACTIVATE_BUDGET_MS;
 }
 
-void s_switch_scene(Scene* scene, SceneCallbacks new_scene_callbacks)
+static JOB_FN_SIG(s_prepare_job)
 {
+    Scene* scene = (Scene*)udata;
+    scene->pending_udata = scene->pending_callbacks.prepare();
+}
+
+static void s_swap_in_pending(Scene* scene)
+{
+    if (scene->callbacks.cleanup)
+        scene->callbacks.cleanup(scene->udata, scene->input);
+
+    scene->callbacks = scene->pending_callbacks;
+    scene->udata = scene->pending_udata;
+    scene->pending_callbacks = (SceneCallbacks){0};
+    scene->pending_udata = NULL;
+    scene->load_state = SceneLoadState_None;
+    scene->last_load_ms = a_get_time_ms() - scene->load_start_ms;
+}
+
+bool s_switch_scene(Scene* scene, SceneCallbacks new_scene_callbacks)
+{
+    if (scene->load_state != SceneLoadState_None)
+        return false;
+
+    scene->load_start_ms = a_get_time_ms();
+    if (new_scene_callbacks.prepare && new_scene_callbacks.activate)
+    {
+        scene->pending_callbacks = new_scene_callbacks;
+        scene->load_state = SceneLoadState_Preparing;
+        j_run_background(&s_prepare_job, scene, &scene->pending_counter);
+        return true;
+    }
+
+    ASSERT(new_scene_callbacks.init);
     if (scene->callbacks.cleanup)
         scene->callbacks.cleanup(scene->udata, scene->input);
 
     scene->callbacks = new_scene_callbacks;
     scene->udata = scene->callbacks.init(scene->input);
+    scene->last_load_ms = a_get_time_ms() - scene->load_start_ms;
+    return true;
+}
+
+bool s_is_loading(const Scene* scene)
+{
+    return scene->load_state != SceneLoadState_None;
 }
 
 void s_update(Scene* scene)
 {
+    if (scene->load_state == SceneLoadState_Preparing &&
+        j_is_done(&scene->pending_counter))
+    {
+        scene->load_state = SceneLoadState_Activating;
+    }
+    if (scene->load_state == SceneLoadState_Activating &&
+        scene->pending_callbacks.activate(scene->pending_udata, scene->input,
+                                          scene->activate_budget_ms))
+    {
+        s_swap_in_pending(scene);
+    }
+
     if (scene->callbacks.update)
         scene->callbacks.update(scene->udata, scene->input);
 }
 
 void s_cleanup(Scene* scene)
 {
+    if (scene->load_state != SceneLoadState_None)
+    {
+        j_wait(&scene->pending_counter);
+        scene->pending_callbacks.cleanup(scene->pending_udata, scene->input);
+        scene->load_state = SceneLoadState_None;
+    }
+
     if (scene->callbacks.cleanup)
         scene->callbacks.cleanup(scene->udata, scene->input);
 }
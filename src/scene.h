@@ -1,6 +1,8 @@
 #ifndef SCENE_H
 #define SCENE_H
+#include "job.h"
 #include <himath.h>
+#include <stdbool.h>
 
 typedef struct Input_ Input;
 
@@ -13,22 +15,60 @@ typedef SCENE_CLEANUP_FN_SIG(SceneCleanupFn);
 #define SCENE_UPDATE_FN_SIG(name) void name(void* udata, const Input* input)
 typedef SCENE_UPDATE_FN_SIG(SceneUpdateFn);
 
+// CPU-side half of init, run on a worker while the current scene renders.
+// There is no GL context, so only files, decoding and CPU structures.
+#define SCENE_PREPARE_FN_SIG(name) void* name(void)
+typedef SCENE_PREPARE_FN_SIG(ScenePrepareFn);
+
+// Called once per frame on the prepared scene until it returns true, doing
+// roughly budget_ms of GPU uploads each time. Cleanup must cope with a scene
+// whose activation never finished.
+#define SCENE_ACTIVATE_FN_SIG(name)                                            \
+    bool name(void* udata, const Input* input, double budget_ms)
+typedef SCENE_ACTIVATE_FN_SIG(SceneActivateFn);
+
 typedef struct SceneCallbacks_
 {
     SceneInitFn* init;
     SceneCleanupFn* cleanup;
     SceneUpdateFn* update;
+    // Optional, switches load in the background when both are set and init
+    // isn't needed then
+    ScenePrepareFn* prepare;
+    SceneActivateFn* activate;
 } SceneCallbacks;
 
+typedef enum SceneLoadState_
+{
+    SceneLoadState_None = 0,
+    SceneLoadState_Preparing,
+    SceneLoadState_Activating,
+} SceneLoadState;
+
+#define SCENE_DEFAULT_ACTIVATE_BUDGET_MS 4.0
+
 typedef struct Scene_
 {
     const Input* input;
     void* udata;
     SceneCallbacks callbacks;
+
+    // The scene being loaded, swapped in once activated
+    SceneLoadState load_state;
+    SceneCallbacks pending_callbacks;
+    void* pending_udata;
+    JobCounter pending_counter;
+    double activate_budget_ms;
+    double load_start_ms;
+    double last_load_ms; // From the switch request to the swap
 } Scene;
 
 void s_init(Scene* scene, const Input* input);
-void s_switch_scene(Scene* scene, SceneCallbacks new_scene_callbacks);
+// Scenes with prepare and activate keep the current one running until they
+// are ready, the rest load synchronously. Returns false while another switch
+// is still loading.
+bool s_switch_scene(Scene* scene, SceneCallbacks new_scene_callbacks);
+bool s_is_loading(const Scene* scene);
 void s_update(Scene* scene);
 void s_cleanup(Scene* scene);
 
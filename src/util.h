@@ -1,15 +1,30 @@
 #ifndef UTIL_H
 #define UTIL_H
+#include <stdint.h>
 
 #define ARRAY_LENGTH(arr) ((int)(sizeof(arr) / sizeof(*(arr))))
 #define ARRAY_CLEAR(arr) memset(arr, 0, sizeof(arr))
 
 #if defined(_MSC_VER)
+#include <intrin.h>
 #define ALIGN_AS(bytes) __declspec(align(bytes))
 #define ALIGN_OF(x) __alignof(x)
+
+// 64 for 0
+static __inline int count_leading_zeros64(uint64_t v)
+{
+    unsigned long index;
+    return _BitScanReverse64(&index, v) ? 63 - (int)index : 64;
+}
 #elif defined(__GNUC__) || defined(__clang__)
 #define ALIGN_AS(bytes) __attribute__((aligned(bytes)))
 #define ALIGN_OF(x) __alignof__(x)
+
+// 64 for 0
+static inline int count_leading_zeros64(uint64_t v)
+{
+    return v ? __builtin_clzll(v) : 64;
+}
 #else
 #error "This compiler is not supported!"
 #endif
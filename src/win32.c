@@ -2,6 +2,7 @@
 #include "app.h"
 #include "primitive.h"
 #include "debug.h"
+#include "mem.h"
 #include "util.h"
 #include <glad/wgl.h>
 #include <himath.h>
@@ -181,7 +182,7 @@ char* win32_load_text_file(const char* filename)
     long size = ftell(f);
     rewind(f);
 
-    char* buf = (char*)malloc(size + 1);
+    char* buf = (char*)mem_alloc(MemTag_Misc, size + 1);
     ASSERT(size >= 0);
     size = (long)fread(buf, 1, (size_t)size, f);
     buf[size] = '\0';
@@ -195,6 +196,18 @@ void win32_print(const char* str)
     OutputDebugStringA(str);
 }
 
+double a_get_time_ms()
+{
+    static LARGE_INTEGER freq;
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    double result = (double)counter.QuadPart * 1000.0 / (double)freq.QuadPart;
+    return result;
+}
+
 void win32_register_input(Input* input)
 {
     g_input = input;
@@ -33,6 +33,7 @@ bool win32_app_init(Win32App* app,
 void win32_app_cleanup(Win32App* app);
 IVec2 win32_get_window_size(HWND window);
 float win32_get_window_aspect_ratio(HWND window);
+// Freed with mem_free
 char* win32_load_text_file(const char* filename);
 void win32_print(const char* str);
 
@@ -5,6 +5,8 @@
 #include "scene.h"
 #include "app.h"
 #include "example.h"
+#include "job.h"
+#include "mem.h"
 #include <himath.h>
 
 typedef struct Win32GlobalState_
@@ -39,7 +41,9 @@ int CALLBACK WinMain(HINSTANCE instance,
                   &max_work_group_invocations);
     PRINTLN("Max local work group invocations: %d", max_work_group_invocations);
 
+    r_state_invalidate();
     r_gui_init();
+    j_init(0);
 
     Input input = {0};
     win32_register_input(&input);
@@ -84,6 +88,8 @@ int CALLBACK WinMain(HINSTANCE instance,
 
         win32_update_input(&app);
 
+        mem_begin_frame();
+        r_state_begin_frame();
         r_gui_new_frame(&input);
 
 #ifdef USER_UPDATE
@@ -101,7 +107,9 @@ int CALLBACK WinMain(HINSTANCE instance,
     USER_CLEANUP
 #endif
 
+    j_cleanup();
     r_gui_cleanup();
+    mem_write_report("memory_report.txt");
 
     win32_app_cleanup(&app);
 